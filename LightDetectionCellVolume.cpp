@@ -0,0 +1,13 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "LightDetectionCellVolume.h"
+#include "Components/BrushComponent.h"
+#include "Engine/CollisionProfile.h"
+
+ALightDetectionCellVolume::ALightDetectionCellVolume()
+{
+	// Cells only partition the lights, they must never block the traces detection makes through them
+	GetBrushComponent()->SetCollisionProfileName(UCollisionProfile::NoCollision_ProfileName);
+	BrushColor = FColor(80, 160, 255);
+	bColored = true;
+}
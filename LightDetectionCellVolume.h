@@ -0,0 +1,22 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+#include "CoreMinimal.h"
+#include "GameFramework/Volume.h"
+#include "LightDetectionCellVolume.generated.h"
+
+/// <summary>
+/// ALightDetectionCellVolume marks out a cell for light detection, such as a room. Its walls are taken to block all light, so while the
+/// manager's bUseLightCells is enabled, lights in other cells are only considered when they can shine in through an
+/// ALightDetectionPortalVolume joining the cells. Only the volume's bounds are used, so cells are best kept to box shaped rooms.
+/// </summary>
+UCLASS()
+class PLANET_NINEMP_API ALightDetectionCellVolume : public AVolume
+{
+
+	GENERATED_BODY()
+
+public:
+
+	ALightDetectionCellVolume();
+};
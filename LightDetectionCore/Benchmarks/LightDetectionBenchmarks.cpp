@@ -0,0 +1,651 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+// Only built by the standalone CMake build, the engine build compiles every source in the module and does not have Google Benchmark
+#if LIGHT_DETECTION_STANDALONE
+
+#include <benchmark/benchmark.h>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+#include "LightDetectionCells.h"
+#include "LightDetectionKernels.h"
+#include "LightDetectionLightTree.h"
+#include "LightDetectionSceneGenerator.h"
+#include "LightDetectionVoxels.h"
+
+/// <summary>
+/// Microbenchmarks for the per-light culling kernels. Each benchmark tests every agent against every light of one type in a synthetic scene,
+/// parameterised by light count and agent count, and reports the cost per light-agent test as ns/light and the throughput as lights/s.
+/// </summary>
+namespace
+{
+	using namespace LightDetection;
+
+	// A scene and agents generated once per parameter combination and shared by every benchmark that uses it
+	struct BenchmarkScene
+	{
+		LightScene Scene;
+		std::vector<AgentData> Agents;
+	};
+
+	const BenchmarkScene& GetBenchmarkScene(int32_t LightCount, int32_t AgentCount)
+	{
+		static int32_t CachedLightCount = -1;
+		static int32_t CachedAgentCount = -1;
+		static BenchmarkScene Cached;
+
+		if (CachedLightCount != LightCount || CachedAgentCount != AgentCount)
+		{
+			SceneGeneratorSettings Settings;
+			GenerateScene(Cached.Scene, LightCount, Settings);
+			Cached.Agents = GenerateAgents(AgentCount, LightCount, Settings);
+			CachedLightCount = LightCount;
+			CachedAgentCount = AgentCount;
+		}
+		return Cached;
+	}
+
+	// SampleCount points spread up a character's height from its detection point
+	std::vector<Vector3> MakeBodySamples(const AgentData& Agent, int32_t SampleCount)
+	{
+		std::vector<Vector3> Samples;
+		for (int32_t SampleIdx = 0; SampleIdx < SampleCount; SampleIdx++)
+		{
+			Samples.push_back(Agent.DetectionPoint + Vector3(0, 0, 170.0f * SampleIdx / (SampleCount > 1 ? SampleCount - 1 : 1)));
+		}
+		return Samples;
+	}
+
+	using BenchmarkClock = std::chrono::steady_clock;
+
+	// Reports how many nanoseconds each of ItemsPerIteration items took since StartTime, taken just before the benchmark's loop, as a plain
+	// number. An inverted rate counter would hold the same value, but the reporters print those with a seconds suffix
+	void SetNanosecondsPerItem(benchmark::State& State, const char* Name, int64_t ItemsPerIteration, BenchmarkClock::time_point StartTime)
+	{
+		const double ElapsedNanoseconds = std::chrono::duration<double, std::nano>(BenchmarkClock::now() - StartTime).count();
+		const double ItemCount = static_cast<double>(State.iterations()) * static_cast<double>(ItemsPerIteration);
+		State.counters[Name] = ItemCount > 0 ? ElapsedNanoseconds / ItemCount : 0.0;
+	}
+
+	// Reports ns/light and lights/s for a benchmark that performs LightTests light-agent tests per iteration
+	void SetLightCounters(benchmark::State& State, int64_t LightTests, BenchmarkClock::time_point StartTime)
+	{
+		SetNanosecondsPerItem(State, "ns/light", LightTests, StartTime);
+		State.counters["lights/s"] = benchmark::Counter(static_cast<double>(LightTests), benchmark::Counter::kIsIterationInvariantRate);
+	}
+
+	void BM_PointLightRange(benchmark::State& State)
+	{
+		const BenchmarkScene& Bench = GetBenchmarkScene(static_cast<int32_t>(State.range(0)), static_cast<int32_t>(State.range(1)));
+		const BenchmarkClock::time_point StartTime = BenchmarkClock::now();
+		for (auto _ : State)
+		{
+			int32_t InRange = 0;
+			for (const AgentData& Agent : Bench.Agents)
+			{
+				for (const PointLightData& PointLight : Bench.Scene.PointLights)
+				{
+					InRange += IsInPointLightRange(PointLight, Agent.DetectionPoint, 0.0f);
+				}
+			}
+			benchmark::DoNotOptimize(InRange);
+		}
+		SetLightCounters(State, State.range(0) * State.range(1), StartTime);
+	}
+
+	void BM_SpotLightCone(benchmark::State& State)
+	{
+		const BenchmarkScene& Bench = GetBenchmarkScene(static_cast<int32_t>(State.range(0)), static_cast<int32_t>(State.range(1)));
+		const BenchmarkClock::time_point StartTime = BenchmarkClock::now();
+		for (auto _ : State)
+		{
+			int32_t InCone = 0;
+			for (const AgentData& Agent : Bench.Agents)
+			{
+				for (const SpotLightData& SpotLight : Bench.Scene.SpotLights)
+				{
+					InCone += IsInSpotLightCone(SpotLight, Agent.DetectionPoint, 0.0f);
+				}
+			}
+			benchmark::DoNotOptimize(InCone);
+		}
+		SetLightCounters(State, State.range(0) * State.range(1), StartTime);
+	}
+
+	// The whole spot light path CheckSpotLights takes per light, with occlusion stubbed out so only the detection maths is measured
+	void BM_EvaluateSpotLight(benchmark::State& State)
+	{
+		const BenchmarkScene& Bench = GetBenchmarkScene(static_cast<int32_t>(State.range(0)), static_cast<int32_t>(State.range(1)));
+		const DetectionSettings Settings;
+		NoOcclusionQuery Occlusion;
+		DetectionCounters Counters;
+		const BenchmarkClock::time_point StartTime = BenchmarkClock::now();
+		for (auto _ : State)
+		{
+			float IlluminanceTotal = 0.0f;
+			for (const AgentData& Agent : Bench.Agents)
+			{
+				for (const SpotLightData& SpotLight : Bench.Scene.SpotLights)
+				{
+					IlluminanceTotal += EvaluateSpotLight(SpotLight, Agent.DetectionPoint, Settings, Occlusion, Counters).Illuminance;
+				}
+			}
+			benchmark::DoNotOptimize(IlluminanceTotal);
+		}
+		SetLightCounters(State, State.range(0) * State.range(1), StartTime);
+	}
+
+	void BM_RectLightFrustum(benchmark::State& State)
+	{
+		const BenchmarkScene& Bench = GetBenchmarkScene(static_cast<int32_t>(State.range(0)), static_cast<int32_t>(State.range(1)));
+		const BenchmarkClock::time_point StartTime = BenchmarkClock::now();
+		for (auto _ : State)
+		{
+			int32_t InFrustum = 0;
+			for (const AgentData& Agent : Bench.Agents)
+			{
+				for (size_t idx = 0; idx < Bench.Scene.RectLights.size(); idx++)
+				{
+					InFrustum += IsInRectLightRange(Bench.Scene.RectLights[idx], Agent.Position, 0.0f) && IsInRectLightFrustum(Bench.Scene.RectFrustums[idx], Agent.Position);
+				}
+			}
+			benchmark::DoNotOptimize(InFrustum);
+		}
+		SetLightCounters(State, State.range(0) * State.range(1), StartTime);
+	}
+
+	// Rect lights evaluated over their emitter from a standing point just in front of each, so after the first few updates each light traces
+	// only its per update samples and weights the rest it already has
+	void BM_EvaluateRectLightArea(benchmark::State& State)
+	{
+		const BenchmarkScene& Bench = GetBenchmarkScene(1000, 1);
+		DetectionSettings Settings;
+		Settings.RectLightSampleCount = static_cast<int32_t>(State.range(0));
+		NoOcclusionQuery Occlusion;
+		DetectionCounters Counters;
+		std::vector<RectLightSamples> Samples(Bench.Scene.RectLights.size());
+		std::vector<Vector3> Points;
+		for (const RectLightData& RectLight : Bench.Scene.RectLights)
+		{
+			Points.push_back(RectLight.Position + (RectLight.Forward * (RectLight.AttenuationRadius * 0.25f)));
+		}
+		const BenchmarkClock::time_point StartTime = BenchmarkClock::now();
+		for (auto _ : State)
+		{
+			float IlluminanceTotal = 0.0f;
+			for (size_t idx = 0; idx < Bench.Scene.RectLights.size(); idx++)
+			{
+				IlluminanceTotal += EvaluateRectLightArea(Bench.Scene.RectLights[idx], Bench.Scene.RectFrustums[idx], Points[idx], Settings, Occlusion,
+					Samples[idx], Counters).Illuminance;
+			}
+			benchmark::DoNotOptimize(IlluminanceTotal);
+		}
+		SetLightCounters(State, static_cast<int64_t>(Bench.Scene.RectLights.size()), StartTime);
+	}
+
+	// Rebuilding the barn door frustum does not depend on the agents, this is the cost a moving rect light pays each update
+	void BM_RectLightFrustumRecompute(benchmark::State& State)
+	{
+		const BenchmarkScene& Bench = GetBenchmarkScene(static_cast<int32_t>(State.range(0)), 1);
+		std::vector<RectLightFrustum> Frustums(Bench.Scene.RectLights.size());
+		const BenchmarkClock::time_point StartTime = BenchmarkClock::now();
+		for (auto _ : State)
+		{
+			for (size_t idx = 0; idx < Bench.Scene.RectLights.size(); idx++)
+			{
+				CalculateFrustumPoints(Bench.Scene.RectLights[idx], Frustums[idx]);
+				CalculateBoundingPlanes(Frustums[idx]);
+			}
+			benchmark::DoNotOptimize(Frustums.data());
+			benchmark::ClobberMemory();
+		}
+		SetLightCounters(State, State.range(0), StartTime);
+	}
+
+	// Several samples over one agent's body evaluated point by point, the cost multi-sample detection would have without a shared broad phase
+	void BM_EvaluateSamplesSeparately(benchmark::State& State)
+	{
+		const BenchmarkScene& Bench = GetBenchmarkScene(static_cast<int32_t>(State.range(0)), 1);
+		const std::vector<Vector3> Samples = MakeBodySamples(Bench.Agents[0], static_cast<int32_t>(State.range(1)));
+		const DetectionSettings Settings;
+		NoOcclusionQuery Occlusion;
+		DetectionCounters Counters;
+		LightCandidates Candidates;
+		const BenchmarkClock::time_point StartTime = BenchmarkClock::now();
+		for (auto _ : State)
+		{
+			float IlluminanceTotal = 0.0f;
+			for (const Vector3& Sample : Samples)
+			{
+				IlluminanceTotal += EvaluateDetectionUpdate(Bench.Scene, Sample, Settings, Occlusion, nullptr, Counters, Candidates);
+			}
+			benchmark::DoNotOptimize(IlluminanceTotal);
+		}
+		SetLightCounters(State, State.range(0) * State.range(1), StartTime);
+	}
+
+	// The same samples evaluated together, sharing one candidate list
+	void BM_EvaluateSamplesTogether(benchmark::State& State)
+	{
+		const BenchmarkScene& Bench = GetBenchmarkScene(static_cast<int32_t>(State.range(0)), 1);
+		const std::vector<Vector3> Samples = MakeBodySamples(Bench.Agents[0], static_cast<int32_t>(State.range(1)));
+		std::vector<float> Illuminance(Samples.size());
+		const DetectionSettings Settings;
+		NoOcclusionQuery Occlusion;
+		DetectionCounters Counters;
+		LightCandidates Candidates;
+		const BenchmarkClock::time_point StartTime = BenchmarkClock::now();
+		for (auto _ : State)
+		{
+			EvaluateDetectionSamples(Bench.Scene, Samples.data(), static_cast<int32_t>(Samples.size()), Settings, Occlusion, nullptr, Counters, Candidates, Illuminance.data());
+			benchmark::DoNotOptimize(Illuminance.data());
+			benchmark::ClobberMemory();
+		}
+		SetLightCounters(State, State.range(0) * State.range(1), StartTime);
+	}
+
+	// A room dressing scene, point lights of short range in tight groups such as candles on a table, clustered a group to a cell
+	struct ClusterBenchmark
+	{
+		LightScene Scene;
+		PointLightClusters Clusters;
+		std::vector<AgentData> Agents;
+	};
+
+	const ClusterBenchmark& GetClusterBenchmark(int32_t LightCount)
+	{
+		constexpr int32_t AgentCount = 256;
+		static int32_t CachedLightCount = -1;
+		static ClusterBenchmark Cached;
+
+		if (CachedLightCount != LightCount)
+		{
+			SceneGeneratorSettings Settings;
+			Settings.LightSpacing = 400.0f;
+			Settings.MinAttenuationRadius = 100.0f;
+			Settings.MaxAttenuationRadius = 400.0f;
+			Settings.PointLightGroupSize = 16;
+			Settings.PointLightGroupRadius = 100.0f;
+			GenerateScene(Cached.Scene, LightCount, Settings);
+			Cached.Agents = GenerateAgents(AgentCount, LightCount, Settings);
+
+			// Only point lights are clustered, the spot lights would cost every mode the same
+			Cached.Scene.SpotLights.clear();
+			std::vector<int32_t> LightIndices(LightCount);
+			for (int32_t idx = 0; idx < LightCount; idx++)
+			{
+				LightIndices[idx] = idx;
+			}
+			BuildPointLightClusters(Cached.Scene, LightIndices, 400.0f, Cached.Clusters);
+			CachedLightCount = LightCount;
+		}
+		return Cached;
+	}
+
+	// Gathers the point light candidates for each agent's detection point, by testing every light, through the clusters, or through the
+	// clusters with each one gathered as a single virtual light. Reports the cost per query and how many candidates each query is left with
+	void BM_GatherPointLights(benchmark::State& State)
+	{
+		const ClusterBenchmark& Bench = GetClusterBenchmark(static_cast<int32_t>(State.range(0)));
+		const int32_t Mode = static_cast<int32_t>(State.range(1));
+		const PointLightClusters* Clusters = Mode > 0 ? &Bench.Clusters : nullptr;
+		const DetectionSettings Settings;
+		LightCandidates Candidates;
+		int64_t CandidateCount = 0;
+		const BenchmarkClock::time_point StartTime = BenchmarkClock::now();
+		for (auto _ : State)
+		{
+			for (const AgentData& Agent : Bench.Agents)
+			{
+				GatherCandidates(Bench.Scene, Agent.DetectionPoint, Agent.DetectionPoint, Settings, Candidates, Clusters, Mode == 2);
+				CandidateCount += static_cast<int64_t>(Candidates.PointLights.size() + Candidates.VirtualPointLights.size());
+			}
+			benchmark::ClobberMemory();
+		}
+
+		const double QueryCount = static_cast<double>(State.iterations()) * static_cast<double>(Bench.Agents.size());
+		SetNanosecondsPerItem(State, "ns/query", static_cast<int64_t>(Bench.Agents.size()), StartTime);
+		State.counters["candidates"] = static_cast<double>(CandidateCount) / QueryCount;
+		State.counters["clusters"] = static_cast<double>(Bench.Clusters.Clusters.size());
+	}
+
+	// A scene dense enough that hundreds of point lights are in range of each agent, with a light tree over them
+	struct ManyLightBenchmark
+	{
+		LightScene Scene;
+		PointLightTree Tree;
+		std::vector<AgentData> Agents;
+	};
+
+	const ManyLightBenchmark& GetManyLightBenchmark(int32_t LightCount)
+	{
+		constexpr int32_t AgentCount = 64;
+		static int32_t CachedLightCount = -1;
+		static ManyLightBenchmark Cached;
+
+		if (CachedLightCount != LightCount)
+		{
+			SceneGeneratorSettings Settings;
+			Settings.LightSpacing = 400.0f;
+			GenerateScene(Cached.Scene, LightCount, Settings);
+			Cached.Tree.Build(Cached.Scene);
+			Cached.Agents = GenerateAgents(AgentCount, LightCount, Settings);
+			CachedLightCount = LightCount;
+		}
+		return Cached;
+	}
+
+	// Sums every point light in range of each agent, tracing each one
+	void BM_SumPointLights(benchmark::State& State)
+	{
+		const ManyLightBenchmark& Bench = GetManyLightBenchmark(static_cast<int32_t>(State.range(0)));
+		const DetectionSettings Settings;
+		NoOcclusionQuery Occlusion;
+		DetectionCounters Counters;
+		LightCandidates Candidates;
+		const BenchmarkClock::time_point StartTime = BenchmarkClock::now();
+		for (auto _ : State)
+		{
+			for (const AgentData& Agent : Bench.Agents)
+			{
+				GatherCandidates(Bench.Scene, Agent.DetectionPoint, Agent.DetectionPoint, Settings, Candidates);
+				float IlluminanceTotal = 0.0f;
+				for (const int32_t LightIndex : Candidates.PointLights)
+				{
+					const PointLightData& PointLight = Bench.Scene.PointLights[LightIndex];
+					const LightSample Sample = EvaluatePointLight(PointLight, Agent.DetectionPoint, Settings, Occlusion, Counters);
+					IlluminanceTotal += GetPointLightContribution(PointLight, Agent.DetectionPoint) * Sample.Illuminance;
+				}
+				benchmark::DoNotOptimize(IlluminanceTotal);
+			}
+		}
+		SetNanosecondsPerItem(State, "ns/query", static_cast<int64_t>(Bench.Agents.size()), StartTime);
+		State.counters["traces"] = static_cast<double>(Counters.TracesIssued) / (static_cast<double>(State.iterations()) * static_cast<double>(Bench.Agents.size()));
+	}
+
+	// The same sum estimated from four lights sampled from the light tree for each agent
+	void BM_EstimatePointLights(benchmark::State& State)
+	{
+		const ManyLightBenchmark& Bench = GetManyLightBenchmark(static_cast<int32_t>(State.range(0)));
+		const DetectionSettings Settings;
+		const StochasticEstimatorSettings EstimatorSettings;
+		NoOcclusionQuery Occlusion;
+		DetectionCounters Counters;
+		std::vector<StochasticIlluminanceState> Estimates(Bench.Agents.size());
+		const BenchmarkClock::time_point StartTime = BenchmarkClock::now();
+		for (auto _ : State)
+		{
+			for (size_t AgentIdx = 0; AgentIdx < Bench.Agents.size(); AgentIdx++)
+			{
+				benchmark::DoNotOptimize(EstimatePointLightIlluminance(Bench.Scene, Bench.Tree, Bench.Agents[AgentIdx].DetectionPoint, Settings, EstimatorSettings, Occlusion,
+					Estimates[AgentIdx], Counters));
+			}
+		}
+		SetNanosecondsPerItem(State, "ns/query", static_cast<int64_t>(Bench.Agents.size()), StartTime);
+		State.counters["traces"] = static_cast<double>(Counters.TracesIssued) / (static_cast<double>(State.iterations()) * static_cast<double>(Bench.Agents.size()));
+	}
+
+	// An office block of 10m rooms filling the scene, each joined to the rooms beside, above and below it by a doorway in the middle of the wall
+	struct CellBenchmark
+	{
+		LightScene Scene;
+		LightCellScene Cells;
+		std::vector<AgentData> Agents;
+	};
+
+	const CellBenchmark& GetCellBenchmark(int32_t LightCount)
+	{
+		constexpr int32_t AgentCount = 256;
+		constexpr float RoomSize = 1000.0f;
+		const Vector3 DoorExtent(60.0f, 60.0f, 110.0f);
+		static int32_t CachedLightCount = -1;
+		static CellBenchmark Cached;
+
+		if (CachedLightCount != LightCount)
+		{
+			SceneGeneratorSettings Settings;
+			Settings.LightSpacing = 400.0f;
+			Settings.MaxAttenuationRadius = 1000.0f;
+			GenerateScene(Cached.Scene, LightCount, Settings);
+			Cached.Agents = GenerateAgents(AgentCount, LightCount, Settings);
+
+			const int32_t RoomsPerSide = static_cast<int32_t>(std::ceil(GetSceneExtent(LightCount, Settings) / RoomSize));
+			Cached.Cells.Reset();
+			for (int32_t X = 0; X < RoomsPerSide; X++)
+			{
+				for (int32_t Y = 0; Y < RoomsPerSide; Y++)
+				{
+					for (int32_t Z = 0; Z < RoomsPerSide; Z++)
+					{
+						const Vector3 RoomMin(X * RoomSize, Y * RoomSize, Z * RoomSize);
+						AddLightCell(Cached.Cells, RoomMin, RoomMin + Vector3(RoomSize, RoomSize, RoomSize));
+					}
+				}
+			}
+
+			// A doorway in the middle of each wall, reaching a little into the rooms either side
+			for (int32_t X = 0; X < RoomsPerSide; X++)
+			{
+				for (int32_t Y = 0; Y < RoomsPerSide; Y++)
+				{
+					for (int32_t Z = 0; Z < RoomsPerSide; Z++)
+					{
+						const Vector3 RoomCenter = Vector3(X + 0.5f, Y + 0.5f, Z + 0.5f) * RoomSize;
+						const Vector3 Walls[3] = { Vector3(RoomSize * 0.5f, 0, 0), Vector3(0, RoomSize * 0.5f, 0), Vector3(0, 0, RoomSize * 0.5f) };
+						for (const Vector3& Wall : Walls)
+						{
+							AddCellPortal(Cached.Cells, RoomCenter + Wall - DoorExtent, RoomCenter + Wall + DoorExtent);
+						}
+					}
+				}
+			}
+
+			std::vector<int32_t> PointLightIndices(Cached.Scene.PointLights.size());
+			std::vector<int32_t> SpotLightIndices(Cached.Scene.SpotLights.size());
+			for (size_t idx = 0; idx < PointLightIndices.size(); idx++)
+			{
+				PointLightIndices[idx] = static_cast<int32_t>(idx);
+			}
+			for (size_t idx = 0; idx < SpotLightIndices.size(); idx++)
+			{
+				SpotLightIndices[idx] = static_cast<int32_t>(idx);
+			}
+			AssignLightsToCells(Cached.Scene, PointLightIndices, SpotLightIndices, Cached.Cells);
+			CachedLightCount = LightCount;
+		}
+		return Cached;
+	}
+
+	// Gathers the point and spot light candidates for each agent's detection point by distance alone, or through the rooms and doorways.
+	// Reports the cost per query and how many candidates each query is left with to cull and trace
+	void BM_GatherCellLights(benchmark::State& State)
+	{
+		const CellBenchmark& Bench = GetCellBenchmark(static_cast<int32_t>(State.range(0)));
+		const bool bCells = State.range(1) != 0;
+		const DetectionSettings Settings;
+		LightCandidates Candidates;
+		int64_t CandidateCount = 0;
+		const BenchmarkClock::time_point StartTime = BenchmarkClock::now();
+		for (auto _ : State)
+		{
+			for (const AgentData& Agent : Bench.Agents)
+			{
+				if (bCells)
+				{
+					GatherCellCandidates(Bench.Scene, Bench.Cells, Agent.DetectionPoint, Settings, 1, Candidates);
+				}
+				else
+				{
+					GatherCandidates(Bench.Scene, Agent.DetectionPoint, Agent.DetectionPoint, Settings, Candidates);
+				}
+				CandidateCount += static_cast<int64_t>(Candidates.PointLights.size() + Candidates.SpotLights.size());
+			}
+			benchmark::ClobberMemory();
+		}
+
+		const double QueryCount = static_cast<double>(State.iterations()) * static_cast<double>(Bench.Agents.size());
+		SetNanosecondsPerItem(State, "ns/query", static_cast<int64_t>(Bench.Agents.size()), StartTime);
+		State.counters["candidates"] = static_cast<double>(CandidateCount) / QueryCount;
+		State.counters["cells"] = static_cast<double>(Bench.Cells.Cells.size());
+	}
+
+	// Occluders scattered through the scene generated for 1000 lights, and segments in groups of OcclusionPacketWidth from one point to
+	// several points on an agent, the pattern several body samples or nearby agents make when traced from the same light. The same occluders
+	// are also voxelized, at half a meter so the grid stays well under the hierarchy's memory
+	struct OcclusionBenchmark
+	{
+		OccluderScene Occluders;
+		OccluderVoxelGrid Voxels;
+		std::vector<Vector3> From;
+		std::vector<Vector3> To;
+	};
+
+	const OcclusionBenchmark& GetOcclusionBenchmark(int32_t OccluderCount)
+	{
+		constexpr int32_t LightCount = 1000;
+		constexpr int32_t GroupCount = 1024;
+		static int32_t CachedOccluderCount = -1;
+		static OcclusionBenchmark Cached;
+
+		if (CachedOccluderCount != OccluderCount)
+		{
+			SceneGeneratorSettings Settings;
+			const std::vector<OccluderTriangle> Triangles = GenerateOccluderTriangles(OccluderCount, LightCount, Settings);
+			Cached.Occluders.Static.Build(Triangles);
+			Cached.Voxels.Build(Triangles, 50.0f);
+			const std::vector<AgentData> Agents = GenerateAgents(GroupCount, LightCount, Settings);
+
+			std::mt19937 Random(Settings.Seed);
+			std::uniform_real_distribution<float> Unit(-1.0f, 1.0f);
+			Cached.From.clear();
+			Cached.To.clear();
+			for (const AgentData& Agent : Agents)
+			{
+				const Vector3 LightPosition = Agent.Position + Vector3(Unit(Random), Unit(Random), Unit(Random)) * Settings.MaxAttenuationRadius * 0.5f;
+				for (const Vector3& Sample : MakeBodySamples(Agent, OcclusionPacketWidth))
+				{
+					Cached.From.push_back(LightPosition);
+					Cached.To.push_back(Sample);
+				}
+			}
+			CachedOccluderCount = OccluderCount;
+		}
+		return Cached;
+	}
+
+	// Reports ns/segment and segments/s for a benchmark that tests SegmentTests segments for occlusion per iteration
+	void SetSegmentCounters(benchmark::State& State, int64_t SegmentTests, BenchmarkClock::time_point StartTime)
+	{
+		SetNanosecondsPerItem(State, "ns/segment", SegmentTests, StartTime);
+		State.counters["segments/s"] = benchmark::Counter(static_cast<double>(SegmentTests), benchmark::Counter::kIsIterationInvariantRate);
+	}
+
+	// Every segment traversed through the occluder hierarchy on its own
+	void BM_OccluderSegments(benchmark::State& State)
+	{
+		const OcclusionBenchmark& Bench = GetOcclusionBenchmark(static_cast<int32_t>(State.range(0)));
+		const BenchmarkClock::time_point StartTime = BenchmarkClock::now();
+		for (auto _ : State)
+		{
+			int32_t Occluded = 0;
+			for (size_t idx = 0; idx < Bench.From.size(); idx++)
+			{
+				Occluded += Bench.Occluders.Static.IsSegmentOccluded(Bench.From[idx], Bench.To[idx]);
+			}
+			benchmark::DoNotOptimize(Occluded);
+		}
+		SetSegmentCounters(State, static_cast<int64_t>(Bench.From.size()), StartTime);
+	}
+
+	// The same segments traversed a packet at a time
+	void BM_OccluderSegmentPackets(benchmark::State& State)
+	{
+		const OcclusionBenchmark& Bench = GetOcclusionBenchmark(static_cast<int32_t>(State.range(0)));
+		const BenchmarkClock::time_point StartTime = BenchmarkClock::now();
+		for (auto _ : State)
+		{
+			int32_t Occluded = 0;
+			for (size_t idx = 0; idx < Bench.From.size(); idx += OcclusionPacketWidth)
+			{
+				bool bOccluded[OcclusionPacketWidth];
+				Bench.Occluders.Static.AreSegmentsOccluded(&Bench.From[idx], &Bench.To[idx], OcclusionPacketWidth, bOccluded);
+				for (const bool bLaneOccluded : bOccluded)
+				{
+					Occluded += bLaneOccluded;
+				}
+			}
+			benchmark::DoNotOptimize(Occluded);
+		}
+		SetSegmentCounters(State, static_cast<int64_t>(Bench.From.size()), StartTime);
+	}
+
+	// The same segments through the occlusion query the detection kernels use, each group from one light asked for at once as the spot light
+	// kernels do, so the query gathers them into packets itself
+	void BM_OccluderSharedOrigin(benchmark::State& State)
+	{
+		const OcclusionBenchmark& Bench = GetOcclusionBenchmark(static_cast<int32_t>(State.range(0)));
+		OccluderOcclusionQuery Occlusion(Bench.Occluders);
+		const BenchmarkClock::time_point StartTime = BenchmarkClock::now();
+		for (auto _ : State)
+		{
+			int32_t Occluded = 0;
+			for (size_t idx = 0; idx < Bench.From.size(); idx += OcclusionPacketWidth)
+			{
+				bool bOccluded[OcclusionPacketWidth];
+				Occlusion.AreOccluded(Bench.From[idx], &Bench.To[idx], OcclusionPacketWidth, bOccluded);
+				for (const bool bSegmentOccluded : bOccluded)
+				{
+					Occluded += bSegmentOccluded;
+				}
+			}
+			benchmark::DoNotOptimize(Occluded);
+		}
+		SetSegmentCounters(State, static_cast<int64_t>(Bench.From.size()), StartTime);
+	}
+
+	// The same segments marched through the voxel grid
+	void BM_VoxelSegments(benchmark::State& State)
+	{
+		const OcclusionBenchmark& Bench = GetOcclusionBenchmark(static_cast<int32_t>(State.range(0)));
+		const BenchmarkClock::time_point StartTime = BenchmarkClock::now();
+		for (auto _ : State)
+		{
+			int32_t Occluded = 0;
+			for (size_t idx = 0; idx < Bench.From.size(); idx++)
+			{
+				Occluded += Bench.Voxels.IsSegmentOccluded(Bench.From[idx], Bench.To[idx]);
+			}
+			benchmark::DoNotOptimize(Occluded);
+		}
+		SetSegmentCounters(State, static_cast<int64_t>(Bench.From.size()), StartTime);
+	}
+
+	// Light counts from 10 to 100k by powers of ten, against 1, 16 and 256 agents
+	void LightAndAgentCounts(benchmark::internal::Benchmark* Benchmark)
+	{
+		Benchmark->ArgNames({ "lights", "agents" });
+		Benchmark->ArgsProduct({ benchmark::CreateRange(10, 100000, 10), { 1, 16, 256 } });
+	}
+}
+
+BENCHMARK(BM_PointLightRange)->Apply(LightAndAgentCounts);
+BENCHMARK(BM_SpotLightCone)->Apply(LightAndAgentCounts);
+BENCHMARK(BM_EvaluateSpotLight)->Apply(LightAndAgentCounts);
+BENCHMARK(BM_RectLightFrustum)->Apply(LightAndAgentCounts);
+BENCHMARK(BM_EvaluateSamplesSeparately)->ArgNames({ "lights", "samples" })->ArgsProduct({ { 1000, 100000 }, { 1, 3, 8 } });
+BENCHMARK(BM_EvaluateSamplesTogether)->ArgNames({ "lights", "samples" })->ArgsProduct({ { 1000, 100000 }, { 1, 3, 8 } });
+BENCHMARK(BM_OccluderSegments)->ArgName("occluders")->RangeMultiplier(10)->Range(1000, 100000);
+BENCHMARK(BM_OccluderSegmentPackets)->ArgName("occluders")->RangeMultiplier(10)->Range(1000, 100000);
+BENCHMARK(BM_OccluderSharedOrigin)->ArgName("occluders")->RangeMultiplier(10)->Range(1000, 100000);
+BENCHMARK(BM_VoxelSegments)->ArgName("occluders")->RangeMultiplier(10)->Range(1000, 100000);
+BENCHMARK(BM_EvaluateRectLightArea)->ArgName("samples")->Arg(1)->Arg(16)->Arg(64);
+BENCHMARK(BM_GatherPointLights)->ArgNames({ "lights", "mode" })->ArgsProduct({ { 1000, 10000 }, { 0, 1, 2 } });
+BENCHMARK(BM_SumPointLights)->ArgName("lights")->RangeMultiplier(10)->Range(1000, 100000);
+BENCHMARK(BM_EstimatePointLights)->ArgName("lights")->RangeMultiplier(10)->Range(1000, 100000);
+BENCHMARK(BM_GatherCellLights)->ArgNames({ "lights", "cells" })->ArgsProduct({ { 1000, 10000 }, { 0, 1 } });
+BENCHMARK(BM_RectLightFrustumRecompute)->ArgName("lights")->RangeMultiplier(10)->Range(10, 100000);
+
+BENCHMARK_MAIN();
+
+#endif
@@ -0,0 +1,224 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "../Public/LightDetectionCells.h"
+#include <algorithm>
+#include "../Public/LightDetectionKernels.h"
+
+namespace LightDetection
+{
+	namespace
+	{
+		bool IsInBox(const Vector3& Point, const Vector3& BoundsMin, const Vector3& BoundsMax)
+		{
+			return Point.X >= BoundsMin.X && Point.Y >= BoundsMin.Y && Point.Z >= BoundsMin.Z
+				&& Point.X <= BoundsMax.X && Point.Y <= BoundsMax.Y && Point.Z <= BoundsMax.Z;
+		}
+
+		bool DoBoxesOverlap(const Vector3& MinA, const Vector3& MaxA, const Vector3& MinB, const Vector3& MaxB)
+		{
+			return MinA.X <= MaxB.X && MinA.Y <= MaxB.Y && MinA.Z <= MaxB.Z
+				&& MinB.X <= MaxA.X && MinB.Y <= MaxA.Y && MinB.Z <= MaxA.Z;
+		}
+
+		// True if the light is visible, switched on and its range reaches the point, and the portal it would have to shine through if Portal is given
+		template <typename LightType>
+		bool CanLightReach(const LightType& Light, const Vector3& Point, const CellPortal* Portal, float ForgivenessBuffer)
+		{
+			return Light.bVisible && Light.Intensity > 0
+				&& IsRangeInBounds(Light.Position, Light.AttenuationRadius, Point, Point, ForgivenessBuffer)
+				&& (!Portal || IsRangeInBounds(Light.Position, Light.AttenuationRadius, Portal->BoundsMin, Portal->BoundsMax, ForgivenessBuffer));
+		}
+
+		// True if Cell was visited at an earlier depth, before DepthEnd, or has already been queued through Portal at the next depth
+		bool IsCellVisited(const std::vector<int32_t>& VisitCells, const std::vector<int32_t>& VisitPortals, size_t DepthEnd, int32_t Cell, int32_t Portal)
+		{
+			for (size_t VisitIdx = 0; VisitIdx < VisitCells.size(); VisitIdx++)
+			{
+				if (VisitCells[VisitIdx] == Cell && (VisitIdx < DepthEnd || VisitPortals[VisitIdx] == Portal))
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+	}
+
+	int32_t AddLightCell(LightCellScene& Cells, const Vector3& BoundsMin, const Vector3& BoundsMax)
+	{
+		LightCell Cell;
+		Cell.BoundsMin = BoundsMin;
+		Cell.BoundsMax = BoundsMax;
+		Cells.Cells.push_back(Cell);
+		return static_cast<int32_t>(Cells.Cells.size()) - 1;
+	}
+
+	int32_t AddCellPortal(LightCellScene& Cells, const Vector3& BoundsMin, const Vector3& BoundsMax)
+	{
+		int32_t PortalCount = 0;
+		for (size_t FirstIdx = 0; FirstIdx < Cells.Cells.size(); FirstIdx++)
+		{
+			if (!DoBoxesOverlap(BoundsMin, BoundsMax, Cells.Cells[FirstIdx].BoundsMin, Cells.Cells[FirstIdx].BoundsMax))
+			{
+				continue;
+			}
+
+			for (size_t SecondIdx = FirstIdx + 1; SecondIdx < Cells.Cells.size(); SecondIdx++)
+			{
+				if (!DoBoxesOverlap(BoundsMin, BoundsMax, Cells.Cells[SecondIdx].BoundsMin, Cells.Cells[SecondIdx].BoundsMax))
+				{
+					continue;
+				}
+
+				const int32_t PortalIndex = static_cast<int32_t>(Cells.Portals.size());
+				Cells.Portals.push_back({ BoundsMin, BoundsMax, static_cast<int32_t>(FirstIdx), static_cast<int32_t>(SecondIdx) });
+				Cells.Cells[FirstIdx].Portals.push_back(PortalIndex);
+				Cells.Cells[SecondIdx].Portals.push_back(PortalIndex);
+				PortalCount++;
+			}
+		}
+		return PortalCount;
+	}
+
+	void AssignLightsToCells(const LightScene& Scene, const std::vector<int32_t>& StaticPointLights, const std::vector<int32_t>& StaticSpotLights, LightCellScene& Cells)
+	{
+		std::vector<bool> bAssigned(Scene.PointLights.size(), false);
+		for (const int32_t LightIndex : StaticPointLights)
+		{
+			for (LightCell& Cell : Cells.Cells)
+			{
+				if (IsInBox(Scene.PointLights[LightIndex].Position, Cell.BoundsMin, Cell.BoundsMax))
+				{
+					Cell.PointLights.push_back(LightIndex);
+					bAssigned[LightIndex] = true;
+				}
+			}
+		}
+		for (size_t idx = 0; idx < bAssigned.size(); idx++)
+		{
+			if (!bAssigned[idx])
+			{
+				Cells.UnassignedPointLights.push_back(static_cast<int32_t>(idx));
+			}
+		}
+
+		bAssigned.assign(Scene.SpotLights.size(), false);
+		for (const int32_t LightIndex : StaticSpotLights)
+		{
+			for (LightCell& Cell : Cells.Cells)
+			{
+				if (IsInBox(Scene.SpotLights[LightIndex].Position, Cell.BoundsMin, Cell.BoundsMax))
+				{
+					Cell.SpotLights.push_back(LightIndex);
+					bAssigned[LightIndex] = true;
+				}
+			}
+		}
+		for (size_t idx = 0; idx < bAssigned.size(); idx++)
+		{
+			if (!bAssigned[idx])
+			{
+				Cells.UnassignedSpotLights.push_back(static_cast<int32_t>(idx));
+			}
+		}
+	}
+
+	int32_t FindLightCell(const LightCellScene& Cells, const Vector3& Point)
+	{
+		for (size_t CellIdx = 0; CellIdx < Cells.Cells.size(); CellIdx++)
+		{
+			if (IsInBox(Point, Cells.Cells[CellIdx].BoundsMin, Cells.Cells[CellIdx].BoundsMax))
+			{
+				return static_cast<int32_t>(CellIdx);
+			}
+		}
+		return -1;
+	}
+
+	void GatherCellCandidates(const LightScene& Scene, const LightCellScene& Cells, const Vector3& Point, const DetectionSettings& Settings, int32_t MaxPortalDepth,
+		LightCandidates& Candidates)
+	{
+		// The walk starts from every cell holding the point, since a point where cells overlap can be reached from the lights in any of them
+		std::vector<int32_t>& VisitCells = Candidates.CellsToVisit;
+		std::vector<int32_t>& VisitPortals = Candidates.CellEntryPortals;
+		VisitCells.clear();
+		VisitPortals.clear();
+		for (size_t CellIdx = 0; CellIdx < Cells.Cells.size(); CellIdx++)
+		{
+			if (IsInBox(Point, Cells.Cells[CellIdx].BoundsMin, Cells.Cells[CellIdx].BoundsMax))
+			{
+				VisitCells.push_back(static_cast<int32_t>(CellIdx));
+				VisitPortals.push_back(-1);
+			}
+		}
+		if (VisitCells.empty())
+		{
+			GatherCandidates(Scene, Point, Point, Settings, Candidates);
+			return;
+		}
+
+		Candidates.Reset();
+		for (const int32_t LightIndex : Cells.UnassignedPointLights)
+		{
+			if (CanLightReach(Scene.PointLights[LightIndex], Point, nullptr, Settings.ForgivenessBuffer))
+			{
+				Candidates.PointLights.push_back(LightIndex);
+			}
+		}
+		for (const int32_t LightIndex : Cells.UnassignedSpotLights)
+		{
+			if (CanLightReach(Scene.SpotLights[LightIndex], Point, nullptr, Settings.ForgivenessBuffer))
+			{
+				Candidates.SpotLights.push_back(LightIndex);
+			}
+		}
+
+		// Walk out from the point's cell through its portals a depth at a time. A cell reached through several portals at the same depth is
+		// visited once through each, so a light is gathered if it reaches any of the portals into its cell
+		size_t DepthStart = 0;
+		for (int32_t Depth = 0; DepthStart < VisitCells.size(); Depth++)
+		{
+			const size_t DepthEnd = VisitCells.size();
+			for (size_t VisitIdx = DepthStart; VisitIdx < DepthEnd; VisitIdx++)
+			{
+				const LightCell& Cell = Cells.Cells[VisitCells[VisitIdx]];
+				const CellPortal* Portal = VisitPortals[VisitIdx] >= 0 ? &Cells.Portals[VisitPortals[VisitIdx]] : nullptr;
+				for (const int32_t LightIndex : Cell.PointLights)
+				{
+					if (CanLightReach(Scene.PointLights[LightIndex], Point, Portal, Settings.ForgivenessBuffer))
+					{
+						Candidates.PointLights.push_back(LightIndex);
+					}
+				}
+				for (const int32_t LightIndex : Cell.SpotLights)
+				{
+					if (CanLightReach(Scene.SpotLights[LightIndex], Point, Portal, Settings.ForgivenessBuffer))
+					{
+						Candidates.SpotLights.push_back(LightIndex);
+					}
+				}
+
+				if (Depth >= MaxPortalDepth)
+				{
+					continue;
+				}
+				for (const int32_t PortalIndex : Cell.Portals)
+				{
+					const CellPortal& Next = Cells.Portals[PortalIndex];
+					const int32_t NextCell = Next.FirstCell == VisitCells[VisitIdx] ? Next.SecondCell : Next.FirstCell;
+					if (!IsCellVisited(VisitCells, VisitPortals, DepthEnd, NextCell, PortalIndex))
+					{
+						VisitCells.push_back(NextCell);
+						VisitPortals.push_back(PortalIndex);
+					}
+				}
+			}
+			DepthStart = DepthEnd;
+		}
+
+		// A light in several overlapping cells may have been gathered more than once, and candidates are kept in scene order
+		std::sort(Candidates.PointLights.begin(), Candidates.PointLights.end());
+		Candidates.PointLights.erase(std::unique(Candidates.PointLights.begin(), Candidates.PointLights.end()), Candidates.PointLights.end());
+		std::sort(Candidates.SpotLights.begin(), Candidates.SpotLights.end());
+		Candidates.SpotLights.erase(std::unique(Candidates.SpotLights.begin(), Candidates.SpotLights.end()), Candidates.SpotLights.end());
+	}
+}
@@ -0,0 +1,185 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "../Public/LightDetectionClusters.h"
+#include <algorithm>
+#include <cmath>
+#include "../Public/LightDetectionKernels.h"
+
+namespace LightDetection
+{
+	namespace
+	{
+		// A point light and the grid cell it was clustered into
+		struct ClusterCellEntry
+		{
+			int64_t CellKey;
+			int32_t LightIndex;
+		};
+
+		// Packs a cell's coordinates into one key, 21 bits each is over a million cells along each axis
+		int64_t GetCellKey(const Vector3& Position, float ClusterSize)
+		{
+			const int64_t Mask = (1 << 21) - 1;
+			const int64_t X = static_cast<int64_t>(std::floor(Position.X / ClusterSize)) & Mask;
+			const int64_t Y = static_cast<int64_t>(std::floor(Position.Y / ClusterSize)) & Mask;
+			const int64_t Z = static_cast<int64_t>(std::floor(Position.Z / ClusterSize)) & Mask;
+			return (X << 42) | (Y << 21) | Z;
+		}
+	}
+
+	void BuildPointLightClusters(const LightScene& Scene, const std::vector<int32_t>& LightIndices, float ClusterSize, PointLightClusters& OutClusters)
+	{
+		OutClusters.Reset();
+		OutClusters.LightClusters.assign(Scene.PointLights.size(), -1);
+
+		if (ClusterSize > 0.0f)
+		{
+			// Order the lights by cell so each cluster's members are next to each other, and by index within a cell so clusters are always
+			// built the same way from the same lights
+			std::vector<ClusterCellEntry> Cells;
+			Cells.reserve(LightIndices.size());
+			for (const int32_t LightIndex : LightIndices)
+			{
+				Cells.push_back({ GetCellKey(Scene.PointLights[LightIndex].Position, ClusterSize), LightIndex });
+			}
+			std::sort(Cells.begin(), Cells.end(), [](const ClusterCellEntry& A, const ClusterCellEntry& B)
+			{
+				return A.CellKey < B.CellKey || (A.CellKey == B.CellKey && A.LightIndex < B.LightIndex);
+			});
+
+			for (size_t CellIdx = 0; CellIdx < Cells.size(); CellIdx++)
+			{
+				if (CellIdx == 0 || Cells[CellIdx].CellKey != Cells[CellIdx - 1].CellKey)
+				{
+					PointLightCluster Cluster;
+					Cluster.FirstMember = static_cast<int32_t>(OutClusters.Members.size());
+					OutClusters.Clusters.push_back(Cluster);
+				}
+
+				const int32_t ClusterIndex = static_cast<int32_t>(OutClusters.Clusters.size()) - 1;
+				OutClusters.Clusters[ClusterIndex].MemberCount++;
+				OutClusters.Members.push_back(Cells[CellIdx].LightIndex);
+				OutClusters.LightClusters[Cells[CellIdx].LightIndex] = ClusterIndex;
+			}
+		}
+
+		for (size_t idx = 0; idx < Scene.PointLights.size(); idx++)
+		{
+			if (OutClusters.LightClusters[idx] < 0)
+			{
+				OutClusters.Unclustered.push_back(static_cast<int32_t>(idx));
+			}
+		}
+
+		for (size_t ClusterIdx = 0; ClusterIdx < OutClusters.Clusters.size(); ClusterIdx++)
+		{
+			UpdatePointLightCluster(Scene, OutClusters, static_cast<int32_t>(ClusterIdx));
+		}
+	}
+
+	void UpdatePointLightCluster(const LightScene& Scene, PointLightClusters& Clusters, int32_t ClusterIndex)
+	{
+		PointLightCluster& Cluster = Clusters.Clusters[ClusterIndex];
+		const int32_t* Members = Clusters.Members.data() + Cluster.FirstMember;
+
+		// Only lights that can light anything count towards the bounds, a cluster with none of them switched on is never tested further
+		Vector3 BoundsMin(0, 0, 0);
+		Vector3 BoundsMax(0, 0, 0);
+		Vector3 WeightedPosition(0, 0, 0);
+		float TotalIntensity = 0.0f;
+		int32_t LitCount = 0;
+		for (int32_t MemberIdx = 0; MemberIdx < Cluster.MemberCount; MemberIdx++)
+		{
+			const PointLightData& PointLight = Scene.PointLights[Members[MemberIdx]];
+			if (!PointLight.bVisible || PointLight.Intensity <= 0)
+			{
+				continue;
+			}
+
+			const Vector3& Position = PointLight.Position;
+			BoundsMin = LitCount == 0 ? Position : Vector3(Min(BoundsMin.X, Position.X), Min(BoundsMin.Y, Position.Y), Min(BoundsMin.Z, Position.Z));
+			BoundsMax = LitCount == 0 ? Position : Vector3(Max(BoundsMax.X, Position.X), Max(BoundsMax.Y, Position.Y), Max(BoundsMax.Z, Position.Z));
+			WeightedPosition += Position * PointLight.Intensity;
+			TotalIntensity += PointLight.Intensity;
+			LitCount++;
+		}
+
+		if (LitCount == 0)
+		{
+			Cluster.BoundsCenter = Vector3(0, 0, 0);
+			Cluster.BoundsRadius = -1.0f;
+			Cluster.VirtualLight = { Vector3(0, 0, 0), 0.0f, 0.0f, false };
+			return;
+		}
+
+		// The bounds are centred on the lit members' box and reach as far as the furthest reaching member
+		Cluster.BoundsCenter = (BoundsMin + BoundsMax) * 0.5f;
+		Cluster.BoundsRadius = 0.0f;
+		Cluster.VirtualLight.Position = WeightedPosition / TotalIntensity;
+		Cluster.VirtualLight.AttenuationRadius = 0.0f;
+		for (int32_t MemberIdx = 0; MemberIdx < Cluster.MemberCount; MemberIdx++)
+		{
+			const PointLightData& PointLight = Scene.PointLights[Members[MemberIdx]];
+			if (!PointLight.bVisible || PointLight.Intensity <= 0)
+			{
+				continue;
+			}
+
+			Cluster.BoundsRadius = Max(Cluster.BoundsRadius, std::sqrt(DistSquared(PointLight.Position, Cluster.BoundsCenter)) + PointLight.AttenuationRadius);
+
+			// A point within this far of the virtual light is within range of this member
+			const float MemberReach = PointLight.AttenuationRadius - std::sqrt(DistSquared(PointLight.Position, Cluster.VirtualLight.Position));
+			Cluster.VirtualLight.AttenuationRadius = Max(Cluster.VirtualLight.AttenuationRadius, MemberReach);
+		}
+		Cluster.VirtualLight.Intensity = TotalIntensity;
+		Cluster.VirtualLight.bVisible = true;
+	}
+
+	void GatherClusteredPointLights(const LightScene& Scene, const PointLightClusters& Clusters, const Vector3& BoundsMin, const Vector3& BoundsMax,
+		const DetectionSettings& Settings, bool bApproximate, LightCandidates& Candidates)
+	{
+		// The forgiveness buffer is added to a member's squared range, so growing the cluster's radius by its root keeps the cluster test from
+		// ever rejecting a cluster with a member in range
+		const float BoundsGrowth = std::sqrt(Max(Settings.ForgivenessBuffer, 0.0f));
+
+		const size_t FirstCandidate = Candidates.PointLights.size();
+		for (size_t ClusterIdx = 0; ClusterIdx < Clusters.Clusters.size(); ClusterIdx++)
+		{
+			const PointLightCluster& Cluster = Clusters.Clusters[ClusterIdx];
+			if (Cluster.BoundsRadius < 0 || !IsRangeInBounds(Cluster.BoundsCenter, Cluster.BoundsRadius + BoundsGrowth, BoundsMin, BoundsMax, 0.0f))
+			{
+				continue;
+			}
+
+			if (bApproximate && Cluster.MemberCount > 1)
+			{
+				Candidates.VirtualPointLights.push_back({ Cluster.VirtualLight, static_cast<int32_t>(ClusterIdx) });
+				continue;
+			}
+
+			for (int32_t MemberIdx = Cluster.FirstMember; MemberIdx < Cluster.FirstMember + Cluster.MemberCount; MemberIdx++)
+			{
+				const int32_t LightIndex = Clusters.Members[MemberIdx];
+				const PointLightData& PointLight = Scene.PointLights[LightIndex];
+				if (PointLight.bVisible && PointLight.Intensity > 0
+					&& IsRangeInBounds(PointLight.Position, PointLight.AttenuationRadius, BoundsMin, BoundsMax, Settings.ForgivenessBuffer))
+				{
+					Candidates.PointLights.push_back(LightIndex);
+				}
+			}
+		}
+
+		for (const int32_t LightIndex : Clusters.Unclustered)
+		{
+			const PointLightData& PointLight = Scene.PointLights[LightIndex];
+			if (PointLight.bVisible && PointLight.Intensity > 0
+				&& IsRangeInBounds(PointLight.Position, PointLight.AttenuationRadius, BoundsMin, BoundsMax, Settings.ForgivenessBuffer))
+			{
+				Candidates.PointLights.push_back(LightIndex);
+			}
+		}
+
+		// Candidates are kept in scene order whichever way they were gathered
+		std::sort(Candidates.PointLights.begin() + FirstCandidate, Candidates.PointLights.end());
+	}
+}
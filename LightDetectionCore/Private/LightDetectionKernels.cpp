@@ -0,0 +1,716 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "../Public/LightDetectionKernels.h"
+#include <algorithm>
+
+namespace LightDetection
+{
+	void SetSpotLightConeAngles(SpotLightData& SpotLight, float InnerConeAngle, float OuterConeAngle)
+	{
+		SpotLight.InnerConeAngle = InnerConeAngle;
+		SpotLight.OuterConeAngle = OuterConeAngle;
+		float Sin;
+		SinCos(InnerConeAngle * DegreesToRadians, Sin, SpotLight.CosInnerConeAngle);
+		SinCos(OuterConeAngle * DegreesToRadians, Sin, SpotLight.CosOuterConeAngle);
+	}
+
+	bool IsInPointLightRange(const PointLightData& PointLight, const Vector3& Point, float ForgivenessBuffer)
+	{
+		// If the distance from light to point exceeds this light's attenuation radius plus a buffer amount, it is out of range
+		const float LightDistanceSqr = DistSquared(PointLight.Position, Point);
+		return LightDistanceSqr <= (PointLight.AttenuationRadius * PointLight.AttenuationRadius) + ForgivenessBuffer;
+	}
+
+	bool IsInSpotLightCone(const SpotLightData& SpotLight, const Vector3& Point, float ForgivenessBuffer)
+	{
+		const Vector3 Displacement = Point - SpotLight.Position;
+		const float LightDistanceSqr = Displacement.SizeSquared();
+
+		// A point on top of the light is always inside its cone
+		if (LightDistanceSqr < SmallNumber)
+		{
+			return true;
+		}
+
+		// If the point is not within "view" of the spot light, comparing cosines rather than angles so no inverse trig is needed
+		const float CosAngleBetween = Dot(Displacement, SpotLight.Direction) / std::sqrt(LightDistanceSqr);
+		if (CosAngleBetween < SpotLight.CosOuterConeAngle)
+		{
+			return false;
+		}
+
+		// If the point is not in range of the spot light's cone height in its direction, it is out of range
+		const float ConeHeight = SpotLight.AttenuationRadius * (SpotLight.CosOuterConeAngle / CosAngleBetween);
+		return LightDistanceSqr <= (ConeHeight * ConeHeight) + ForgivenessBuffer;
+	}
+
+	bool IsInRectLightRange(const RectLightData& RectLight, const Vector3& Point, float ForgivenessBuffer)
+	{
+		const float LightDistanceSqr = DistSquared(RectLight.Position, Point);
+		return LightDistanceSqr <= (RectLight.AttenuationRadius * RectLight.AttenuationRadius) + ForgivenessBuffer;
+	}
+
+	void CalculateFrustumPoints(const RectLightData& RectLight, RectLightFrustum& Frustum)
+	{
+		const Vector3 HalfWidth = RectLight.Right * (RectLight.SourceWidth / 2);
+		const Vector3 HalfHeight = RectLight.Up * (RectLight.SourceHeight / 2);
+
+		// Top left, top right, bottom right and bottom left of the near plane
+		Frustum.FrustumPoints[0] = RectLight.Position - HalfWidth + HalfHeight;
+		Frustum.FrustumPoints[1] = RectLight.Position + HalfWidth + HalfHeight;
+		Frustum.FrustumPoints[2] = RectLight.Position + HalfWidth - HalfHeight;
+		Frustum.FrustumPoints[3] = RectLight.Position - HalfWidth - HalfHeight;
+
+		// Top left, far plane
+		const Vector3 FarPlaneSegment = Frustum.FrustumPoints[0] + (RectLight.Forward * RectLight.BarnDoorLength).RotateAngleAxis(-RectLight.BarnDoorAngle, RectLight.Right);
+		float BarnDoorSin;
+		float BarnDoorCos;
+		SinCos(RectLight.BarnDoorAngle * DegreesToRadians, BarnDoorSin, BarnDoorCos);
+		const float FarPlaneSegmentLength = RectLight.BarnDoorLength * BarnDoorSin;
+		Frustum.FrustumPoints[4] = FarPlaneSegment - (RectLight.Right * FarPlaneSegmentLength);
+
+		// Top right, bottom right and bottom left of the far plane
+		Frustum.FrustumPoints[5] = Frustum.FrustumPoints[4] + (RectLight.Right * (2 * FarPlaneSegmentLength + RectLight.SourceWidth));
+		Frustum.FrustumPoints[6] = Frustum.FrustumPoints[5] - (RectLight.Up * (2 * FarPlaneSegmentLength + RectLight.SourceHeight));
+		Frustum.FrustumPoints[7] = Frustum.FrustumPoints[6] - (RectLight.Right * (2 * FarPlaneSegmentLength + RectLight.SourceWidth));
+	}
+
+	void CalculateBoundingPlanes(RectLightFrustum& Frustum)
+	{
+		const Vector3* Points = Frustum.FrustumPoints;
+
+		// Calculate the top bounding plane
+		const Vector3 TopPlaneNormal = Cross(Points[3] - Points[2], Points[4] - Points[2]).GetSafeNormal();
+		Frustum.BoundingPlanes[0] = Plane(TopPlaneNormal, Dot(TopPlaneNormal, Points[2])).Flip();
+
+		// Calculate the right bounding plane
+		const Vector3 RightPlaneNormal = Cross(Points[0] - Points[3], Points[5] - Points[3]).GetSafeNormal();
+		Frustum.BoundingPlanes[1] = Plane(RightPlaneNormal, Dot(RightPlaneNormal, Points[0])).Flip();
+
+		// Calculate the bottom bounding plane
+		const Vector3 BottomPlaneNormal = Cross(Points[7] - Points[1], Points[0] - Points[1]).GetSafeNormal();
+		Frustum.BoundingPlanes[2] = Plane(BottomPlaneNormal, Dot(BottomPlaneNormal, Points[0])).Flip();
+
+		// Calculate the left bounding plane
+		const Vector3 LeftPlaneNormal = Cross(Points[4] - Points[2], Points[1] - Points[2]).GetSafeNormal();
+		Frustum.BoundingPlanes[3] = Plane(LeftPlaneNormal, Dot(LeftPlaneNormal, Points[1])).Flip();
+	}
+
+	bool IsInRectLightFrustum(const RectLightFrustum& Frustum, const Vector3& Point)
+	{
+		// Check if the point is above all 4 bounding planes
+		const float TopPlaneDist = PointPlaneDist(Point, Frustum.FrustumPoints[3], Frustum.BoundingPlanes[0].Normal);
+		const float RightPlaneDist = PointPlaneDist(Point, Frustum.FrustumPoints[0], Frustum.BoundingPlanes[1].Normal);
+		const float BottomPlaneDist = PointPlaneDist(Point, Frustum.FrustumPoints[0], Frustum.BoundingPlanes[2].Normal);
+		const float LeftPlaneDist = PointPlaneDist(Point, Frustum.FrustumPoints[1], Frustum.BoundingPlanes[3].Normal);
+		return TopPlaneDist > 0 && RightPlaneDist > 0 && BottomPlaneDist > 0 && LeftPlaneDist > 0;
+	}
+
+	Vector3 GetDirectionalLightRayStart(const DirectionalLightData& DirectionalLight, const Vector3& Point, float Distance)
+	{
+		return Point - (DirectionalLight.Direction * Distance);
+	}
+
+	namespace
+	{
+		// True if this point light is visible, switched on and in range of the point, counting it as tested and culled if not
+		bool CullPointLight(const PointLightData& PointLight, const Vector3& Point, const DetectionSettings& Settings, DetectionCounters& Counters)
+		{
+			Counters.LightsTested++;
+
+			// If this point light is not visible in the scene or out of range, it contributes nothing
+			if (!PointLight.bVisible || PointLight.Intensity <= 0 || !IsInPointLightRange(PointLight, Point, Settings.ForgivenessBuffer))
+			{
+				Counters.LightsCulled++;
+				return true;
+			}
+			return false;
+		}
+
+		// The fraction of a light's illuminance that reaches To from From, only asking the query for partial transmittance when it is enabled
+		float TraceTransmittance(IOcclusionQuery& Occlusion, const Vector3& From, const Vector3& To, const DetectionSettings& Settings)
+		{
+			if (Settings.bTransmission)
+			{
+				return Occlusion.GetTransmittance(From, To);
+			}
+			return Occlusion.IsOccluded(From, To) ? 0.0f : 1.0f;
+		}
+
+		// A fixed pseudo random value from 0 to 1 for an index, so a stratum's jitter is the same every time its samples are started over
+		float HashToUnitFloat(uint32_t Value)
+		{
+			Value ^= Value >> 16;
+			Value *= 0x7FEB352Du;
+			Value ^= Value >> 15;
+			Value *= 0x846CA68Bu;
+			Value ^= Value >> 16;
+			return static_cast<float>(Value >> 8) * (1.0f / 16777216.0f);
+		}
+
+		// The grid of strata closest to SampleCount with the emitter's aspect ratio
+		void GetRectLightStrata(const RectLightData& RectLight, int32_t SampleCount, int32_t& OutColumns, int32_t& OutRows)
+		{
+			SampleCount = std::max(1, std::min(SampleCount, MaxRectLightSamples));
+			const float Aspect = RectLight.SourceHeight > 0.0f ? RectLight.SourceWidth / RectLight.SourceHeight : 1.0f;
+			OutColumns = std::max(1, std::min(SampleCount, static_cast<int32_t>(std::lround(std::sqrt(SampleCount * Aspect)))));
+			OutRows = std::max(1, SampleCount / OutColumns);
+		}
+
+		// Splits the emitter into strata and places a sample at a jittered point in each. Strata are put in an order that strides across the grid,
+		// so the samples traced first are spread over the whole emitter
+		void ResetRectLightSamples(const RectLightData& RectLight, const Vector3& Point, int32_t StratumCount, int32_t Columns, RectLightSamples& Samples)
+		{
+			const int32_t Rows = StratumCount / Columns;
+
+			// The largest stride near the golden ratio of the count that visits every stratum once
+			int32_t Stride = std::max(1, static_cast<int32_t>(StratumCount * 0.618f));
+			const auto GreatestCommonDivisor = [](int32_t A, int32_t B) { while (B != 0) { const int32_t Remainder = A % B; A = B; B = Remainder; } return A; };
+			while (Stride > 1 && GreatestCommonDivisor(Stride, StratumCount) != 1)
+			{
+				Stride--;
+			}
+
+			Samples.OffsetRight.resize(StratumCount);
+			Samples.OffsetUp.resize(StratumCount);
+			Samples.Transmittance.assign(StratumCount, 0.0f);
+			for (int32_t SampleIdx = 0; SampleIdx < StratumCount; SampleIdx++)
+			{
+				// A lone sample sits at the centre, matching a trace from the light's position
+				const int32_t Stratum = (SampleIdx * Stride) % StratumCount;
+				const float JitterRight = StratumCount > 1 ? HashToUnitFloat(static_cast<uint32_t>(Stratum) * 2) : 0.5f;
+				const float JitterUp = StratumCount > 1 ? HashToUnitFloat(static_cast<uint32_t>(Stratum) * 2 + 1) : 0.5f;
+				Samples.OffsetRight[SampleIdx] = ((static_cast<float>(Stratum % Columns) + JitterRight) / Columns) - 0.5f;
+				Samples.OffsetUp[SampleIdx] = ((static_cast<float>(Stratum / Columns) + JitterUp) / Rows) - 0.5f;
+			}
+
+			Samples.Light = RectLight;
+			Samples.Point = Point;
+			Samples.bValid = true;
+			Samples.TracedCount = 0;
+			Samples.NextSample = 0;
+		}
+
+		// True if this spot light is not visible, the point is outside its cone, or it is switched off, counting it as tested and culled if so
+		bool CullSpotLight(const SpotLightData& SpotLight, const Vector3& Point, const DetectionSettings& Settings, DetectionCounters& Counters)
+		{
+			Counters.LightsTested++;
+
+			// If this spot light is not visible, the point is outside its cone, or it is switched off, it contributes nothing and is not worth tracing
+			if (!SpotLight.bVisible || !IsInSpotLightCone(SpotLight, Point, Settings.ForgivenessBuffer) || SpotLight.Intensity <= 0)
+			{
+				Counters.LightsCulled++;
+				return true;
+			}
+			return false;
+		}
+
+		// The illuminance of a spot light that reaches the point
+		float GetSpotLightIlluminance(const SpotLightData& /*SpotLight*/, const Vector3& /*Point*/)
+		{
+			//////////////////////////////////////////// OLD PHOTOMETRY MATHS ////////////////////////////////////////////
+			//// Linearly scale the luminous power down if the point is between the inner and outer cones, otherwise leave it as the full intensity
+			//// Find the surface area of the spherical sector of the spot light at the point's distance, and spread the luminous power over it
+			return 1.0f;
+		}
+
+		// The illuminance of a point light that reaches the point
+		float GetPointLightIlluminance(const PointLightData& /*PointLight*/, const Vector3& /*Point*/)
+		{
+			//////////////////////////////////////////// OLD PHOTOMETRY MATHS ////////////////////////////////////////////
+			//float LightDistance = std::sqrt(DistSquared(PointLight.Position, Point)) * 0.01f;
+			//return PointLight.Intensity / (4 * Pi * LightDistance);
+			return 1.0f;
+		}
+
+		// EvaluatePointLightCandidates() for one of several points, cache entries are kept for each light and point pair
+		LightSample EvaluatePointLightsNearestFirst(const LightScene& Scene, LightCandidates& Candidates, const Vector3& Point, const DetectionSettings& Settings,
+			IOcclusionQuery& Occlusion, OcclusionCache* Cache, int32_t PointIdx, int32_t PointCount, int32_t& TracesLeft, DetectionCounters& Counters, int32_t& OutLitLightIndex)
+		{
+			OutLitLightIndex = -1;
+			LightSample Best = { LightEvaluation::Culled, 0.0f };
+
+			// Cull every candidate first, so the ones left can be traced in order of distance. Virtual lights are numbered after the scene's lights
+			const int32_t SceneLightCount = static_cast<int32_t>(Scene.PointLights.size());
+			std::vector<PointLightInRange>& InRange = Candidates.PointLightsInRange;
+			InRange.clear();
+			for (const int32_t LightIndex : Candidates.PointLights)
+			{
+				const PointLightData& PointLight = Scene.PointLights[LightIndex];
+				if (!CullPointLight(PointLight, Point, Settings, Counters))
+				{
+					InRange.push_back({ DistSquared(PointLight.Position, Point), LightIndex });
+				}
+			}
+			for (size_t VirtualIdx = 0; VirtualIdx < Candidates.VirtualPointLights.size(); VirtualIdx++)
+			{
+				const PointLightData& PointLight = Candidates.VirtualPointLights[VirtualIdx].Light;
+				if (!CullPointLight(PointLight, Point, Settings, Counters))
+				{
+					InRange.push_back({ DistSquared(PointLight.Position, Point), SceneLightCount + static_cast<int32_t>(VirtualIdx) });
+				}
+			}
+
+			// The nearest lights are the most likely to light the point, so they are the ones the trace budget is spent on. Ties are broken by
+			// index so the order, and with it the traces made, never depends on the sort
+			std::sort(InRange.begin(), InRange.end(), [](const PointLightInRange& A, const PointLightInRange& B)
+			{
+				return A.DistanceSqr < B.DistanceSqr || (A.DistanceSqr == B.DistanceSqr && A.LightIndex < B.LightIndex);
+			});
+
+			for (const PointLightInRange& Light : InRange)
+			{
+				// A virtual light is known by its ID rather than where it was gathered, so its cache entries and result carry over between updates
+				const bool bVirtual = Light.LightIndex >= SceneLightCount;
+				const VirtualPointLight* Virtual = bVirtual ? &Candidates.VirtualPointLights[Light.LightIndex - SceneLightCount] : nullptr;
+				const PointLightData& PointLight = bVirtual ? Virtual->Light : Scene.PointLights[Light.LightIndex];
+				const int32_t LightIndex = bVirtual ? SceneLightCount + Virtual->Id : Light.LightIndex;
+				const int32_t CacheIndex = LightIndex * PointCount + PointIdx;
+
+				float Transmittance;
+				if (Cache && Cache->Find(CacheIndex, PointLight.Position, Point, Settings.OcclusionCacheTolerance, Settings.OcclusionCacheMaxAge, Transmittance))
+				{
+					Counters.TracesSaved++;
+				}
+				else if (TracesLeft > 0)
+				{
+					TracesLeft--;
+					Counters.TracesIssued++;
+					Transmittance = TraceTransmittance(Occlusion, PointLight.Position, Point, Settings);
+					if (Cache)
+					{
+						Cache->Store(CacheIndex, PointLight.Position, Point, Transmittance);
+					}
+				}
+				else
+				{
+					// Out of budget with no answer to reuse, this light is tried again next update
+					continue;
+				}
+
+				// Point lights do not add up, the point is as lit as the brightest light reaching it. A light partly hidden by foliage or glass
+				// does not end the search, as a farther light may reach the point fully, but the first light nothing dims does
+				if (Transmittance > 0.0f)
+				{
+					const float Illuminance = GetPointLightIlluminance(PointLight, Point) * Transmittance;
+					if (Illuminance > Best.Illuminance)
+					{
+						OutLitLightIndex = LightIndex;
+						Best = { LightEvaluation::Lit, Illuminance };
+					}
+					if (Transmittance >= 1.0f)
+					{
+						return Best;
+					}
+				}
+			}
+
+			return Best;
+		}
+	}
+
+	LightSample EvaluatePointLight(const PointLightData& PointLight, const Vector3& Point, const DetectionSettings& Settings, IOcclusionQuery& Occlusion, DetectionCounters& Counters)
+	{
+		if (CullPointLight(PointLight, Point, Settings, Counters))
+		{
+			return { LightEvaluation::Culled, 0.0f };
+		}
+
+		// If there is something between this light and the point, it is in shadow
+		Counters.TracesIssued++;
+		const float Transmittance = TraceTransmittance(Occlusion, PointLight.Position, Point, Settings);
+		if (Transmittance <= 0.0f)
+		{
+			return { LightEvaluation::Occluded, 0.0f };
+		}
+
+		return { LightEvaluation::Lit, GetPointLightIlluminance(PointLight, Point) * Transmittance };
+	}
+
+	LightSample EvaluateSpotLight(const SpotLightData& SpotLight, const Vector3& Point, const DetectionSettings& Settings, IOcclusionQuery& Occlusion, DetectionCounters& Counters)
+	{
+		if (CullSpotLight(SpotLight, Point, Settings, Counters))
+		{
+			return { LightEvaluation::Culled, 0.0f };
+		}
+
+		// If there is something between this light and the point, it is in shadow
+		Counters.TracesIssued++;
+		const float Transmittance = TraceTransmittance(Occlusion, SpotLight.Position, Point, Settings);
+		if (Transmittance <= 0.0f)
+		{
+			return { LightEvaluation::Occluded, 0.0f };
+		}
+
+		return { LightEvaluation::Lit, GetSpotLightIlluminance(SpotLight, Point) * Transmittance };
+	}
+
+	void EvaluateSpotLightPoints(const SpotLightData& SpotLight, const Vector3* Points, int32_t PointCount, const DetectionSettings& Settings, IOcclusionQuery& Occlusion,
+		DetectionCounters& Counters, LightSample* OutSamples)
+	{
+		// Partial transmittance is traced a segment at a time, there is no batched form of it
+		if (Settings.bTransmission)
+		{
+			for (int32_t PointIdx = 0; PointIdx < PointCount; PointIdx++)
+			{
+				OutSamples[PointIdx] = EvaluateSpotLight(SpotLight, Points[PointIdx], Settings, Occlusion, Counters);
+			}
+			return;
+		}
+
+		// The points in the cone are gathered into batches, every segment in a batch starting at the light, so the occlusion query can traverse them together
+		Vector3 BatchPoints[OcclusionBatchSize];
+		int32_t BatchIndices[OcclusionBatchSize];
+		int32_t BatchCount = 0;
+		const auto TestBatch = [&]()
+		{
+			bool bOccluded[OcclusionBatchSize];
+			Counters.TracesIssued += BatchCount;
+			Occlusion.AreOccluded(SpotLight.Position, BatchPoints, BatchCount, bOccluded);
+			for (int32_t BatchIdx = 0; BatchIdx < BatchCount; BatchIdx++)
+			{
+				const int32_t PointIdx = BatchIndices[BatchIdx];
+				OutSamples[PointIdx] = bOccluded[BatchIdx] ? LightSample{ LightEvaluation::Occluded, 0.0f }
+					: LightSample{ LightEvaluation::Lit, GetSpotLightIlluminance(SpotLight, Points[PointIdx]) };
+			}
+			BatchCount = 0;
+		};
+
+		for (int32_t PointIdx = 0; PointIdx < PointCount; PointIdx++)
+		{
+			if (CullSpotLight(SpotLight, Points[PointIdx], Settings, Counters))
+			{
+				OutSamples[PointIdx] = { LightEvaluation::Culled, 0.0f };
+				continue;
+			}
+
+			BatchPoints[BatchCount] = Points[PointIdx];
+			BatchIndices[BatchCount] = PointIdx;
+			if (++BatchCount == OcclusionBatchSize)
+			{
+				TestBatch();
+			}
+		}
+		if (BatchCount > 0)
+		{
+			TestBatch();
+		}
+	}
+
+	LightSample EvaluateRectLightArea(const RectLightData& RectLight, const RectLightFrustum& Frustum, const Vector3& Point, const DetectionSettings& Settings, IOcclusionQuery& Occlusion,
+		RectLightSamples& Samples, DetectionCounters& Counters)
+	{
+		Counters.LightsTested++;
+
+		// If this rect light is not visible in the scene, out of range, or the point is outside its barn doors, it contributes nothing
+		if (!RectLight.bVisible || !IsInRectLightRange(RectLight, Point, Settings.ForgivenessBuffer) || !IsInRectLightFrustum(Frustum, Point))
+		{
+			Counters.LightsCulled++;
+			return { LightEvaluation::Culled, 0.0f };
+		}
+
+		// Earlier samples only hold while the light and the point are where they were traced
+		const float ToleranceSqr = Settings.OcclusionCacheTolerance * Settings.OcclusionCacheTolerance;
+		int32_t Columns = 1;
+		int32_t Rows = 1;
+		GetRectLightStrata(RectLight, Settings.RectLightSampleCount, Columns, Rows);
+		const int32_t StratumCount = Columns * Rows;
+		if (!Samples.bValid || !IsSameLight(Samples.Light, RectLight) || DistSquared(Samples.Point, Point) > ToleranceSqr || static_cast<int32_t>(Samples.OffsetRight.size()) != StratumCount)
+		{
+			ResetRectLightSamples(RectLight, Point, StratumCount, Columns, Samples);
+		}
+
+		const Vector3 Width = RectLight.Right * RectLight.SourceWidth;
+		const Vector3 Height = RectLight.Up * RectLight.SourceHeight;
+		const int32_t TracesThisUpdate = std::max(1, std::min(Settings.RectLightSamplesPerUpdate, StratumCount));
+		for (int32_t TraceIdx = 0; TraceIdx < TracesThisUpdate; TraceIdx++)
+		{
+			const int32_t SampleIdx = Samples.NextSample;
+			const Vector3 SamplePosition = RectLight.Position + (Width * Samples.OffsetRight[SampleIdx]) + (Height * Samples.OffsetUp[SampleIdx]);
+			Counters.TracesIssued++;
+			Samples.Transmittance[SampleIdx] = TraceTransmittance(Occlusion, SamplePosition, Point, Settings);
+			Samples.NextSample = (SampleIdx + 1) % StratumCount;
+			Samples.TracedCount = std::max(Samples.TracedCount, SampleIdx + 1);
+		}
+		Counters.TracesSaved += Samples.TracedCount - TracesThisUpdate;
+
+		// Each traced sample is weighted by the cosine of its angle off the emitter's facing over its squared distance, the emitter side of the form
+		// factor. The samples are stored a component at a time and summed into RectLightWeightLanes partial sums a block of lanes at a time, so the
+		// block loop has no branches and compiles to SIMD instructions. Samples past the last full block are added to the first lanes
+		const Vector3 ToPoint = Point - RectLight.Position;
+		const float ForwardDistance = Dot(ToPoint, RectLight.Forward);
+		const float Facing = Max(ForwardDistance, 0.0f);
+		const float RightDistance = Dot(ToPoint, RectLight.Right);
+		const float UpDistance = Dot(ToPoint, RectLight.Up);
+		const float* OffsetRight = Samples.OffsetRight.data();
+		const float* OffsetUp = Samples.OffsetUp.data();
+		const float* Transmittance = Samples.Transmittance.data();
+		const auto SampleWeight = [&](int32_t SampleIdx)
+		{
+			// The point relative to the sample, in the light's basis
+			const float Right = RightDistance - (RectLight.SourceWidth * OffsetRight[SampleIdx]);
+			const float Up = UpDistance - (RectLight.SourceHeight * OffsetUp[SampleIdx]);
+			// Offset rather than clamped away from zero, a comparison in the loop would stop it being vectorized
+			const float DistanceSqr = (ForwardDistance * ForwardDistance) + (Right * Right) + (Up * Up) + SmallNumber;
+			return Facing / (DistanceSqr * std::sqrt(DistanceSqr));
+		};
+
+		float WeightLanes[RectLightWeightLanes] = {};
+		float VisibleLanes[RectLightWeightLanes] = {};
+		const int32_t BlockEnd = Samples.TracedCount - (Samples.TracedCount % RectLightWeightLanes);
+		for (int32_t FirstSample = 0; FirstSample < BlockEnd; FirstSample += RectLightWeightLanes)
+		{
+			for (int32_t Lane = 0; Lane < RectLightWeightLanes; Lane++)
+			{
+				const float Weight = SampleWeight(FirstSample + Lane);
+				WeightLanes[Lane] += Weight;
+				VisibleLanes[Lane] += Weight * Transmittance[FirstSample + Lane];
+			}
+		}
+		for (int32_t SampleIdx = BlockEnd; SampleIdx < Samples.TracedCount; SampleIdx++)
+		{
+			const float Weight = SampleWeight(SampleIdx);
+			WeightLanes[SampleIdx - BlockEnd] += Weight;
+			VisibleLanes[SampleIdx - BlockEnd] += Weight * Transmittance[SampleIdx];
+		}
+
+		// The lanes are added in a fixed order, so the total is the same whether or not the loop above was vectorized
+		float WeightTotal = 0.0f;
+		float VisibleWeight = 0.0f;
+		for (int32_t Lane = 0; Lane < RectLightWeightLanes; Lane++)
+		{
+			WeightTotal += WeightLanes[Lane];
+			VisibleWeight += VisibleLanes[Lane];
+		}
+
+		if (VisibleWeight <= 0.0f)
+		{
+			return { WeightTotal > 0.0f ? LightEvaluation::Occluded : LightEvaluation::Culled, 0.0f };
+		}
+
+		const float LightDistance = std::sqrt(DistSquared(RectLight.Position, Point)) * 0.01f;
+		return { LightEvaluation::Lit, (RectLight.Intensity / (2 * Pi * LightDistance)) * (VisibleWeight / WeightTotal) };
+	}
+
+	LightSample EvaluateDirectionalLight(const DirectionalLightData& DirectionalLight, const Vector3& Point, const DetectionSettings& Settings, IOcclusionQuery& Occlusion, DetectionCounters& Counters)
+	{
+		Counters.LightsTested++;
+
+		// If the directional light is not visible, it contributes nothing
+		if (!DirectionalLight.bVisible)
+		{
+			Counters.LightsCulled++;
+			return { LightEvaluation::Culled, 0.0f };
+		}
+
+		Counters.TracesIssued++;
+		const float Transmittance = TraceTransmittance(Occlusion, GetDirectionalLightRayStart(DirectionalLight, Point, Settings.DirectionalLightDistance), Point, Settings);
+		if (Transmittance <= 0.0f)
+		{
+			return { LightEvaluation::Occluded, 0.0f };
+		}
+
+		return { LightEvaluation::Lit, DirectionalLight.Intensity * Transmittance };
+	}
+
+	LightSample EvaluatePointLightCandidates(const LightScene& Scene, LightCandidates& Candidates, const Vector3& Point, const DetectionSettings& Settings,
+		IOcclusionQuery& Occlusion, OcclusionCache* Cache, int32_t& TracesLeft, DetectionCounters& Counters, int32_t& OutLitLightIndex)
+	{
+		return EvaluatePointLightsNearestFirst(Scene, Candidates, Point, Settings, Occlusion, Cache, 0, 1, TracesLeft, Counters, OutLitLightIndex);
+	}
+
+	float EvaluateDetectionUpdate(const LightScene& Scene, const Vector3& Point, const DetectionSettings& Settings, IOcclusionQuery& Occlusion, OcclusionCache* Cache,
+		DetectionCounters& Counters, LightCandidates& Candidates)
+	{
+		// Every point light is a candidate, the ones that cannot reach the point are culled as they are evaluated
+		Candidates.Reset();
+		for (size_t idx = 0; idx < Scene.PointLights.size(); idx++)
+		{
+			Candidates.PointLights.push_back(static_cast<int32_t>(idx));
+		}
+
+		// Point and spot lights do not add up, the point is as lit as the brightest of them that reaches it
+		float IlluminanceTotal = 0.0f;
+		int32_t TracesLeft = Settings.MaxPointLightTraces;
+		int32_t LitLightIndex;
+		const LightSample PointLightSample = EvaluatePointLightCandidates(Scene, Candidates, Point, Settings, Occlusion, Cache, TracesLeft, Counters, LitLightIndex);
+		if (PointLightSample.Evaluation == LightEvaluation::Lit)
+		{
+			IlluminanceTotal = PointLightSample.Illuminance;
+		}
+
+		for (const SpotLightData& SpotLight : Scene.SpotLights)
+		{
+			const LightSample Sample = EvaluateSpotLight(SpotLight, Point, Settings, Occlusion, Counters);
+			if (Sample.Evaluation == LightEvaluation::Lit)
+			{
+				IlluminanceTotal = Max(IlluminanceTotal, Sample.Illuminance);
+			}
+		}
+
+		return IlluminanceTotal;
+	}
+
+	bool IsRangeInBounds(const Vector3& Position, float AttenuationRadius, const Vector3& BoundsMin, const Vector3& BoundsMax, float ForgivenessBuffer)
+	{
+		const Vector3 Closest(
+			Clamp(Position.X, BoundsMin.X, BoundsMax.X),
+			Clamp(Position.Y, BoundsMin.Y, BoundsMax.Y),
+			Clamp(Position.Z, BoundsMin.Z, BoundsMax.Z));
+		return DistSquared(Position, Closest) <= (AttenuationRadius * AttenuationRadius) + ForgivenessBuffer;
+	}
+
+	void GatherCandidates(const LightScene& Scene, const Vector3& BoundsMin, const Vector3& BoundsMax, const DetectionSettings& Settings, LightCandidates& Candidates,
+		const PointLightClusters* Clusters, bool bApproximateClusters)
+	{
+		Candidates.Reset();
+
+		if (Clusters)
+		{
+			GatherClusteredPointLights(Scene, *Clusters, BoundsMin, BoundsMax, Settings, bApproximateClusters, Candidates);
+		}
+		else
+		{
+			for (size_t idx = 0; idx < Scene.PointLights.size(); idx++)
+			{
+				const PointLightData& PointLight = Scene.PointLights[idx];
+				if (PointLight.bVisible && PointLight.Intensity > 0
+					&& IsRangeInBounds(PointLight.Position, PointLight.AttenuationRadius, BoundsMin, BoundsMax, Settings.ForgivenessBuffer))
+				{
+					Candidates.PointLights.push_back(static_cast<int32_t>(idx));
+				}
+			}
+		}
+
+		// A spot light's cone never reaches further than its attenuation radius, so its range sphere bounds the cone
+		for (size_t idx = 0; idx < Scene.SpotLights.size(); idx++)
+		{
+			const SpotLightData& SpotLight = Scene.SpotLights[idx];
+			if (SpotLight.bVisible && SpotLight.Intensity > 0
+				&& IsRangeInBounds(SpotLight.Position, SpotLight.AttenuationRadius, BoundsMin, BoundsMax, Settings.ForgivenessBuffer))
+			{
+				Candidates.SpotLights.push_back(static_cast<int32_t>(idx));
+			}
+		}
+	}
+
+	float EvaluateCandidates(const LightScene& Scene, LightCandidates& Candidates, const Vector3& Point, const DetectionSettings& Settings, IOcclusionQuery& Occlusion,
+		OcclusionCache* Cache, DetectionCounters& Counters)
+	{
+		float IlluminanceTotal = 0.0f;
+
+		// Point and spot lights do not add up, the point is as lit as the brightest of them that reaches it
+		int32_t TracesLeft = Settings.MaxPointLightTraces;
+		int32_t LitLightIndex;
+		const LightSample PointLightSample = EvaluatePointLightCandidates(Scene, Candidates, Point, Settings, Occlusion, Cache, TracesLeft, Counters, LitLightIndex);
+		if (PointLightSample.Evaluation == LightEvaluation::Lit)
+		{
+			IlluminanceTotal = PointLightSample.Illuminance;
+		}
+
+		for (const int32_t LightIndex : Candidates.SpotLights)
+		{
+			const LightSample Sample = EvaluateSpotLight(Scene.SpotLights[LightIndex], Point, Settings, Occlusion, Counters);
+			if (Sample.Evaluation == LightEvaluation::Lit)
+			{
+				IlluminanceTotal = Max(IlluminanceTotal, Sample.Illuminance);
+			}
+		}
+
+		return IlluminanceTotal;
+	}
+
+	void EvaluateDetectionSamples(const LightScene& Scene, const Vector3* Points, int32_t PointCount, const DetectionSettings& Settings, IOcclusionQuery& Occlusion,
+		OcclusionCache* Cache, DetectionCounters& Counters, LightCandidates& Candidates, float* OutIlluminance, const PointLightClusters* Clusters, bool bApproximateClusters)
+	{
+		if (PointCount <= 0)
+		{
+			return;
+		}
+
+		std::vector<uint8_t>& Grouped = Candidates.PointGrouped;
+		std::vector<Vector3>& GroupPoints = Candidates.GroupPoints;
+		std::vector<int32_t>& GroupIndices = Candidates.GroupPointIndices;
+		Grouped.assign(PointCount, 0);
+		for (int32_t PointIdx = 0; PointIdx < PointCount; PointIdx++)
+		{
+			OutIlluminance[PointIdx] = 0.0f;
+		}
+
+		for (int32_t SeedIdx = 0; SeedIdx < PointCount; SeedIdx++)
+		{
+			if (Grouped[SeedIdx])
+			{
+				continue;
+			}
+
+			// Grow a group from the first point not yet in one, taking every later point that keeps the group's bounds within MaxSampleGroupExtent.
+			// Points close together, such as the samples over one body, always end up in one group
+			Vector3 BoundsMin = Points[SeedIdx];
+			Vector3 BoundsMax = Points[SeedIdx];
+			GroupPoints.clear();
+			GroupIndices.clear();
+			for (int32_t PointIdx = SeedIdx; PointIdx < PointCount; PointIdx++)
+			{
+				if (Grouped[PointIdx])
+				{
+					continue;
+				}
+
+				const Vector3& Point = Points[PointIdx];
+				const Vector3 GrownMin(Min(BoundsMin.X, Point.X), Min(BoundsMin.Y, Point.Y), Min(BoundsMin.Z, Point.Z));
+				const Vector3 GrownMax(Max(BoundsMax.X, Point.X), Max(BoundsMax.Y, Point.Y), Max(BoundsMax.Z, Point.Z));
+				if (GrownMax.X - GrownMin.X > Settings.MaxSampleGroupExtent || GrownMax.Y - GrownMin.Y > Settings.MaxSampleGroupExtent
+					|| GrownMax.Z - GrownMin.Z > Settings.MaxSampleGroupExtent)
+				{
+					continue;
+				}
+
+				BoundsMin = GrownMin;
+				BoundsMax = GrownMax;
+				Grouped[PointIdx] = 1;
+				GroupPoints.push_back(Point);
+				GroupIndices.push_back(PointIdx);
+			}
+
+			// One broad phase for the bounds of the group
+			GatherCandidates(Scene, BoundsMin, BoundsMax, Settings, Candidates, Clusters, bApproximateClusters);
+
+			// Point lights are ordered by distance from each point, so they are evaluated point by point. Each point has its own trace budget, so
+			// the points given first can never use up the budget of the ones after them. Cache entries are kept for the point's place in the
+			// caller's points, whichever group it falls in
+			const int32_t GroupCount = static_cast<int32_t>(GroupPoints.size());
+			for (int32_t GroupIdx = 0; GroupIdx < GroupCount; GroupIdx++)
+			{
+				const int32_t PointIdx = GroupIndices[GroupIdx];
+				int32_t TracesLeft = Settings.MaxPointLightTraces;
+				int32_t LitLightIndex;
+				const LightSample Sample = EvaluatePointLightsNearestFirst(Scene, Candidates, Points[PointIdx], Settings, Occlusion, Cache, PointIdx, PointCount, TracesLeft, Counters, LitLightIndex);
+				if (Sample.Evaluation == LightEvaluation::Lit)
+				{
+					OutIlluminance[PointIdx] = Sample.Illuminance;
+				}
+			}
+
+			// Each spot light is evaluated at the group's points a batch at a time, so its occlusion tests all start at the light, and the brightest
+			// light reaching each point sets its total
+			for (const int32_t LightIndex : Candidates.SpotLights)
+			{
+				for (int32_t FirstPoint = 0; FirstPoint < GroupCount; FirstPoint += OcclusionBatchSize)
+				{
+					const int32_t BatchCount = std::min(GroupCount - FirstPoint, OcclusionBatchSize);
+					LightSample Samples[OcclusionBatchSize];
+					EvaluateSpotLightPoints(Scene.SpotLights[LightIndex], GroupPoints.data() + FirstPoint, BatchCount, Settings, Occlusion, Counters, Samples);
+					for (int32_t BatchIdx = 0; BatchIdx < BatchCount; BatchIdx++)
+					{
+						if (Samples[BatchIdx].Evaluation == LightEvaluation::Lit)
+						{
+							float& Illuminance = OutIlluminance[GroupIndices[FirstPoint + BatchIdx]];
+							Illuminance = Max(Illuminance, Samples[BatchIdx].Illuminance);
+						}
+					}
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,217 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "../Public/LightDetectionLightTree.h"
+#include <algorithm>
+#include <cmath>
+#include "../Public/LightDetectionKernels.h"
+
+namespace LightDetection
+{
+	namespace
+	{
+		// A bound on what a node's lights contribute at Point, zero only if none of them can reach it. Every light is at least as far as the
+		// nearest point of the node's bounds and reaches no further than the node's longest range
+		float GetNodeImportance(const PointLightTreeNode& Node, const Vector3& Point, float ForgivenessBuffer)
+		{
+			if (Node.TotalIntensity <= 0.0f)
+			{
+				return 0.0f;
+			}
+
+			const Vector3 Closest(
+				Clamp(Point.X, Node.BoundsMin.X, Node.BoundsMax.X),
+				Clamp(Point.Y, Node.BoundsMin.Y, Node.BoundsMax.Y),
+				Clamp(Point.Z, Node.BoundsMin.Z, Node.BoundsMax.Z));
+			const float DistanceSqr = DistSquared(Point, Closest);
+			if (DistanceSqr > (Node.MaxAttenuationRadius * Node.MaxAttenuationRadius) + ForgivenessBuffer)
+			{
+				return 0.0f;
+			}
+
+			return Node.TotalIntensity / (4 * Pi * Max(std::sqrt(DistanceSqr) * 0.01f, MinLightDistance));
+		}
+
+		// The next number from 0 to 1 from a xorshift generator, so the estimator picks the same lights on every platform
+		float NextRandom(uint32_t& State)
+		{
+			State ^= State << 13;
+			State ^= State >> 17;
+			State ^= State << 5;
+			return static_cast<float>(State >> 8) * (1.0f / 16777216.0f);
+		}
+	}
+
+	void PointLightTree::Build(const LightScene& Scene)
+	{
+		Nodes.clear();
+		if (Scene.PointLights.empty())
+		{
+			return;
+		}
+
+		std::vector<int32_t> Lights(Scene.PointLights.size());
+		for (size_t idx = 0; idx < Lights.size(); idx++)
+		{
+			Lights[idx] = static_cast<int32_t>(idx);
+		}
+		Nodes.reserve((Lights.size() * 2) - 1);
+		BuildNode(Scene, Lights.data(), static_cast<int32_t>(Lights.size()));
+		Refit(Scene);
+	}
+
+	int32_t PointLightTree::BuildNode(const LightScene& Scene, int32_t* Lights, int32_t LightCount)
+	{
+		const int32_t NodeIndex = static_cast<int32_t>(Nodes.size());
+		Nodes.emplace_back();
+		if (LightCount == 1)
+		{
+			Nodes[NodeIndex].LightIndex = Lights[0];
+			return NodeIndex;
+		}
+
+		// Split along the longest axis of the lights' positions, ties broken by index so the tree is always built the same way
+		Vector3 BoundsMin = Scene.PointLights[Lights[0]].Position;
+		Vector3 BoundsMax = BoundsMin;
+		for (int32_t idx = 1; idx < LightCount; idx++)
+		{
+			const Vector3& Position = Scene.PointLights[Lights[idx]].Position;
+			BoundsMin = Vector3(Min(BoundsMin.X, Position.X), Min(BoundsMin.Y, Position.Y), Min(BoundsMin.Z, Position.Z));
+			BoundsMax = Vector3(Max(BoundsMax.X, Position.X), Max(BoundsMax.Y, Position.Y), Max(BoundsMax.Z, Position.Z));
+		}
+		const Vector3 Size = BoundsMax - BoundsMin;
+		const int32_t Axis = Size.X >= Size.Y && Size.X >= Size.Z ? 0 : (Size.Y >= Size.Z ? 1 : 2);
+		const auto AxisValue = [Axis](const Vector3& Position) { return Axis == 0 ? Position.X : (Axis == 1 ? Position.Y : Position.Z); };
+
+		const int32_t HalfCount = LightCount / 2;
+		std::nth_element(Lights, Lights + HalfCount, Lights + LightCount, [&Scene, &AxisValue](int32_t A, int32_t B)
+		{
+			const float ValueA = AxisValue(Scene.PointLights[A].Position);
+			const float ValueB = AxisValue(Scene.PointLights[B].Position);
+			return ValueA < ValueB || (ValueA == ValueB && A < B);
+		});
+
+		BuildNode(Scene, Lights, HalfCount);
+		const int32_t SecondChild = BuildNode(Scene, Lights + HalfCount, LightCount - HalfCount);
+		Nodes[NodeIndex].SecondChild = SecondChild;
+		return NodeIndex;
+	}
+
+	void PointLightTree::Refit(const LightScene& Scene)
+	{
+		// Children always come after their parent, so walking backwards visits both children before each parent
+		for (int32_t NodeIdx = static_cast<int32_t>(Nodes.size()) - 1; NodeIdx >= 0; NodeIdx--)
+		{
+			PointLightTreeNode& Node = Nodes[NodeIdx];
+			if (Node.LightIndex >= 0)
+			{
+				const PointLightData& PointLight = Scene.PointLights[Node.LightIndex];
+				Node.BoundsMin = PointLight.Position;
+				Node.BoundsMax = PointLight.Position;
+				Node.MaxAttenuationRadius = PointLight.AttenuationRadius;
+				Node.TotalIntensity = PointLight.bVisible && PointLight.Intensity > 0 ? PointLight.Intensity : 0.0f;
+				continue;
+			}
+
+			const PointLightTreeNode& First = Nodes[NodeIdx + 1];
+			const PointLightTreeNode& Second = Nodes[Node.SecondChild];
+			Node.BoundsMin = Vector3(Min(First.BoundsMin.X, Second.BoundsMin.X), Min(First.BoundsMin.Y, Second.BoundsMin.Y), Min(First.BoundsMin.Z, Second.BoundsMin.Z));
+			Node.BoundsMax = Vector3(Max(First.BoundsMax.X, Second.BoundsMax.X), Max(First.BoundsMax.Y, Second.BoundsMax.Y), Max(First.BoundsMax.Z, Second.BoundsMax.Z));
+			Node.MaxAttenuationRadius = Max(First.MaxAttenuationRadius, Second.MaxAttenuationRadius);
+			Node.TotalIntensity = First.TotalIntensity + Second.TotalIntensity;
+		}
+	}
+
+	int32_t PointLightTree::SampleLight(const Vector3& Point, float ForgivenessBuffer, float Random, float& OutProbability) const
+	{
+		OutProbability = 0.0f;
+		if (Nodes.empty() || GetNodeImportance(Nodes[0], Point, ForgivenessBuffer) <= 0.0f)
+		{
+			return -1;
+		}
+
+		float Probability = 1.0f;
+		int32_t NodeIdx = 0;
+		while (Nodes[NodeIdx].LightIndex < 0)
+		{
+			const float FirstImportance = GetNodeImportance(Nodes[NodeIdx + 1], Point, ForgivenessBuffer);
+			const float SecondImportance = GetNodeImportance(Nodes[Nodes[NodeIdx].SecondChild], Point, ForgivenessBuffer);
+			const float TotalImportance = FirstImportance + SecondImportance;
+			if (TotalImportance <= 0.0f)
+			{
+				return -1;
+			}
+
+			// Descend into a child with a chance in proportion to its importance, rescaling the random number to pick within that child
+			const float FirstChance = FirstImportance / TotalImportance;
+			if (Random < FirstChance)
+			{
+				Random = Min(Random / FirstChance, 0.99999994f);
+				Probability *= FirstChance;
+				NodeIdx = NodeIdx + 1;
+			}
+			else
+			{
+				Random = Min((Random - FirstChance) / (1.0f - FirstChance), 0.99999994f);
+				Probability *= 1.0f - FirstChance;
+				NodeIdx = Nodes[NodeIdx].SecondChild;
+			}
+		}
+
+		OutProbability = Probability;
+		return Nodes[NodeIdx].LightIndex;
+	}
+
+	float GetPointLightContribution(const PointLightData& PointLight, const Vector3& Point)
+	{
+		const float LightDistance = std::sqrt(DistSquared(PointLight.Position, Point)) * 0.01f;
+		return PointLight.Intensity / (4 * Pi * Max(LightDistance, MinLightDistance));
+	}
+
+	float EstimatePointLightIlluminance(const LightScene& Scene, const PointLightTree& Tree, const Vector3& Point, const DetectionSettings& Settings,
+		const StochasticEstimatorSettings& EstimatorSettings, IOcclusionQuery& Occlusion, StochasticIlluminanceState& State, DetectionCounters& Counters)
+	{
+		// Samples taken somewhere else estimate a different sum, so they count for less the further the point has moved since, keeping
+		// HistoryFadeDistance / (HistoryFadeDistance + moved) of their weight. A ratio rather than an exponential, so it rounds the same everywhere
+		if (!State.bValid)
+		{
+			State.bValid = true;
+			State.Estimate = 0.0f;
+			State.SampleWeight = 0.0f;
+		}
+		else if (DistSquared(State.Point, Point) > 0.0f)
+		{
+			const float Moved = std::sqrt(DistSquared(State.Point, Point));
+			State.SampleWeight = EstimatorSettings.HistoryFadeDistance > 0.0f
+				? State.SampleWeight * (EstimatorSettings.HistoryFadeDistance / (EstimatorSettings.HistoryFadeDistance + Moved)) : 0.0f;
+		}
+		State.Point = Point;
+		if (State.RandomState == 0)
+		{
+			State.RandomState = 1;
+		}
+
+		// Each sample on its own is an unbiased estimate of the sum, so they are averaged evenly until MaxAccumulatedSamples have been taken,
+		// after which each new sample replaces an even share of the average so changes in the lights are picked up
+		const float MaxSamples = static_cast<float>(std::max(1, EstimatorSettings.MaxAccumulatedSamples));
+		for (int32_t SampleIdx = 0; SampleIdx < EstimatorSettings.SamplesPerUpdate; SampleIdx++)
+		{
+			float Value = 0.0f;
+			float Probability;
+			const int32_t LightIndex = Tree.SampleLight(Point, Settings.ForgivenessBuffer, NextRandom(State.RandomState), Probability);
+			if (LightIndex >= 0 && Probability > 0.0f)
+			{
+				const PointLightData& PointLight = Scene.PointLights[LightIndex];
+				const LightSample Sample = EvaluatePointLight(PointLight, Point, Settings, Occlusion, Counters);
+				if (Sample.Evaluation == LightEvaluation::Lit)
+				{
+					Value = (GetPointLightContribution(PointLight, Point) * Sample.Illuminance) / Probability;
+				}
+			}
+
+			State.SampleWeight = Min(State.SampleWeight + 1.0f, MaxSamples);
+			State.Estimate += (Value - State.Estimate) / State.SampleWeight;
+		}
+
+		return State.Estimate;
+	}
+}
@@ -0,0 +1,494 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "../Public/LightDetectionOccluders.h"
+#include <algorithm>
+#include <limits>
+
+namespace LightDetection
+{
+	namespace
+	{
+		// Leaves are made once a node has this few triangles, or it is this deep. The depth limit keeps the traversal stack a fixed size
+		constexpr uint32_t MaxLeafTriangles = 4;
+		constexpr int32_t MaxBuildDepth = 48;
+		constexpr int32_t TraversalStackSize = MaxBuildDepth + 2;
+
+		// The number of buckets triangle centroids are sorted into along the split axis when choosing where to split a node
+		constexpr int32_t SplitBinCount = 8;
+
+		// The fraction of a segment at each end that is not tested, so the surface a detection point or light sits on does not occlude it
+		constexpr float SegmentEndTolerance = 1.e-4f;
+
+		// The inverse of a segment direction component, with zero replaced by a tiny value so the slab tests never divide by zero
+		float SafeInverse(float Value)
+		{
+			return 1.0f / (Value != 0.0f ? Value : 1.e-30f);
+		}
+
+		struct AxisAlignedBox
+		{
+			Vector3 Min = Vector3(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+			Vector3 Max = Vector3(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
+
+			void Grow(const Vector3& Point)
+			{
+				Min = Vector3(LightDetection::Min(Min.X, Point.X), LightDetection::Min(Min.Y, Point.Y), LightDetection::Min(Min.Z, Point.Z));
+				Max = Vector3(LightDetection::Max(Max.X, Point.X), LightDetection::Max(Max.Y, Point.Y), LightDetection::Max(Max.Z, Point.Z));
+			}
+
+			void Grow(const AxisAlignedBox& Other)
+			{
+				Grow(Other.Min);
+				Grow(Other.Max);
+			}
+
+			// Half the surface area, which is all the surface area heuristic needs as only the ratios between areas matter
+			float HalfArea() const
+			{
+				const Vector3 Size = Max - Min;
+				return Size.X < 0 ? 0.0f : (Size.X * Size.Y) + (Size.Y * Size.Z) + (Size.Z * Size.X);
+			}
+		};
+
+		Vector3 GetCentroid(const OccluderTriangle& Triangle)
+		{
+			return Triangle.V0 + ((Triangle.Edge1 + Triangle.Edge2) * (1.0f / 3.0f));
+		}
+
+		void GrowByTriangle(AxisAlignedBox& Box, const OccluderTriangle& Triangle)
+		{
+			Box.Grow(Triangle.V0);
+			Box.Grow(Triangle.V0 + Triangle.Edge1);
+			Box.Grow(Triangle.V0 + Triangle.Edge2);
+		}
+
+		// True if the segment starting at Origin, with the inverse of its direction InvDirection, passes through the box within its length
+		bool IsSegmentInBounds(const float* BoundsMin, const float* BoundsMax, const Vector3& Origin, const Vector3& InvDirection)
+		{
+			const float TX0 = (BoundsMin[0] - Origin.X) * InvDirection.X;
+			const float TX1 = (BoundsMax[0] - Origin.X) * InvDirection.X;
+			const float TY0 = (BoundsMin[1] - Origin.Y) * InvDirection.Y;
+			const float TY1 = (BoundsMax[1] - Origin.Y) * InvDirection.Y;
+			const float TZ0 = (BoundsMin[2] - Origin.Z) * InvDirection.Z;
+			const float TZ1 = (BoundsMax[2] - Origin.Z) * InvDirection.Z;
+			const float TNear = Max(Max(Min(TX0, TX1), Min(TY0, TY1)), Max(Min(TZ0, TZ1), 0.0f));
+			const float TFar = Min(Min(Max(TX0, TX1), Max(TY0, TY1)), Min(Max(TZ0, TZ1), 1.0f));
+			return TNear <= TFar;
+		}
+
+		// Moller-Trumbore, Direction is the whole segment so the hit distance is a fraction of it
+		bool IsSegmentThroughTriangle(const OccluderTriangle& Triangle, const Vector3& Origin, const Vector3& Direction)
+		{
+			const Vector3 P = Cross(Direction, Triangle.Edge2);
+			const float Det = Dot(Triangle.Edge1, P);
+			if (std::abs(Det) < SmallNumber)
+			{
+				return false;
+			}
+
+			const float InvDet = 1.0f / Det;
+			const Vector3 T = Origin - Triangle.V0;
+			const float U = Dot(T, P) * InvDet;
+			if (U < 0.0f || U > 1.0f)
+			{
+				return false;
+			}
+
+			const Vector3 Q = Cross(T, Triangle.Edge1);
+			const float V = Dot(Direction, Q) * InvDet;
+			if (V < 0.0f || U + V > 1.0f)
+			{
+				return false;
+			}
+
+			const float HitDistance = Dot(Triangle.Edge2, Q) * InvDet;
+			return HitDistance > SegmentEndTolerance && HitDistance < 1.0f - SegmentEndTolerance;
+		}
+	}
+
+	OccluderTriangle MakeOccluderTriangle(const Vector3& V0, const Vector3& V1, const Vector3& V2)
+	{
+		return { V0, V1 - V0, V2 - V0 };
+	}
+
+	void AppendBoxTriangles(const OccluderBox& Box, std::vector<OccluderTriangle>& Triangles)
+	{
+		const Vector3 X = Box.Axes[0] * Box.Extent.X;
+		const Vector3 Y = Box.Axes[1] * Box.Extent.Y;
+		const Vector3 Z = Box.Axes[2] * Box.Extent.Z;
+
+		// Corners are indexed by bit, bit 0 set is +X, bit 1 set is +Y and bit 2 set is +Z
+		Vector3 Corners[8];
+		for (int32_t CornerIdx = 0; CornerIdx < 8; CornerIdx++)
+		{
+			Corners[CornerIdx] = Box.Center + ((CornerIdx & 1) ? X : -X) + ((CornerIdx & 2) ? Y : -Y) + ((CornerIdx & 4) ? Z : -Z);
+		}
+
+		// Each face as a quad of corners in winding order, -X, +X, -Y, +Y, -Z, +Z
+		static constexpr int32_t Faces[6][4] = { { 0, 2, 6, 4 }, { 1, 5, 7, 3 }, { 0, 4, 5, 1 }, { 2, 3, 7, 6 }, { 0, 1, 3, 2 }, { 4, 6, 7, 5 } };
+		for (const int32_t* Face : Faces)
+		{
+			Triangles.push_back(MakeOccluderTriangle(Corners[Face[0]], Corners[Face[1]], Corners[Face[2]]));
+			Triangles.push_back(MakeOccluderTriangle(Corners[Face[0]], Corners[Face[2]], Corners[Face[3]]));
+		}
+	}
+
+	bool IsSegmentOccluded(const OccluderBox& Box, const Vector3& From, const Vector3& To)
+	{
+		// Slab test in the box's own space, where it is axis aligned and centred on the origin
+		const Vector3 Offset = From - Box.Center;
+		const Vector3 Direction = To - From;
+		float TNear = SegmentEndTolerance;
+		float TFar = 1.0f - SegmentEndTolerance;
+		for (int32_t Axis = 0; Axis < 3; Axis++)
+		{
+			const float Origin = Dot(Offset, Box.Axes[Axis]);
+			const float InvDirection = SafeInverse(Dot(Direction, Box.Axes[Axis]));
+			const float Extent = GetAxis(Box.Extent, Axis);
+			const float T0 = (-Extent - Origin) * InvDirection;
+			const float T1 = (Extent - Origin) * InvDirection;
+			TNear = Max(TNear, Min(T0, T1));
+			TFar = Min(TFar, Max(T0, T1));
+		}
+		return TNear <= TFar;
+	}
+
+	void OccluderBVH::Build(std::vector<OccluderTriangle> InTriangles)
+	{
+		Triangles = std::move(InTriangles);
+		Nodes.clear();
+		if (Triangles.empty())
+		{
+			return;
+		}
+
+		// A binary tree with at least one triangle in each leaf has fewer than twice as many nodes as triangles
+		Nodes.reserve(Triangles.size() * 2);
+		Nodes.emplace_back();
+		BuildNode(0, 0, static_cast<uint32_t>(Triangles.size()), 0);
+		Nodes.shrink_to_fit();
+	}
+
+	void OccluderBVH::BuildNode(uint32_t NodeIndex, uint32_t FirstTriangle, uint32_t TriangleCount, int32_t Depth)
+	{
+		AxisAlignedBox Bounds;
+		AxisAlignedBox CentroidBounds;
+		for (uint32_t TriangleIdx = FirstTriangle; TriangleIdx < FirstTriangle + TriangleCount; TriangleIdx++)
+		{
+			GrowByTriangle(Bounds, Triangles[TriangleIdx]);
+			CentroidBounds.Grow(GetCentroid(Triangles[TriangleIdx]));
+		}
+
+		Node& Current = Nodes[NodeIndex];
+		Current.BoundsMin[0] = Bounds.Min.X;
+		Current.BoundsMin[1] = Bounds.Min.Y;
+		Current.BoundsMin[2] = Bounds.Min.Z;
+		Current.BoundsMax[0] = Bounds.Max.X;
+		Current.BoundsMax[1] = Bounds.Max.Y;
+		Current.BoundsMax[2] = Bounds.Max.Z;
+		Current.FirstIndex = FirstTriangle;
+		Current.TriangleCount = TriangleCount;
+
+		// Split along the axis the centroids are most spread out on, if they are all in the same place there is nothing to split
+		const Vector3 CentroidExtent = CentroidBounds.Max - CentroidBounds.Min;
+		const int32_t Axis = (CentroidExtent.X >= CentroidExtent.Y && CentroidExtent.X >= CentroidExtent.Z) ? 0 : (CentroidExtent.Y >= CentroidExtent.Z ? 1 : 2);
+		const float AxisMin = GetAxis(CentroidBounds.Min, Axis);
+		const float AxisExtent = GetAxis(CentroidExtent, Axis);
+		if (TriangleCount <= MaxLeafTriangles || Depth >= MaxBuildDepth || AxisExtent <= 0.0f)
+		{
+			return;
+		}
+
+		auto GetBin = [&](const OccluderTriangle& Triangle)
+		{
+			const int32_t Bin = static_cast<int32_t>((GetAxis(GetCentroid(Triangle), Axis) - AxisMin) / AxisExtent * SplitBinCount);
+			return Bin < SplitBinCount ? Bin : SplitBinCount - 1;
+		};
+
+		uint32_t BinCounts[SplitBinCount] = {};
+		AxisAlignedBox BinBounds[SplitBinCount];
+		for (uint32_t TriangleIdx = FirstTriangle; TriangleIdx < FirstTriangle + TriangleCount; TriangleIdx++)
+		{
+			const int32_t Bin = GetBin(Triangles[TriangleIdx]);
+			BinCounts[Bin]++;
+			GrowByTriangle(BinBounds[Bin], Triangles[TriangleIdx]);
+		}
+
+		// Sweep from the right to find the cost of everything after each split, then from the left to find the cheapest split. The cost of a
+		// side is the chance a segment through the node enters it, proportional to its surface area, times the triangles it would test
+		float RightCosts[SplitBinCount] = {};
+		AxisAlignedBox RightBounds;
+		uint32_t RightCount = 0;
+		for (int32_t Bin = SplitBinCount - 1; Bin > 0; Bin--)
+		{
+			RightBounds.Grow(BinBounds[Bin]);
+			RightCount += BinCounts[Bin];
+			RightCosts[Bin] = RightBounds.HalfArea() * RightCount;
+		}
+
+		int32_t BestSplit = 1;
+		float BestCost = std::numeric_limits<float>::max();
+		AxisAlignedBox LeftBounds;
+		uint32_t LeftCount = 0;
+		for (int32_t Split = 1; Split < SplitBinCount; Split++)
+		{
+			LeftBounds.Grow(BinBounds[Split - 1]);
+			LeftCount += BinCounts[Split - 1];
+			const float Cost = (LeftBounds.HalfArea() * LeftCount) + RightCosts[Split];
+			if (LeftCount > 0 && LeftCount < TriangleCount && Cost < BestCost)
+			{
+				BestCost = Cost;
+				BestSplit = Split;
+			}
+		}
+
+		const auto First = Triangles.begin() + FirstTriangle;
+		const auto Last = First + TriangleCount;
+		auto Middle = std::partition(First, Last, [&](const OccluderTriangle& Triangle) { return GetBin(Triangle) < BestSplit; });
+
+		// If every centroid fell into one bin, split at the median instead so the node still divides
+		if (Middle == First || Middle == Last)
+		{
+			Middle = First + (TriangleCount / 2);
+			std::nth_element(First, Middle, Last, [Axis](const OccluderTriangle& A, const OccluderTriangle& B)
+			{
+				return GetAxis(GetCentroid(A), Axis) < GetAxis(GetCentroid(B), Axis);
+			});
+		}
+
+		// Children are added after the parent is finished with, as adding them can move the node array
+		const uint32_t LeftIndex = static_cast<uint32_t>(Nodes.size());
+		const uint32_t LeftTriangleCount = static_cast<uint32_t>(Middle - First);
+		Nodes[NodeIndex].FirstIndex = LeftIndex;
+		Nodes[NodeIndex].TriangleCount = 0;
+		Nodes.emplace_back();
+		Nodes.emplace_back();
+		BuildNode(LeftIndex, FirstTriangle, LeftTriangleCount, Depth + 1);
+		BuildNode(LeftIndex + 1, FirstTriangle + LeftTriangleCount, TriangleCount - LeftTriangleCount, Depth + 1);
+	}
+
+	bool OccluderBVH::IsSegmentOccluded(const Vector3& From, const Vector3& To) const
+	{
+		if (Nodes.empty())
+		{
+			return false;
+		}
+
+		const Vector3 Direction = To - From;
+		const Vector3 InvDirection(SafeInverse(Direction.X), SafeInverse(Direction.Y), SafeInverse(Direction.Z));
+
+		uint32_t Stack[TraversalStackSize];
+		int32_t StackSize = 0;
+		Stack[StackSize++] = 0;
+		while (StackSize > 0)
+		{
+			const Node& Current = Nodes[Stack[--StackSize]];
+			if (!IsSegmentInBounds(Current.BoundsMin, Current.BoundsMax, From, InvDirection))
+			{
+				continue;
+			}
+
+			if (Current.TriangleCount == 0)
+			{
+				Stack[StackSize++] = Current.FirstIndex;
+				Stack[StackSize++] = Current.FirstIndex + 1;
+				continue;
+			}
+
+			for (uint32_t TriangleIdx = Current.FirstIndex; TriangleIdx < Current.FirstIndex + Current.TriangleCount; TriangleIdx++)
+			{
+				if (IsSegmentThroughTriangle(Triangles[TriangleIdx], From, Direction))
+				{
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	void OccluderBVH::AreSegmentsOccluded(const Vector3* From, const Vector3* To, int32_t Count, bool* bOutOccluded) const
+	{
+		constexpr int32_t Width = OcclusionPacketWidth;
+		Count = Count < Width ? Count : Width;
+
+		// The packet is stored a component at a time so each test below is one loop over the lanes, which compiles to SIMD instructions.
+		// Lanes past Count, and lanes that have found an occluder, are inactive and never report a hit
+		float OriginX[Width], OriginY[Width], OriginZ[Width];
+		float DirectionX[Width], DirectionY[Width], DirectionZ[Width];
+		float InvDirectionX[Width], InvDirectionY[Width], InvDirectionZ[Width];
+		int32_t Active[Width];
+		for (int32_t Lane = 0; Lane < Width; Lane++)
+		{
+			const Vector3 Origin = Lane < Count ? From[Lane] : Vector3();
+			const Vector3 Direction = Lane < Count ? To[Lane] - From[Lane] : Vector3(1, 1, 1);
+			OriginX[Lane] = Origin.X;
+			OriginY[Lane] = Origin.Y;
+			OriginZ[Lane] = Origin.Z;
+			DirectionX[Lane] = Direction.X;
+			DirectionY[Lane] = Direction.Y;
+			DirectionZ[Lane] = Direction.Z;
+			InvDirectionX[Lane] = SafeInverse(Direction.X);
+			InvDirectionY[Lane] = SafeInverse(Direction.Y);
+			InvDirectionZ[Lane] = SafeInverse(Direction.Z);
+			Active[Lane] = Lane < Count;
+		}
+		for (int32_t Lane = 0; Lane < Count; Lane++)
+		{
+			bOutOccluded[Lane] = false;
+		}
+
+		if (Nodes.empty())
+		{
+			return;
+		}
+
+		int32_t ActiveCount = Count;
+		uint32_t Stack[TraversalStackSize];
+		int32_t StackSize = 0;
+		Stack[StackSize++] = 0;
+		while (StackSize > 0 && ActiveCount > 0)
+		{
+			const Node& Current = Nodes[Stack[--StackSize]];
+
+			// The node is visited if any active lane passes through its bounds
+			int32_t InBounds[Width];
+			int32_t AnyInBounds = 0;
+			for (int32_t Lane = 0; Lane < Width; Lane++)
+			{
+				const float TX0 = (Current.BoundsMin[0] - OriginX[Lane]) * InvDirectionX[Lane];
+				const float TX1 = (Current.BoundsMax[0] - OriginX[Lane]) * InvDirectionX[Lane];
+				const float TY0 = (Current.BoundsMin[1] - OriginY[Lane]) * InvDirectionY[Lane];
+				const float TY1 = (Current.BoundsMax[1] - OriginY[Lane]) * InvDirectionY[Lane];
+				const float TZ0 = (Current.BoundsMin[2] - OriginZ[Lane]) * InvDirectionZ[Lane];
+				const float TZ1 = (Current.BoundsMax[2] - OriginZ[Lane]) * InvDirectionZ[Lane];
+				const float TNear = Max(Max(Min(TX0, TX1), Min(TY0, TY1)), Max(Min(TZ0, TZ1), 0.0f));
+				const float TFar = Min(Min(Max(TX0, TX1), Max(TY0, TY1)), Min(Max(TZ0, TZ1), 1.0f));
+				InBounds[Lane] = Active[Lane] & (TNear <= TFar);
+				AnyInBounds |= InBounds[Lane];
+			}
+			if (!AnyInBounds)
+			{
+				continue;
+			}
+
+			if (Current.TriangleCount == 0)
+			{
+				Stack[StackSize++] = Current.FirstIndex;
+				Stack[StackSize++] = Current.FirstIndex + 1;
+				continue;
+			}
+
+			for (uint32_t TriangleIdx = Current.FirstIndex; TriangleIdx < Current.FirstIndex + Current.TriangleCount; TriangleIdx++)
+			{
+				const OccluderTriangle& Triangle = Triangles[TriangleIdx];
+
+				// Moller-Trumbore for every lane at once, degenerate determinants give non-finite values which fail the comparisons
+				int32_t Hit[Width];
+				int32_t AnyHit = 0;
+				for (int32_t Lane = 0; Lane < Width; Lane++)
+				{
+					const float PX = (DirectionY[Lane] * Triangle.Edge2.Z) - (DirectionZ[Lane] * Triangle.Edge2.Y);
+					const float PY = (DirectionZ[Lane] * Triangle.Edge2.X) - (DirectionX[Lane] * Triangle.Edge2.Z);
+					const float PZ = (DirectionX[Lane] * Triangle.Edge2.Y) - (DirectionY[Lane] * Triangle.Edge2.X);
+					const float Det = (Triangle.Edge1.X * PX) + (Triangle.Edge1.Y * PY) + (Triangle.Edge1.Z * PZ);
+					const float InvDet = 1.0f / Det;
+					const float TX = OriginX[Lane] - Triangle.V0.X;
+					const float TY = OriginY[Lane] - Triangle.V0.Y;
+					const float TZ = OriginZ[Lane] - Triangle.V0.Z;
+					const float U = ((TX * PX) + (TY * PY) + (TZ * PZ)) * InvDet;
+					const float QX = (TY * Triangle.Edge1.Z) - (TZ * Triangle.Edge1.Y);
+					const float QY = (TZ * Triangle.Edge1.X) - (TX * Triangle.Edge1.Z);
+					const float QZ = (TX * Triangle.Edge1.Y) - (TY * Triangle.Edge1.X);
+					const float V = ((DirectionX[Lane] * QX) + (DirectionY[Lane] * QY) + (DirectionZ[Lane] * QZ)) * InvDet;
+					const float HitDistance = ((Triangle.Edge2.X * QX) + (Triangle.Edge2.Y * QY) + (Triangle.Edge2.Z * QZ)) * InvDet;
+					Hit[Lane] = InBounds[Lane] & Active[Lane] & (std::abs(Det) >= SmallNumber) & (U >= 0.0f) & (V >= 0.0f) & (U + V <= 1.0f)
+						& (HitDistance > SegmentEndTolerance) & (HitDistance < 1.0f - SegmentEndTolerance);
+					AnyHit |= Hit[Lane];
+				}
+
+				if (AnyHit)
+				{
+					for (int32_t Lane = 0; Lane < Count; Lane++)
+					{
+						if (Hit[Lane])
+						{
+							bOutOccluded[Lane] = true;
+							Active[Lane] = 0;
+							ActiveCount--;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	size_t OccluderBVH::GetAllocatedSize() const
+	{
+		return (Nodes.capacity() * sizeof(Node)) + (Triangles.capacity() * sizeof(OccluderTriangle));
+	}
+
+	bool OccluderOcclusionQuery::IsOccluded(const Vector3& From, const Vector3& To)
+	{
+		// The movable occluders are few, so they are cheaper to rule out than the hierarchy
+		for (const OccluderBox& Box : Occluders.Dynamic)
+		{
+			if (IsSegmentOccluded(Box, From, To))
+			{
+				return true;
+			}
+		}
+		return Occluders.Static.IsSegmentOccluded(From, To);
+	}
+
+	void OccluderOcclusionQuery::AreOccluded(const Vector3& From, const Vector3* To, int32_t Count, bool* bOutOccluded)
+	{
+		Vector3 PacketFrom[OcclusionPacketWidth];
+		for (Vector3& LaneFrom : PacketFrom)
+		{
+			LaneFrom = From;
+		}
+
+		// Segments are gathered into a packet as they are found not to hit a movable occluder, and the packet traversed each time it fills
+		Vector3 PacketTo[OcclusionPacketWidth];
+		int32_t PacketIndices[OcclusionPacketWidth];
+		int32_t PacketCount = 0;
+		const auto TraversePacket = [&]()
+		{
+			bool bPacketOccluded[OcclusionPacketWidth];
+			Occluders.Static.AreSegmentsOccluded(PacketFrom, PacketTo, PacketCount, bPacketOccluded);
+			for (int32_t Lane = 0; Lane < PacketCount; Lane++)
+			{
+				bOutOccluded[PacketIndices[Lane]] = bPacketOccluded[Lane];
+			}
+			PacketCount = 0;
+		};
+
+		for (int32_t idx = 0; idx < Count; idx++)
+		{
+			bOutOccluded[idx] = false;
+			for (const OccluderBox& Box : Occluders.Dynamic)
+			{
+				if (IsSegmentOccluded(Box, From, To[idx]))
+				{
+					bOutOccluded[idx] = true;
+					break;
+				}
+			}
+			if (bOutOccluded[idx])
+			{
+				continue;
+			}
+
+			PacketTo[PacketCount] = To[idx];
+			PacketIndices[PacketCount] = idx;
+			if (++PacketCount == OcclusionPacketWidth)
+			{
+				TraversePacket();
+			}
+		}
+		if (PacketCount > 0)
+		{
+			TraversePacket();
+		}
+	}
+}
@@ -0,0 +1,501 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "../Public/LightDetectionRecording.h"
+#include <cstring>
+#include "../Public/LightDetectionKernels.h"
+
+namespace LightDetection
+{
+	namespace
+	{
+		constexpr char RecordingMagic[4] = { 'L', 'D', 'R', 'C' };
+
+		// How close a queried segment's end points must be to a recorded one to be given its answer, in centimetres
+		constexpr float TraceMatchTolerance = 0.01f;
+
+		// Far more lights of one type than any level registers. Light counts and indices read from a recording are refused from here up, so a
+		// corrupt file cannot make the reader allocate without limit
+		constexpr uint32_t MaxRecordedLights = 1 << 20;
+
+		// Values are copied as they are in memory, every platform the engine and tools run on is little endian
+		template<typename T>
+		void Write(std::vector<uint8_t>& Data, const T& Value)
+		{
+			const size_t Offset = Data.size();
+			Data.resize(Offset + sizeof(T));
+			std::memcpy(Data.data() + Offset, &Value, sizeof(T));
+		}
+
+		void Write(std::vector<uint8_t>& Data, const Vector3& Value)
+		{
+			Write(Data, Value.X);
+			Write(Data, Value.Y);
+			Write(Data, Value.Z);
+		}
+
+		void Write(std::vector<uint8_t>& Data, RecordTag Tag)
+		{
+			Write(Data, static_cast<uint8_t>(Tag));
+		}
+
+		void WritePointLight(std::vector<uint8_t>& Data, const PointLightData& PointLight)
+		{
+			Write(Data, PointLight.Position);
+			Write(Data, PointLight.AttenuationRadius);
+			Write(Data, PointLight.Intensity);
+			Write(Data, static_cast<uint8_t>(PointLight.bVisible));
+		}
+
+		// The cone angle cosines are derived from the angles, so they are recalculated on read rather than stored
+		void WriteSpotLight(std::vector<uint8_t>& Data, const SpotLightData& SpotLight)
+		{
+			Write(Data, SpotLight.Position);
+			Write(Data, SpotLight.Direction);
+			Write(Data, SpotLight.AttenuationRadius);
+			Write(Data, SpotLight.Intensity);
+			Write(Data, SpotLight.InnerConeAngle);
+			Write(Data, SpotLight.OuterConeAngle);
+			Write(Data, static_cast<uint8_t>(SpotLight.bVisible));
+		}
+
+		void WriteRectLight(std::vector<uint8_t>& Data, const RectLightData& RectLight)
+		{
+			Write(Data, RectLight.Position);
+			Write(Data, RectLight.Forward);
+			Write(Data, RectLight.Right);
+			Write(Data, RectLight.Up);
+			Write(Data, RectLight.AttenuationRadius);
+			Write(Data, RectLight.Intensity);
+			Write(Data, RectLight.SourceWidth);
+			Write(Data, RectLight.SourceHeight);
+			Write(Data, RectLight.BarnDoorAngle);
+			Write(Data, RectLight.BarnDoorLength);
+			Write(Data, static_cast<uint8_t>(RectLight.bVisible));
+		}
+
+		void WriteDirectionalLight(std::vector<uint8_t>& Data, const DirectionalLightData& DirectionalLight)
+		{
+			Write(Data, DirectionalLight.Direction);
+			Write(Data, DirectionalLight.Intensity);
+			Write(Data, static_cast<uint8_t>(DirectionalLight.bVisible));
+		}
+
+		// Grows a light array to hold LightIndex, for lights that were registered after the recording began. Returns false without growing it
+		// for an index of MaxRecordedLights or more
+		template<typename T>
+		bool EnsureLightIndex(std::vector<T>& Lights, uint32_t LightIndex)
+		{
+			if (LightIndex >= MaxRecordedLights)
+			{
+				return false;
+			}
+			if (static_cast<size_t>(LightIndex) >= Lights.size())
+			{
+				Lights.resize(static_cast<size_t>(LightIndex) + 1, T());
+			}
+			return true;
+		}
+
+		bool IsMatchingTrace(const RecordedTrace& Trace, const Vector3& From, const Vector3& To)
+		{
+			const float ToleranceSqr = TraceMatchTolerance * TraceMatchTolerance;
+			return DistSquared(Trace.From, From) <= ToleranceSqr && DistSquared(Trace.To, To) <= ToleranceSqr;
+		}
+	}
+
+	void RecordingWriter::BeginRecording(const LightScene& Scene)
+	{
+		RecordedScene = Scene;
+		Data.clear();
+		bRecording = true;
+
+		for (char MagicChar : RecordingMagic)
+		{
+			Write(Data, MagicChar);
+		}
+		Write(Data, RecordingVersion);
+
+		Write(Data, static_cast<uint32_t>(Scene.PointLights.size()));
+		Write(Data, static_cast<uint32_t>(Scene.SpotLights.size()));
+		Write(Data, static_cast<uint32_t>(Scene.RectLights.size()));
+		Write(Data, static_cast<uint8_t>(Scene.bHasDirectionalLight));
+		for (const PointLightData& PointLight : Scene.PointLights)
+		{
+			WritePointLight(Data, PointLight);
+		}
+		for (const SpotLightData& SpotLight : Scene.SpotLights)
+		{
+			WriteSpotLight(Data, SpotLight);
+		}
+		for (const RectLightData& RectLight : Scene.RectLights)
+		{
+			WriteRectLight(Data, RectLight);
+		}
+		if (Scene.bHasDirectionalLight)
+		{
+			WriteDirectionalLight(Data, Scene.DirectionalLight);
+		}
+	}
+
+	void RecordingWriter::BeginFrame(double Time, const AgentData& Agent, const DetectionSettings& Settings)
+	{
+		Write(Data, RecordTag::Frame);
+		Write(Data, Time);
+		Write(Data, Agent.DetectionPoint);
+		Write(Data, Agent.Position);
+		Write(Data, Settings.ForgivenessBuffer);
+		Write(Data, Settings.DirectionalLightDistance);
+		Write(Data, Settings.MaxPointLightTraces);
+		Write(Data, Settings.OcclusionCacheTolerance);
+		Write(Data, Settings.OcclusionCacheMaxAge);
+		Write(Data, Settings.RectLightSampleCount);
+		Write(Data, Settings.RectLightSamplesPerUpdate);
+		Write(Data, static_cast<uint8_t>(Settings.bTransmission));
+	}
+
+	void RecordingWriter::RecordPointLight(int32_t LightIndex, const PointLightData& PointLight)
+	{
+		if (LightIndex < 0 || !EnsureLightIndex(RecordedScene.PointLights, static_cast<uint32_t>(LightIndex)))
+		{
+			return;
+		}
+		if (IsSameLight(RecordedScene.PointLights[LightIndex], PointLight))
+		{
+			return;
+		}
+		RecordedScene.PointLights[LightIndex] = PointLight;
+
+		Write(Data, RecordTag::PointLight);
+		Write(Data, static_cast<uint32_t>(LightIndex));
+		WritePointLight(Data, PointLight);
+	}
+
+	void RecordingWriter::RecordSpotLight(int32_t LightIndex, const SpotLightData& SpotLight)
+	{
+		if (LightIndex < 0 || !EnsureLightIndex(RecordedScene.SpotLights, static_cast<uint32_t>(LightIndex)))
+		{
+			return;
+		}
+		if (IsSameLight(RecordedScene.SpotLights[LightIndex], SpotLight))
+		{
+			return;
+		}
+		RecordedScene.SpotLights[LightIndex] = SpotLight;
+
+		Write(Data, RecordTag::SpotLight);
+		Write(Data, static_cast<uint32_t>(LightIndex));
+		WriteSpotLight(Data, SpotLight);
+	}
+
+	void RecordingWriter::RecordRectLight(int32_t LightIndex, const RectLightData& RectLight)
+	{
+		if (LightIndex < 0 || !EnsureLightIndex(RecordedScene.RectLights, static_cast<uint32_t>(LightIndex)))
+		{
+			return;
+		}
+		if (IsSameLight(RecordedScene.RectLights[LightIndex], RectLight))
+		{
+			return;
+		}
+		RecordedScene.RectLights[LightIndex] = RectLight;
+
+		Write(Data, RecordTag::RectLight);
+		Write(Data, static_cast<uint32_t>(LightIndex));
+		WriteRectLight(Data, RectLight);
+	}
+
+	void RecordingWriter::RecordDirectionalLight(const DirectionalLightData& DirectionalLight)
+	{
+		if (RecordedScene.bHasDirectionalLight && IsSameLight(RecordedScene.DirectionalLight, DirectionalLight))
+		{
+			return;
+		}
+		RecordedScene.DirectionalLight = DirectionalLight;
+		RecordedScene.bHasDirectionalLight = true;
+
+		Write(Data, RecordTag::DirectionalLight);
+		WriteDirectionalLight(Data, DirectionalLight);
+	}
+
+	void RecordingWriter::RecordTrace(const Vector3& From, const Vector3& To, float Transmittance)
+	{
+		Write(Data, RecordTag::Trace);
+		Write(Data, From);
+		Write(Data, To);
+		Write(Data, Transmittance);
+	}
+
+	void RecordingWriter::EndFrame(float IlluminanceTotal)
+	{
+		Write(Data, RecordTag::FrameEnd);
+		Write(Data, IlluminanceTotal);
+	}
+
+	bool RecordingReader::Open(const uint8_t* InData, size_t InSize, LightScene& Scene)
+	{
+		Data = InData;
+		Size = InSize;
+		Offset = 0;
+		bError = true;
+
+		char Magic[4];
+		uint32_t Version;
+		if (!Read(Magic, sizeof(Magic)) || std::memcmp(Magic, RecordingMagic, sizeof(Magic)) != 0 || !Read(Version) || Version != RecordingVersion)
+		{
+			return false;
+		}
+
+		uint32_t PointLightCount, SpotLightCount, RectLightCount;
+		uint8_t bHasDirectionalLight;
+		if (!Read(PointLightCount) || !Read(SpotLightCount) || !Read(RectLightCount) || !Read(bHasDirectionalLight)
+			|| PointLightCount > MaxRecordedLights || SpotLightCount > MaxRecordedLights || RectLightCount > MaxRecordedLights)
+		{
+			return false;
+		}
+
+		Scene.PointLights.resize(PointLightCount);
+		Scene.SpotLights.resize(SpotLightCount);
+		Scene.RectLights.resize(RectLightCount);
+		Scene.RectFrustums.resize(RectLightCount);
+		Scene.bHasDirectionalLight = bHasDirectionalLight != 0;
+		for (PointLightData& PointLight : Scene.PointLights)
+		{
+			if (!ReadPointLight(PointLight))
+			{
+				return false;
+			}
+		}
+		for (SpotLightData& SpotLight : Scene.SpotLights)
+		{
+			if (!ReadSpotLight(SpotLight))
+			{
+				return false;
+			}
+		}
+		for (uint32_t idx = 0; idx < RectLightCount; idx++)
+		{
+			if (!ReadRectLight(Scene.RectLights[idx]))
+			{
+				return false;
+			}
+			CalculateFrustumPoints(Scene.RectLights[idx], Scene.RectFrustums[idx]);
+			CalculateBoundingPlanes(Scene.RectFrustums[idx]);
+		}
+		if (Scene.bHasDirectionalLight && !ReadDirectionalLight(Scene.DirectionalLight))
+		{
+			return false;
+		}
+
+		bError = false;
+		return true;
+	}
+
+	bool RecordingReader::ReadFrame(RecordedFrame& Frame, LightScene& Scene)
+	{
+		// A clean end of the recording, the session stopped between frames
+		if (bError || Offset == Size)
+		{
+			return false;
+		}
+
+		uint8_t Tag;
+		uint8_t bTransmission = 0;
+		if (!Read(Tag) || Tag != static_cast<uint8_t>(RecordTag::Frame)
+			|| !Read(Frame.Time) || !Read(Frame.Agent.DetectionPoint) || !Read(Frame.Agent.Position)
+			|| !Read(Frame.Settings.ForgivenessBuffer) || !Read(Frame.Settings.DirectionalLightDistance) || !Read(Frame.Settings.MaxPointLightTraces)
+			|| !Read(Frame.Settings.OcclusionCacheTolerance) || !Read(Frame.Settings.OcclusionCacheMaxAge)
+			|| !Read(Frame.Settings.RectLightSampleCount) || !Read(Frame.Settings.RectLightSamplesPerUpdate) || !Read(bTransmission))
+		{
+			bError = true;
+			return false;
+		}
+		Frame.Settings.bTransmission = bTransmission != 0;
+		Frame.Traces.clear();
+		Frame.LightDeltas = 0;
+
+		while (Read(Tag))
+		{
+			uint32_t LightIndex;
+			switch (static_cast<RecordTag>(Tag))
+			{
+			case RecordTag::PointLight:
+				if (!Read(LightIndex) || !EnsureLightIndex(Scene.PointLights, LightIndex))
+				{
+					break;
+				}
+				if (!ReadPointLight(Scene.PointLights[LightIndex]))
+				{
+					break;
+				}
+				Frame.LightDeltas++;
+				continue;
+			case RecordTag::SpotLight:
+				if (!Read(LightIndex) || !EnsureLightIndex(Scene.SpotLights, LightIndex))
+				{
+					break;
+				}
+				if (!ReadSpotLight(Scene.SpotLights[LightIndex]))
+				{
+					break;
+				}
+				Frame.LightDeltas++;
+				continue;
+			case RecordTag::RectLight:
+				if (!Read(LightIndex) || !EnsureLightIndex(Scene.RectLights, LightIndex) || !EnsureLightIndex(Scene.RectFrustums, LightIndex))
+				{
+					break;
+				}
+				if (!ReadRectLight(Scene.RectLights[LightIndex]))
+				{
+					break;
+				}
+				// The recorded light moved or changed shape, so its frustum has to follow it
+				CalculateFrustumPoints(Scene.RectLights[LightIndex], Scene.RectFrustums[LightIndex]);
+				CalculateBoundingPlanes(Scene.RectFrustums[LightIndex]);
+				Frame.LightDeltas++;
+				continue;
+			case RecordTag::DirectionalLight:
+				if (!ReadDirectionalLight(Scene.DirectionalLight))
+				{
+					break;
+				}
+				Scene.bHasDirectionalLight = true;
+				Frame.LightDeltas++;
+				continue;
+			case RecordTag::Trace:
+			{
+				RecordedTrace Trace;
+				if (!Read(Trace.From) || !Read(Trace.To) || !Read(Trace.Transmittance))
+				{
+					break;
+				}
+				Frame.Traces.push_back(Trace);
+				continue;
+			}
+			case RecordTag::FrameEnd:
+				if (!Read(Frame.IlluminanceTotal))
+				{
+					break;
+				}
+				return true;
+			default:
+				break;
+			}
+
+			// Anything that was not read in full, or an unknown tag
+			break;
+		}
+
+		// The recording ended partway through a frame, which happens if the session was not shut down cleanly
+		bError = true;
+		return false;
+	}
+
+	bool RecordingReader::Read(void* Destination, size_t Bytes)
+	{
+		if (Size - Offset < Bytes)
+		{
+			return false;
+		}
+		std::memcpy(Destination, Data + Offset, Bytes);
+		Offset += Bytes;
+		return true;
+	}
+
+	bool RecordingReader::Read(Vector3& Value)
+	{
+		return Read(Value.X) && Read(Value.Y) && Read(Value.Z);
+	}
+
+	bool RecordingReader::ReadPointLight(PointLightData& PointLight)
+	{
+		uint8_t bVisible;
+		if (!Read(PointLight.Position) || !Read(PointLight.AttenuationRadius) || !Read(PointLight.Intensity) || !Read(bVisible))
+		{
+			return false;
+		}
+		PointLight.bVisible = bVisible != 0;
+		return true;
+	}
+
+	bool RecordingReader::ReadSpotLight(SpotLightData& SpotLight)
+	{
+		float InnerConeAngle, OuterConeAngle;
+		uint8_t bVisible;
+		if (!Read(SpotLight.Position) || !Read(SpotLight.Direction) || !Read(SpotLight.AttenuationRadius) || !Read(SpotLight.Intensity)
+			|| !Read(InnerConeAngle) || !Read(OuterConeAngle) || !Read(bVisible))
+		{
+			return false;
+		}
+		SetSpotLightConeAngles(SpotLight, InnerConeAngle, OuterConeAngle);
+		SpotLight.bVisible = bVisible != 0;
+		return true;
+	}
+
+	bool RecordingReader::ReadRectLight(RectLightData& RectLight)
+	{
+		uint8_t bVisible;
+		if (!Read(RectLight.Position) || !Read(RectLight.Forward) || !Read(RectLight.Right) || !Read(RectLight.Up)
+			|| !Read(RectLight.AttenuationRadius) || !Read(RectLight.Intensity) || !Read(RectLight.SourceWidth) || !Read(RectLight.SourceHeight)
+			|| !Read(RectLight.BarnDoorAngle) || !Read(RectLight.BarnDoorLength) || !Read(bVisible))
+		{
+			return false;
+		}
+		RectLight.bVisible = bVisible != 0;
+		return true;
+	}
+
+	bool RecordingReader::ReadDirectionalLight(DirectionalLightData& DirectionalLight)
+	{
+		uint8_t bVisible;
+		if (!Read(DirectionalLight.Direction) || !Read(DirectionalLight.Intensity) || !Read(bVisible))
+		{
+			return false;
+		}
+		DirectionalLight.bVisible = bVisible != 0;
+		return true;
+	}
+
+	void RecordedOcclusionQuery::SetFrame(const RecordedFrame& Frame)
+	{
+		Traces = &Frame.Traces;
+		NextTrace = 0;
+	}
+
+	bool RecordedOcclusionQuery::IsOccluded(const Vector3& From, const Vector3& To)
+	{
+		return FindTransmittance(From, To) <= 0.0f;
+	}
+
+	float RecordedOcclusionQuery::GetTransmittance(const Vector3& From, const Vector3& To)
+	{
+		return FindTransmittance(From, To);
+	}
+
+	float RecordedOcclusionQuery::FindTransmittance(const Vector3& From, const Vector3& To)
+	{
+		if (!Traces)
+		{
+			MissCount++;
+			return 1.0f;
+		}
+
+		// The detection code normally asks the same questions in the same order as when it was recorded
+		if (NextTrace < Traces->size() && IsMatchingTrace((*Traces)[NextTrace], From, To))
+		{
+			return (*Traces)[NextTrace++].Transmittance;
+		}
+
+		// Otherwise look for the same segment anywhere in the frame
+		for (const RecordedTrace& Trace : *Traces)
+		{
+			if (IsMatchingTrace(Trace, From, To))
+			{
+				return Trace.Transmittance;
+			}
+		}
+
+		MissCount++;
+		return 1.0f;
+	}
+}
@@ -0,0 +1,113 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "../Public/LightDetectionReplication.h"
+#include <cmath>
+#include "../Public/LightDetectionMath.h"
+
+namespace LightDetection
+{
+	uint8_t QuantizeIlluminance(float Illuminance, float MaxIlluminance)
+	{
+		if (!(MaxIlluminance > 0.0f) || !(Illuminance > 0.0f))
+		{
+			return 0;
+		}
+
+		const float Normalized = Min(Illuminance / MaxIlluminance, 1.0f);
+		return static_cast<uint8_t>(std::lround(std::sqrt(Normalized) * 255.0f));
+	}
+
+	float DequantizeIlluminance(uint8_t Quantized, float MaxIlluminance)
+	{
+		const float Root = static_cast<float>(Quantized) / 255.0f;
+		return Root * Root * MaxIlluminance;
+	}
+
+	float GetSendInterval(float Relevance, const ReplicationSettings& Settings)
+	{
+		const float Alpha = Clamp(Relevance, 0.0f, 1.0f);
+		return Settings.MaxSendInterval + ((Settings.MinSendInterval - Settings.MaxSendInterval) * Alpha);
+	}
+
+	bool ShouldSendIlluminance(ReplicatedIlluminanceState& State, uint8_t Quantized, double Time, float Interval)
+	{
+		if (State.bSent && (Quantized == State.LastSent || Time - State.LastSendTime < Interval))
+		{
+			return false;
+		}
+
+		State.LastSent = Quantized;
+		State.bSent = true;
+		State.LastSendTime = Time;
+		State.Sequence++;
+		return true;
+	}
+
+	void IlluminancePredictor::Reset()
+	{
+		*this = IlluminancePredictor();
+	}
+
+	void IlluminancePredictor::AddPrediction(const Vector3& Point, float Illuminance)
+	{
+		LatestPrediction = (LatestPrediction + 1) % HistorySize;
+		History[LatestPrediction] = { Point, Illuminance };
+		HistoryCount = HistoryCount < HistorySize ? HistoryCount + 1 : HistorySize;
+
+		if (bCorrected && DistSquared(Point, CorrectionPoint) > CorrectionDistance * CorrectionDistance)
+		{
+			bCorrected = false;
+		}
+	}
+
+	ServerValueResult IlluminancePredictor::ApplyServerValue(uint16_t Sequence, const Vector3& ServerPoint, uint8_t ServerValue, float MaxIlluminance, float MatchDistance,
+		int32_t Tolerance)
+	{
+		// Sequence numbers wrap, so a value is newer if it is less than half the range ahead of the last one
+		if (bHasServerValue && static_cast<int16_t>(static_cast<uint16_t>(Sequence - LastSequence)) <= 0)
+		{
+			return ServerValueResult::Stale;
+		}
+		bHasServerValue = true;
+		LastSequence = Sequence;
+
+		// The prediction made nearest where the server evaluated the player
+		int32_t NearestIdx = -1;
+		float NearestDistanceSqr = MatchDistance * MatchDistance;
+		for (int32_t HistoryIdx = 0; HistoryIdx < HistoryCount; HistoryIdx++)
+		{
+			const float DistanceSqr = DistSquared(History[HistoryIdx].Point, ServerPoint);
+			if (DistanceSqr <= NearestDistanceSqr)
+			{
+				NearestDistanceSqr = DistanceSqr;
+				NearestIdx = HistoryIdx;
+			}
+		}
+		if (NearestIdx < 0)
+		{
+			return ServerValueResult::Unmatched;
+		}
+
+		const int32_t Difference = static_cast<int32_t>(QuantizeIlluminance(History[NearestIdx].Illuminance, MaxIlluminance)) - static_cast<int32_t>(ServerValue);
+		if (Difference <= Tolerance && -Difference <= Tolerance)
+		{
+			bCorrected = false;
+			return ServerValueResult::Confirmed;
+		}
+
+		bCorrected = true;
+		CorrectionPoint = ServerPoint;
+		CorrectionDistance = MatchDistance;
+		CorrectionIlluminance = DequantizeIlluminance(ServerValue, MaxIlluminance);
+		return ServerValueResult::Corrected;
+	}
+
+	float IlluminancePredictor::GetIlluminance() const
+	{
+		if (bCorrected)
+		{
+			return CorrectionIlluminance;
+		}
+		return LatestPrediction >= 0 ? History[LatestPrediction].Illuminance : 0.0f;
+	}
+}
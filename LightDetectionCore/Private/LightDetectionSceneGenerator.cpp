@@ -0,0 +1,155 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "../Public/LightDetectionSceneGenerator.h"
+#include <random>
+#include "../Public/LightDetectionKernels.h"
+
+namespace LightDetection
+{
+	namespace
+	{
+		// The height of the detection point above an agent's feet, matching the player's capsule
+		constexpr float AgentDetectionHeight = 10.0f;
+		constexpr float AgentHalfHeight = 93.98f;
+
+		float RandomRange(std::mt19937& Random, float Min, float Max)
+		{
+			return std::uniform_real_distribution<float>(Min, Max)(Random);
+		}
+
+		Vector3 RandomPosition(std::mt19937& Random, float Extent)
+		{
+			return Vector3(RandomRange(Random, 0, Extent), RandomRange(Random, 0, Extent), RandomRange(Random, 0, Extent));
+		}
+
+		Vector3 RandomDirection(std::mt19937& Random)
+		{
+			// Rejection sample the unit ball so directions are uniform over the sphere
+			for (;;)
+			{
+				const Vector3 Candidate(RandomRange(Random, -1, 1), RandomRange(Random, -1, 1), RandomRange(Random, -1, 1));
+				const float LengthSquared = Candidate.SizeSquared();
+				if (LengthSquared > 0.01f && LengthSquared <= 1.0f)
+				{
+					return Candidate.GetSafeNormal();
+				}
+			}
+		}
+	}
+
+	float GetSceneExtent(int32_t LightCount, const SceneGeneratorSettings& Settings)
+	{
+		return std::cbrt(static_cast<float>(LightCount > 0 ? LightCount : 1)) * Settings.LightSpacing;
+	}
+
+	void GenerateScene(LightScene& Scene, int32_t LightCount, const SceneGeneratorSettings& Settings)
+	{
+		std::mt19937 Random(Settings.Seed);
+		const float Extent = GetSceneExtent(LightCount, Settings);
+
+		Scene.PointLights.resize(LightCount);
+		const int32_t GroupSize = Settings.PointLightGroupSize > 1 ? Settings.PointLightGroupSize : 1;
+		for (int32_t idx = 0; idx < LightCount; idx++)
+		{
+			PointLightData& PointLight = Scene.PointLights[idx];
+			if (idx % GroupSize == 0)
+			{
+				PointLight.Position = RandomPosition(Random, Extent);
+			}
+			else
+			{
+				const Vector3& GroupPosition = Scene.PointLights[idx - (idx % GroupSize)].Position;
+				PointLight.Position = GroupPosition + RandomDirection(Random) * RandomRange(Random, 0.0f, Settings.PointLightGroupRadius);
+			}
+			PointLight.AttenuationRadius = RandomRange(Random, Settings.MinAttenuationRadius, Settings.MaxAttenuationRadius);
+			PointLight.Intensity = RandomRange(Random, 1.0f, 10.0f);
+			PointLight.bVisible = true;
+		}
+
+		Scene.SpotLights.resize(LightCount);
+		for (SpotLightData& SpotLight : Scene.SpotLights)
+		{
+			SpotLight.Position = RandomPosition(Random, Extent);
+			SpotLight.Direction = RandomDirection(Random);
+			SpotLight.AttenuationRadius = RandomRange(Random, Settings.MinAttenuationRadius, Settings.MaxAttenuationRadius);
+			SpotLight.Intensity = RandomRange(Random, 1.0f, 10.0f);
+			SpotLight.bVisible = true;
+			const float OuterConeAngle = RandomRange(Random, Settings.MinOuterConeAngle, Settings.MaxOuterConeAngle);
+			SetSpotLightConeAngles(SpotLight, OuterConeAngle * RandomRange(Random, 0.0f, 1.0f), OuterConeAngle);
+		}
+
+		Scene.RectLights.resize(LightCount);
+		Scene.RectFrustums.resize(LightCount);
+		for (int32_t idx = 0; idx < LightCount; idx++)
+		{
+			RectLightData& RectLight = Scene.RectLights[idx];
+			RectLight.Position = RandomPosition(Random, Extent);
+
+			// Build an orthonormal basis around a random forward direction
+			RectLight.Forward = RandomDirection(Random);
+			const Vector3 WorldUp = std::abs(RectLight.Forward.Z) < 0.99f ? Vector3(0, 0, 1) : Vector3(1, 0, 0);
+			RectLight.Right = Cross(WorldUp, RectLight.Forward).GetSafeNormal();
+			RectLight.Up = Cross(RectLight.Forward, RectLight.Right);
+
+			RectLight.AttenuationRadius = RandomRange(Random, Settings.MinAttenuationRadius, Settings.MaxAttenuationRadius);
+			RectLight.Intensity = RandomRange(Random, 1.0f, 10.0f);
+			RectLight.SourceWidth = RandomRange(Random, Settings.MinSourceSize, Settings.MaxSourceSize);
+			RectLight.SourceHeight = RandomRange(Random, Settings.MinSourceSize, Settings.MaxSourceSize);
+			RectLight.BarnDoorAngle = RandomRange(Random, 0.0f, Settings.MaxBarnDoorAngle);
+			RectLight.BarnDoorLength = RandomRange(Random, Settings.MinBarnDoorLength, Settings.MaxBarnDoorLength);
+			RectLight.bVisible = true;
+
+			CalculateFrustumPoints(RectLight, Scene.RectFrustums[idx]);
+			CalculateBoundingPlanes(Scene.RectFrustums[idx]);
+		}
+
+		// Straight down, so it is the same in every generated scene
+		Scene.DirectionalLight.Direction = Vector3(0, 0, -1);
+		Scene.DirectionalLight.Intensity = 1.0f;
+		Scene.DirectionalLight.bVisible = true;
+		Scene.bHasDirectionalLight = true;
+	}
+
+	std::vector<OccluderTriangle> GenerateOccluderTriangles(int32_t OccluderCount, int32_t LightCount, const SceneGeneratorSettings& Settings)
+	{
+		// Offset the seed so occluders are not placed on top of the lights or agents generated from the same settings
+		std::mt19937 Random(Settings.Seed ^ 0x85EBCA6Bu);
+		const float Extent = GetSceneExtent(LightCount, Settings);
+
+		std::vector<OccluderTriangle> Triangles;
+		Triangles.reserve(static_cast<size_t>(OccluderCount > 0 ? OccluderCount : 0) * 12);
+		for (int32_t idx = 0; idx < OccluderCount; idx++)
+		{
+			OccluderBox Box;
+			Box.Center = RandomPosition(Random, Extent);
+			Box.Axes[0] = RandomDirection(Random);
+			const Vector3 WorldUp = std::abs(Box.Axes[0].Z) < 0.99f ? Vector3(0, 0, 1) : Vector3(1, 0, 0);
+			Box.Axes[1] = Cross(WorldUp, Box.Axes[0]).GetSafeNormal();
+			Box.Axes[2] = Cross(Box.Axes[0], Box.Axes[1]);
+			Box.Extent = Vector3(RandomRange(Random, 1.0f, Settings.MaxOccluderSize), RandomRange(Random, 1.0f, Settings.MaxOccluderSize), RandomRange(Random, 1.0f, Settings.MaxOccluderSize)) * 0.5f;
+			AppendBoxTriangles(Box, Triangles);
+		}
+		return Triangles;
+	}
+
+	void GenerateOccluders(OccluderScene& Occluders, int32_t OccluderCount, int32_t LightCount, const SceneGeneratorSettings& Settings)
+	{
+		Occluders.Static.Build(GenerateOccluderTriangles(OccluderCount, LightCount, Settings));
+		Occluders.Dynamic.clear();
+	}
+
+	std::vector<AgentData> GenerateAgents(int32_t AgentCount, int32_t LightCount, const SceneGeneratorSettings& Settings)
+	{
+		// Offset the seed so agents are not placed on top of the lights generated from the same settings
+		std::mt19937 Random(Settings.Seed ^ 0x9E3779B9u);
+		const float Extent = GetSceneExtent(LightCount, Settings);
+
+		std::vector<AgentData> Agents(AgentCount > 0 ? AgentCount : 0);
+		for (AgentData& Agent : Agents)
+		{
+			Agent.Position = RandomPosition(Random, Extent);
+			Agent.DetectionPoint = Agent.Position + Vector3(0, 0, AgentDetectionHeight - AgentHalfHeight);
+		}
+		return Agents;
+	}
+}
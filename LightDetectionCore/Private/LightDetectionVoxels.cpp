@@ -0,0 +1,310 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "../Public/LightDetectionVoxels.h"
+#include <cmath>
+#include <limits>
+
+namespace LightDetection
+{
+	namespace
+	{
+		int32_t ClampCell(int32_t Cell, int32_t CellMin, int32_t CellMax)
+		{
+			return Cell < CellMin ? CellMin : (Cell >= CellMax ? CellMax - 1 : Cell);
+		}
+
+		/// <summary>
+		/// Walks the unit cells from CellMin to CellMax that the segment Start + Direction * T passes through between TNear and TFar, in order,
+		/// calling Visit with each cell and the range of T spent in it. Stops and returns true as soon as Visit does.
+		/// </summary>
+		template <typename VisitCellFunc>
+		bool MarchCells(const float* Start, const float* Direction, float TNear, float TFar, const int32_t* CellMin, const int32_t* CellMax, VisitCellFunc&& VisitCell)
+		{
+			int32_t Cell[3];
+			int32_t Step[3];
+			float TNext[3];
+			float TDelta[3];
+			for (int32_t Axis = 0; Axis < 3; Axis++)
+			{
+				// Clamped, as rounding can put the entry point just outside a range the segment was clipped to
+				Cell[Axis] = ClampCell(static_cast<int32_t>(std::floor(Start[Axis] + (Direction[Axis] * TNear))), CellMin[Axis], CellMax[Axis]);
+				if (Direction[Axis] > 0.0f)
+				{
+					Step[Axis] = 1;
+					TDelta[Axis] = 1.0f / Direction[Axis];
+					TNext[Axis] = (static_cast<float>(Cell[Axis] + 1) - Start[Axis]) * TDelta[Axis];
+				}
+				else if (Direction[Axis] < 0.0f)
+				{
+					Step[Axis] = -1;
+					TDelta[Axis] = -1.0f / Direction[Axis];
+					TNext[Axis] = (Start[Axis] - static_cast<float>(Cell[Axis])) * TDelta[Axis];
+				}
+				else
+				{
+					Step[Axis] = 0;
+					TDelta[Axis] = std::numeric_limits<float>::infinity();
+					TNext[Axis] = std::numeric_limits<float>::infinity();
+				}
+			}
+
+			float T = TNear;
+			while (true)
+			{
+				const int32_t Axis = TNext[0] < TNext[1] ? (TNext[0] < TNext[2] ? 0 : 2) : (TNext[1] < TNext[2] ? 1 : 2);
+				const float TExit = Min(TNext[Axis], TFar);
+				if (VisitCell(Cell, T, TExit))
+				{
+					return true;
+				}
+				if (TExit >= TFar)
+				{
+					return false;
+				}
+
+				Cell[Axis] += Step[Axis];
+				if (Cell[Axis] < CellMin[Axis] || Cell[Axis] >= CellMax[Axis])
+				{
+					return false;
+				}
+				T = TExit;
+				TNext[Axis] += TDelta[Axis];
+			}
+		}
+	}
+
+	void OccluderVoxelGrid::Build(const std::vector<OccluderTriangle>& Triangles, float InVoxelSize)
+	{
+		BrickIndices.clear();
+		BrickBits.clear();
+		BrickDims[0] = BrickDims[1] = BrickDims[2] = 0;
+		VoxelSize = InVoxelSize;
+		InvVoxelSize = InVoxelSize > 0.0f ? 1.0f / InVoxelSize : 0.0f;
+		if (Triangles.empty() || InVoxelSize <= 0.0f)
+		{
+			return;
+		}
+
+		Vector3 BoundsMin(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+		Vector3 BoundsMax(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
+		for (const OccluderTriangle& Triangle : Triangles)
+		{
+			for (const Vector3& Vertex : { Triangle.V0, Triangle.V0 + Triangle.Edge1, Triangle.V0 + Triangle.Edge2 })
+			{
+				BoundsMin = Vector3(Min(BoundsMin.X, Vertex.X), Min(BoundsMin.Y, Vertex.Y), Min(BoundsMin.Z, Vertex.Z));
+				BoundsMax = Vector3(Max(BoundsMax.X, Vertex.X), Max(BoundsMax.Y, Vertex.Y), Max(BoundsMax.Z, Vertex.Z));
+			}
+		}
+
+		// A voxel of padding on every side, so a triangle on the bounds never lands outside the grid through rounding
+		Origin = BoundsMin - Vector3(VoxelSize, VoxelSize, VoxelSize);
+		const Vector3 GridSize = (BoundsMax - Origin) * InvVoxelSize + Vector3(1.0f, 1.0f, 1.0f);
+		for (int32_t Axis = 0; Axis < 3; Axis++)
+		{
+			BrickDims[Axis] = static_cast<int32_t>(std::ceil(GetAxis(GridSize, Axis) / BrickSize));
+		}
+		BrickIndices.assign(static_cast<size_t>(BrickDims[0]) * BrickDims[1] * BrickDims[2], EmptyBrick);
+
+		const int32_t VoxelDims[3] = { BrickDims[0] * BrickSize, BrickDims[1] * BrickSize, BrickDims[2] * BrickSize };
+		for (const OccluderTriangle& Triangle : Triangles)
+		{
+			// Voxelized in grid space, where every voxel is a unit cube
+			const Vector3 P0 = (Triangle.V0 - Origin) * InvVoxelSize;
+			const Vector3 Corners[3] = { P0, P0 + (Triangle.Edge1 * InvVoxelSize), P0 + (Triangle.Edge2 * InvVoxelSize) };
+			const Vector3 Normal = Cross(Corners[1] - Corners[0], Corners[2] - Corners[0]);
+			const float NormalAbs[3] = { std::abs(Normal.X), std::abs(Normal.Y), std::abs(Normal.Z) };
+			if (NormalAbs[0] + NormalAbs[1] + NormalAbs[2] <= 0.0f)
+			{
+				continue;
+			}
+
+			// The triangle is walked column by column along the axis its normal is closest to, so each column it crosses holds one or two voxels
+			const int32_t W = NormalAbs[0] > NormalAbs[1] ? (NormalAbs[0] > NormalAbs[2] ? 0 : 2) : (NormalAbs[1] > NormalAbs[2] ? 1 : 2);
+			const int32_t U = (W + 1) % 3;
+			const int32_t V = (W + 2) % 3;
+			float CornerU[3];
+			float CornerV[3];
+			float CornerW[3];
+			for (int32_t CornerIdx = 0; CornerIdx < 3; CornerIdx++)
+			{
+				CornerU[CornerIdx] = GetAxis(Corners[CornerIdx], U);
+				CornerV[CornerIdx] = GetAxis(Corners[CornerIdx], V);
+				CornerW[CornerIdx] = GetAxis(Corners[CornerIdx], W);
+			}
+
+			// The triangle's edges in the column plane, each normal facing into the triangle
+			float EdgeNormalU[3];
+			float EdgeNormalV[3];
+			float EdgeOffset[3];
+			for (int32_t EdgeIdx = 0; EdgeIdx < 3; EdgeIdx++)
+			{
+				const int32_t Next = (EdgeIdx + 1) % 3;
+				const int32_t Opposite = (EdgeIdx + 2) % 3;
+				float NormalU = CornerV[EdgeIdx] - CornerV[Next];
+				float NormalV = CornerU[Next] - CornerU[EdgeIdx];
+				if ((NormalU * (CornerU[Opposite] - CornerU[EdgeIdx])) + (NormalV * (CornerV[Opposite] - CornerV[EdgeIdx])) < 0.0f)
+				{
+					NormalU = -NormalU;
+					NormalV = -NormalV;
+				}
+				EdgeNormalU[EdgeIdx] = NormalU;
+				EdgeNormalV[EdgeIdx] = NormalV;
+				EdgeOffset[EdgeIdx] = -((NormalU * CornerU[EdgeIdx]) + (NormalV * CornerV[EdgeIdx]));
+			}
+
+			// W across the triangle's plane is a linear function of U and V
+			const float NormalW = GetAxis(Normal, W);
+			const float PlaneOffset = Dot(Normal, Corners[0]);
+			const float SlopeU = GetAxis(Normal, U) / NormalW;
+			const float SlopeV = GetAxis(Normal, V) / NormalW;
+			const float ColumnSpread = (std::abs(SlopeU) + std::abs(SlopeV)) * 0.5f;
+			const float TriangleMinW = Min(Min(CornerW[0], CornerW[1]), CornerW[2]);
+			const float TriangleMaxW = Max(Max(CornerW[0], CornerW[1]), CornerW[2]);
+
+			const int32_t MinU = ClampCell(static_cast<int32_t>(std::floor(Min(Min(CornerU[0], CornerU[1]), CornerU[2]))), 0, VoxelDims[U]);
+			const int32_t MaxU = ClampCell(static_cast<int32_t>(std::floor(Max(Max(CornerU[0], CornerU[1]), CornerU[2]))), 0, VoxelDims[U]);
+			const int32_t MinV = ClampCell(static_cast<int32_t>(std::floor(Min(Min(CornerV[0], CornerV[1]), CornerV[2]))), 0, VoxelDims[V]);
+			const int32_t MaxV = ClampCell(static_cast<int32_t>(std::floor(Max(Max(CornerV[0], CornerV[1]), CornerV[2]))), 0, VoxelDims[V]);
+			for (int32_t ColumnU = MinU; ColumnU <= MaxU; ColumnU++)
+			{
+				for (int32_t ColumnV = MinV; ColumnV <= MaxV; ColumnV++)
+				{
+					// The column is skipped if its square lies wholly outside any edge
+					const float CenterU = static_cast<float>(ColumnU) + 0.5f;
+					const float CenterV = static_cast<float>(ColumnV) + 0.5f;
+					bool bOverlaps = true;
+					for (int32_t EdgeIdx = 0; EdgeIdx < 3 && bOverlaps; EdgeIdx++)
+					{
+						const float Reach = (std::abs(EdgeNormalU[EdgeIdx]) + std::abs(EdgeNormalV[EdgeIdx])) * 0.5f;
+						bOverlaps = (EdgeNormalU[EdgeIdx] * CenterU) + (EdgeNormalV[EdgeIdx] * CenterV) + EdgeOffset[EdgeIdx] + Reach >= 0.0f;
+					}
+					if (!bOverlaps)
+					{
+						continue;
+					}
+
+					// Every voxel in the column the plane passes through over the column's square, kept within the triangle's own extent
+					const float CenterW = (PlaneOffset / NormalW) - (SlopeU * CenterU) - (SlopeV * CenterV);
+					const float ColumnMinW = Max(CenterW - ColumnSpread, TriangleMinW);
+					const float ColumnMaxW = Min(CenterW + ColumnSpread, TriangleMaxW);
+					const int32_t MinW = ClampCell(static_cast<int32_t>(std::floor(ColumnMinW)), 0, VoxelDims[W]);
+					const int32_t MaxW = ClampCell(static_cast<int32_t>(std::floor(ColumnMaxW)), 0, VoxelDims[W]);
+					for (int32_t ColumnW = MinW; ColumnW <= MaxW; ColumnW++)
+					{
+						int32_t Voxel[3];
+						Voxel[U] = ColumnU;
+						Voxel[V] = ColumnV;
+						Voxel[W] = ColumnW;
+						SetVoxel(Voxel[0], Voxel[1], Voxel[2]);
+					}
+				}
+			}
+		}
+
+		BrickBits.shrink_to_fit();
+	}
+
+	void OccluderVoxelGrid::SetVoxel(int32_t X, int32_t Y, int32_t Z)
+	{
+		const size_t BrickCell = static_cast<size_t>(X / BrickSize) + (static_cast<size_t>(BrickDims[0]) * (static_cast<size_t>(Y / BrickSize) + (static_cast<size_t>(BrickDims[1]) * static_cast<size_t>(Z / BrickSize))));
+		if (BrickIndices[BrickCell] == EmptyBrick)
+		{
+			BrickIndices[BrickCell] = static_cast<uint32_t>(BrickBits.size() / WordsPerBrick);
+			BrickBits.resize(BrickBits.size() + WordsPerBrick, 0);
+		}
+
+		const int32_t Bit = (X % BrickSize) + (BrickSize * ((Y % BrickSize) + (BrickSize * (Z % BrickSize))));
+		BrickBits[(static_cast<size_t>(BrickIndices[BrickCell]) * WordsPerBrick) + (Bit / 64)] |= uint64_t(1) << (Bit % 64);
+	}
+
+	bool OccluderVoxelGrid::IsVoxelSet(uint32_t BrickIndex, int32_t X, int32_t Y, int32_t Z) const
+	{
+		const int32_t Bit = X + (BrickSize * (Y + (BrickSize * Z)));
+		return (BrickBits[(static_cast<size_t>(BrickIndex) * WordsPerBrick) + (Bit / 64)] >> (Bit % 64)) & 1;
+	}
+
+	bool OccluderVoxelGrid::IsSegmentOccluded(const Vector3& From, const Vector3& To) const
+	{
+		if (BrickBits.empty())
+		{
+			return false;
+		}
+
+		// Marched in grid space, where every voxel is a unit cube, with T running from 0 at From to 1 at To
+		const Vector3 GridFrom = (From - Origin) * InvVoxelSize;
+		const Vector3 GridDirection = (To - From) * InvVoxelSize;
+		const float Length = std::sqrt(Dot(GridDirection, GridDirection));
+		if (Length <= 2.0f)
+		{
+			return false;
+		}
+
+		float Start[3];
+		float Direction[3];
+		float TNear = 1.0f / Length;
+		float TFar = 1.0f - TNear;
+		int32_t VoxelDims[3];
+		for (int32_t Axis = 0; Axis < 3; Axis++)
+		{
+			Start[Axis] = GetAxis(GridFrom, Axis);
+			Direction[Axis] = GetAxis(GridDirection, Axis);
+			VoxelDims[Axis] = BrickDims[Axis] * BrickSize;
+
+			// Clipped to the grid, as there is nothing to occlude outside it
+			if (Direction[Axis] == 0.0f)
+			{
+				if (Start[Axis] < 0.0f || Start[Axis] >= static_cast<float>(VoxelDims[Axis]))
+				{
+					return false;
+				}
+				continue;
+			}
+			const float T0 = -Start[Axis] / Direction[Axis];
+			const float T1 = (static_cast<float>(VoxelDims[Axis]) - Start[Axis]) / Direction[Axis];
+			TNear = Max(TNear, Min(T0, T1));
+			TFar = Min(TFar, Max(T0, T1));
+		}
+		if (TNear >= TFar)
+		{
+			return false;
+		}
+
+		// Bricks first, in brick sized cells, then the voxels of each brick that has any
+		const float BrickStart[3] = { Start[0] / BrickSize, Start[1] / BrickSize, Start[2] / BrickSize };
+		const float BrickDirection[3] = { Direction[0] / BrickSize, Direction[1] / BrickSize, Direction[2] / BrickSize };
+		const int32_t GridMin[3] = { 0, 0, 0 };
+		return MarchCells(BrickStart, BrickDirection, TNear, TFar, GridMin, BrickDims, [&](const int32_t* Brick, float BrickTNear, float BrickTFar)
+		{
+			const uint32_t BrickIndex = BrickIndices[static_cast<size_t>(Brick[0]) + (static_cast<size_t>(BrickDims[0]) * (static_cast<size_t>(Brick[1]) + (static_cast<size_t>(BrickDims[1]) * static_cast<size_t>(Brick[2]))))];
+			if (BrickIndex == EmptyBrick)
+			{
+				return false;
+			}
+
+			const int32_t BrickMin[3] = { Brick[0] * BrickSize, Brick[1] * BrickSize, Brick[2] * BrickSize };
+			const int32_t BrickMax[3] = { BrickMin[0] + BrickSize, BrickMin[1] + BrickSize, BrickMin[2] + BrickSize };
+			return MarchCells(Start, Direction, BrickTNear, BrickTFar, BrickMin, BrickMax, [&](const int32_t* Voxel, float, float)
+			{
+				return IsVoxelSet(BrickIndex, Voxel[0] - BrickMin[0], Voxel[1] - BrickMin[1], Voxel[2] - BrickMin[2]);
+			});
+		});
+	}
+
+	size_t OccluderVoxelGrid::GetAllocatedSize() const
+	{
+		return (BrickIndices.capacity() * sizeof(uint32_t)) + (BrickBits.capacity() * sizeof(uint64_t));
+	}
+
+	bool VoxelOcclusionQuery::IsOccluded(const Vector3& From, const Vector3& To)
+	{
+		// The movable occluders are few, so they are cheaper to rule out than the grid
+		for (const OccluderBox& Box : Dynamic)
+		{
+			if (IsSegmentOccluded(Box, From, To))
+			{
+				return true;
+			}
+		}
+		return Voxels.IsSegmentOccluded(From, To);
+	}
+}
@@ -0,0 +1,72 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "LightDetectionTypes.h"
+
+/// <summary>
+/// Cells and portals for indoor levels. A cell is a box such as a room, holding the lights inside it, and a portal is an opening such as a
+/// doorway joining the cells it overlaps. Walls between cells are assumed to block all light, so a light can only reach a point in another
+/// cell through the portals between them. Detection looks up the point's cell and considers only the lights in it and in the cells beyond
+/// its portals whose range reaches the portal they would shine through, before any of them are tested against the point.
+/// </summary>
+namespace LightDetection
+{
+	struct CellPortal
+	{
+		Vector3 BoundsMin;
+		Vector3 BoundsMax;
+		// The two cells the portal joins
+		int32_t FirstCell;
+		int32_t SecondCell;
+	};
+
+	struct LightCell
+	{
+		Vector3 BoundsMin;
+		Vector3 BoundsMax;
+		// The lights whose position is inside the cell, a light inside several overlapping cells is in each of them
+		std::vector<int32_t> PointLights;
+		std::vector<int32_t> SpotLights;
+		// Indices of the portals leading out of the cell
+		std::vector<int32_t> Portals;
+	};
+
+	struct LightCellScene
+	{
+		std::vector<LightCell> Cells;
+		std::vector<CellPortal> Portals;
+		// Lights that are in no cell or may move out of their cell, considered from every cell
+		std::vector<int32_t> UnassignedPointLights;
+		std::vector<int32_t> UnassignedSpotLights;
+
+		void Reset()
+		{
+			Cells.clear();
+			Portals.clear();
+			UnassignedPointLights.clear();
+			UnassignedSpotLights.clear();
+		}
+	};
+
+	// Adds a cell with the given bounds, returning its index. Cells must all be added before any portals
+	int32_t AddLightCell(LightCellScene& Cells, const Vector3& BoundsMin, const Vector3& BoundsMax);
+
+	// Adds a portal joining every pair of cells its bounds overlap, so it should reach a little into the cells on each side of the opening.
+	// Returns the number of portals added
+	int32_t AddCellPortal(LightCellScene& Cells, const Vector3& BoundsMin, const Vector3& BoundsMax);
+
+	// Puts the lights in StaticPointLights and StaticSpotLights into the cells their positions are inside, the scene's other lights and any
+	// inside no cell are left unassigned. Lights that can move must be left out of the static lists, since they could leave their cell
+	void AssignLightsToCells(const LightScene& Scene, const std::vector<int32_t>& StaticPointLights, const std::vector<int32_t>& StaticSpotLights, LightCellScene& Cells);
+
+	// The first cell whose bounds hold Point, or -1 if it is in none
+	int32_t FindLightCell(const LightCellScene& Cells, const Vector3& Point);
+
+	// Broad phase for a single point through the cells, gathering the same kinds of light as GatherCandidates(). Lights in the cells holding the
+	// point and unassigned lights are gathered if their range reaches the point. Lights in cells up to MaxPortalDepth portals away are gathered
+	// if their range reaches both the point and a portal into their cell. A point in no cell gathers from every light, as GatherCandidates() does
+	void GatherCellCandidates(const LightScene& Scene, const LightCellScene& Cells, const Vector3& Point, const DetectionSettings& Settings, int32_t MaxPortalDepth,
+		LightCandidates& Candidates);
+}
@@ -0,0 +1,61 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "LightDetectionTypes.h"
+
+/// <summary>
+/// Clusters of nearby point lights, built once when the scene is loaded, so a broad phase over a room dressed with dozens of candles or
+/// monitors tests one cluster rather than every light. A cluster's bounds hold the range of every member, so only when a query reaches the
+/// bounds are its members tested. In approximate mode a cluster is not opened at all and is evaluated as a single virtual light.
+/// </summary>
+namespace LightDetection
+{
+	struct PointLightCluster
+	{
+		// A sphere holding the range of every member, a point outside it is out of range of them all
+		Vector3 BoundsCenter;
+		float BoundsRadius = 0.0f;
+
+		// The cluster as one light for approximate detection. It sits at the members' intensity weighted centre with their combined intensity,
+		// and only reaches as far as some visible member is sure to, so approximate detection never lights a point that no member reaches
+		PointLightData VirtualLight;
+
+		// The cluster's members are MemberCount indices into PointLightClusters::Members starting at FirstMember
+		int32_t FirstMember = 0;
+		int32_t MemberCount = 0;
+	};
+
+	struct PointLightClusters
+	{
+		std::vector<PointLightCluster> Clusters;
+		// Point light indices, each cluster's members together
+		std::vector<int32_t> Members;
+		// The cluster each of the scene's point lights is in, or -1 for lights left out of clustering
+		std::vector<int32_t> LightClusters;
+		// Point lights left out of clustering, such as movable lights that would leave their cluster's bounds, tested on their own
+		std::vector<int32_t> Unclustered;
+
+		void Reset()
+		{
+			Clusters.clear();
+			Members.clear();
+			LightClusters.clear();
+			Unclustered.clear();
+		}
+	};
+
+	// Groups the point lights in LightIndices into clusters by the grid cell of ClusterSize their position falls in. The scene's other point
+	// lights are left unclustered. The lights in a cluster must not move, but may change intensity or be switched on and off as long as their
+	// cluster is updated with UpdatePointLightCluster() when they do
+	void BuildPointLightClusters(const LightScene& Scene, const std::vector<int32_t>& LightIndices, float ClusterSize, PointLightClusters& OutClusters);
+
+	// Recalculates a cluster's bounds and virtual light from its members' current snapshots
+	void UpdatePointLightCluster(const LightScene& Scene, PointLightClusters& Clusters, int32_t ClusterIndex);
+
+	// The point light half of GatherCandidates(), testing each cluster's bounds before its members. Clusters of more than one light are added
+	// as a virtual light rather than opened when bApproximate is set. Adds to the candidates rather than replacing them
+	void GatherClusteredPointLights(const LightScene& Scene, const PointLightClusters& Clusters, const Vector3& BoundsMin, const Vector3& BoundsMax,
+		const DetectionSettings& Settings, bool bApproximate, LightCandidates& Candidates);
+}
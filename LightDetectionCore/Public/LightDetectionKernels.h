@@ -0,0 +1,86 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+#include "LightDetectionTypes.h"
+#include "LightDetectionClusters.h"
+#include "LightDetectionOcclusion.h"
+
+/// <summary>
+/// The per-light detection maths. The range, cone and frustum tests are pure functions of a light and a point, and the Evaluate functions
+/// combine them with an occlusion query to give the light's contribution to that point, counting the work they do as they go.
+/// </summary>
+namespace LightDetection
+{
+	// Sets a spot light's cone angles in degrees along with the cosines the cone tests use
+	void SetSpotLightConeAngles(SpotLightData& SpotLight, float InnerConeAngle, float OuterConeAngle);
+
+	// Returns true if Point is within the point light's attenuation radius plus the forgiveness buffer
+	bool IsInPointLightRange(const PointLightData& PointLight, const Vector3& Point, float ForgivenessBuffer);
+
+	// Returns true if Point is inside the spot light's outer cone and within its attenuation radius along the cone
+	bool IsInSpotLightCone(const SpotLightData& SpotLight, const Vector3& Point, float ForgivenessBuffer);
+
+	// Returns true if Point is within the rect light's attenuation radius plus the forgiveness buffer
+	bool IsInRectLightRange(const RectLightData& RectLight, const Vector3& Point, float ForgivenessBuffer);
+
+	// Rebuilds the barn door frustum of a rect light from its current transform and shape
+	void CalculateFrustumPoints(const RectLightData& RectLight, RectLightFrustum& Frustum);
+	void CalculateBoundingPlanes(RectLightFrustum& Frustum);
+
+	// Returns true if Point is in front of all four bounding planes of the frustum
+	bool IsInRectLightFrustum(const RectLightFrustum& Frustum, const Vector3& Point);
+
+	// Returns the point the directional light is traced from, Distance back from Point along the light's direction
+	Vector3 GetDirectionalLightRayStart(const DirectionalLightData& DirectionalLight, const Vector3& Point, float Distance);
+
+	LightSample EvaluatePointLight(const PointLightData& PointLight, const Vector3& Point, const DetectionSettings& Settings, IOcclusionQuery& Occlusion, DetectionCounters& Counters);
+	LightSample EvaluateSpotLight(const SpotLightData& SpotLight, const Vector3& Point, const DetectionSettings& Settings, IOcclusionQuery& Occlusion, DetectionCounters& Counters);
+	// Evaluates one spot light at each of PointCount points, OutSamples is index aligned with the points. The points in the light's cone are
+	// tested for occlusion in batches of up to OcclusionBatchSize segments from the light, so a backend that traverses segments with a shared
+	// origin together, such as the occluder hierarchy, can answer them as packets
+	void EvaluateSpotLightPoints(const SpotLightData& SpotLight, const Vector3* Points, int32_t PointCount, const DetectionSettings& Settings, IOcclusionQuery& Occlusion,
+		DetectionCounters& Counters, LightSample* OutSamples);
+	// Evaluates the rect light as an area rather than from its centre, so a point that only part of the emitter can see is only partly lit. The
+	// emitter is split into Settings.RectLightSampleCount strata, each traced from a point jittered within it, and the light reaching the point is
+	// the share of the visible samples weighted by how directly and how closely each faces the point. Up to Settings.RectLightSamplesPerUpdate
+	// samples are traced per call, the rest reused from Samples, which starts over whenever the light or the point moves. The rect light's
+	// frustum must be up to date with the light, see CalculateFrustumPoints() and CalculateBoundingPlanes()
+	LightSample EvaluateRectLightArea(const RectLightData& RectLight, const RectLightFrustum& Frustum, const Vector3& Point, const DetectionSettings& Settings, IOcclusionQuery& Occlusion,
+		RectLightSamples& Samples, DetectionCounters& Counters);
+	LightSample EvaluateDirectionalLight(const DirectionalLightData& DirectionalLight, const Vector3& Point, const DetectionSettings& Settings, IOcclusionQuery& Occlusion, DetectionCounters& Counters);
+
+	// Evaluates the candidate point lights at Point nearest first, returning the sample of the brightest light found to reach it and setting
+	// OutLitLightIndex to that light, or -1 if none do. Point lights do not add up, so the lights past the first one that reaches the point
+	// undimmed are never traced, while one dimmed by transmission leaves the search going in case a farther light is brighter. Lights the
+	// cache has a recent answer for are not traced again, otherwise each trace spends one of TracesLeft, and once it runs out the remaining
+	// lights are skipped. Cache may be null to always trace. The candidates' virtual lights are evaluated along with the rest, and one that
+	// lights the point sets OutLitLightIndex to its ID past the end of the scene's point lights
+	LightSample EvaluatePointLightCandidates(const LightScene& Scene, LightCandidates& Candidates, const Vector3& Point, const DetectionSettings& Settings,
+		IOcclusionQuery& Occlusion, OcclusionCache* Cache, int32_t& TracesLeft, DetectionCounters& Counters, int32_t& OutLitLightIndex);
+
+	// Evaluates the scene's point and spot lights at Point the same way ALightDetectionManager::UpdateDetection() does and returns the
+	// illuminance total, so recorded sessions and tools run the same pipeline as the game. Candidates is only used as scratch
+	float EvaluateDetectionUpdate(const LightScene& Scene, const Vector3& Point, const DetectionSettings& Settings, IOcclusionQuery& Occlusion, OcclusionCache* Cache,
+		DetectionCounters& Counters, LightCandidates& Candidates);
+
+	// True if a light's range sphere, grown by the forgiveness buffer like the range tests are, overlaps the box from BoundsMin to BoundsMax
+	bool IsRangeInBounds(const Vector3& Position, float AttenuationRadius, const Vector3& BoundsMin, const Vector3& BoundsMax, float ForgivenessBuffer);
+
+	// Broad phase for detection queries, gathers the visible, switched on point and spot lights whose range reaches into the box from
+	// BoundsMin to BoundsMax. Point lights are gathered through Clusters if given, see GatherClusteredPointLights()
+	void GatherCandidates(const LightScene& Scene, const Vector3& BoundsMin, const Vector3& BoundsMax, const DetectionSettings& Settings, LightCandidates& Candidates,
+		const PointLightClusters* Clusters = nullptr, bool bApproximateClusters = false);
+
+	// Evaluates only the candidate lights at Point, giving the same illuminance total as EvaluateDetectionUpdate() for any point inside the
+	// bounds the candidates were gathered for
+	float EvaluateCandidates(const LightScene& Scene, LightCandidates& Candidates, const Vector3& Point, const DetectionSettings& Settings, IOcclusionQuery& Occlusion,
+		OcclusionCache* Cache, DetectionCounters& Counters);
+
+	// Evaluates several points together, such as samples spread over a character's body. The points are split into groups no wider than
+	// Settings.MaxSampleGroupExtent and candidates are gathered once for the bounds of each group, then each point's point lights are evaluated
+	// nearest first from its own Settings.MaxPointLightTraces budget, and each candidate spot light is evaluated at every point in the group with
+	// EvaluateSpotLightPoints() so its occlusion rays are batched. Cache entries are kept per light and point
+	void EvaluateDetectionSamples(const LightScene& Scene, const Vector3* Points, int32_t PointCount, const DetectionSettings& Settings, IOcclusionQuery& Occlusion,
+		OcclusionCache* Cache, DetectionCounters& Counters, LightCandidates& Candidates, float* OutIlluminance, const PointLightClusters* Clusters = nullptr,
+		bool bApproximateClusters = false);
+}
@@ -0,0 +1,97 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "LightDetectionTypes.h"
+#include "LightDetectionOcclusion.h"
+
+/// <summary>
+/// Stochastic evaluation of many point lights for continuous illuminance, where every light in range adds to the total rather than the first
+/// lit one setting it. Tracing every light in range is unaffordable once there are hundreds of them, so a few lights are picked each update
+/// from a tree over the lights, each with a chance in proportion to a bound on what it could contribute, and only those are traced. Dividing
+/// each picked light's contribution by its chance gives an unbiased estimate of the sum, and the estimates are averaged over updates so the
+/// noise fades while the player stands still. Each pick walks the tree from the root, so an update costs the same however dense the lights are.
+/// </summary>
+namespace LightDetection
+{
+	// A node of the light tree. A leaf holds one light, an inner node's first child is the next node and its second is SecondChild
+	struct PointLightTreeNode
+	{
+		// Bounds of the positions of the node's lights, and the longest range among them
+		Vector3 BoundsMin;
+		Vector3 BoundsMax;
+		float MaxAttenuationRadius = 0.0f;
+		// The summed intensity of the node's lights that are visible and switched on
+		float TotalIntensity = 0.0f;
+		int32_t SecondChild = -1;
+		int32_t LightIndex = -1;
+	};
+
+	class PointLightTree
+	{
+	public:
+
+		// Builds the tree over every point light in the scene, splitting each node's lights in half along the longest axis of their bounds
+		void Build(const LightScene& Scene);
+
+		// Recalculates every node's bounds and intensity from the lights' current snapshots, for when lights have moved, been switched on or off
+		// or changed intensity. The tree's shape is kept, so it stays correct but may sample less well if lights move far
+		void Refit(const LightScene& Scene);
+
+		// Picks a light for Point with a chance in proportion to the nodes' bounds on what they contribute there, setting OutProbability to the
+		// chance the light was picked with. Random is a number from 0 to 1. Returns -1 if no light in the tree can reach the point
+		int32_t SampleLight(const Vector3& Point, float ForgivenessBuffer, float Random, float& OutProbability) const;
+
+		bool IsEmpty() const
+		{
+			return Nodes.empty();
+		}
+
+	private:
+
+		int32_t BuildNode(const LightScene& Scene, int32_t* Lights, int32_t LightCount);
+
+		std::vector<PointLightTreeNode> Nodes;
+	};
+
+	// How many lights the estimator samples each update, and how many updates' samples it averages before older ones start to fade
+	struct StochasticEstimatorSettings
+	{
+		int32_t SamplesPerUpdate = 4;
+		int32_t MaxAccumulatedSamples = 64;
+		// How far the point moves for the samples taken before it moved to count for half as much, in centimetres. Zero starts the estimate over
+		// whenever the point moves
+		float HistoryFadeDistance = 100.0f;
+	};
+
+	// The estimate built up so far, kept by whoever evaluates it. Samples taken further from where the point is now count for less, see
+	// EstimatePointLightIlluminance()
+	struct StochasticIlluminanceState
+	{
+		Vector3 Point;
+		bool bValid = false;
+		float Estimate = 0.0f;
+		// How many samples the estimate is worth, less than were taken once the point has moved away from where they were taken
+		float SampleWeight = 0.0f;
+		uint32_t RandomState = 1;
+
+		// Starts the estimate over, such as when the lights have changed
+		void Reset()
+		{
+			bValid = false;
+		}
+	};
+
+	// What a point light contributes to continuous illuminance at Point before occlusion. Its intensity falls off with distance in metres as in
+	// the old photometry maths, with the distance kept from going below MinLightDistance
+	float GetPointLightContribution(const PointLightData& PointLight, const Vector3& Point);
+	constexpr float MinLightDistance = 0.1f;
+
+	// Estimates the summed contribution of every point light in the tree at Point, each light dimmed by what lies between it and the point.
+	// Samples EstimatorSettings.SamplesPerUpdate lights from the tree, traces only those, and averages the result into State. When the point moves,
+	// the samples already in State are faded by EstimatorSettings.HistoryFadeDistance rather than thrown away, so a moving point keeps a
+	// smoothed estimate instead of starting from a single update's noise. Returns the estimate so far
+	float EstimatePointLightIlluminance(const LightScene& Scene, const PointLightTree& Tree, const Vector3& Point, const DetectionSettings& Settings,
+		const StochasticEstimatorSettings& EstimatorSettings, IOcclusionQuery& Occlusion, StochasticIlluminanceState& State, DetectionCounters& Counters);
+}
@@ -0,0 +1,148 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+#include <cmath>
+
+/// <summary>
+/// Minimal vector and plane maths for the engine-independent light detection core. The conventions match the engine types they stand in for
+/// (centimetres, degrees for angles, planes stored as a normal and a distance along it) so the adapter can convert between them by copying.
+/// </summary>
+namespace LightDetection
+{
+	constexpr float Pi = 3.14159265358979323846f;
+	constexpr float DegreesToRadians = Pi / 180.0f;
+	constexpr float SmallNumber = 1.e-8f;
+
+	// Plain comparisons rather than std::fmin and std::fmax, which handle NaNs and so are not inlined into tight loops. These compile to
+	// branchless min and max instructions, which matters when the comparison is unpredictable such as clamping light positions to a box
+	inline float Min(float A, float B) { return A < B ? A : B; }
+	inline float Max(float A, float B) { return A > B ? A : B; }
+	inline float Clamp(float Value, float MinValue, float MaxValue) { return Min(Max(Value, MinValue), MaxValue); }
+
+	// Sine and cosine from polynomials of plain arithmetic rather than the C runtime, whose results differ between platforms, so clients
+	// predicting detection get the same answer as the server. Accurate to within a few units in the last place for angles within a turn or two
+	inline void SinCos(float Radians, float& OutSin, float& OutCos)
+	{
+		// Reduce to Y within [-Pi, Pi], then mirror into [-Pi/2, Pi/2] where the polynomials are accurate, remembering the cosine's sign
+		const float Turns = Radians * (0.5f / Pi);
+		const float Quotient = static_cast<float>(static_cast<int>(Turns >= 0.0f ? Turns + 0.5f : Turns - 0.5f));
+		float Y = Radians - ((2.0f * Pi) * Quotient);
+		float Sign = 1.0f;
+		if (Y > 0.5f * Pi)
+		{
+			Y = Pi - Y;
+			Sign = -1.0f;
+		}
+		else if (Y < -0.5f * Pi)
+		{
+			Y = -Pi - Y;
+			Sign = -1.0f;
+		}
+
+		// Minimax polynomials, degree 11 for the sine and 10 for the cosine
+		const float Y2 = Y * Y;
+		OutSin = (((((-2.3889859e-08f * Y2 + 2.7525562e-06f) * Y2 - 0.00019840874f) * Y2 + 0.0083333310f) * Y2 - 0.16666667f) * Y2 + 1.0f) * Y;
+		OutCos = Sign * ((((((-2.6051615e-07f * Y2 + 2.4760495e-05f) * Y2 - 0.0013888378f) * Y2 + 0.041666638f) * Y2 - 0.5f) * Y2) + 1.0f);
+	}
+
+	struct Vector3
+	{
+		float X;
+		float Y;
+		float Z;
+
+		constexpr Vector3() : X(0), Y(0), Z(0) {}
+		constexpr Vector3(float x, float y, float z) : X(x), Y(y), Z(z) {}
+
+		constexpr Vector3 operator+(const Vector3& Other) const { return Vector3(X + Other.X, Y + Other.Y, Z + Other.Z); }
+		constexpr Vector3 operator-(const Vector3& Other) const { return Vector3(X - Other.X, Y - Other.Y, Z - Other.Z); }
+		constexpr Vector3 operator-() const { return Vector3(-X, -Y, -Z); }
+		constexpr Vector3 operator*(float Scale) const { return Vector3(X * Scale, Y * Scale, Z * Scale); }
+		constexpr Vector3 operator/(float Scale) const { return Vector3(X / Scale, Y / Scale, Z / Scale); }
+		Vector3& operator+=(const Vector3& Other) { X += Other.X; Y += Other.Y; Z += Other.Z; return *this; }
+		Vector3& operator-=(const Vector3& Other) { X -= Other.X; Y -= Other.Y; Z -= Other.Z; return *this; }
+
+		float SizeSquared() const { return (X * X) + (Y * Y) + (Z * Z); }
+		float Size() const { return std::sqrt(SizeSquared()); }
+
+		// Returns a unit length copy of this vector, or the zero vector if it is too short to normalise
+		Vector3 GetSafeNormal() const
+		{
+			const float LengthSquared = SizeSquared();
+			if (LengthSquared < SmallNumber)
+			{
+				return Vector3();
+			}
+			return *this * (1.0f / std::sqrt(LengthSquared));
+		}
+
+		// Rotates this vector by AngleDeg degrees around a unit length Axis
+		Vector3 RotateAngleAxis(float AngleDeg, const Vector3& Axis) const
+		{
+			float S;
+			float C;
+			SinCos(AngleDeg * DegreesToRadians, S, C);
+			const float OMC = 1.0f - C;
+
+			const float XX = Axis.X * Axis.X;
+			const float YY = Axis.Y * Axis.Y;
+			const float ZZ = Axis.Z * Axis.Z;
+			const float XY = Axis.X * Axis.Y;
+			const float YZ = Axis.Y * Axis.Z;
+			const float ZX = Axis.Z * Axis.X;
+			const float XS = Axis.X * S;
+			const float YS = Axis.Y * S;
+			const float ZS = Axis.Z * S;
+
+			return Vector3(
+				((OMC * XX + C) * X) + ((OMC * XY - ZS) * Y) + ((OMC * ZX + YS) * Z),
+				((OMC * XY + ZS) * X) + ((OMC * YY + C) * Y) + ((OMC * YZ - XS) * Z),
+				((OMC * ZX - YS) * X) + ((OMC * YZ + XS) * Y) + ((OMC * ZZ + C) * Z));
+		}
+	};
+
+	inline float Dot(const Vector3& A, const Vector3& B)
+	{
+		return (A.X * B.X) + (A.Y * B.Y) + (A.Z * B.Z);
+	}
+
+	inline Vector3 Cross(const Vector3& A, const Vector3& B)
+	{
+		return Vector3((A.Y * B.Z) - (A.Z * B.Y), (A.Z * B.X) - (A.X * B.Z), (A.X * B.Y) - (A.Y * B.X));
+	}
+
+	inline float DistSquared(const Vector3& A, const Vector3& B)
+	{
+		return (B - A).SizeSquared();
+	}
+
+	inline float Distance(const Vector3& A, const Vector3& B)
+	{
+		return (B - A).Size();
+	}
+
+	// A component of Vector by index, 0 for X, 1 for Y and 2 for Z
+	inline float GetAxis(const Vector3& Vector, int32_t Axis)
+	{
+		return Axis == 0 ? Vector.X : (Axis == 1 ? Vector.Y : Vector.Z);
+	}
+
+	struct Plane
+	{
+		// Points in front of the plane have a positive distance along the normal
+		Vector3 Normal;
+		float W;
+
+		constexpr Plane() : Normal(), W(0) {}
+		constexpr Plane(const Vector3& normal, float w) : Normal(normal), W(w) {}
+
+		// Returns the same plane facing the opposite way
+		constexpr Plane Flip() const { return Plane(-Normal, -W); }
+	};
+
+	// Signed distance of Point from the plane through Origin with the given Normal
+	inline float PointPlaneDist(const Vector3& Point, const Vector3& Origin, const Vector3& Normal)
+	{
+		return Dot(Point - Origin, Normal);
+	}
+}
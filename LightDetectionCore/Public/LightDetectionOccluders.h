@@ -0,0 +1,109 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "LightDetectionOcclusion.h"
+
+/// <summary>
+/// A light detection only occlusion structure, so occlusion can be answered without the physics scene. Static light blocking geometry is held
+/// as triangles in a bounding volume hierarchy, and the few occluders that move, such as doors and crates, are held as oriented boxes that are
+/// tested one by one. Nothing is modified by a query, so once built any number of threads can query it at once without any locks.
+/// </summary>
+namespace LightDetection
+{
+	// The number of segments traversed together by OccluderBVH::AreSegmentsOccluded()
+	constexpr int32_t OcclusionPacketWidth = 4;
+
+	// A triangle stored as one vertex and the two edges from it, which is what the intersection test uses
+	struct OccluderTriangle
+	{
+		Vector3 V0;
+		Vector3 Edge1;
+		Vector3 Edge2;
+	};
+
+	OccluderTriangle MakeOccluderTriangle(const Vector3& V0, const Vector3& V1, const Vector3& V2);
+
+	// An oriented box, Axes are unit length and Extent is the half size of the box along each of them
+	struct OccluderBox
+	{
+		Vector3 Center;
+		Vector3 Axes[3];
+		Vector3 Extent;
+	};
+
+	// Adds the 12 triangles of the box's faces
+	void AppendBoxTriangles(const OccluderBox& Box, std::vector<OccluderTriangle>& Triangles);
+
+	// Returns true if the segment from From to To passes through the box
+	bool IsSegmentOccluded(const OccluderBox& Box, const Vector3& From, const Vector3& To);
+
+	/// <summary>
+	/// OccluderBVH is a binary bounding volume hierarchy over occluder triangles, split by the surface area heuristic. Segments are tested for
+	/// any hit rather than the nearest one, so traversal stops at the first triangle found between the two ends.
+	/// </summary>
+	class OccluderBVH
+	{
+	public:
+
+		// Builds the hierarchy over the triangles, replacing anything built before
+		void Build(std::vector<OccluderTriangle> InTriangles);
+
+		// Returns true if the segment from From to To passes through any triangle, the ends themselves are not tested
+		bool IsSegmentOccluded(const Vector3& From, const Vector3& To) const;
+
+		// Tests up to OcclusionPacketWidth segments at once, setting bOutOccluded for each. The segments are traversed together, each node's bounds
+		// being tested against every segment in the packet at once, so segments that start at the same light visit most nodes only once
+		void AreSegmentsOccluded(const Vector3* From, const Vector3* To, int32_t Count, bool* bOutOccluded) const;
+
+		size_t GetTriangleCount() const { return Triangles.size(); }
+		size_t GetNodeCount() const { return Nodes.size(); }
+		// The memory held by the hierarchy in bytes
+		size_t GetAllocatedSize() const;
+
+	private:
+
+		// Leaves have a triangle count and index the first of their triangles, other nodes index the first of their two adjacent children
+		struct Node
+		{
+			float BoundsMin[3];
+			float BoundsMax[3];
+			uint32_t FirstIndex;
+			uint32_t TriangleCount;
+		};
+
+		void BuildNode(uint32_t NodeIndex, uint32_t FirstTriangle, uint32_t TriangleCount, int32_t Depth);
+
+		std::vector<Node> Nodes;
+		std::vector<OccluderTriangle> Triangles;
+	};
+
+	// Every occluder light detection tests against, static geometry in the hierarchy and any movable occluders alongside it
+	struct OccluderScene
+	{
+		OccluderBVH Static;
+		// Kept small, each is tested against every segment. Update their transforms before detection whenever they move
+		std::vector<OccluderBox> Dynamic;
+	};
+
+	// Answers occlusion queries from an occluder scene rather than the physics scene
+	class OccluderOcclusionQuery final : public IOcclusionQuery
+	{
+	public:
+
+		explicit OccluderOcclusionQuery(const OccluderScene& InOccluders)
+			: Occluders(InOccluders)
+		{
+		}
+
+		virtual bool IsOccluded(const Vector3& From, const Vector3& To) override;
+		// Segments not already blocked by a movable occluder are traversed through the hierarchy as packets of OcclusionPacketWidth
+		virtual void AreOccluded(const Vector3& From, const Vector3* To, int32_t Count, bool* bOutOccluded) override;
+
+	private:
+
+		const OccluderScene& Occluders;
+	};
+}
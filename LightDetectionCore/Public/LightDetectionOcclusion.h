@@ -0,0 +1,152 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "LightDetectionMath.h"
+
+namespace LightDetection
+{
+	// The most segments the detection kernels pass to IOcclusionQuery::AreOccluded() at once, kept on the stack so batching never allocates
+	constexpr int32_t OcclusionBatchSize = 16;
+
+	/// <summary>
+	/// IOcclusionQuery answers whether anything blocks the straight line between two points. Light detection only ever asks for visibility through
+	/// this interface, so the same detection code can run against the engine's physics scene, a custom occluder structure, or recorded answers.
+	/// </summary>
+	class IOcclusionQuery
+	{
+	public:
+
+		virtual ~IOcclusionQuery() = default;
+
+		// Returns true if the segment from From to To is blocked
+		virtual bool IsOccluded(const Vector3& From, const Vector3& To) = 0;
+
+		// Returns the fraction of light that gets from From to To, 0 if it is blocked and 1 if nothing is in the way. Queries that know what
+		// the segment passes through, such as foliage or glass, override this, otherwise any occluder blocks all of the light
+		virtual float GetTransmittance(const Vector3& From, const Vector3& To)
+		{
+			return IsOccluded(From, To) ? 0.0f : 1.0f;
+		}
+
+		// Sets bOutOccluded for each of Count segments from the shared point From, such as a light, to each of the points in To. Queries that can
+		// traverse segments with a common origin together override this, otherwise each segment is answered on its own in order
+		virtual void AreOccluded(const Vector3& From, const Vector3* To, int32_t Count, bool* bOutOccluded)
+		{
+			for (int32_t idx = 0; idx < Count; idx++)
+			{
+				bOutOccluded[idx] = IsOccluded(From, To[idx]);
+			}
+		}
+	};
+
+	// An occlusion query for when nothing is ever in the way
+	class NoOcclusionQuery final : public IOcclusionQuery
+	{
+	public:
+
+		virtual bool IsOccluded(const Vector3& /*From*/, const Vector3& /*To*/) override
+		{
+			return false;
+		}
+	};
+
+	/// <summary>
+	/// OcclusionCache keeps the last transmittance traced for each light, so while neither a light nor the point it was traced to has moved
+	/// further than a tolerance, the answer can be reused for a few detection updates instead of tracing again. Entries are indexed by the caller,
+	/// usually by the light's index in the scene, and are only kept by the detection that owns the cache, never shared between agents.
+	/// The cache holds at most MaxEntries entries however large the indices grow, such as a light and point pair for a large batch of points, and
+	/// past that an entry takes the slot of an earlier one whose index shares its low bits, so large batches cost a retrace rather than memory.
+	/// </summary>
+	class OcclusionCache
+	{
+	public:
+
+		// A power of two, so an index finds its slot with a mask
+		static constexpr int32_t MaxEntries = 4096;
+
+		// Ages every entry by one detection update, called once at the start of each update
+		void BeginUpdate()
+		{
+			UpdateIndex++;
+		}
+
+		void Reset()
+		{
+			Entries.clear();
+			UpdateIndex = 0;
+		}
+
+		// Returns true and sets OutTransmittance if the entry was traced from within Tolerance of From to within Tolerance of To at most MaxAge updates ago
+		bool Find(int32_t EntryIndex, const Vector3& From, const Vector3& To, float Tolerance, int32_t MaxAge, float& OutTransmittance) const
+		{
+			if (Entries.empty())
+			{
+				return false;
+			}
+
+			const Entry& Cached = Entries[GetSlot(EntryIndex)];
+			const float ToleranceSqr = Tolerance * Tolerance;
+			if (Cached.EntryIndex != EntryIndex || UpdateIndex - Cached.UpdateIndex > static_cast<uint32_t>(MaxAge) || DistSquared(Cached.From, From) > ToleranceSqr
+				|| DistSquared(Cached.To, To) > ToleranceSqr)
+			{
+				return false;
+			}
+
+			OutTransmittance = Cached.Transmittance;
+			return true;
+		}
+
+		void Store(int32_t EntryIndex, const Vector3& From, const Vector3& To, float Transmittance)
+		{
+			if (EntryIndex >= static_cast<int32_t>(Entries.size()) && static_cast<int32_t>(Entries.size()) < MaxEntries)
+			{
+				Grow(EntryIndex);
+			}
+			Entries[GetSlot(EntryIndex)] = { From, To, UpdateIndex, Transmittance, EntryIndex };
+		}
+
+	private:
+
+		struct Entry
+		{
+			Vector3 From;
+			Vector3 To;
+			uint32_t UpdateIndex = 0;
+			float Transmittance = 0.0f;
+			// The index stored in this slot, or -1 while it is empty
+			int32_t EntryIndex = -1;
+		};
+
+		int32_t GetSlot(int32_t EntryIndex) const
+		{
+			return EntryIndex & (static_cast<int32_t>(Entries.size()) - 1);
+		}
+
+		// Doubles the slots until EntryIndex has one of its own or there are MaxEntries of them, moving the entries held so far into their new slots.
+		// Indices below the slot count map to themselves, so a cache indexed by light never has two lights share a slot until it is full
+		void Grow(int32_t EntryIndex)
+		{
+			int32_t SlotCount = Entries.empty() ? 16 : static_cast<int32_t>(Entries.size());
+			while (SlotCount <= EntryIndex && SlotCount < MaxEntries)
+			{
+				SlotCount *= 2;
+			}
+
+			std::vector<Entry> OldEntries;
+			OldEntries.swap(Entries);
+			Entries.resize(SlotCount);
+			for (const Entry& Old : OldEntries)
+			{
+				if (Old.EntryIndex >= 0)
+				{
+					Entries[GetSlot(Old.EntryIndex)] = Old;
+				}
+			}
+		}
+
+		std::vector<Entry> Entries;
+		uint32_t UpdateIndex = 0;
+	};
+}
@@ -0,0 +1,146 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "LightDetectionTypes.h"
+#include "LightDetectionOcclusion.h"
+
+/// <summary>
+/// A compact binary log of detection updates, so a real play session can be re-run against the detection core without the engine. A recording
+/// starts with a snapshot of every light, then for each update stores the agent, only the lights that changed since the previous update, the
+/// answer to every occlusion query in the order it was made, and the resulting illuminance total.
+///
+/// Layout, little endian: "LDRC", uint32 version, the light scene snapshot, then a stream of records each starting with a RecordTag.
+/// </summary>
+namespace LightDetection
+{
+	constexpr uint32_t RecordingVersion = 4;
+
+	enum class RecordTag : uint8_t
+	{
+		// double time, agent detection point and position, then the detection settings in declaration order
+		Frame = 1,
+		// uint32 light index followed by the light's data
+		PointLight = 2,
+		SpotLight = 3,
+		RectLight = 4,
+		// The directional light's data
+		DirectionalLight = 5,
+		// From, To, float transmittance, 0 when occluded
+		Trace = 6,
+		// float illuminance total
+		FrameEnd = 7
+	};
+
+	struct RecordedTrace
+	{
+		Vector3 From;
+		Vector3 To;
+		float Transmittance;
+	};
+
+	struct RecordedFrame
+	{
+		double Time = 0.0;
+		AgentData Agent;
+		DetectionSettings Settings;
+		std::vector<RecordedTrace> Traces;
+		// The number of lights that changed since the previous frame
+		int32_t LightDeltas = 0;
+		// The illuminance total the engine arrived at for this frame
+		float IlluminanceTotal = 0.0f;
+	};
+
+	/// <summary>
+	/// RecordingWriter appends a recording to an in-memory buffer which the owner periodically drains to wherever it is being stored. Every light
+	/// can be passed in every frame, only those that differ from the last recorded state are written.
+	/// </summary>
+	class RecordingWriter
+	{
+	public:
+
+		// Clears any previous recording and writes the header and a full snapshot of the scene
+		void BeginRecording(const LightScene& Scene);
+		bool IsRecording() const { return bRecording; }
+
+		void BeginFrame(double Time, const AgentData& Agent, const DetectionSettings& Settings);
+		void RecordPointLight(int32_t LightIndex, const PointLightData& PointLight);
+		void RecordSpotLight(int32_t LightIndex, const SpotLightData& SpotLight);
+		void RecordRectLight(int32_t LightIndex, const RectLightData& RectLight);
+		void RecordDirectionalLight(const DirectionalLightData& DirectionalLight);
+		void RecordTrace(const Vector3& From, const Vector3& To, float Transmittance);
+		void EndFrame(float IlluminanceTotal);
+
+		// The bytes written since the data was last cleared
+		const std::vector<uint8_t>& GetData() const { return Data; }
+		void ClearData() { Data.clear(); }
+
+	private:
+
+		// The last recorded state of every light, used to only write the lights that have changed
+		LightScene RecordedScene;
+		std::vector<uint8_t> Data;
+		bool bRecording = false;
+	};
+
+	/// <summary>
+	/// RecordingReader walks a recording frame by frame, applying each frame's light changes to the scene it is given so the scene always
+	/// matches the state the engine was in for the frame that was just read.
+	/// </summary>
+	class RecordingReader
+	{
+	public:
+
+		// Reads the header and initial scene snapshot, returns false if this is not a recording this version can read
+		bool Open(const uint8_t* InData, size_t InSize, LightScene& Scene);
+
+		// Reads the next frame and applies its light changes to the scene, returns false at the end of the recording or if it is truncated
+		bool ReadFrame(RecordedFrame& Frame, LightScene& Scene);
+
+		// True if reading stopped because the recording was malformed rather than because it ended
+		bool HasError() const { return bError; }
+
+	private:
+
+		bool Read(void* Destination, size_t Bytes);
+		template<typename T> bool Read(T& Value) { return Read(&Value, sizeof(T)); }
+		bool Read(Vector3& Value);
+		bool ReadPointLight(PointLightData& PointLight);
+		bool ReadSpotLight(SpotLightData& SpotLight);
+		bool ReadRectLight(RectLightData& RectLight);
+		bool ReadDirectionalLight(DirectionalLightData& DirectionalLight);
+
+		const uint8_t* Data = nullptr;
+		size_t Size = 0;
+		size_t Offset = 0;
+		bool bError = false;
+	};
+
+	/// <summary>
+	/// RecordedOcclusionQuery answers occlusion queries from a recorded frame. Queries are expected in the order they were recorded, but if
+	/// the detection code now asks different questions, for example because it culls more lights before tracing, the frame is searched for the
+	/// same segment. Queries that were never recorded are answered as unoccluded and counted as misses.
+	/// </summary>
+	class RecordedOcclusionQuery final : public IOcclusionQuery
+	{
+	public:
+
+		void SetFrame(const RecordedFrame& Frame);
+
+		virtual bool IsOccluded(const Vector3& From, const Vector3& To) override;
+		virtual float GetTransmittance(const Vector3& From, const Vector3& To) override;
+
+		int32_t GetMissCount() const { return MissCount; }
+
+	private:
+
+		// The recorded transmittance of the segment, or 1 if it was never recorded
+		float FindTransmittance(const Vector3& From, const Vector3& To);
+
+		const std::vector<RecordedTrace>* Traces = nullptr;
+		size_t NextTrace = 0;
+		int32_t MissCount = 0;
+	};
+}
@@ -0,0 +1,109 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+#include <cstdint>
+#include "LightDetectionMath.h"
+
+/// <summary>
+/// The engine-independent half of server authoritative detection. Each player's illuminance is sent to clients as a single byte, and only
+/// when the byte has changed and the player's send interval has passed, so players standing still in steady light cost no bandwidth and
+/// players far from anyone who could see them are sent less often. Clients predict their own illuminance with the same core, see
+/// IlluminancePredictor, so the core avoids anything whose result differs between platforms or compilers.
+/// </summary>
+namespace LightDetection
+{
+	struct ReplicationSettings
+	{
+		// Illuminance at or above this is sent as the brightest value, anything brighter is indistinguishable once replicated
+		float MaxIlluminance = 1.0f;
+		// The send interval of the most relevant players and of the least, in seconds
+		float MinSendInterval = 0.1f;
+		float MaxSendInterval = 1.0f;
+	};
+
+	// What was last sent for one player. The sequence number goes up with every send, so clients can tell a new value from one they have seen
+	struct ReplicatedIlluminanceState
+	{
+		uint8_t LastSent = 0;
+		bool bSent = false;
+		double LastSendTime = 0.0;
+		uint16_t Sequence = 0;
+	};
+
+	// Quantizes illuminance from 0 to MaxIlluminance into a byte on a square root curve, so the dim values stealth decisions are made around
+	// keep more of the precision than bright ones
+	uint8_t QuantizeIlluminance(float Illuminance, float MaxIlluminance);
+	float DequantizeIlluminance(uint8_t Quantized, float MaxIlluminance);
+
+	// The send interval for a player with the given relevance, from MaxSendInterval at 0 to MinSendInterval at 1
+	float GetSendInterval(float Relevance, const ReplicationSettings& Settings);
+
+	// Returns true and updates State if Quantized should be sent at Time. Nothing is sent while the value is unchanged, and a changed value
+	// waits until Interval has passed since the last send. The first value is always sent
+	bool ShouldSendIlluminance(ReplicatedIlluminanceState& State, uint8_t Quantized, double Time, float Interval);
+
+	// What a server value did when it was applied to an IlluminancePredictor
+	enum class ServerValueResult : uint8_t
+	{
+		// Not newer than the last server value applied, and ignored
+		Stale,
+		// No prediction was made close enough to where the server evaluated the player to compare it with
+		Unmatched,
+		// The prediction made there agrees with the server
+		Confirmed,
+		// The prediction made there disagrees, the server's value is shown while the player stays there
+		Corrected
+	};
+
+	/// <summary>
+	/// IlluminancePredictor reconciles a client's prediction of its own illuminance with the values the server replicates for it, so the light
+	/// meter responds at once while the server stays authoritative. Each prediction is recorded with the point it was made at. When a server
+	/// value with a newer sequence number arrives, it is compared with the prediction made closest to the point the server evaluated, since the
+	/// server evaluates the player where it last heard they were. If they agree the client's predictions are trusted. If they disagree the
+	/// client is missing something the server knows, such as an occluder only the server has, so the server's value is shown instead until the
+	/// player moves away from where it was evaluated or a later server value agrees with the prediction.
+	/// </summary>
+	class IlluminancePredictor
+	{
+	public:
+
+		// Predictions older than this many updates are forgotten
+		static constexpr int32_t HistorySize = 32;
+
+		void Reset();
+
+		// Records this update's prediction, made at Point. A correction is dropped once a prediction is made away from where it applies
+		void AddPrediction(const Vector3& Point, float Illuminance);
+
+		// Compares a replicated server value with the prediction made nearest ServerPoint, if one was made within MatchDistance of it. Values
+		// are compared once quantized, and a prediction agrees when it would have replicated within Tolerance quantization steps of the server's
+		// byte, so the small differences left by the client's cheaper evaluation and by quantization near a step are not corrected
+		ServerValueResult ApplyServerValue(uint16_t Sequence, const Vector3& ServerPoint, uint8_t ServerValue, float MaxIlluminance, float MatchDistance,
+			int32_t Tolerance);
+
+		// The illuminance to show for the latest prediction, the server's instead while a correction applies to where the player is
+		float GetIlluminance() const;
+
+	private:
+
+		struct Prediction
+		{
+			Vector3 Point;
+			float Illuminance;
+		};
+
+		// A ring of the latest predictions, LatestPrediction is the most recent
+		Prediction History[HistorySize];
+		int32_t HistoryCount = 0;
+		int32_t LatestPrediction = -1;
+
+		bool bHasServerValue = false;
+		uint16_t LastSequence = 0;
+
+		// The server value shown instead of predictions within CorrectionDistance of CorrectionPoint
+		bool bCorrected = false;
+		Vector3 CorrectionPoint;
+		float CorrectionDistance = 0.0f;
+		float CorrectionIlluminance = 0.0f;
+	};
+}
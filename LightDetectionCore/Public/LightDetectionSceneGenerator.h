@@ -0,0 +1,52 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "LightDetectionTypes.h"
+#include "LightDetectionOccluders.h"
+
+/// <summary>
+/// Deterministic synthetic scenes for exercising the detection core without a level. Lights are scattered through a cube that grows with the
+/// light count so the density, and so the proportion of lights in range of any one agent, stays roughly the same at every scene size.
+/// </summary>
+namespace LightDetection
+{
+	struct SceneGeneratorSettings
+	{
+		uint32_t Seed = 1;
+		// Average distance between neighbouring lights of the same type, in centimetres
+		float LightSpacing = 1000.0f;
+		float MinAttenuationRadius = 200.0f;
+		float MaxAttenuationRadius = 2000.0f;
+		// Point lights are placed in groups of this many within GroupRadius of the group's first light, like the candles or monitors dressing a
+		// room. Groups of one scatter every point light through the scene
+		int32_t PointLightGroupSize = 1;
+		float PointLightGroupRadius = 150.0f;
+		// Outer cone angles of spot lights in degrees, the inner cone is a random fraction of the outer cone
+		float MinOuterConeAngle = 10.0f;
+		float MaxOuterConeAngle = 60.0f;
+		float MinSourceSize = 50.0f;
+		float MaxSourceSize = 400.0f;
+		float MaxBarnDoorAngle = 88.0f;
+		float MinBarnDoorLength = 20.0f;
+		float MaxBarnDoorLength = 50.0f;
+		// Occluders are boxes of random size and orientation, up to this long along each side
+		float MaxOccluderSize = 800.0f;
+	};
+
+	// Returns the side length of the cube LightCount lights are scattered through
+	float GetSceneExtent(int32_t LightCount, const SceneGeneratorSettings& Settings);
+
+	// Fills the scene with LightCount each of point, spot and rect lights, with their rect frustums already calculated
+	void GenerateScene(LightScene& Scene, int32_t LightCount, const SceneGeneratorSettings& Settings);
+
+	// Returns the triangles of OccluderCount boxes scattered through the scene generated for LightCount lights
+	std::vector<OccluderTriangle> GenerateOccluderTriangles(int32_t OccluderCount, int32_t LightCount, const SceneGeneratorSettings& Settings);
+
+	// Fills the occluder scene's hierarchy with the boxes from GenerateOccluderTriangles(), with no movable occluders
+	void GenerateOccluders(OccluderScene& Occluders, int32_t OccluderCount, int32_t LightCount, const SceneGeneratorSettings& Settings);
+
+	// Returns AgentCount agents standing at random positions within the scene generated for LightCount lights
+	std::vector<AgentData> GenerateAgents(int32_t AgentCount, int32_t LightCount, const SceneGeneratorSettings& Settings);
+}
@@ -0,0 +1,251 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "LightDetectionMath.h"
+
+/// <summary>
+/// Plain data snapshots of the lights and agents light detection works on. The engine adapter fills these from light components, but they can
+/// equally be generated synthetically, loaded from a recording, or built by hand, so the detection maths can run without the engine.
+/// </summary>
+namespace LightDetection
+{
+	struct PointLightData
+	{
+		Vector3 Position;
+		float AttenuationRadius;
+		float Intensity;
+		bool bVisible;
+	};
+
+	struct SpotLightData
+	{
+		Vector3 Position;
+		// Unit length forward direction of the spot light
+		Vector3 Direction;
+		float AttenuationRadius;
+		float Intensity;
+		// Cone angles in degrees, along with their cosines which are what the cone tests use
+		float InnerConeAngle;
+		float OuterConeAngle;
+		float CosInnerConeAngle;
+		float CosOuterConeAngle;
+		bool bVisible;
+	};
+
+	struct RectLightData
+	{
+		Vector3 Position;
+		// Unit length basis of the rect light, the emitter faces along Forward and is SourceWidth along Right by SourceHeight along Up
+		Vector3 Forward;
+		Vector3 Right;
+		Vector3 Up;
+		float AttenuationRadius;
+		float Intensity;
+		float SourceWidth;
+		float SourceHeight;
+		float BarnDoorAngle;
+		float BarnDoorLength;
+		bool bVisible;
+	};
+
+	struct RectLightFrustum
+	{
+		// Index starts at the near plane top left, moves counterclockwise, then the far plane in the same order
+		Vector3 FrustumPoints[8];
+
+		// Index starts at the top plane, moves counterclockwise
+		Plane BoundingPlanes[4];
+	};
+
+	struct DirectionalLightData
+	{
+		// Unit length direction the light travels in
+		Vector3 Direction;
+		float Intensity;
+		bool bVisible;
+	};
+
+	// Something light detection is evaluated for, such as the player
+	struct AgentData
+	{
+		// The point on the agent that is tested against each light
+		Vector3 DetectionPoint;
+		// The agent's origin, used by the lights that are tested against the agent rather than the detection point
+		Vector3 Position;
+	};
+
+	// Exact comparisons of light snapshots, used to find the lights that have changed since they were last snapshotted
+	inline bool IsSameVector(const Vector3& A, const Vector3& B)
+	{
+		return A.X == B.X && A.Y == B.Y && A.Z == B.Z;
+	}
+
+	inline bool IsSameLight(const PointLightData& A, const PointLightData& B)
+	{
+		return IsSameVector(A.Position, B.Position) && A.AttenuationRadius == B.AttenuationRadius && A.Intensity == B.Intensity && A.bVisible == B.bVisible;
+	}
+
+	inline bool IsSameLight(const SpotLightData& A, const SpotLightData& B)
+	{
+		return IsSameVector(A.Position, B.Position) && IsSameVector(A.Direction, B.Direction) && A.AttenuationRadius == B.AttenuationRadius
+			&& A.Intensity == B.Intensity && A.InnerConeAngle == B.InnerConeAngle && A.OuterConeAngle == B.OuterConeAngle && A.bVisible == B.bVisible;
+	}
+
+	inline bool IsSameLight(const RectLightData& A, const RectLightData& B)
+	{
+		return IsSameVector(A.Position, B.Position) && IsSameVector(A.Forward, B.Forward) && IsSameVector(A.Right, B.Right) && IsSameVector(A.Up, B.Up)
+			&& A.AttenuationRadius == B.AttenuationRadius && A.Intensity == B.Intensity && A.SourceWidth == B.SourceWidth && A.SourceHeight == B.SourceHeight
+			&& A.BarnDoorAngle == B.BarnDoorAngle && A.BarnDoorLength == B.BarnDoorLength && A.bVisible == B.bVisible;
+	}
+
+	inline bool IsSameLight(const DirectionalLightData& A, const DirectionalLightData& B)
+	{
+		return IsSameVector(A.Direction, B.Direction) && A.Intensity == B.Intensity && A.bVisible == B.bVisible;
+	}
+
+	// Every registered light, the rect frustums are index aligned with the rect lights
+	struct LightScene
+	{
+		std::vector<PointLightData> PointLights;
+		std::vector<SpotLightData> SpotLights;
+		std::vector<RectLightData> RectLights;
+		std::vector<RectLightFrustum> RectFrustums;
+		DirectionalLightData DirectionalLight;
+		bool bHasDirectionalLight = false;
+	};
+
+	// A point light in range of the point being evaluated, see EvaluatePointLightCandidates()
+	struct PointLightInRange
+	{
+		float DistanceSqr;
+		int32_t LightIndex;
+	};
+
+	// A point light standing in for several, such as a cluster evaluated as one light, see GatherClusteredPointLights()
+	struct VirtualPointLight
+	{
+		PointLightData Light;
+		// Tells the light apart from other virtual lights from one update to the next, such as the index of the cluster it stands in for
+		int32_t Id;
+	};
+
+	// The lights a broad phase found could reach a region, as indices into the scene's light arrays in scene order
+	struct LightCandidates
+	{
+		std::vector<int32_t> PointLights;
+		std::vector<int32_t> SpotLights;
+		// Point lights that are not in the scene, evaluated along with the candidate point lights
+		std::vector<VirtualPointLight> VirtualPointLights;
+
+		// Scratch for ordering the candidate point lights nearest first, kept with the candidates so evaluation does not allocate
+		std::vector<PointLightInRange> PointLightsInRange;
+		// Scratch for the cells visited by GatherCellCandidates() and the portal each was entered through
+		std::vector<int32_t> CellsToVisit;
+		std::vector<int32_t> CellEntryPortals;
+		// Scratch for the groups of nearby points EvaluateDetectionSamples() gathers candidates for together, the points of the group being
+		// evaluated and where each is in the caller's points
+		std::vector<uint8_t> PointGrouped;
+		std::vector<Vector3> GroupPoints;
+		std::vector<int32_t> GroupPointIndices;
+
+		void Reset()
+		{
+			PointLights.clear();
+			SpotLights.clear();
+			VirtualPointLights.clear();
+		}
+	};
+
+	// The most points a rect light's emitter is sampled at, see EvaluateRectLightArea()
+	constexpr int32_t MaxRectLightSamples = 64;
+	// How many partial sums a rect light's sample weights are added into, one SIMD register of floats on AVX
+	constexpr int32_t RectLightWeightLanes = 8;
+
+	/// <summary>
+	/// RectLightSamples holds a rect light's emitter samples for one point, so the fraction of the emitter that can see the point builds up over
+	/// several detection updates instead of being traced all at once. Sample offsets are stored a component at a time so their weights are worked
+	/// out a block of lanes at a time. Kept by whoever evaluates the light, one for each rect light.
+	/// </summary>
+	struct RectLightSamples
+	{
+		// The light and point the samples were traced for, they are started over if either moves
+		RectLightData Light;
+		Vector3 Point;
+		bool bValid = false;
+
+		// Stratified sample positions on the emitter, as fractions of its width and height from its centre, in the order they are traced
+		std::vector<float> OffsetRight;
+		std::vector<float> OffsetUp;
+		// Each sample's transmittance, only meaningful for the first TracedCount samples
+		std::vector<float> Transmittance;
+		int32_t TracedCount = 0;
+		// The sample traced next, once every sample has been traced the oldest are traced again so changes to the geometry are picked up
+		int32_t NextSample = 0;
+	};
+
+	struct DetectionSettings
+	{
+		// Extra squared distance allowed past a light's range before it is culled
+		float ForgivenessBuffer = 0.0f;
+		// How far back along the directional light's direction its occlusion ray starts
+		float DirectionalLightDistance = 5000.0f;
+
+		// The most occlusion traces point lights may make for one point in one detection update. Point lights in range are traced nearest first,
+		// and any past the budget without a cached answer are left unevaluated for that update
+		int32_t MaxPointLightTraces = 4;
+		// A cached occlusion answer is reused while both ends of its trace are within this distance of where they were, and it is no more
+		// than this many detection updates old
+		float OcclusionCacheTolerance = 10.0f;
+		int32_t OcclusionCacheMaxAge = 5;
+
+		// The widest, along any axis, the bounds of the points EvaluateDetectionSamples() gathers candidates for together may be. Points further
+		// apart are split into groups that each have their own broad phase, so players spread across a level are not each tested against every
+		// light between them
+		float MaxSampleGroupExtent = 2000.0f;
+
+		// The number of points across a rect light's emitter it is traced from, rounded to a grid matching the emitter's shape, up to MaxRectLightSamples.
+		// One traces from the centre only
+		int32_t RectLightSampleCount = 1;
+		// How many of a rect light's samples are traced in each update, the rest are reused from earlier updates
+		int32_t RectLightSamplesPerUpdate = 2;
+
+		// When set, lights are traced with IOcclusionQuery::GetTransmittance() and dimmed by whatever they partly pass through, such as foliage or
+		// glass, rather than only being blocked or not. A light is only occluded once none of it gets through
+		bool bTransmission = false;
+	};
+
+	// The work done by detection, accumulated until the caller resets it
+	struct DetectionCounters
+	{
+		int32_t LightsTested = 0;
+		int32_t LightsCulled = 0;
+		int32_t LightsReused = 0;
+		int32_t TracesIssued = 0;
+		int32_t TracesSaved = 0;
+
+		void Reset()
+		{
+			*this = DetectionCounters();
+		}
+	};
+
+	// How a single light was found to affect a point
+	enum class LightEvaluation : uint8_t
+	{
+		// The light was rejected before any occlusion test, it is out of range, facing away or switched off
+		Culled,
+		// The light could reach the point but something is in the way
+		Occluded,
+		// The light reaches the point
+		Lit
+	};
+
+	struct LightSample
+	{
+		LightEvaluation Evaluation;
+		// The illuminance the light contributes to the point, unitless, zero unless lit
+		float Illuminance;
+	};
+}
@@ -0,0 +1,77 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "LightDetectionOccluders.h"
+
+/// <summary>
+/// A coarser alternative to the occluder hierarchy, light blocking geometry voxelized into a sparse grid of solid bits. Answers are conservative,
+/// any voxel a triangle touches is solid, so segments that pass close to geometry may be reported as occluded, which stealth can live with in
+/// return for a query that only marches through a few cells and never touches a triangle.
+/// </summary>
+namespace LightDetection
+{
+	/// <summary>
+	/// OccluderVoxelGrid holds the voxels in bricks of BrickSize^3, each brick a bitfield that fits a cache line. A dense grid of brick indices
+	/// covers the bounds of the geometry and only bricks with a solid voxel are allocated, so open space costs four bytes a brick. Segments are
+	/// marched with a 3D-DDA through the brick grid, skipping empty bricks whole, and then through the voxels of any brick they enter.
+	/// </summary>
+	class OccluderVoxelGrid
+	{
+	public:
+
+		// Voxels along each side of a brick, a brick's bits are BrickSize^3 / 64 words
+		static constexpr int32_t BrickSize = 8;
+
+		// Voxelizes the triangles into voxels VoxelSize units along each side, replacing anything built before
+		void Build(const std::vector<OccluderTriangle>& Triangles, float InVoxelSize);
+
+		// Returns true if the segment from From to To passes through a solid voxel. The voxels within a voxel of either end are not tested,
+		// so the wall a light is mounted on or the floor under a detection point does not occlude it
+		bool IsSegmentOccluded(const Vector3& From, const Vector3& To) const;
+
+		float GetVoxelSize() const { return VoxelSize; }
+		size_t GetBrickCount() const { return BrickBits.size() / WordsPerBrick; }
+		// The memory held by the grid in bytes
+		size_t GetAllocatedSize() const;
+
+	private:
+
+		static constexpr int32_t WordsPerBrick = (BrickSize * BrickSize * BrickSize) / 64;
+		static constexpr uint32_t EmptyBrick = ~0u;
+
+		void SetVoxel(int32_t X, int32_t Y, int32_t Z);
+		bool IsVoxelSet(uint32_t BrickIndex, int32_t X, int32_t Y, int32_t Z) const;
+
+		// World position of the grid's minimum corner, and the grid's size in bricks
+		Vector3 Origin;
+		float VoxelSize = 0.0f;
+		float InvVoxelSize = 0.0f;
+		int32_t BrickDims[3] = { 0, 0, 0 };
+
+		// An index into BrickBits for each brick in the grid, X fastest, EmptyBrick where no voxel is solid
+		std::vector<uint32_t> BrickIndices;
+		std::vector<uint64_t> BrickBits;
+	};
+
+	// Answers occlusion queries from a voxel grid, with any movable occluders alongside it
+	class VoxelOcclusionQuery final : public IOcclusionQuery
+	{
+	public:
+
+		VoxelOcclusionQuery(const OccluderVoxelGrid& InVoxels, const std::vector<OccluderBox>& InDynamic)
+			: Voxels(InVoxels)
+			, Dynamic(InDynamic)
+		{
+		}
+
+		virtual bool IsOccluded(const Vector3& From, const Vector3& To) override;
+
+	private:
+
+		const OccluderVoxelGrid& Voxels;
+		const std::vector<OccluderBox>& Dynamic;
+	};
+}
@@ -0,0 +1,172 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+// Only built by the standalone CMake build, the engine build compiles every source in the module
+#if LIGHT_DETECTION_STANDALONE
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include "LightDetectionKernels.h"
+#include "LightDetectionRecording.h"
+
+/// <summary>
+/// Re-runs the detection pipeline over a session recorded by the light detection manager, answering occlusion from the recorded traces,
+/// and reports how long detection took along with how much work it did. Frames whose illuminance total no longer matches the recording are
+/// counted, as are occlusion queries the recording has no answer for, so a change in behaviour shows up next to the change in timings.
+/// A checksum of every frame's result is printed as well. Clients predict detection with the same core as the server, so the checksum from
+/// a client build and a server build of the replayer must match for the same recording.
+///
+/// Usage: LightDetectionReplayer recording.ldrec [-repeat N]
+/// </summary>
+namespace
+{
+	using namespace LightDetection;
+
+	constexpr float IlluminanceTolerance = 1.e-4f;
+
+	struct ReplayTotals
+	{
+		int64_t Frames = 0;
+		int64_t LightDeltas = 0;
+		int64_t Mismatches = 0;
+		int64_t TraceMisses = 0;
+		int64_t DetectionNanoseconds = 0;
+		// Each frame's counters totalled in 64 bits, as a long session replayed several times tests more lights than the counters can hold
+		int64_t LightsTested = 0;
+		int64_t LightsCulled = 0;
+		int64_t TracesIssued = 0;
+		int64_t TracesSaved = 0;
+		// FNV-1a over the bits of every frame's illuminance total
+		uint64_t ResultChecksum = 14695981039346656037ull;
+	};
+
+	void AddToChecksum(uint64_t& Checksum, float Value)
+	{
+		uint32_t Bits;
+		std::memcpy(&Bits, &Value, sizeof(Bits));
+		for (int ByteIdx = 0; ByteIdx < 4; ByteIdx++)
+		{
+			Checksum = (Checksum ^ ((Bits >> (ByteIdx * 8)) & 0xFF)) * 1099511628211ull;
+		}
+	}
+
+	bool ReplayRecording(const std::vector<uint8_t>& Recording, ReplayTotals& Totals)
+	{
+		LightScene Scene;
+		RecordingReader Reader;
+		if (!Reader.Open(Recording.data(), Recording.size(), Scene))
+		{
+			std::fprintf(stderr, "Not a light detection recording, or one from an unsupported version\n");
+			return false;
+		}
+
+		RecordedFrame Frame;
+		RecordedOcclusionQuery Occlusion;
+		// The cache and each rect light's emitter samples are carried between frames as the manager carries them between updates, so the same
+		// traces are made
+		OcclusionCache Cache;
+		LightCandidates Candidates;
+		std::vector<RectLightSamples> RectSamples;
+		DetectionCounters Counters;
+		while (Reader.ReadFrame(Frame, Scene))
+		{
+			Occlusion.SetFrame(Frame);
+			Cache.BeginUpdate();
+			Counters.Reset();
+
+			// Only the detection itself is timed, reading the frame and applying its light changes is not
+			const auto StartTime = std::chrono::steady_clock::now();
+			float IlluminanceTotal = EvaluateDetectionUpdate(Scene, Frame.Agent.DetectionPoint, Frame.Settings, Occlusion, &Cache, Counters, Candidates);
+
+			// Rect lights add to the total after the point and spot lights, evaluated at the agent's position as the manager evaluates them
+			RectSamples.resize(Scene.RectLights.size());
+			for (size_t idx = 0; idx < Scene.RectLights.size(); idx++)
+			{
+				IlluminanceTotal += EvaluateRectLightArea(Scene.RectLights[idx], Scene.RectFrustums[idx], Frame.Agent.Position, Frame.Settings, Occlusion, RectSamples[idx],
+					Counters).Illuminance;
+			}
+			const auto EndTime = std::chrono::steady_clock::now();
+
+			Totals.DetectionNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(EndTime - StartTime).count();
+			Totals.Frames++;
+			Totals.LightDeltas += Frame.LightDeltas;
+			Totals.LightsTested += Counters.LightsTested;
+			Totals.LightsCulled += Counters.LightsCulled;
+			Totals.TracesIssued += Counters.TracesIssued;
+			Totals.TracesSaved += Counters.TracesSaved;
+			AddToChecksum(Totals.ResultChecksum, IlluminanceTotal);
+			if (std::abs(IlluminanceTotal - Frame.IlluminanceTotal) > IlluminanceTolerance)
+			{
+				Totals.Mismatches++;
+			}
+		}
+		Totals.TraceMisses += Occlusion.GetMissCount();
+
+		if (Reader.HasError())
+		{
+			std::fprintf(stderr, "Recording is truncated or malformed after %lld frames, the rest is ignored\n", static_cast<long long>(Totals.Frames));
+		}
+		return true;
+	}
+}
+
+int main(int ArgC, char** ArgV)
+{
+	if (ArgC < 2)
+	{
+		std::fprintf(stderr, "Usage: %s recording.ldrec [-repeat N]\n", ArgV[0]);
+		return 1;
+	}
+
+	int Repeats = 1;
+	for (int ArgIdx = 2; ArgIdx < ArgC; ArgIdx++)
+	{
+		if (std::strcmp(ArgV[ArgIdx], "-repeat") == 0 && ArgIdx + 1 < ArgC)
+		{
+			Repeats = std::max(1, std::atoi(ArgV[++ArgIdx]));
+		}
+	}
+
+	std::ifstream File(ArgV[1], std::ios::binary);
+	if (!File)
+	{
+		std::fprintf(stderr, "Could not open %s\n", ArgV[1]);
+		return 1;
+	}
+	const std::vector<uint8_t> Recording((std::istreambuf_iterator<char>(File)), std::istreambuf_iterator<char>());
+
+	ReplayTotals Totals;
+	for (int Repeat = 0; Repeat < Repeats; Repeat++)
+	{
+		if (!ReplayRecording(Recording, Totals))
+		{
+			return 1;
+		}
+	}
+
+	const double Frames = static_cast<double>(std::max<int64_t>(Totals.Frames, 1));
+	const double LightsTested = static_cast<double>(std::max<int64_t>(Totals.LightsTested, 1));
+	std::printf("Frames replayed:    %lld (%d pass%s)\n", static_cast<long long>(Totals.Frames), Repeats, Repeats == 1 ? "" : "es");
+	std::printf("Light changes:      %lld\n", static_cast<long long>(Totals.LightDeltas));
+	std::printf("Lights tested:      %lld\n", static_cast<long long>(Totals.LightsTested));
+	std::printf("Lights culled:      %lld\n", static_cast<long long>(Totals.LightsCulled));
+	std::printf("Traces issued:      %lld\n", static_cast<long long>(Totals.TracesIssued));
+	std::printf("Traces saved:       %lld\n", static_cast<long long>(Totals.TracesSaved));
+	std::printf("Unrecorded traces:  %lld\n", static_cast<long long>(Totals.TraceMisses));
+	std::printf("Total mismatches:   %lld\n", static_cast<long long>(Totals.Mismatches));
+	std::printf("Detection time:     %.3f ms\n", Totals.DetectionNanoseconds * 1.e-6);
+	std::printf("ns/frame:           %.1f\n", Totals.DetectionNanoseconds / Frames);
+	std::printf("ns/light:           %.2f\n", Totals.DetectionNanoseconds / LightsTested);
+	std::printf("Result checksum:    %016llx\n", static_cast<unsigned long long>(Totals.ResultChecksum));
+
+	// A non-zero exit lets scripts catch behaviour changes as well as slowdowns
+	return Totals.Mismatches == 0 ? 0 : 2;
+}
+
+#endif
@@ -0,0 +1,467 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "LightDetectionCoreAdapter.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "Async/ParallelFor.h"
+#include "LightDetectionStats.h"
+#include "LightDetectionCellVolume.h"
+#include "LightDetectionPortalVolume.h"
+#include "Components/PointLightComponent.h"
+#include "Components/SpotLightComponent.h"
+#include "Components/RectLightComponent.h"
+#include "Components/DirectionalLightComponent.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "GameFramework/Pawn.h"
+#include "PhysicsEngine/BodySetup.h"
+#include "PhysicalMaterials/PhysicalMaterial.h"
+
+namespace LightDetectionAdapter
+{
+	LightDetection::PointLightData MakePointLightData(const UPointLightComponent* PointLight)
+	{
+		LightDetection::PointLightData PointLightData;
+		PointLightData.Position = ToCoreVector(PointLight->GetLightPosition());
+		PointLightData.AttenuationRadius = PointLight->AttenuationRadius;
+		PointLightData.Intensity = PointLight->Intensity;
+		PointLightData.bVisible = PointLight->IsVisible();
+		return PointLightData;
+	}
+
+	LightDetection::SpotLightData MakeSpotLightData(const USpotLightComponent* SpotLight)
+	{
+		LightDetection::SpotLightData SpotLightData;
+		SpotLightData.Position = ToCoreVector(SpotLight->GetLightPosition());
+		SpotLightData.Direction = ToCoreVector(SpotLight->GetForwardVector());
+		SpotLightData.AttenuationRadius = SpotLight->AttenuationRadius;
+		SpotLightData.Intensity = SpotLight->Intensity;
+		SpotLightData.bVisible = SpotLight->IsVisible();
+		LightDetection::SetSpotLightConeAngles(SpotLightData, SpotLight->InnerConeAngle, SpotLight->OuterConeAngle);
+		return SpotLightData;
+	}
+
+	LightDetection::RectLightData MakeRectLightData(const URectLightComponent* RectLight)
+	{
+		LightDetection::RectLightData RectLightData;
+		RectLightData.Position = ToCoreVector(RectLight->GetLightPosition());
+		RectLightData.Forward = ToCoreVector(RectLight->GetForwardVector());
+		RectLightData.Right = ToCoreVector(RectLight->GetRightVector());
+		RectLightData.Up = ToCoreVector(RectLight->GetUpVector());
+		RectLightData.AttenuationRadius = RectLight->AttenuationRadius;
+		RectLightData.Intensity = RectLight->Intensity;
+		RectLightData.SourceWidth = RectLight->SourceWidth;
+		RectLightData.SourceHeight = RectLight->SourceHeight;
+		RectLightData.BarnDoorAngle = RectLight->BarnDoorAngle;
+		RectLightData.BarnDoorLength = RectLight->BarnDoorLength;
+		RectLightData.bVisible = RectLight->IsVisible();
+		return RectLightData;
+	}
+
+	LightDetection::DirectionalLightData MakeDirectionalLightData(const UDirectionalLightComponent* DirectionalLight)
+	{
+		LightDetection::DirectionalLightData DirectionalLightData;
+		DirectionalLightData.Direction = ToCoreVector(DirectionalLight->GetForwardVector());
+		DirectionalLightData.Intensity = DirectionalLight->Intensity;
+		DirectionalLightData.bVisible = DirectionalLight->IsVisible();
+		return DirectionalLightData;
+	}
+
+	void GatherTaggedLights(UWorld* World, TArray<UPointLightComponent*>& PointLights, TArray<USpotLightComponent*>& SpotLights,
+		TArray<URectLightComponent*>* RectLights)
+	{
+		// Iterate through all actors in the world, checking for point, spot and rect light tags
+		for (TActorIterator<AActor> ActorItr(World); ActorItr; ++ActorItr)
+		{
+			AActor* Actor = *ActorItr;
+
+			// If the actor is tagged as a point or spot light, add a reference of it to it's respective array
+			if (Actor->ActorHasTag(TEXT("Point Light")))
+			{
+				UPointLightComponent* PointLightComponent = Actor->FindComponentByClass<UPointLightComponent>();
+				if (PointLightComponent)
+				{
+					PointLights.Add(PointLightComponent);
+				}
+			}
+			else if (Actor->ActorHasTag(TEXT("Spot Light")))
+			{
+				USpotLightComponent* SpotLightComponent = Actor->FindComponentByClass<USpotLightComponent>();
+				if (SpotLightComponent)
+				{
+					SpotLights.Add(SpotLightComponent);
+				}
+			}
+			else if (RectLights && Actor->ActorHasTag(TEXT("Rect Light")))
+			{
+				URectLightComponent* RectLightComponent = Actor->FindComponentByClass<URectLightComponent>();
+				if (RectLightComponent)
+				{
+					RectLights->Add(RectLightComponent);
+				}
+			}
+		}
+	}
+
+	void SnapshotLightScene(const TArray<UPointLightComponent*>& PointLights, const TArray<USpotLightComponent*>& SpotLights,
+		const TArray<URectLightComponent*>& RectLights, const UDirectionalLightComponent* DirectionalLight, LightDetection::LightScene& Scene)
+	{
+		Scene.PointLights.resize(PointLights.Num());
+		for (int idx = 0; idx < PointLights.Num(); idx++)
+		{
+			Scene.PointLights[idx] = MakePointLightData(PointLights[idx]);
+		}
+
+		Scene.SpotLights.resize(SpotLights.Num());
+		for (int idx = 0; idx < SpotLights.Num(); idx++)
+		{
+			Scene.SpotLights[idx] = MakeSpotLightData(SpotLights[idx]);
+		}
+
+		Scene.RectLights.resize(RectLights.Num());
+		Scene.RectFrustums.resize(RectLights.Num());
+		for (int idx = 0; idx < RectLights.Num(); idx++)
+		{
+			Scene.RectLights[idx] = MakeRectLightData(RectLights[idx]);
+			LightDetection::CalculateFrustumPoints(Scene.RectLights[idx], Scene.RectFrustums[idx]);
+			LightDetection::CalculateBoundingPlanes(Scene.RectFrustums[idx]);
+		}
+
+		Scene.bHasDirectionalLight = DirectionalLight != nullptr;
+		if (DirectionalLight)
+		{
+			Scene.DirectionalLight = MakeDirectionalLightData(DirectionalLight);
+		}
+	}
+
+	void BuildLightClusters(const TArray<UPointLightComponent*>& PointLights, const LightDetection::LightScene& Scene, float ClusterSize, LightDetection::PointLightClusters& OutClusters)
+	{
+		std::vector<int32_t> LightIndices;
+		for (int idx = 0; idx < PointLights.Num(); idx++)
+		{
+			if (PointLights[idx]->Mobility != EComponentMobility::Movable)
+			{
+				LightIndices.push_back(idx);
+			}
+		}
+		LightDetection::BuildPointLightClusters(Scene, LightIndices, ClusterSize, OutClusters);
+	}
+
+	void BuildLightCells(UWorld* World, const TArray<UPointLightComponent*>& PointLights, const TArray<USpotLightComponent*>& SpotLights, const LightDetection::LightScene& Scene,
+		LightDetection::LightCellScene& OutCells)
+	{
+		OutCells.Reset();
+
+		// Every cell has to be added before the portals joining them
+		for (TActorIterator<ALightDetectionCellVolume> CellItr(World); CellItr; ++CellItr)
+		{
+			const FBox Bounds = CellItr->GetBounds().GetBox();
+			LightDetection::AddLightCell(OutCells, ToCoreVector(Bounds.Min), ToCoreVector(Bounds.Max));
+		}
+		for (TActorIterator<ALightDetectionPortalVolume> PortalItr(World); PortalItr; ++PortalItr)
+		{
+			const FBox Bounds = PortalItr->GetBounds().GetBox();
+			LightDetection::AddCellPortal(OutCells, ToCoreVector(Bounds.Min), ToCoreVector(Bounds.Max));
+		}
+
+		std::vector<int32_t> StaticPointLights;
+		for (int idx = 0; idx < PointLights.Num(); idx++)
+		{
+			if (PointLights[idx]->Mobility != EComponentMobility::Movable)
+			{
+				StaticPointLights.push_back(idx);
+			}
+		}
+		std::vector<int32_t> StaticSpotLights;
+		for (int idx = 0; idx < SpotLights.Num(); idx++)
+		{
+			if (SpotLights[idx]->Mobility != EComponentMobility::Movable)
+			{
+				StaticSpotLights.push_back(idx);
+			}
+		}
+		LightDetection::AssignLightsToCells(Scene, StaticPointLights, StaticSpotLights, OutCells);
+	}
+
+	LightDetection::OccluderBox MakeOccluderBox(const FTransform& Transform, const FRotator& LocalRotation, const FVector& LocalCenter, const FVector& LocalExtent)
+	{
+		const FQuat Rotation = Transform.GetRotation() * LocalRotation.Quaternion();
+		const FVector Scale = Transform.GetScale3D();
+
+		// Each of the box's axes is stretched by however much the transform's scale stretches that direction
+		LightDetection::OccluderBox Box;
+		Box.Center = ToCoreVector(Transform.TransformPosition(LocalCenter));
+		Box.Axes[0] = ToCoreVector(Rotation.GetAxisX());
+		Box.Axes[1] = ToCoreVector(Rotation.GetAxisY());
+		Box.Axes[2] = ToCoreVector(Rotation.GetAxisZ());
+		Box.Extent = ToCoreVector(FVector(
+			LocalExtent.X * (LocalRotation.RotateVector(FVector::XAxisVector) * Scale).Size(),
+			LocalExtent.Y * (LocalRotation.RotateVector(FVector::YAxisVector) * Scale).Size(),
+			LocalExtent.Z * (LocalRotation.RotateVector(FVector::ZAxisVector) * Scale).Size()));
+		return Box;
+	}
+
+	// Adds the simple collision shapes of a body, in the space of Transform, as occluder triangles. Convex hulls without cooked indices, spheres
+	// and capsules are added as their bounding boxes, which is conservative for light detection
+	static void AppendBodyTriangles(const UBodySetup* BodySetup, const FTransform& Transform, std::vector<LightDetection::OccluderTriangle>& Triangles)
+	{
+		const FKAggregateGeom& AggGeom = BodySetup->AggGeom;
+		for (const FKBoxElem& BoxElem : AggGeom.BoxElems)
+		{
+			LightDetection::AppendBoxTriangles(MakeOccluderBox(Transform, BoxElem.Rotation, BoxElem.Center, FVector(BoxElem.X, BoxElem.Y, BoxElem.Z) * 0.5f), Triangles);
+		}
+		for (const FKSphereElem& SphereElem : AggGeom.SphereElems)
+		{
+			LightDetection::AppendBoxTriangles(MakeOccluderBox(Transform, FRotator::ZeroRotator, SphereElem.Center, FVector(SphereElem.Radius)), Triangles);
+		}
+		for (const FKSphylElem& SphylElem : AggGeom.SphylElems)
+		{
+			const FVector Extent(SphylElem.Radius, SphylElem.Radius, (SphylElem.Length * 0.5f) + SphylElem.Radius);
+			LightDetection::AppendBoxTriangles(MakeOccluderBox(Transform, SphylElem.Rotation, SphylElem.Center, Extent), Triangles);
+		}
+		for (const FKConvexElem& ConvexElem : AggGeom.ConvexElems)
+		{
+			const FTransform ElemTransform = ConvexElem.GetTransform() * Transform;
+			if (ConvexElem.IndexData.Num() < 3)
+			{
+				LightDetection::AppendBoxTriangles(MakeOccluderBox(ElemTransform, FRotator::ZeroRotator, ConvexElem.ElemBox.GetCenter(), ConvexElem.ElemBox.GetExtent()), Triangles);
+				continue;
+			}
+			for (int32 Index = 0; Index + 2 < ConvexElem.IndexData.Num(); Index += 3)
+			{
+				Triangles.push_back(LightDetection::MakeOccluderTriangle(
+					ToCoreVector(ElemTransform.TransformPosition(ConvexElem.VertexData[ConvexElem.IndexData[Index]])),
+					ToCoreVector(ElemTransform.TransformPosition(ConvexElem.VertexData[ConvexElem.IndexData[Index + 1]])),
+					ToCoreVector(ElemTransform.TransformPosition(ConvexElem.VertexData[ConvexElem.IndexData[Index + 2]]))));
+			}
+		}
+	}
+
+	// True if the component blocks the trace channel light detection traces on
+	static bool IsLightBlocking(const UPrimitiveComponent* Component, ECollisionChannel TraceChannel)
+	{
+		return Component->IsQueryCollisionEnabled() && Component->GetCollisionResponseToChannel(TraceChannel) == ECollisionResponse::ECR_Block;
+	}
+
+	void GatherOccluders(UWorld* World, ECollisionChannel TraceChannel, std::vector<LightDetection::OccluderTriangle>& OutTriangles,
+		TArray<TWeakObjectPtr<UPrimitiveComponent>>& OutDynamicOccluders)
+	{
+		OutTriangles.clear();
+		OutDynamicOccluders.Reset();
+
+		for (TActorIterator<AActor> ActorItr(World); ActorItr; ++ActorItr)
+		{
+			// Pawns move every frame and the player's own collision must never occlude their detection point
+			AActor* Actor = *ActorItr;
+			if (Actor->IsA<APawn>())
+			{
+				continue;
+			}
+
+			TInlineComponentArray<UPrimitiveComponent*> Components(Actor);
+			for (UPrimitiveComponent* Component : Components)
+			{
+				if (!IsLightBlocking(Component, TraceChannel))
+				{
+					continue;
+				}
+
+				if (Component->Mobility == EComponentMobility::Movable)
+				{
+					OutDynamicOccluders.Add(Component);
+					continue;
+				}
+
+				const UBodySetup* BodySetup = Component->GetBodySetup();
+				if (!BodySetup)
+				{
+					continue;
+				}
+
+				// Instanced meshes share one body between every instance
+				if (const UInstancedStaticMeshComponent* InstancedComponent = Cast<UInstancedStaticMeshComponent>(Component))
+				{
+					for (int32 InstanceIdx = 0; InstanceIdx < InstancedComponent->GetInstanceCount(); InstanceIdx++)
+					{
+						FTransform InstanceTransform;
+						if (InstancedComponent->GetInstanceTransform(InstanceIdx, InstanceTransform, true))
+						{
+							AppendBodyTriangles(BodySetup, InstanceTransform, OutTriangles);
+						}
+					}
+				}
+				else
+				{
+					AppendBodyTriangles(BodySetup, Component->GetComponentTransform(), OutTriangles);
+				}
+			}
+		}
+	}
+
+	void GatherDynamicOccluders(AActor* Actor, ECollisionChannel TraceChannel, TArray<TWeakObjectPtr<UPrimitiveComponent>>& DynamicOccluders)
+	{
+		if (!IsValid(Actor) || Actor->IsA<APawn>())
+		{
+			return;
+		}
+
+		TInlineComponentArray<UPrimitiveComponent*> Components(Actor);
+		for (UPrimitiveComponent* Component : Components)
+		{
+			if (Component->Mobility == EComponentMobility::Movable && IsLightBlocking(Component, TraceChannel))
+			{
+				DynamicOccluders.AddUnique(Component);
+			}
+		}
+	}
+
+	void BuildOccluderScene(UWorld* World, ECollisionChannel TraceChannel, LightDetection::OccluderScene& Occluders, TArray<TWeakObjectPtr<UPrimitiveComponent>>& OutDynamicOccluders)
+	{
+		std::vector<LightDetection::OccluderTriangle> Triangles;
+		GatherOccluders(World, TraceChannel, Triangles, OutDynamicOccluders);
+		Occluders.Static.Build(MoveTemp(Triangles));
+		UpdateDynamicOccluders(OutDynamicOccluders, Occluders);
+	}
+
+	void UpdateDynamicOccluders(TArray<TWeakObjectPtr<UPrimitiveComponent>>& DynamicOccluders, LightDetection::OccluderScene& Occluders)
+	{
+		DynamicOccluders.RemoveAll([](const TWeakObjectPtr<UPrimitiveComponent>& Component) { return !Component.IsValid(); });
+
+		Occluders.Dynamic.resize(DynamicOccluders.Num());
+		for (int idx = 0; idx < DynamicOccluders.Num(); idx++)
+		{
+			const FBox LocalBounds = DynamicOccluders[idx]->CalcBounds(FTransform::Identity).GetBox();
+			Occluders.Dynamic[idx] = MakeOccluderBox(DynamicOccluders[idx]->GetComponentTransform(), FRotator::ZeroRotator, LocalBounds.GetCenter(), LocalBounds.GetExtent());
+		}
+	}
+
+	void BuildTransmissionTable(const TMap<TEnumAsByte<EPhysicalSurface>, float>& SurfaceTransmittance, float MinTransmittance, TransmissionTable& OutTable)
+	{
+		for (float& Transmittance : OutTable.SurfaceTransmittance)
+		{
+			Transmittance = 1.0f;
+		}
+		for (const TPair<TEnumAsByte<EPhysicalSurface>, float>& Surface : SurfaceTransmittance)
+		{
+			OutTable.SurfaceTransmittance[Surface.Key.GetValue()] = FMath::Clamp(Surface.Value, 0.0f, 1.0f);
+		}
+		OutTable.MinTransmittance = MinTransmittance;
+	}
+
+	void EvaluatePointsParallel(const UWorld* World, const LightDetection::LightScene& Scene, int32 PointCount, TFunctionRef<FVector(int32)> GetPoint,
+		bool bSkipOcclusion, TArray<float>& OutIlluminance, ParallelDetectionTotals& OutTotals)
+	{
+		// The number of points each parallel task evaluates
+		constexpr int32 PointsPerBatch = 1024;
+
+		OutIlluminance.SetNumZeroed(PointCount);
+		const int32 BatchCount = FMath::DivideAndRoundUp(PointCount, PointsPerBatch);
+		TArray<LightDetection::DetectionCounters> BatchCounters;
+		BatchCounters.SetNum(BatchCount);
+		// Nothing is waiting on the result, so every point light in range may be traced
+		LightDetection::DetectionSettings Settings;
+		Settings.MaxPointLightTraces = TNumericLimits<int32>::Max();
+
+		// Each task has its own occlusion query and counters so nothing is shared between threads
+		ParallelFor(BatchCount, [&](int32 BatchIdx)
+		{
+			FLightTraceOcclusionQuery TraceOcclusion(World, ECollisionChannel::ECC_GameTraceChannel5);
+			LightDetection::NoOcclusionQuery NoOcclusion;
+			LightDetection::IOcclusionQuery& Occlusion = bSkipOcclusion ? static_cast<LightDetection::IOcclusionQuery&>(NoOcclusion) : TraceOcclusion;
+			LightDetection::LightCandidates Candidates;
+
+			const int32 FirstPoint = BatchIdx * PointsPerBatch;
+			const int32 LastPoint = FMath::Min(FirstPoint + PointsPerBatch, PointCount);
+			for (int32 PointIdx = FirstPoint; PointIdx < LastPoint; PointIdx++)
+			{
+				OutIlluminance[PointIdx] = LightDetection::EvaluateDetectionUpdate(Scene, ToCoreVector(GetPoint(PointIdx)), Settings, Occlusion, nullptr, BatchCounters[BatchIdx], Candidates);
+			}
+		});
+
+		for (const LightDetection::DetectionCounters& Counters : BatchCounters)
+		{
+			OutTotals.LightsTested += Counters.LightsTested;
+			OutTotals.LightsCulled += Counters.LightsCulled;
+			OutTotals.TracesIssued += Counters.TracesIssued;
+		}
+	}
+}
+
+FLightTraceOcclusionQuery::FLightTraceOcclusionQuery(const UWorld* InWorld, ECollisionChannel InTraceChannel, LightDetection::RecordingWriter* InRecorder,
+	LightDetection::IOcclusionQuery* InBackend)
+	: World(InWorld)
+	, TraceChannel(InTraceChannel)
+	, Recorder(InRecorder)
+	, Backend(InBackend)
+{
+}
+
+bool FLightTraceOcclusionQuery::IsOccluded(const LightDetection::Vector3& From, const LightDetection::Vector3& To)
+{
+	LIGHT_DETECTION_SCOPE(SceneQuery);
+
+	const bool bOccluded = Backend ? Backend->IsOccluded(From, To)
+		: World->LineTraceSingleByChannel(LastHitResult, LightDetectionAdapter::ToFVector(From), LightDetectionAdapter::ToFVector(To), TraceChannel);
+	if (Recorder)
+	{
+		Recorder->RecordTrace(From, To, bOccluded ? 0.0f : 1.0f);
+	}
+	return bOccluded;
+}
+
+void FLightTraceOcclusionQuery::AreOccluded(const LightDetection::Vector3& From, const LightDetection::Vector3* To, int32_t Count, bool* bOutOccluded)
+{
+	if (!Backend)
+	{
+		LightDetection::IOcclusionQuery::AreOccluded(From, To, Count, bOutOccluded);
+		return;
+	}
+
+	LIGHT_DETECTION_SCOPE(SceneQuery);
+
+	Backend->AreOccluded(From, To, Count, bOutOccluded);
+	if (Recorder)
+	{
+		for (int32 idx = 0; idx < Count; idx++)
+		{
+			Recorder->RecordTrace(From, To[idx], bOutOccluded[idx] ? 0.0f : 1.0f);
+		}
+	}
+}
+
+/// <summary>
+/// GetTransmittance() traces through every surface that overlaps the trace channel, such as foliage or glass, up to the first surface that blocks
+/// it. The hits come back nearest first, and the light is attenuated by each one's surface type in turn until it is blocked or so little gets
+/// through that it is treated as blocked. Overlapping surfaces are not part of a single hit trace at all, so when there are none this costs the
+/// same as IsOccluded() plus reading back the hits.
+/// </summary>
+float FLightTraceOcclusionQuery::GetTransmittance(const LightDetection::Vector3& From, const LightDetection::Vector3& To)
+{
+	if (Backend || !Transmission)
+	{
+		return IsOccluded(From, To) ? 0.0f : 1.0f;
+	}
+
+	LIGHT_DETECTION_SCOPE(SceneQuery);
+
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(LightDetectionTransmission));
+	QueryParams.bReturnPhysicalMaterial = true;
+	World->LineTraceMultiByChannel(TransmissionHits, LightDetectionAdapter::ToFVector(From), LightDetectionAdapter::ToFVector(To), TraceChannel, QueryParams);
+
+	float Transmittance = 1.0f;
+	for (const FHitResult& Hit : TransmissionHits)
+	{
+		Transmittance = Hit.bBlockingHit ? 0.0f : Transmittance * Transmission->SurfaceTransmittance[UPhysicalMaterial::DetermineSurfaceType(Hit.PhysMaterial.Get())];
+		if (Transmittance <= Transmission->MinTransmittance)
+		{
+			LastHitResult = Hit;
+			Transmittance = 0.0f;
+			break;
+		}
+	}
+
+	if (Recorder)
+	{
+		Recorder->RecordTrace(From, To, Transmittance);
+	}
+	return Transmittance;
+}
@@ -0,0 +1,143 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+#include "CoreMinimal.h"
+#include "Engine/EngineTypes.h"
+#include "LightDetectionCore/Public/LightDetectionCells.h"
+#include "LightDetectionCore/Public/LightDetectionClusters.h"
+#include "LightDetectionCore/Public/LightDetectionKernels.h"
+#include "LightDetectionCore/Public/LightDetectionLightTree.h"
+#include "LightDetectionCore/Public/LightDetectionOccluders.h"
+#include "LightDetectionCore/Public/LightDetectionRecording.h"
+#include "LightDetectionCore/Public/LightDetectionReplication.h"
+#include "LightDetectionCore/Public/LightDetectionVoxels.h"
+
+// Forward Declarations
+class UWorld;
+class AActor;
+class UPointLightComponent;
+class USpotLightComponent;
+class URectLightComponent;
+class UDirectionalLightComponent;
+class UPrimitiveComponent;
+
+/// <summary>
+/// Conversions between engine types and the plain data the engine-independent light detection core works on. Lights are snapshotted into
+/// the core's structs whenever they are about to be evaluated, so the core never touches a UObject.
+/// </summary>
+namespace LightDetectionAdapter
+{
+	FORCEINLINE LightDetection::Vector3 ToCoreVector(const FVector& Vector)
+	{
+		return LightDetection::Vector3(static_cast<float>(Vector.X), static_cast<float>(Vector.Y), static_cast<float>(Vector.Z));
+	}
+
+	FORCEINLINE FVector ToFVector(const LightDetection::Vector3& Vector)
+	{
+		return FVector(Vector.X, Vector.Y, Vector.Z);
+	}
+
+	LightDetection::PointLightData MakePointLightData(const UPointLightComponent* PointLight);
+	LightDetection::SpotLightData MakeSpotLightData(const USpotLightComponent* SpotLight);
+	LightDetection::RectLightData MakeRectLightData(const URectLightComponent* RectLight);
+	LightDetection::DirectionalLightData MakeDirectionalLightData(const UDirectionalLightComponent* DirectionalLight);
+
+	// Finds the light components of every actor in the world tagged as a point or spot light, this is how lights are registered for detection.
+	// Actors tagged as a rect light are only gathered if RectLights is given, for the callers that evaluate rect lights
+	void GatherTaggedLights(UWorld* World, TArray<UPointLightComponent*>& PointLights, TArray<USpotLightComponent*>& SpotLights,
+		TArray<URectLightComponent*>* RectLights = nullptr);
+
+	// Snapshots every light into the scene, index aligned with the light arrays, and calculates the rect light frustums
+	void SnapshotLightScene(const TArray<UPointLightComponent*>& PointLights, const TArray<USpotLightComponent*>& SpotLights,
+		const TArray<URectLightComponent*>& RectLights, const UDirectionalLightComponent* DirectionalLight, LightDetection::LightScene& Scene);
+
+	// Clusters the point lights that cannot move, the scene must already hold their snapshots. Movable lights are left unclustered, since a
+	// light that moved out of its cluster's bounds could be missed
+	void BuildLightClusters(const TArray<UPointLightComponent*>& PointLights, const LightDetection::LightScene& Scene, float ClusterSize, LightDetection::PointLightClusters& OutClusters);
+
+	// Builds the light cells from every ALightDetectionCellVolume in the world, joined by every ALightDetectionPortalVolume, and puts the lights
+	// that cannot move into the cells they are in. The scene must already hold the lights' snapshots
+	void BuildLightCells(UWorld* World, const TArray<UPointLightComponent*>& PointLights, const TArray<USpotLightComponent*>& SpotLights, const LightDetection::LightScene& Scene,
+		LightDetection::LightCellScene& OutCells);
+
+	// An oriented box for a box in the space of Transform, rotated by LocalRotation about LocalCenter. Exact unless Transform has a non-uniform
+	// scale that LocalRotation is not aligned with, which would shear the box, then it is approximated by a box with the same stretched axes
+	LightDetection::OccluderBox MakeOccluderBox(const FTransform& Transform, const FRotator& LocalRotation, const FVector& LocalCenter, const FVector& LocalExtent);
+
+	// Finds every component in the world that blocks TraceChannel. Static and stationary components have their simple collision shapes added
+	// to OutTriangles, movable components are returned in OutDynamicOccluders to be approximated by their bounds. Pawns are never occluders
+	void GatherOccluders(UWorld* World, ECollisionChannel TraceChannel, std::vector<LightDetection::OccluderTriangle>& OutTriangles,
+		TArray<TWeakObjectPtr<UPrimitiveComponent>>& OutDynamicOccluders);
+
+	// Adds the movable components of one actor that block TraceChannel to DynamicOccluders, for actors that appear after the occluders were
+	// gathered. Components already in DynamicOccluders are not added again
+	void GatherDynamicOccluders(AActor* Actor, ECollisionChannel TraceChannel, TArray<TWeakObjectPtr<UPrimitiveComponent>>& DynamicOccluders);
+
+	// Builds the occluder scene's hierarchy from the triangles GatherOccluders() finds, and its dynamic occluders from the movable components,
+	// which UpdateDynamicOccluders() then keeps up to date
+	void BuildOccluderScene(UWorld* World, ECollisionChannel TraceChannel, LightDetection::OccluderScene& Occluders, TArray<TWeakObjectPtr<UPrimitiveComponent>>& OutDynamicOccluders);
+
+	// Moves the occluder scene's dynamic occluders to their components' current transforms, dropping any component that has been destroyed
+	void UpdateDynamicOccluders(TArray<TWeakObjectPtr<UPrimitiveComponent>>& DynamicOccluders, LightDetection::OccluderScene& Occluders);
+
+	// How much light passes through each physical surface type, so a hit's transmittance is found by indexing with its surface type rather than
+	// by looking at its material. Surfaces that block the trace channel block all light, this only applies to surfaces that overlap it
+	struct TransmissionTable
+	{
+		float SurfaceTransmittance[SurfaceType_Max];
+		// Once less than this fraction of the light gets through, it is treated as fully occluded and no further hits are considered
+		float MinTransmittance = 0.0f;
+	};
+
+	// Fills the table from per surface transmittances, surfaces not listed let all light through
+	void BuildTransmissionTable(const TMap<TEnumAsByte<EPhysicalSurface>, float>& SurfaceTransmittance, float MinTransmittance, TransmissionTable& OutTable);
+
+	// The work done by EvaluatePointsParallel(), totalled in 64 bits as large point sets test more lights than a single update's counters can hold
+	struct ParallelDetectionTotals
+	{
+		int64 LightsTested = 0;
+		int64 LightsCulled = 0;
+		int64 TracesIssued = 0;
+	};
+
+	// Evaluates detection at PointCount points in parallel batches, OutIlluminance is index aligned with the points. Each batch traces against
+	// the world with its own occlusion query unless bSkipOcclusion is set, so this must only be called while the world is not being modified
+	void EvaluatePointsParallel(const UWorld* World, const LightDetection::LightScene& Scene, int32 PointCount, TFunctionRef<FVector(int32)> GetPoint,
+		bool bSkipOcclusion, TArray<float>& OutIlluminance, ParallelDetectionTotals& OutTotals);
+}
+
+/// <summary>
+/// FLightTraceOcclusionQuery answers the core's occlusion queries with single line traces against the physics scene on the given channel.
+/// The hit result of the last blocked trace is kept so debug output can report what was in the way. If a recorder is given, every answer is
+/// also written to the session recording so it can be replayed without the physics scene. If a backend is given, such as an occluder scene,
+/// queries are answered by it instead of the physics scene and there is no hit result. If a transmission table is set, transmittance queries
+/// trace through every overlapping surface up to the first blocking hit and attenuate the light by each surface they pass.
+/// </summary>
+class FLightTraceOcclusionQuery final : public LightDetection::IOcclusionQuery
+{
+public:
+
+	FLightTraceOcclusionQuery(const UWorld* InWorld, ECollisionChannel InTraceChannel, LightDetection::RecordingWriter* InRecorder = nullptr,
+		LightDetection::IOcclusionQuery* InBackend = nullptr);
+
+	virtual bool IsOccluded(const LightDetection::Vector3& From, const LightDetection::Vector3& To) override;
+	// Batched through the backend if there is one, the physics scene has no batched line trace so each segment is traced on its own
+	virtual void AreOccluded(const LightDetection::Vector3& From, const LightDetection::Vector3* To, int32_t Count, bool* bOutOccluded) override;
+	virtual float GetTransmittance(const LightDetection::Vector3& From, const LightDetection::Vector3& To) override;
+
+	// The table must outlive the query, without one or with a backend set every occluder blocks all of the light
+	void SetTransmission(const LightDetectionAdapter::TransmissionTable* InTransmission) { Transmission = InTransmission; }
+
+	const FHitResult& GetLastHitResult() const { return LastHitResult; }
+
+private:
+
+	const UWorld* World;
+	ECollisionChannel TraceChannel;
+	LightDetection::RecordingWriter* Recorder;
+	LightDetection::IOcclusionQuery* Backend;
+	const LightDetectionAdapter::TransmissionTable* Transmission = nullptr;
+	FHitResult LastHitResult;
+	// Reused by transmittance traces so they do not allocate
+	TArray<FHitResult> TransmissionHits;
+};
@@ -0,0 +1,28 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+#include "CoreMinimal.h"
+#include "Engine/Engine.h"
+
+// Light detection debug output is compiled in for development builds only, Shipping and Test builds strip it out entirely
+#ifndef LIGHT_DETECTION_DEBUG
+	#define LIGHT_DETECTION_DEBUG !(UE_BUILD_SHIPPING || UE_BUILD_TEST)
+#endif
+
+#if LIGHT_DETECTION_DEBUG
+
+// Prints an on-screen message when the given debug flag is set, the message is only formatted when it is going to be shown
+#define LIGHT_DETECTION_DEBUG_MESSAGE(bDebugFlag, Key, Duration, Color, Format, ...) \
+	do \
+	{ \
+		if ((bDebugFlag) && GEngine) \
+		{ \
+			GEngine->AddOnScreenDebugMessage(Key, Duration, Color, FString::Printf(Format, ##__VA_ARGS__)); \
+		} \
+	} while (0)
+
+#else
+
+#define LIGHT_DETECTION_DEBUG_MESSAGE(bDebugFlag, Key, Duration, Color, Format, ...) do { } while (0)
+
+#endif
@@ -0,0 +1,245 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "LightDetectionHeatmapCommandlet.h"
+#include "EngineUtils.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryWriter.h"
+#include "NavMesh/RecastNavMesh.h"
+#include "Components/PointLightComponent.h"
+#include "Components/SpotLightComponent.h"
+#include "Components/RectLightComponent.h"
+#include "LightDetectionCoreAdapter.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogLightDetectionHeatmap, Log, All);
+
+namespace
+{
+	// Heatmap layout, little endian: "LDHM", uint32 version, uint8 layout, the summary stats, then the samples for the layout
+	// Grid: float3 first cell centre, float cell size, int32 cell counts along X, Y and Z, then one float per cell with X varying fastest
+	// Points: int32 sample count, then a float3 position and a float illuminance per sample
+	constexpr uint32 HeatmapVersion = 1;
+	enum class EHeatmapLayout : uint8
+	{
+		Grid = 0,
+		Points = 1
+	};
+
+	struct HeatmapSummary
+	{
+		int32 SampleCount = 0;
+		int32 LitCount = 0;
+		float MinIlluminance = 0.0f;
+		float MaxIlluminance = 0.0f;
+		float MeanIlluminance = 0.0f;
+	};
+
+	// Every point the lights can reach is inside the union of their ranges
+	FBox GetLightInfluenceBounds(const LightDetection::LightScene& Scene)
+	{
+		FBox Bounds(ForceInit);
+		for (const LightDetection::PointLightData& PointLight : Scene.PointLights)
+		{
+			Bounds += FBox::BuildAABB(LightDetectionAdapter::ToFVector(PointLight.Position), FVector(PointLight.AttenuationRadius));
+		}
+		for (const LightDetection::SpotLightData& SpotLight : Scene.SpotLights)
+		{
+			Bounds += FBox::BuildAABB(LightDetectionAdapter::ToFVector(SpotLight.Position), FVector(SpotLight.AttenuationRadius));
+		}
+		for (const LightDetection::RectLightData& RectLight : Scene.RectLights)
+		{
+			Bounds += FBox::BuildAABB(LightDetectionAdapter::ToFVector(RectLight.Position), FVector(RectLight.AttenuationRadius));
+		}
+		return Bounds;
+	}
+}
+
+ULightDetectionHeatmapCommandlet::ULightDetectionHeatmapCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = true;
+	LogToConsole = true;
+	ShowErrorCount = true;
+}
+
+int32 ULightDetectionHeatmapCommandlet::Main(const FString& Params)
+{
+	FString MapName;
+	if (!FParse::Value(*Params, TEXT("Map="), MapName))
+	{
+		UE_LOG(LogLightDetectionHeatmap, Error, TEXT("Usage: -run=LightDetectionHeatmap -Map=/Game/Maps/Level [-CellSize=100] [-NavMesh] [-Height=10] [-NoOcclusion] [-MaxSamples=N] [-Output=Path.ldhm]"));
+		return 1;
+	}
+
+	float CellSize = 100.0f;
+	float Height = 10.0f;
+	int32 MaxSamples = 16 * 1024 * 1024;
+	FString OutputPath = FPaths::ProfilingDir() / TEXT("LightDetection") / FString::Printf(TEXT("%s_Heatmap.ldhm"), *FPaths::GetBaseFilename(MapName));
+	FParse::Value(*Params, TEXT("CellSize="), CellSize);
+	FParse::Value(*Params, TEXT("Height="), Height);
+	FParse::Value(*Params, TEXT("MaxSamples="), MaxSamples);
+	FParse::Value(*Params, TEXT("Output="), OutputPath);
+	const bool bNavMeshSamples = FParse::Param(*Params, TEXT("NavMesh"));
+	const bool bSkipOcclusion = FParse::Param(*Params, TEXT("NoOcclusion"));
+	CellSize = FMath::Max(CellSize, 1.0f);
+
+	// Load the map and bring its world up far enough for line traces to work, nothing in it is ticked or begun play
+	UPackage* MapPackage = LoadPackage(nullptr, *MapName, LOAD_None);
+	UWorld* World = MapPackage ? UWorld::FindWorldInPackage(MapPackage) : nullptr;
+	if (!World)
+	{
+		UE_LOG(LogLightDetectionHeatmap, Error, TEXT("Could not load map %s"), *MapName);
+		return 1;
+	}
+	World->AddToRoot();
+	World->WorldType = EWorldType::Editor;
+	FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Editor);
+	WorldContext.SetCurrentWorld(World);
+	World->InitWorld(UWorld::InitializationValues()
+		.AllowAudioPlayback(false)
+		.RequiresHitProxies(false)
+		.CreatePhysicsScene(true)
+		.CreateNavigation(false)
+		.CreateAISystem(false)
+		.ShouldSimulatePhysics(false)
+		.EnableTraceCollision(true)
+		.SetTransactional(false)
+		.CreateFXSystem(false));
+	World->UpdateWorldComponents(true, false);
+	World->FlushLevelStreaming(EFlushLevelStreamingType::Full);
+
+	// Register the lights exactly like the detection manager does
+	TArray<UPointLightComponent*> PointLights;
+	TArray<USpotLightComponent*> SpotLights;
+	TArray<URectLightComponent*> RectLights;
+	LightDetection::LightScene Scene;
+	LightDetectionAdapter::GatherTaggedLights(World, PointLights, SpotLights);
+	LightDetectionAdapter::SnapshotLightScene(PointLights, SpotLights, RectLights, nullptr, Scene);
+	UE_LOG(LogLightDetectionHeatmap, Display, TEXT("%s: %d point lights, %d spot lights"), *MapName, PointLights.Num(), SpotLights.Num());
+
+	// Gather the sample points, either the centre of every navmesh polygon raised to the detection height, or the cells of a grid over the lights
+	TArray<FVector> NavMeshPoints;
+	FBox GridBounds(ForceInit);
+	FIntVector GridCounts(0, 0, 0);
+	int32 SampleCount = 0;
+	if (bNavMeshSamples)
+	{
+		// The navmesh's tiles are loaded with the level, so they can be read without building navigation
+		for (TActorIterator<ARecastNavMesh> NavMeshItr(World); NavMeshItr; ++NavMeshItr)
+		{
+			TArray<FNavPoly> Polys;
+			for (int32 TileIdx = 0; TileIdx < NavMeshItr->GetNavMeshTilesCount(); TileIdx++)
+			{
+				Polys.Reset();
+				NavMeshItr->GetPolysInTile(TileIdx, Polys);
+				for (const FNavPoly& Poly : Polys)
+				{
+					NavMeshPoints.Add(Poly.Center + (Height * FVector::UpVector));
+				}
+			}
+		}
+		SampleCount = NavMeshPoints.Num();
+	}
+	else
+	{
+		GridBounds = GetLightInfluenceBounds(Scene);
+		if (GridBounds.IsValid)
+		{
+			const FVector GridSize = GridBounds.GetSize();
+			GridCounts = FIntVector(FMath::CeilToInt(GridSize.X / CellSize), FMath::CeilToInt(GridSize.Y / CellSize), FMath::CeilToInt(GridSize.Z / CellSize));
+			const int64 GridSampleCount = int64(FMath::Max(GridCounts.X, 1)) * FMath::Max(GridCounts.Y, 1) * FMath::Max(GridCounts.Z, 1);
+			if (GridSampleCount > MaxSamples)
+			{
+				UE_LOG(LogLightDetectionHeatmap, Error, TEXT("A %d x %d x %d grid is more than %d samples, increase -CellSize or -MaxSamples"), GridCounts.X, GridCounts.Y, GridCounts.Z, MaxSamples);
+				GEngine->DestroyWorldContext(World);
+				World->DestroyWorld(false);
+				World->RemoveFromRoot();
+				return 1;
+			}
+			GridCounts = FIntVector(FMath::Max(GridCounts.X, 1), FMath::Max(GridCounts.Y, 1), FMath::Max(GridCounts.Z, 1));
+			SampleCount = static_cast<int32>(GridSampleCount);
+		}
+	}
+	const FVector FirstCellCentre = GridBounds.IsValid ? GridBounds.Min + FVector(CellSize * 0.5f) : FVector::ZeroVector;
+
+	auto GetSamplePoint = [&](int32 SampleIdx) -> FVector
+	{
+		if (bNavMeshSamples)
+		{
+			return NavMeshPoints[SampleIdx];
+		}
+		const int32 CellX = SampleIdx % GridCounts.X;
+		const int32 CellY = (SampleIdx / GridCounts.X) % GridCounts.Y;
+		const int32 CellZ = SampleIdx / (GridCounts.X * GridCounts.Y);
+		return FirstCellCentre + (FVector(CellX, CellY, CellZ) * CellSize);
+	};
+
+	// Evaluate every sample in parallel
+	TArray<float> Illuminance;
+	LightDetectionAdapter::ParallelDetectionTotals Totals;
+	const double StartTime = FPlatformTime::Seconds();
+	LightDetectionAdapter::EvaluatePointsParallel(World, Scene, SampleCount, GetSamplePoint, bSkipOcclusion, Illuminance, Totals);
+	const double ElapsedSeconds = FPlatformTime::Seconds() - StartTime;
+
+	HeatmapSummary Summary;
+	Summary.SampleCount = SampleCount;
+	if (SampleCount > 0)
+	{
+		double IlluminanceSum = 0.0;
+		Summary.MinIlluminance = TNumericLimits<float>::Max();
+		Summary.MaxIlluminance = TNumericLimits<float>::Lowest();
+		for (float SampleIlluminance : Illuminance)
+		{
+			Summary.LitCount += SampleIlluminance > 0.0f;
+			Summary.MinIlluminance = FMath::Min(Summary.MinIlluminance, SampleIlluminance);
+			Summary.MaxIlluminance = FMath::Max(Summary.MaxIlluminance, SampleIlluminance);
+			IlluminanceSum += SampleIlluminance;
+		}
+		Summary.MeanIlluminance = static_cast<float>(IlluminanceSum / SampleCount);
+	}
+
+	// Write the heatmap
+	TArray<uint8> HeatmapData;
+	FMemoryWriter Writer(HeatmapData);
+	uint8 Magic[4] = { 'L', 'D', 'H', 'M' };
+	Writer.Serialize(Magic, sizeof(Magic));
+	uint32 Version = HeatmapVersion;
+	uint8 Layout = static_cast<uint8>(bNavMeshSamples ? EHeatmapLayout::Points : EHeatmapLayout::Grid);
+	Writer << Version << Layout;
+	Writer << Summary.SampleCount << Summary.LitCount << Summary.MinIlluminance << Summary.MaxIlluminance << Summary.MeanIlluminance;
+	if (bNavMeshSamples)
+	{
+		Writer << SampleCount;
+		for (int32 SampleIdx = 0; SampleIdx < SampleCount; SampleIdx++)
+		{
+			FVector3f Point(NavMeshPoints[SampleIdx]);
+			Writer << Point << Illuminance[SampleIdx];
+		}
+	}
+	else
+	{
+		FVector3f GridOrigin(FirstCellCentre);
+		Writer << GridOrigin << CellSize << GridCounts.X << GridCounts.Y << GridCounts.Z;
+		Writer.Serialize(Illuminance.GetData(), Illuminance.Num() * sizeof(float));
+	}
+	const bool bSaved = FFileHelper::SaveArrayToFile(HeatmapData, *OutputPath);
+
+	const double SamplesPerSecond = ElapsedSeconds > 0.0 ? SampleCount / ElapsedSeconds : 0.0;
+	UE_LOG(LogLightDetectionHeatmap, Display, TEXT("Samples: %d (%s), lit: %d (%.1f%%)"), SampleCount, bNavMeshSamples ? TEXT("navmesh") : TEXT("grid"),
+		Summary.LitCount, SampleCount > 0 ? 100.0f * Summary.LitCount / SampleCount : 0.0f);
+	UE_LOG(LogLightDetectionHeatmap, Display, TEXT("Illuminance min: %f, max: %f, mean: %f"), Summary.MinIlluminance, Summary.MaxIlluminance, Summary.MeanIlluminance);
+	UE_LOG(LogLightDetectionHeatmap, Display, TEXT("Lights tested: %lld, culled: %lld, traces issued: %lld%s"), Totals.LightsTested, Totals.LightsCulled,
+		Totals.TracesIssued, bSkipOcclusion ? TEXT(" (occlusion skipped)") : TEXT(""));
+	UE_LOG(LogLightDetectionHeatmap, Display, TEXT("Evaluated in %.3f s, %.0f samples/s, %.1f ns/light"), ElapsedSeconds, SamplesPerSecond,
+		Totals.LightsTested > 0 ? ElapsedSeconds * 1.e9 / Totals.LightsTested : 0.0);
+	UE_LOG(LogLightDetectionHeatmap, Display, TEXT("Heatmap %s %s"), bSaved ? TEXT("written to") : TEXT("could not be written to"), *OutputPath);
+
+	GEngine->DestroyWorldContext(World);
+	World->DestroyWorld(false);
+	World->RemoveFromRoot();
+
+	return bSaved ? 0 : 1;
+}
@@ -0,0 +1,28 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "LightDetectionHeatmapCommandlet.generated.h"
+
+/// <summary>
+/// ULightDetectionHeatmapCommandlet loads a map headlessly, registers its lights the same way ALightDetectionManager::BeginPlay() does, and
+/// evaluates light detection over a dense grid covering every light's range, or over the centre of every navmesh polygon, in parallel. The
+/// result is written as a binary heatmap along with summary stats, so dark spots can be found without walking the level, and the run doubles
+/// as a large scale throughput benchmark for the detection code.
+///
+/// Usage: UnrealEditor-Cmd Project.uproject -run=LightDetectionHeatmap -Map=/Game/Maps/Level -nullrhi
+///        [-CellSize=100] [-NavMesh] [-Height=10] [-NoOcclusion] [-MaxSamples=16777216] [-Output=Path.ldhm]
+/// </summary>
+UCLASS()
+class PLANET_NINEMP_API ULightDetectionHeatmapCommandlet : public UCommandlet
+{
+
+	GENERATED_BODY()
+
+public:
+
+	ULightDetectionHeatmapCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
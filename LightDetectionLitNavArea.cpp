@@ -0,0 +1,10 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "LightDetectionLitNavArea.h"
+
+ULightDetectionLitNavArea::ULightDetectionLitNavArea()
+{
+	// Lit ground is still walkable, but paths prefer to go around it
+	DefaultCost = 10.0f;
+	DrawColor = FColor(255, 220, 80);
+}
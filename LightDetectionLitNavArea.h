@@ -0,0 +1,22 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+#include "CoreMinimal.h"
+#include "NavAreas/NavArea.h"
+#include "LightDetectionLitNavArea.generated.h"
+
+/// <summary>
+/// ULightDetectionLitNavArea marks navmesh polygons that light detection found to be lit. ULightDetectionNavBakerComponent moves polygons in
+/// and out of this area as lights change, so AI path queries weigh lit ground by its cost without doing any detection work themselves.
+/// Query filters can override the cost, or exclude the area entirely, for AI that should only move through the dark.
+/// </summary>
+UCLASS(Config = Engine)
+class PLANET_NINEMP_API ULightDetectionLitNavArea : public UNavArea
+{
+
+	GENERATED_BODY()
+
+public:
+
+	ULightDetectionLitNavArea();
+};
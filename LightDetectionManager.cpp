@@ -1,399 +1,1514 @@
-// Fill out your copyright notice in the Description page of Project Settings.
-
-#include "LightDetectionManager.h"
-#include <cmath>
-#include "EngineUtils.h"
-#include "Containers/Array.h"
-#include "DrawDebugHelpers.h"
-#include "Kismet/GameplayStatics.h"
-#include "Components/PointLightComponent.h"
-#include "Components/SpotLightComponent.h"
-#include "Components/RectLightComponent.h"
-#include "Components/DirectionalLightComponent.h"
-#include "Math/Plane.h"
-
-// Sets default values
-ALightDetectionManager::ALightDetectionManager()
-{
- 	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
-	PrimaryActorTick.bCanEverTick = true;
-}
-
-/// <summary>
-/// BeginPlay() first calls the base class BeginPlay(), and then will store a reference to the player character using the UGameplayStatistics class.
-/// The function then iterates through all active objects in the scene and stores actors tagged with Spot Light, Point Light or Rect Light into their
-/// respective TArrays, and then finally initialises the UpdateTimer as the inverse of whatever the UpdateFrequency has been set to in editor.
-/// </summary>
-void ALightDetectionManager::BeginPlay()
-{
-	Super::BeginPlay();
-	
-	// Store a reference to the player character by attempting to cast it from the base ACharacter class into its player character child class
-	Player = dynamic_cast<APlanet_NineMPCharacter*>(UGameplayStatics::GetPlayerCharacter(GetWorld(), 0));
-
-	// Iterate through all actors in the scene, checking for point, spot, and rect light tags
-	for (TActorIterator<AActor> ActorItr(GetWorld()); ActorItr; ++ActorItr)
-	{
-		AActor* Actor = *ActorItr;
-
-		// If the actor is tagged as a point, spot, or rect light, add a reference of it to it's respective array
-		if (Actor->ActorHasTag(TEXT("Point Light")))
-		{
-			UPointLightComponent* PointLightComponent = Actor->FindComponentByClass<UPointLightComponent>();
-			if (PointLightComponent)
-			{
-				PointLights.Add(PointLightComponent);
-				continue;
-			}
-		}
-		else if (Actor->ActorHasTag(TEXT("Spot Light")))
-		{
-			USpotLightComponent* SpotLightComponent = Actor->FindComponentByClass<USpotLightComponent>();
-			if (SpotLightComponent)
-			{
-				SpotLights.Add(SpotLightComponent);
-				continue;
-			}
-		}
-	}
-
-	// Set the update timer based on the update frequency that has been set in editor
-	UpdateTimer = 1 / UpdateFrequency;
-}
-
-/// <summary>
-/// UpdateDetection() iterates through all lights in each of the light arrays, and if they are within range of their
-/// attenuation radius, calculates their relative lighting contribution to the player to calculate a CurrentLightTotal, which
-/// is the total amount of light intensity that is currently falling on the player. The BP_LightMeter class uses the CurrentLightTotal
-/// to update the LightTotalPercentage and display it on the LightMeterUI.
-/// </summary>
-void ALightDetectionManager::UpdateDetection()
-{	
-	// Illuminance total on the player for this update tick
-	IlluminanceTotal = 0.0f;
-
-	FVector PlayerPosition = Player->GetActorLocation();
-	FVector DetectionPoint;
-	FHitResult HitResult;
-	// If there is a floor below the player, check if it is within standing range
-	if (GetWorld()->LineTraceSingleByChannel(HitResult, PlayerPosition, PlayerPosition + (100 * FVector::DownVector), ECollisionChannel::ECC_GameTraceChannel5))
-	{
-		// If the player is standing on the detected floor below them, use it as the detection point for light detection
-		if (FVector::Distance(HitResult.Location, PlayerPosition) < 98)
-		{
-			FString dist = FString::SanitizeFloat(FVector::Distance(HitResult.Location, PlayerPosition));
-			if (GEngine) GEngine->AddOnScreenDebugMessage(4, 0.1f, FColor::Red, FString::Printf(TEXT("floor distance: %s"), *dist));
-			
-			DetectionPoint = HitResult.Location + (10 * FVector::UpVector);
-		}
-	}
-	// Otherwise just use the player's approximate feet position for the detection point if not on the floor
-	else
-	{
-		DetectionPoint = PlayerPosition + (93.980003 * FVector::DownVector);
-		if (GEngine) GEngine->AddOnScreenDebugMessage(5, 0.1f, FColor::Red, FString::Printf(TEXT("no hit floor")));
-	}
-
-	CheckPointLights(DetectionPoint);
-	CheckSpotLights(DetectionPoint);
-	
-	//CheckRectLights();
-	//CheckDirectionalLight();
-
-	// Print the current light total to the screen
-	if (DebugIlluminanceTotal)
-	{
-		FString LightTotalString = FString::SanitizeFloat(IlluminanceTotal);
-		if (GEngine) GEngine->AddOnScreenDebugMessage(1, 0.1f, FColor::Red, FString::Printf(TEXT("Current Intensity Total: %s"), *LightTotalString));
-	}
-}
-
-void ALightDetectionManager::CheckPointLights(FVector PlayerPosition)
-{
-	// Placeholder variable for the line trace results
-	FHitResult HitResult;
-
-	// For each point light in the point lights array
-	for (int idx = 0; idx < PointLights.Num(); idx++)
-	{
-		// If this point light is not visible in the scene, skip it
-		if (!PointLights[idx]->IsVisible() || PointLights[idx]->Intensity <= 0)
-		{
-			return;
-		}
-		
-		// Cache  the light and player positions for use
-		FVector4 LightPosition = PointLights[idx]->GetLightPosition();
-
-		// Draw a debug line from this point light to the player
-		if (DebugPointLights)
-		{
-			DrawDebugLine(GetWorld(), LightPosition, PlayerPosition, FColor::Green, false, 0.15f, 0, 0.5f);
-		}
-
-		// Store the distance from light to player, if it exceeds this light's attenuation radius plus a buffer amount, skip this light's contribution
-		float LightDistanceSqr = FVector::DistSquared(LightPosition, PlayerPosition);
-		if (LightDistanceSqr > (PointLights[idx]->AttenuationRadius * PointLights[idx]->AttenuationRadius) + ForgivenessBuffer)
-		{
-			continue;
-		}
-
-		// If there is nothing between this light and the player, set InLight to true and add this lights relative intensity to the temporary total
-		
-		{
-			IlluminanceTotal = 1.0f;
-
-			//////////////////////////////////////////// OLD PHOTOMETRY MATHS ////////////////////////////////////////////
-			//float LightDistance = FMath::Sqrt(LightDistanceSqr) * 0.01f;
-			//IlluminanceTotal += (PointLights[idx]->Intensity) / (4 * PI * LightDistance);
-		}
-	}
-}
-
-void ALightDetectionManager::CheckSpotLights(FVector PlayerPosition)
-{
-	// Placeholder variable for the line trace results
-	FHitResult HitResult;
-
-	// For each spot light in the spot lights array
-	for (int idx = 0; idx < SpotLights.Num(); idx++)
-	{
-		// If this spot light light is not visible in the scene or the intensity is zero, skip it
-		if (!SpotLights[idx]->IsVisible())
-		{
-			continue;
-		}
-
-		// Cache  the light and player positions for use, as well as the spot light forward direction
-		FVector4 SpotLightPosition = SpotLights[idx]->GetLightPosition();
-		FVector SpotLightDir = SpotLights[idx]->GetForwardVector();
-		FVector PlayerDisplacement = PlayerPosition - SpotLightPosition;
-		
-		// Draw a debug line from this point light to the player
-		if (DebugSpotLights)
-		{
-			DrawDebugLine(GetWorld(), SpotLightPosition, PlayerPosition, FColor::Green, false, 0.15f, 0, 0.5f);
-		}
-
-		// If the player is not in range of the spotlight's cone height, do not include this spot light in the CurrentLightTotal calculation
-		float LightDistanceSqr = FVector::DistSquared(SpotLightPosition, PlayerPosition);
-		float AngleBetween = FMath::Acos(FVector::DotProduct(PlayerDisplacement, SpotLightDir) / PlayerDisplacement.Size());
-		float ConeHeight = SpotLights[idx]->AttenuationRadius * (FMath::Cos(SpotLights[idx]->OuterConeAngle * (PI / 180)) / FMath::Cos(AngleBetween));
-		if (LightDistanceSqr > (ConeHeight * ConeHeight) + ForgivenessBuffer)
-		{
-			continue;
-		}
-
-		// If the player is in range but not within "view" of the spot light, do not include this spot light in the CurrentLightTotal calculation
-		float SpotLightToPlayerAngle = FMath::Acos(FVector::DotProduct(SpotLightDir, PlayerDisplacement.GetSafeNormal())) * (180 / PI);
-		if (SpotLightToPlayerAngle > SpotLights[idx]->OuterConeAngle)
-		{
-			continue;
-		}
-
-		// If there is nothing between this light and the player, set InLight to true and add this lights relative intensity to the temporary total
-		if (!GetWorld()->LineTraceSingleByChannel(HitResult, SpotLightPosition, PlayerPosition, ECollisionChannel::ECC_GameTraceChannel5))
-		{
-			if (SpotLights[idx]->Intensity <= 0)
-			{
-				continue;
-			}
-
-			//if (GEngine && DebugSpotLights) GEngine->AddOnScreenDebugMessage(4, 0.1f, FColor::Red, SpotLights[idx]->GetOwner()->GetName());
-			IlluminanceTotal = 1.0f;
-
-			//////////////////////////////////////////// OLD PHOTOMETRY MATHS ////////////////////////////////////////////
-			//// Linearly scale the luminous power down if the player is between the inner and outer cones, otherwise leave it as the full intensity
-			//float LuminousPower = LuminousPower = SpotLights[idx]->Intensity;
-			//if (SpotLightToPlayerAngle > SpotLights[idx]->InnerConeAngle)
-			//{
-			//	LuminousPower *= (1 - ((SpotLightToPlayerAngle - SpotLights[idx]->InnerConeAngle) / (SpotLights[idx]->OuterConeAngle - SpotLights[idx]->InnerConeAngle)));
-			//}
-
-			//// Find the surface area of the spherical sector of the spot light at the player's distance
-			//float LightDistance = FMath::Sqrt(LightDistanceSqr) * 0.01f;
-			//float SpotLightSurfaceArea = 2 * PI * (1 - cos(SpotLights[idx]->OuterConeAngle * (PI / 180))) * LightDistance;
-			//IlluminanceTotal += LuminousPower / SpotLightSurfaceArea;
-		}
-		else
-		{
-			if (GEngine) GEngine->AddOnScreenDebugMessage(3, 5.0f, FColor::Red, HitResult.GetActor()->GetName());
-		}
-	}
-}
-
-void ALightDetectionManager::CheckRectLights()
-{
-	// Placeholder variable for the line trace results
-	FHitResult HitResult;
-	FVector PlayerPosition = Player->GetActorLocation();
-
-	// For each rect light in the rect lights wrapper array
-	for (int idx = 0; idx < RectLights.Num(); idx++)
-	{
-		// If this rect light is not visible in the scene, skip it
-		if (!RectLights[idx]->RectLight->IsVisible())
-		{
-			return;
-		}
-
-		FVector LightPosition = RectLights[idx]->RectLight->GetLightPosition();
-
-		// Store the distance from light to player, if it exceeds this light's attenuation radius plus a buffer amount, skip this light's contribution
-		float LightDistanceSqr = FVector::DistSquared(LightPosition, PlayerPosition);
-		if (LightDistanceSqr > (RectLights[idx]->RectLight->AttenuationRadius * RectLights[idx]->RectLight->AttenuationRadius) + ForgivenessBuffer)
-		{
-			continue;
-		}
-
-		if (!GetWorld()->LineTraceSingleByChannel(HitResult, LightPosition, PlayerPosition, ECollisionChannel::ECC_GameTraceChannel5))
-		{
-			// If this rect light is dynamic, re-calculate the frustum points and bounding planes
-			if (true)
-			{
-				CalculateFrustumPoints(RectLights[idx]);
-				CalculateBoundingPlanes(RectLights[idx]);
-			}
-
-			// Check if the player is above all 4 bounding planes
-			float TopPlaneDist = FPlane::PointPlaneDist(PlayerPosition, RectLights[idx]->FrustumPoints[3], RectLights[idx]->BoundingPlanes[0].GetNormal());
-			float RightPlaneDist = FPlane::PointPlaneDist(PlayerPosition, RectLights[idx]->FrustumPoints[0], RectLights[idx]->BoundingPlanes[1].GetNormal());
-			float BottomPlaneDist = FPlane::PointPlaneDist(PlayerPosition, RectLights[idx]->FrustumPoints[0], RectLights[idx]->BoundingPlanes[2].GetNormal());
-			float LeftPlaneDist = FPlane::PointPlaneDist(PlayerPosition, RectLights[idx]->FrustumPoints[1], RectLights[idx]->BoundingPlanes[3].GetNormal());
-			// If the player is infront of all the bounding planes, calculate the relative illuminance from this light as if it's a point light
-			if (TopPlaneDist > 0 && RightPlaneDist > 0 && BottomPlaneDist > 0 && LeftPlaneDist > 0)
-			{
-				float LightDistance = FMath::Sqrt(LightDistanceSqr) * 0.01f;
-				IlluminanceTotal += (RectLights[idx]->RectLight->Intensity) / (2 * PI * LightDistance);
-			}
-		}
-
-		/////// DEBUG DRAWING ///////
-		if (DebugRectLights)
-		{
-			// Draw each of the points for this rect light frustum
-			for (int pointIdx = 0; pointIdx < RectLights[idx]->FrustumPoints.Num(); pointIdx++)
-			{
-				DrawDebugPoint(GetWorld(), RectLights[idx]->FrustumPoints[pointIdx], 10.0f, FColor::Red);
-			}
-
-			// Draw the four bounding planes, counterclockwise starting from the top plane
-			DrawDebugSolidPlane(GetWorld(), RectLights[idx]->BoundingPlanes[0], (RectLights[idx]->FrustumPoints[2] + RectLights[idx]->FrustumPoints[3]) / 2, FVector2D(200, 500), FColor::Purple, false, 0.05f);
-			DrawDebugSolidPlane(GetWorld(), RectLights[idx]->BoundingPlanes[1], (RectLights[idx]->FrustumPoints[0] + RectLights[idx]->FrustumPoints[3]) / 2, FVector2D(700, 500), FColor::Yellow, false, 0.05f);
-			DrawDebugSolidPlane(GetWorld(), RectLights[idx]->BoundingPlanes[2], (RectLights[idx]->FrustumPoints[0] + RectLights[idx]->FrustumPoints[1]) / 2, FVector2D(200, 500), FColor::Orange, false, 0.05f);
-			DrawDebugSolidPlane(GetWorld(), RectLights[idx]->BoundingPlanes[3], (RectLights[idx]->FrustumPoints[1] + RectLights[idx]->FrustumPoints[2]) / 2, FVector2D(700, 500), FColor::Red, false, 0.05f);
-
-			// Draw a debug line from this point light to the player (DEBUG ONLY)
-			DrawDebugLine(GetWorld(), LightPosition, PlayerPosition, FColor::Green, false, 0.015f, 0, 0.5f);
-		}
-	}
-}
-
-void ALightDetectionManager::CheckDirectionalLight()
-{
-	// If there is not directional light in the scene, skip it
-	if (!MainDirectionalLight)
-	{
-		return;
-	}
-
-	// If the main directional light is not visible, skip it
-	if (!MainDirectionalLight->IsVisible())
-	{
-		return;
-	}
-
-	// Placeholder variable for the line trace results
-	FHitResult HitResult;
-
-	// Cache  the light and player positions for use, as well as the spot light forward direction
-	FVector LightDirection = MainDirectionalLight->GetForwardVector();
-	FVector PlayerPosition = Player->GetActorLocation();
-	// Get a position of the directional light, 5000cm from the player along the directional light's forward vector
-	FVector DirecitonalLightPosition = PlayerPosition - (LightDirection * 5000);
-
-	if (!GetWorld()->LineTraceSingleByChannel(HitResult, DirecitonalLightPosition, PlayerPosition, ECollisionChannel::ECC_Visibility))
-	{
-		IlluminanceTotal += MainDirectionalLight->Intensity;
-	}
-
-	// Draw a debug line from this point light to the player (DEBUG ONLY)
-	if (DebugDirectionalLight)
-	{
-		DrawDebugLine(GetWorld(), DirecitonalLightPosition, PlayerPosition, FColor::Green, false, 0.015f, 0, 0.5f);
-	}
-}
-
-void ALightDetectionManager::CalculateFrustumPoints(RectLightWrapper* rectLightWrapper)
-{
-	// Top left, near plane
-	rectLightWrapper->FrustumPoints[0] = rectLightWrapper->RectLight->GetLightPosition() - (rectLightWrapper->RectLight->GetRightVector() * (rectLightWrapper->RectLight->SourceWidth / 2)) + (rectLightWrapper->RectLight->GetUpVector() * (rectLightWrapper->RectLight->SourceHeight / 2));
-
-	// Top right, near plane
-	rectLightWrapper->FrustumPoints[1] = rectLightWrapper->RectLight->GetLightPosition() + (rectLightWrapper->RectLight->GetRightVector() * (rectLightWrapper->RectLight->SourceWidth / 2)) + (rectLightWrapper->RectLight->GetUpVector() * (rectLightWrapper->RectLight->SourceHeight / 2));;
-
-	// Bottom right, near plane
-	rectLightWrapper->FrustumPoints[2] = rectLightWrapper->RectLight->GetLightPosition() + (rectLightWrapper->RectLight->GetRightVector() * (rectLightWrapper->RectLight->SourceWidth / 2)) - (rectLightWrapper->RectLight->GetUpVector() * (rectLightWrapper->RectLight->SourceHeight / 2));;
-
-	// Bottom left, near plane
-	rectLightWrapper->FrustumPoints[3] = rectLightWrapper->RectLight->GetLightPosition() - (rectLightWrapper->RectLight->GetRightVector() * (rectLightWrapper->RectLight->SourceWidth / 2)) - (rectLightWrapper->RectLight->GetUpVector() * (rectLightWrapper->RectLight->SourceHeight / 2));;
-
-	// Top left, far plane
-	FVector farPlaneSegment = rectLightWrapper->FrustumPoints[0] + (rectLightWrapper->RectLight->GetForwardVector() * rectLightWrapper->RectLight->BarnDoorLength).RotateAngleAxis(-rectLightWrapper->RectLight->BarnDoorAngle, rectLightWrapper->RectLight->GetRightVector());
-	float farPlaneSegmentLength = rectLightWrapper->RectLight->BarnDoorLength * sinf(rectLightWrapper->RectLight->BarnDoorAngle * (PI / 180));
-	rectLightWrapper->FrustumPoints[4] = farPlaneSegment - (rectLightWrapper->RectLight->GetRightVector() * farPlaneSegmentLength);
-
-	// Top right, far plane
-	rectLightWrapper->FrustumPoints[5] = rectLightWrapper->FrustumPoints[4] + (rectLightWrapper->RectLight->GetRightVector() * (2 * farPlaneSegmentLength + rectLightWrapper->RectLight->SourceWidth));
-
-	// Bottom right, far plane
-	rectLightWrapper->FrustumPoints[6] = rectLightWrapper->FrustumPoints[5] - (rectLightWrapper->RectLight->GetUpVector() * (2 * farPlaneSegmentLength + rectLightWrapper->RectLight->SourceHeight));
-
-	// Bottom left, far plane
-	rectLightWrapper->FrustumPoints[7] = rectLightWrapper->FrustumPoints[6] - (rectLightWrapper->RectLight->GetRightVector() * (2 * farPlaneSegmentLength + rectLightWrapper->RectLight->SourceWidth));
-}
-
-void ALightDetectionManager::CalculateBoundingPlanes(RectLightWrapper* rectLightWrapper)
-{
-	// Calculate the top bounding plane
-	FVector topPlaneNormal = FVector::CrossProduct(rectLightWrapper->FrustumPoints[3] - rectLightWrapper->FrustumPoints[2], rectLightWrapper->FrustumPoints[4] - rectLightWrapper->FrustumPoints[2]);
-	topPlaneNormal.Normalize();
-	rectLightWrapper->BoundingPlanes[0] = FPlane(topPlaneNormal, FVector::DotProduct(topPlaneNormal, rectLightWrapper->FrustumPoints[2])).Flip();
-
-	// Calculate the right bounding plane
-	FVector rightPlaneNormal = FVector::CrossProduct(rectLightWrapper->FrustumPoints[0] - rectLightWrapper->FrustumPoints[3], rectLightWrapper->FrustumPoints[5] - rectLightWrapper->FrustumPoints[3]);
-	rightPlaneNormal.Normalize();
-	rectLightWrapper->BoundingPlanes[1] = FPlane(rightPlaneNormal, FVector::DotProduct(rightPlaneNormal, rectLightWrapper->FrustumPoints[0])).Flip();
-
-	// Calculate the bottom bounding plane
-	FVector bottomPlaneNormal = FVector::CrossProduct(rectLightWrapper->FrustumPoints[7] - rectLightWrapper->FrustumPoints[1], rectLightWrapper->FrustumPoints[0] - rectLightWrapper->FrustumPoints[1]);
-	bottomPlaneNormal.Normalize();
-	rectLightWrapper->BoundingPlanes[2] = FPlane(bottomPlaneNormal, FVector::DotProduct(bottomPlaneNormal, rectLightWrapper->FrustumPoints[0])).Flip();
-
-	// Calculate the left bounding plane
-	FVector leftPlaneNormal = FVector::CrossProduct(rectLightWrapper->FrustumPoints[4] - rectLightWrapper->FrustumPoints[2], rectLightWrapper->FrustumPoints[1] - rectLightWrapper->FrustumPoints[2]);
-	leftPlaneNormal.Normalize();
-	rectLightWrapper->BoundingPlanes[3] = FPlane(leftPlaneNormal, FVector::DotProduct(leftPlaneNormal, rectLightWrapper->FrustumPoints[1])).Flip();
-}
-
-/// <summary>
-/// Every Tick, the function will decrement the UpdateTimer by the amount of time passed, and if the timer has reached zero,
-/// a call to UpdateDetection() is made and the UpdateTimer is reset. The function then checks to see if the player is currently
-/// not in light and if the CurrentLightTotal is still above zero, and will decrement it towards zero at a rate determined by the
-/// DrainSpeed.
-/// </summary>
-void ALightDetectionManager::Tick(float DeltaTime)
-{
-	Super::Tick(DeltaTime);
-
-	UpdateTimer -= DeltaTime;
-	// If the updateTimer has run out, update the light detection and reset the timer
-	if (UpdateTimer <= 0) 
-	{ 
-		// Call a detection update
-		UpdateDetection(); 
-		// Reset the update timer
-		UpdateTimer = 1 / UpdateFrequency; 
-	}
-}
-
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "LightDetectionManager.h"
+#include "Containers/Array.h"
+#include "LightDetectionDebug.h"
+#include "LightDetectionStats.h"
+#include "LightDetectionVisualizerComponent.h"
+#include "Kismet/GameplayStatics.h"
+#include "Components/CapsuleComponent.h"
+#include "Components/SkeletalMeshComponent.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "Components/PointLightComponent.h"
+#include "Components/SpotLightComponent.h"
+#include "Components/RectLightComponent.h"
+#include "Components/DirectionalLightComponent.h"
+#include "GameFramework/PlayerController.h"
+#include "Net/UnrealNetwork.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Engine/World.h"
+#include "Engine/Level.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogLightDetection, Log, All);
+
+DEFINE_STAT(STAT_LightDetection_UpdateDetection);
+DEFINE_STAT(STAT_LightDetection_UpdateDetectionTimeSliced);
+DEFINE_STAT(STAT_LightDetection_UpdateServerDetection);
+DEFINE_STAT(STAT_LightDetection_ReplicateIlluminance);
+DEFINE_STAT(STAT_LightDetection_UpdateClientPrediction);
+DEFINE_STAT(STAT_LightDetection_FindDetectionPoint);
+DEFINE_STAT(STAT_LightDetection_UpdateLightPriorities);
+DEFINE_STAT(STAT_LightDetection_CheckPointLights);
+DEFINE_STAT(STAT_LightDetection_CheckSpotLights);
+DEFINE_STAT(STAT_LightDetection_GatherCellCandidates);
+DEFINE_STAT(STAT_LightDetection_CheckBodySamples);
+DEFINE_STAT(STAT_LightDetection_CheckRectLights);
+DEFINE_STAT(STAT_LightDetection_CheckDirectionalLight);
+DEFINE_STAT(STAT_LightDetection_CalculateFrustum);
+DEFINE_STAT(STAT_LightDetection_SceneQuery);
+DEFINE_STAT(STAT_LightDetection_IlluminanceQuery);
+DEFINE_STAT(STAT_LightDetection_BakeNavigation);
+DEFINE_STAT(STAT_LightDetection_BuildOccluders);
+DEFINE_STAT(STAT_LightDetection_OccluderMemory);
+DEFINE_STAT(STAT_LightDetection_VoxelMemory);
+DEFINE_STAT(STAT_LightDetection_LightsTested);
+DEFINE_STAT(STAT_LightDetection_LightsCulled);
+DEFINE_STAT(STAT_LightDetection_LightsReused);
+DEFINE_STAT(STAT_LightDetection_TracesIssued);
+DEFINE_STAT(STAT_LightDetection_TracesSaved);
+DEFINE_STAT(STAT_LightDetection_ServerPlayers);
+DEFINE_STAT(STAT_LightDetection_ServerMicrosecondsPerPlayer);
+DEFINE_STAT(STAT_LightDetection_PlayersReplicated);
+DEFINE_STAT(STAT_LightDetection_ReplicatedBytes);
+DEFINE_STAT(STAT_LightDetection_PredictionCorrections);
+
+CSV_DEFINE_CATEGORY_MODULE(PLANET_NINEMP_API, LightDetection, true);
+
+// The session recording is written out whenever this much of it has built up in memory, and when play ends
+static constexpr size_t SessionRecordingFlushSize = 1024 * 1024;
+
+// Sets default values
+ALightDetectionManager::ALightDetectionManager()
+{
+ 	// Set this actor to call Tick() on the engine's tick interval rather than every frame, the interval is set in BeginPlay() from the UpdateFrequency
+	PrimaryActorTick.bCanEverTick = true;
+	// Tick after physics so the player's transform for this frame is final before it is used for detection
+	PrimaryActorTick.TickGroup = TG_PostPhysics;
+
+	// The visualizer holds the debug geometry for lights with their Debug* flag set, it is also the root so the manager can be placed in the level
+	Visualizer = CreateDefaultSubobject<ULightDetectionVisualizerComponent>(TEXT("Visualizer"));
+	RootComponent = Visualizer;
+
+	// Server authoritative detection replicates every player's illuminance to every client. Without it the replicated array stays empty
+	bReplicates = true;
+	bAlwaysRelevant = true;
+}
+
+/// <summary>
+/// BeginPlay() first calls the base class BeginPlay(), and then will store a reference to the player character using the UGameplayStatistics class.
+/// The function then stores the lights of all actors in the scene tagged with Spot Light or Point Light into their respective TArrays, snapshots
+/// them for the detection core, builds the rolling result table used for time-sliced detection, and then finally sets the actor tick interval
+/// as the inverse of whatever the UpdateFrequency has been set to in editor, so the manager does not tick at all between updates.
+/// </summary>
+void ALightDetectionManager::BeginPlay()
+{
+	Super::BeginPlay();
+	
+	// Store a reference to the player character by attempting to cast it from the base ACharacter class into its player character child class
+	Player = dynamic_cast<APlanet_NineMPCharacter*>(UGameplayStatics::GetPlayerCharacter(GetWorld(), 0));
+
+	// Store a reference to the light component of every actor tagged as a point, spot or rect light
+	LightDetectionAdapter::GatherTaggedLights(GetWorld(), PointLights, SpotLights, &RectLights);
+
+	// Snapshot the lights into the detection core's scene, each light is snapshotted again whenever it is evaluated
+	LightDetectionAdapter::SnapshotLightScene(PointLights, SpotLights, RectLights, MainDirectionalLight, Scene);
+
+	// Cluster the point lights that cannot move, so the broad phase can pass over a group of them that is out of range in one test
+	LightClusters.Reset();
+	UnclusteredPointLights.Reset();
+	ClusteredPointLights.Reset();
+	ChangedPointLights.Reset();
+	ChangedSpotLights.Reset();
+	if (bClusterLights)
+	{
+		LightDetectionAdapter::BuildLightClusters(PointLights, Scene, LightClusterSize, LightClusters);
+		for (int idx = 0; idx < PointLights.Num(); idx++)
+		{
+			(LightClusters.LightClusters[idx] >= 0 ? ClusteredPointLights : UnclusteredPointLights).Add(idx);
+		}
+	}
+
+	// Split the lights between the level's cells
+	LightCells.Reset();
+	if (bUseLightCells)
+	{
+		LightDetectionAdapter::BuildLightCells(GetWorld(), PointLights, SpotLights, Scene, LightCells);
+	}
+
+	// Build the tree continuous illuminance samples point lights from
+	PointLightEstimate.Reset();
+	if (bContinuousIlluminance)
+	{
+		PointLightImportanceTree.Build(Scene);
+		bPointLightTreeDirty = false;
+	}
+
+	// Build the rolling per-light result table used by time-sliced detection
+	BuildDetectionResultTable();
+
+	// Precompute the transmittance of every surface type so transmission traces never look at a hit's material
+	LightDetectionAdapter::BuildTransmissionTable(SurfaceTransmittance, MinTransmittance, Transmission);
+
+	// Build the occluders from the level's light blocking geometry if occlusion is not answered by the physics scene. Clients of server
+	// authoritative detection only trace when they predict
+	if (OcclusionBackend != ELightOcclusionBackend::PhysicsScene && (!IsServerDetectionClient() || bClientPrediction))
+	{
+		BuildOccluders();
+	}
+
+	// Warn about detection modes another enabled mode leaves with no effect, turning off session recording if the session could not be replayed
+	ValidateDetectionModes();
+	if (bRecordSession)
+	{
+		BeginSessionRecording();
+	}
+
+	// Make sure the player has finished ticking this frame before the manager samples its position
+	if (Player)
+	{
+		AddTickPrerequisiteActor(Player);
+	}
+
+	// Replicate often enough for the most relevant players' send interval, the replicated array is only sent when an entry has changed
+	if (bServerDetection && HasAuthority())
+	{
+		NetUpdateFrequency = MinReplicationInterval > 0 ? 1 / MinReplicationInterval : UpdateFrequency;
+	}
+
+	// Set the tick interval based on the update frequency that has been set in editor, time-sliced detection needs to tick every frame instead
+	UpdateTimeError = 0.0f;
+	SetActorTickInterval(bTimeSlicedDetection && !bServerDetection ? 0.0f : 1 / UpdateFrequency);
+}
+
+void ALightDetectionManager::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	// Write out whatever is left of the session recording
+	FlushSessionRecording();
+
+	if (ActorSpawnedHandle.IsValid())
+	{
+		GetWorld()->RemoveOnActorSpawnedHandler(ActorSpawnedHandle);
+		ActorSpawnedHandle.Reset();
+	}
+	if (LevelAddedHandle.IsValid())
+	{
+		FWorldDelegates::LevelAddedToWorld.Remove(LevelAddedHandle);
+		LevelAddedHandle.Reset();
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+/// <summary>
+/// UpdateDetection() iterates through all lights in each of the light arrays, and if they are within range of their
+/// attenuation radius, calculates their relative lighting contribution to the player to calculate a CurrentLightTotal, which
+/// is the total amount of light intensity that is currently falling on the player. The BP_LightMeter class uses the CurrentLightTotal
+/// to update the LightTotalPercentage and display it on the LightMeterUI.
+/// </summary>
+void ALightDetectionManager::UpdateDetection()
+{	
+	LIGHT_DETECTION_SCOPE(UpdateDetection);
+	UpdateCounters.Reset();
+
+	// Illuminance total on the player for this update tick
+	IlluminanceTotal = 0.0f;
+	ApplyDetectionSettings();
+	UpdateOccluders();
+	PointLightOcclusionCache.BeginUpdate();
+
+	FVector DetectionPoint = FindDetectionPoint(Player);
+
+	// Record the state of this update before detection so the occlusion queries it makes are recorded as part of it
+	if (SessionRecorder.IsRecording())
+	{
+		LightDetection::AgentData Agent;
+		Agent.DetectionPoint = LightDetectionAdapter::ToCoreVector(DetectionPoint);
+		Agent.Position = LightDetectionAdapter::ToCoreVector(Player->GetActorLocation());
+		SessionRecorder.BeginFrame(GetWorld()->GetTimeSeconds(), Agent, Settings);
+		RecordLightSnapshots();
+	}
+
+	if (HasBodySamples())
+	{
+		CheckBodySamples(DetectionPoint);
+	}
+	else
+	{
+		// With cells the point and spot light checks share the candidates of a single walk out from the player's cell
+		if (GetLightCells())
+		{
+			GatherCellCandidates(DetectionPoint);
+		}
+
+		if (bContinuousIlluminance)
+		{
+			EstimatePointLights(DetectionPoint);
+		}
+		else
+		{
+			CheckPointLights(DetectionPoint);
+		}
+		CheckSpotLights(DetectionPoint);
+	}
+
+	// Rect lights add to the total whichever way the point and spot lights were evaluated
+	CheckRectLights();
+	//CheckDirectionalLight();
+
+	// Print the current light total to the screen
+	LIGHT_DETECTION_DEBUG_MESSAGE(DebugIlluminanceTotal, 1, 0.1f, FColor::Red, TEXT("Current Intensity Total: %f"), IlluminanceTotal);
+
+	// Send any visualisation changes from this update to the render thread
+	FlushVisualizer();
+
+	RecordUpdateStats();
+
+	if (SessionRecorder.IsRecording())
+	{
+		SessionRecorder.EndFrame(IlluminanceTotal);
+		if (SessionRecorder.GetData().size() >= SessionRecordingFlushSize)
+		{
+			FlushSessionRecording();
+		}
+	}
+}
+
+/// <summary>
+/// UpdateDetectionTimeSliced() is the incremental alternative to UpdateDetection(). Rather than evaluating every light in one burst,
+/// each tick it re-prioritises the rolling DetectionResults table and evaluates the most urgent lights until the TimeSliceBudget
+/// (in microseconds) has been spent, the re-prioritising included. Lights that are near, were lit last time, or have moved accumulate urgency faster and so are
+/// revisited more often, while every light is still guaranteed to be revisited eventually. IlluminanceTotal is resolved from the
+/// table every tick, so it is always available even though only some of the lights were re-evaluated.
+/// </summary>
+void ALightDetectionManager::UpdateDetectionTimeSliced(float DeltaTime)
+{
+	LIGHT_DETECTION_SCOPE(UpdateDetectionTimeSliced);
+	UpdateCounters.Reset();
+
+	FVector DetectionPoint = FindDetectionPoint(Player);
+	ApplyDetectionSettings();
+	UpdateOccluders();
+	FLightTraceOcclusionQuery Occlusion = MakeOcclusionQuery();
+
+	// The budget covers scoring the lights as well as evaluating them, scoring may use up to half of it
+	const double SliceStartTime = FPlatformTime::Seconds();
+	const double SliceEndTime = SliceStartTime + (TimeSliceBudget * 0.000001);
+	UpdateLightPriorities(DetectionPoint, DeltaTime, SliceStartTime + (TimeSliceBudget * 0.0000005));
+
+	// Evaluate lights in urgency order until the budget for this tick runs out, always evaluating at least one light. The order is a heap, so
+	// only the lights that are evaluated are ever sorted
+	const auto IsMoreUrgent = [this](int32 A, int32 B)
+	{
+		return DetectionResults[A].Urgency > DetectionResults[B].Urgency;
+	};
+	for (int evaluatedCount = 0; EvaluationOrder.Num() > 0; evaluatedCount++)
+	{
+		if (evaluatedCount > 0 && FPlatformTime::Seconds() >= SliceEndTime)
+		{
+			// Every light left in the order keeps its result from the table
+			UpdateCounters.LightsReused += EvaluationOrder.Num();
+			break;
+		}
+
+		int32 ResultIndex;
+		EvaluationOrder.HeapPop(ResultIndex, IsMoreUrgent, false);
+		LightDetectionResult& Result = DetectionResults[ResultIndex];
+		switch (Result.Type)
+		{
+		case ELightDetectionType::Point:
+			Result.Illuminance = EvaluatePointLight(Result.LightIndex, DetectionPoint, Occlusion).Illuminance;
+			Result.LastLightTransform = PointLights[Result.LightIndex]->GetComponentTransform();
+			break;
+		case ELightDetectionType::Spot:
+			Result.Illuminance = EvaluateSpotLight(Result.LightIndex, DetectionPoint, Occlusion).Illuminance;
+			Result.LastLightTransform = SpotLights[Result.LightIndex]->GetComponentTransform();
+			break;
+		}
+		Result.Urgency = 0.0f;
+	}
+
+	ResolveIlluminanceTotal();
+
+	// Rect lights are not in the table, they add to the total every tick, and only trace RectLightSamplesPerUpdate of their samples when they do
+	CheckRectLights();
+
+	// Print the current light total to the screen
+	LIGHT_DETECTION_DEBUG_MESSAGE(DebugIlluminanceTotal, 1, 0.1f, FColor::Red, TEXT("Current Intensity Total: %f"), IlluminanceTotal);
+
+	// Send any visualisation changes from this update to the render thread
+	FlushVisualizer();
+
+	RecordUpdateStats();
+}
+
+/// <summary>
+/// UpdateServerDetection() is the server authoritative alternative to UpdateDetection(). Rather than evaluating local player 0, it finds the
+/// detection point of every connected player's character and evaluates all of them together with the detection core, so the lights that can
+/// reach any player are gathered once and each spot light's occlusion tests against the players are batched. The results are replicated to
+/// clients by ReplicateIlluminance(), and a listen server's own player takes theirs as the IlluminanceTotal.
+/// </summary>
+void ALightDetectionManager::UpdateServerDetection()
+{
+	LIGHT_DETECTION_SCOPE(UpdateServerDetection);
+	UpdateCounters.Reset();
+	const double StartTime = FPlatformTime::Seconds();
+
+	ApplyDetectionSettings();
+	UpdateOccluders();
+	ServerOcclusionCache.BeginUpdate();
+
+	// Find the detection point of every connected player who has a character
+	ServerPlayers.Reset();
+	ServerDetectionPoints.Reset();
+	for (FConstPlayerControllerIterator Iterator = GetWorld()->GetPlayerControllerIterator(); Iterator; ++Iterator)
+	{
+		const APlayerController* Controller = Iterator->Get();
+		APlanet_NineMPCharacter* Character = Controller ? Cast<APlanet_NineMPCharacter>(Controller->GetPawn()) : nullptr;
+		if (Character)
+		{
+			ServerPlayers.Add(Character);
+			ServerDetectionPoints.Add(LightDetectionAdapter::ToCoreVector(FindDetectionPoint(Character)));
+		}
+	}
+	ServerIlluminance.SetNumZeroed(ServerPlayers.Num());
+
+	if (ServerPlayers.Num() > 0)
+	{
+		// The broad phase considers every light, so they all need to be up to date
+		SnapshotPointAndSpotLights();
+
+		// Every player has their own point light trace budget, and players further apart than MaxSampleGroupExtent each have their own broad phase
+		FLightTraceOcclusionQuery Occlusion = MakeOcclusionQuery();
+		LightDetection::EvaluateDetectionSamples(Scene, ServerDetectionPoints.GetData(), ServerDetectionPoints.Num(), Settings, Occlusion, &ServerOcclusionCache,
+			UpdateCounters, ServerCandidates, ServerIlluminance.GetData(), GetLightClusters(), bApproximateLightClusters);
+	}
+
+	// A listen server's own player reads their illuminance directly
+	IlluminanceTotal = 0.0f;
+	for (int idx = 0; idx < ServerPlayers.Num(); idx++)
+	{
+		if (ServerPlayers[idx] == Player)
+		{
+			IlluminanceTotal = ServerIlluminance[idx];
+		}
+	}
+	const double DetectionSeconds = FPlatformTime::Seconds() - StartTime;
+
+	ReplicateIlluminance(ServerPlayers, ServerDetectionPoints, ServerIlluminance);
+
+	// The cost of detection for each player, not counting replication
+	const float MicrosecondsPerPlayer = ServerPlayers.Num() > 0 ? static_cast<float>((DetectionSeconds * 1000000.0) / ServerPlayers.Num()) : 0.0f;
+	INC_DWORD_STAT_BY(STAT_LightDetection_ServerPlayers, ServerPlayers.Num());
+	INC_FLOAT_STAT_BY(STAT_LightDetection_ServerMicrosecondsPerPlayer, MicrosecondsPerPlayer);
+	CSV_CUSTOM_STAT(LightDetection, ServerMicrosecondsPerPlayer, MicrosecondsPerPlayer, ECsvCustomStatOp::Set);
+	LIGHT_DETECTION_DEBUG_MESSAGE(DebugIlluminanceTotal, 2, 0.1f, FColor::Red, TEXT("Server detection: %d players, %f us per player"), ServerPlayers.Num(), MicrosecondsPerPlayer);
+
+	RecordUpdateStats(ServerPlayers.Num());
+}
+
+/// <summary>
+/// ReplicateIlluminance() updates each evaluated player's entry in the replicated array. Illuminance is quantized to a byte, and an entry is
+/// only marked dirty when its byte has changed and its send interval has passed, so only those entries are delta serialized to clients. The
+/// send interval shortens as another player comes within ReplicationRelevanceDistance, since that is when a player's illuminance matters to
+/// someone else. Entries for players who have left are removed.
+/// </summary>
+void ALightDetectionManager::ReplicateIlluminance(const TArray<APlanet_NineMPCharacter*>& Players, const TArray<LightDetection::Vector3>& DetectionPoints, const TArray<float>& Illuminance)
+{
+	LIGHT_DETECTION_SCOPE(ReplicateIlluminance);
+
+	LightDetection::ReplicationSettings Replication;
+	Replication.MaxIlluminance = MaxReplicatedIlluminance;
+	Replication.MinSendInterval = MinReplicationInterval;
+	Replication.MaxSendInterval = MaxReplicationInterval;
+
+	// Remove the entries of players who were not evaluated this update
+	TArray<FLightDetectionPlayerIlluminance>& Items = ReplicatedIlluminance.Items;
+	const int32 PreviousCount = Items.Num();
+	Items.RemoveAllSwap([&Players](const FLightDetectionPlayerIlluminance& Item)
+	{
+		return !Players.Contains(Item.Pawn);
+	});
+	if (Items.Num() != PreviousCount)
+	{
+		ReplicatedIlluminance.MarkArrayDirty();
+	}
+
+	const double Time = GetWorld()->GetTimeSeconds();
+	int32 PlayersReplicated = 0;
+	for (int idx = 0; idx < Players.Num(); idx++)
+	{
+		APawn* Pawn = Players[idx];
+		FLightDetectionPlayerIlluminance* Item = Items.FindByPredicate([Pawn](const FLightDetectionPlayerIlluminance& Entry) { return Entry.Pawn == Pawn; });
+		if (!Item)
+		{
+			Item = &Items.AddDefaulted_GetRef();
+			Item->Pawn = Pawn;
+		}
+		Item->ServerIlluminance = Illuminance[idx];
+
+		// Relevance rises from 0 to 1 as the nearest other player closes in from ReplicationRelevanceDistance
+		float NearestDistanceSqr = TNumericLimits<float>::Max();
+		for (int otherIdx = 0; otherIdx < Players.Num(); otherIdx++)
+		{
+			if (otherIdx != idx)
+			{
+				NearestDistanceSqr = FMath::Min(NearestDistanceSqr, static_cast<float>(FVector::DistSquared(Pawn->GetActorLocation(), Players[otherIdx]->GetActorLocation())));
+			}
+		}
+		const float Relevance = 1.0f - FMath::Min(FMath::Sqrt(NearestDistanceSqr) / ReplicationRelevanceDistance, 1.0f);
+
+		// Unchanged values are never sent, changed ones wait for the player's send interval
+		const uint8 Quantized = LightDetection::QuantizeIlluminance(Item->ServerIlluminance, Replication.MaxIlluminance);
+		if (LightDetection::ShouldSendIlluminance(Item->SendState, Quantized, Time, LightDetection::GetSendInterval(Relevance, Replication)))
+		{
+			Item->Illuminance = Quantized;
+			Item->Sequence = Item->SendState.Sequence;
+			Item->DetectionPoint = LightDetectionAdapter::ToFVector(DetectionPoints[idx]);
+			ReplicatedIlluminance.MarkItemDirty(*Item);
+			PlayersReplicated++;
+		}
+	}
+
+	// The bytes actually written for the array to every client since the last update, counted as it is delta serialized. Replication runs after
+	// the tick, so these are the bytes sent for the previous update's changes
+	const int32 ReplicatedBytes = static_cast<int32>(FMath::DivideAndRoundUp<int64>(ReplicatedIlluminance.SerializedBits, 8));
+	ReplicatedIlluminance.SerializedBits = 0;
+
+	INC_DWORD_STAT_BY(STAT_LightDetection_PlayersReplicated, PlayersReplicated);
+	INC_DWORD_STAT_BY(STAT_LightDetection_ReplicatedBytes, ReplicatedBytes);
+	CSV_CUSTOM_STAT(LightDetection, PlayersReplicated, PlayersReplicated, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(LightDetection, ReplicatedBytes, ReplicatedBytes, ECsvCustomStatOp::Set);
+}
+
+void ALightDetectionManager::ReadReplicatedIlluminance()
+{
+	// Clients do not run detection, the local player is as lit as the server last said they were
+	IlluminanceTotal = GetPlayerIlluminance(UGameplayStatics::GetPlayerPawn(GetWorld(), 0));
+
+	// Print the current light total to the screen
+	LIGHT_DETECTION_DEBUG_MESSAGE(DebugIlluminanceTotal, 1, 0.1f, FColor::Red, TEXT("Current Intensity Total: %f"), IlluminanceTotal);
+}
+
+/// <summary>
+/// UpdateClientPrediction() predicts the local player's illuminance on a client of server authoritative detection, so the light meter responds
+/// straight away rather than a round trip later. The prediction goes through the same batched evaluation, broad phase and clusters the server
+/// evaluates each player with, but it is kept cheap by reusing cached occlusion answers for longer and tracing at most PredictionTraceBudget
+/// point lights, so it can still differ from the server where a light it left untraced would have decided the total. Each prediction is kept with the point it was made at, and each
+/// new value from the server is compared with the prediction made where the server evaluated the player. Where they disagree the server's
+/// value is shown until the player moves on, so the server always has the final say.
+/// </summary>
+void ALightDetectionManager::UpdateClientPrediction()
+{
+	LIGHT_DETECTION_SCOPE(UpdateClientPrediction);
+	UpdateCounters.Reset();
+
+	// The local player's character may not have been spawned yet when play began
+	if (!Player)
+	{
+		Player = Cast<APlanet_NineMPCharacter>(UGameplayStatics::GetPlayerCharacter(GetWorld(), 0));
+		if (!Player)
+		{
+			return;
+		}
+	}
+
+	ApplyDetectionSettings();
+	UpdateOccluders();
+	PointLightOcclusionCache.BeginUpdate();
+
+	LightDetection::DetectionSettings PredictionSettings = Settings;
+	PredictionSettings.MaxPointLightTraces = PredictionTraceBudget;
+	PredictionSettings.OcclusionCacheMaxAge = PredictionCacheMaxAge;
+
+	// The player is evaluated the way UpdateServerDetection() evaluates them, as a batch of one, so the broad phase considers every light and
+	// they all need to be up to date
+	SnapshotPointAndSpotLights();
+	const LightDetection::Vector3 DetectionPoint = LightDetectionAdapter::ToCoreVector(FindDetectionPoint(Player));
+	FLightTraceOcclusionQuery Occlusion = MakeOcclusionQuery();
+	float Predicted = 0.0f;
+	LightDetection::EvaluateDetectionSamples(Scene, &DetectionPoint, 1, PredictionSettings, Occlusion, &PointLightOcclusionCache, UpdateCounters, UpdateCandidates, &Predicted,
+		GetLightClusters(), bApproximateLightClusters);
+	Predictor.AddPrediction(DetectionPoint, Predicted);
+
+	// Reconcile with the latest value from the server, which is ignored if it has already been seen
+	if (const FLightDetectionPlayerIlluminance* Item = FindReplicatedIlluminance(Player))
+	{
+		const LightDetection::ServerValueResult Result = Predictor.ApplyServerValue(Item->Sequence, LightDetectionAdapter::ToCoreVector(Item->DetectionPoint), Item->Illuminance,
+			MaxReplicatedIlluminance, ReconciliationDistance, ReconciliationTolerance);
+		if (Result == LightDetection::ServerValueResult::Corrected)
+		{
+			INC_DWORD_STAT(STAT_LightDetection_PredictionCorrections);
+			CSV_CUSTOM_STAT(LightDetection, PredictionCorrections, 1, ECsvCustomStatOp::Accumulate);
+		}
+	}
+	IlluminanceTotal = Predictor.GetIlluminance();
+
+	// Print the current light total to the screen
+	LIGHT_DETECTION_DEBUG_MESSAGE(DebugIlluminanceTotal, 1, 0.1f, FColor::Red, TEXT("Current Intensity Total: %f (predicted %f)"), IlluminanceTotal, Predicted);
+
+	RecordUpdateStats();
+}
+
+const FLightDetectionPlayerIlluminance* ALightDetectionManager::FindReplicatedIlluminance(const APawn* Pawn) const
+{
+	return Pawn ? ReplicatedIlluminance.Items.FindByPredicate([Pawn](const FLightDetectionPlayerIlluminance& Entry) { return Entry.Pawn == Pawn; }) : nullptr;
+}
+
+bool ALightDetectionManager::IsServerDetectionClient() const
+{
+	return bServerDetection && GetNetMode() == NM_Client;
+}
+
+/// <summary>
+/// FindDetectionPoint() returns the point light detection is evaluated at, just above the floor the player is standing on. The character
+/// movement component already finds the current floor every frame, so when the player is walking on a walkable floor that also blocks the
+/// light channel its result is reused. Only when the player is airborne, or the floor is a surface the light channel does not know about,
+/// is a downward trace made. If no standing floor is found, the player's approximate feet position is used.
+/// </summary>
+FVector ALightDetectionManager::FindDetectionPoint(const APlanet_NineMPCharacter* Character)
+{
+	LIGHT_DETECTION_SCOPE(FindDetectionPoint);
+
+	FVector PlayerPosition = Character->GetActorLocation();
+	// Default to the player's approximate feet position if no standing floor is found
+	FVector DetectionPoint = PlayerPosition + (93.980003 * FVector::DownVector);
+
+	// If the movement component has a walkable floor under the player this frame, derive the detection point from it instead of tracing
+	const UCharacterMovementComponent* CharacterMovement = Character->GetCharacterMovement();
+	if (CharacterMovement && CharacterMovement->IsMovingOnGround() && CharacterMovement->CurrentFloor.IsWalkableFloor())
+	{
+		// The floor is only trusted if it would also have been hit by the light channel trace
+		const UPrimitiveComponent* FloorComponent = CharacterMovement->CurrentFloor.HitResult.GetComponent();
+		if (FloorComponent && FloorComponent->GetCollisionResponseToChannel(ECollisionChannel::ECC_GameTraceChannel5) == ECollisionResponse::ECR_Block)
+		{
+			// The floor distance is measured from the bottom of the capsule, so add the half height to get the distance from the player's origin
+			float FloorDistance = Character->GetCapsuleComponent()->GetScaledCapsuleHalfHeight() + CharacterMovement->CurrentFloor.GetDistanceToFloor();
+			if (FloorDistance < 98)
+			{
+				LIGHT_DETECTION_DEBUG_MESSAGE(DebugDetectionPoint, 4, 0.1f, FColor::Red, TEXT("floor distance: %f"), FloorDistance);
+				UpdateCounters.TracesSaved++;
+
+				return PlayerPosition + (FloorDistance * FVector::DownVector) + (10 * FVector::UpVector);
+			}
+		}
+	}
+
+	FHitResult HitResult;
+	UpdateCounters.TracesIssued++;
+	// If there is a floor below the player, check if it is within standing range
+	if (TraceLightChannel(HitResult, PlayerPosition, PlayerPosition + (100 * FVector::DownVector)))
+	{
+		// If the player is standing on the detected floor below them, use it as the detection point for light detection
+		if (FVector::Distance(HitResult.Location, PlayerPosition) < 98)
+		{
+			LIGHT_DETECTION_DEBUG_MESSAGE(DebugDetectionPoint, 4, 0.1f, FColor::Red, TEXT("floor distance: %f"), FVector::Distance(HitResult.Location, PlayerPosition));
+			
+			DetectionPoint = HitResult.Location + (10 * FVector::UpVector);
+		}
+	}
+	// Otherwise just use the player's approximate feet position for the detection point if not on the floor
+	else
+	{
+		LIGHT_DETECTION_DEBUG_MESSAGE(DebugDetectionPoint, 5, 0.1f, FColor::Red, TEXT("no hit floor"));
+	}
+
+	return DetectionPoint;
+}
+
+void ALightDetectionManager::BuildDetectionResultTable()
+{
+	DetectionResults.Reset(PointLights.Num() + SpotLights.Num());
+	for (int idx = 0; idx < PointLights.Num(); idx++)
+	{
+		DetectionResults.Add(LightDetectionResult(ELightDetectionType::Point, idx));
+	}
+	for (int idx = 0; idx < SpotLights.Num(); idx++)
+	{
+		DetectionResults.Add(LightDetectionResult(ELightDetectionType::Spot, idx));
+	}
+
+	// Start every light with full urgency so the whole table is populated as soon as possible
+	for (LightDetectionResult& Result : DetectionResults)
+	{
+		Result.Urgency = TNumericLimits<float>::Max();
+	}
+
+	EvaluationOrder.Reset(DetectionResults.Num());
+	for (int idx = 0; idx < DetectionResults.Num(); idx++)
+	{
+		EvaluationOrder.Add(idx);
+	}
+}
+
+/// <summary>
+/// UpdateLightPriorities() accumulates every light's urgency from its last priority, then re-scores lights round robin from where the last tick
+/// stopped until RescoreEndTime. Only re-scoring reads a light's transform, so the time spent on UObjects each tick is bounded however many lights
+/// there are, and every light is still re-scored every few ticks. The evaluation order is then rebuilt as a heap on urgency rather than sorted.
+/// </summary>
+void ALightDetectionManager::UpdateLightPriorities(const FVector& DetectionPoint, float DeltaTime, double RescoreEndTime)
+{
+	LIGHT_DETECTION_SCOPE(UpdateLightPriorities);
+
+	// Saturate rather than overflow for lights that have never been evaluated
+	for (LightDetectionResult& Result : DetectionResults)
+	{
+		Result.Urgency = FMath::Min(Result.Urgency + (Result.Priority * DeltaTime), TNumericLimits<float>::Max());
+	}
+
+	// Re-score at least one light each tick, whatever the budget
+	for (int rescoredCount = 0; rescoredCount < DetectionResults.Num(); rescoredCount++)
+	{
+		if (rescoredCount > 0 && FPlatformTime::Seconds() >= RescoreEndTime)
+		{
+			break;
+		}
+
+		PriorityCursor = PriorityCursor < DetectionResults.Num() ? PriorityCursor : 0;
+		LightDetectionResult& Result = DetectionResults[PriorityCursor++];
+		const ULightComponent* Light = nullptr;
+		switch (Result.Type)
+		{
+		case ELightDetectionType::Point:
+			Light = PointLights[Result.LightIndex];
+			break;
+		case ELightDetectionType::Spot:
+			Light = SpotLights[Result.LightIndex];
+			break;
+		}
+
+		// Every light has a base priority so that even distant, unlit, static lights are eventually revisited
+		Result.Priority = 1.0f;
+
+		// Lights closer to the detection point than the near distance gain priority the closer they are
+		float LightDistance = FVector::Distance(Light->GetComponentLocation(), DetectionPoint);
+		if (LightDistance < NearPriorityDistance)
+		{
+			Result.Priority += NearPriorityBoost * (1.0f - (LightDistance / NearPriorityDistance));
+		}
+
+		// Lights that were lit last time are the most likely to change the total when they stop lighting the player
+		if (Result.Illuminance > 0)
+		{
+			Result.Priority += LitPriorityBoost;
+		}
+
+		// Lights that have moved or rotated since they were last evaluated have a stale result
+		if (!Light->GetComponentTransform().Equals(Result.LastLightTransform, 1.0f))
+		{
+			Result.Priority += MovingPriorityBoost;
+		}
+	}
+
+	EvaluationOrder.Reset();
+	for (int idx = 0; idx < DetectionResults.Num(); idx++)
+	{
+		EvaluationOrder.Add(idx);
+	}
+	EvaluationOrder.Heapify([this](int32 A, int32 B)
+	{
+		return DetectionResults[A].Urgency > DetectionResults[B].Urgency;
+	});
+}
+
+void ALightDetectionManager::ResolveIlluminanceTotal()
+{
+	// Point and spot lights set the total rather than add to it, so the total is the brightest result in the table
+	IlluminanceTotal = 0.0f;
+	for (const LightDetectionResult& Result : DetectionResults)
+	{
+		IlluminanceTotal = FMath::Max(IlluminanceTotal, Result.Illuminance);
+	}
+}
+
+/// <summary>
+/// GetIlluminanceAt() answers how lit any point in the world is, for systems other than the player such as AI, audio and VFX. The point is
+/// evaluated with the same detection pipeline as the player, against the light snapshots taken by the most recent detection update, but only
+/// the lights whose range reaches the point are considered. Occlusion can be skipped for a cheaper answer that treats every light in range as
+/// unobstructed.
+/// </summary>
+float ALightDetectionManager::GetIlluminanceAt(const FVector& Point, bool bSkipOcclusion)
+{
+	LIGHT_DETECTION_SCOPE(IlluminanceQuery);
+
+	const LightDetection::Vector3 CorePoint = LightDetectionAdapter::ToCoreVector(Point);
+	const LightDetection::DetectionSettings QuerySettings = Settings;
+	if (const LightDetection::LightCellScene* Cells = GetLightCells())
+	{
+		LightDetection::GatherCellCandidates(Scene, *Cells, CorePoint, QuerySettings, MaxPortalDepth, QueryCandidates);
+	}
+	else
+	{
+		LightDetection::GatherCandidates(Scene, CorePoint, CorePoint, QuerySettings, QueryCandidates, GetLightClusters(), bApproximateLightClusters);
+	}
+
+	FLightTraceOcclusionQuery TraceOcclusion = MakeOcclusionQuery();
+	LightDetection::NoOcclusionQuery NoOcclusion;
+	LightDetection::IOcclusionQuery& Occlusion = bSkipOcclusion ? static_cast<LightDetection::IOcclusionQuery&>(NoOcclusion) : TraceOcclusion;
+
+	// Query work is kept out of the per-update counters so it does not skew the player's detection stats. Answers made without occlusion are
+	// never cached, they would stand in for traced ones
+	LightDetection::DetectionCounters QueryCounters;
+	return LightDetection::EvaluateCandidates(Scene, QueryCandidates, CorePoint, QuerySettings, Occlusion, bSkipOcclusion ? nullptr : &QueryOcclusionCache, QueryCounters);
+}
+
+void ALightDetectionManager::GetIlluminanceAtPoints(const TArray<FVector>& Points, TArray<float>& OutIlluminance, bool bSkipOcclusion)
+{
+	LIGHT_DETECTION_SCOPE(IlluminanceQuery);
+
+	OutIlluminance.SetNumUninitialized(Points.Num());
+	if (Points.Num() == 0)
+	{
+		return;
+	}
+
+	// The points are evaluated together, so the lights that reach anywhere in the batch are gathered once and each spot light's occlusion tests
+	// against the points are batched from the light. Each point keeps the trace budget it would have had on its own
+	const LightDetection::DetectionSettings QuerySettings = Settings;
+
+	TArray<LightDetection::Vector3> CorePoints;
+	CorePoints.Reserve(Points.Num());
+	for (const FVector& Point : Points)
+	{
+		CorePoints.Add(LightDetectionAdapter::ToCoreVector(Point));
+	}
+
+	FLightTraceOcclusionQuery TraceOcclusion = MakeOcclusionQuery();
+	LightDetection::NoOcclusionQuery NoOcclusion;
+	LightDetection::IOcclusionQuery& Occlusion = bSkipOcclusion ? static_cast<LightDetection::IOcclusionQuery&>(NoOcclusion) : TraceOcclusion;
+
+	LightDetection::DetectionCounters QueryCounters;
+	LightDetection::EvaluateDetectionSamples(Scene, CorePoints.GetData(), CorePoints.Num(), QuerySettings, Occlusion, bSkipOcclusion ? nullptr : &QueryOcclusionCache, QueryCounters,
+		QueryCandidates, OutIlluminance.GetData(), GetLightClusters(), bApproximateLightClusters);
+}
+
+float ALightDetectionManager::GetPlayerIlluminance(const APawn* Pawn) const
+{
+	const FLightDetectionPlayerIlluminance* Item = FindReplicatedIlluminance(Pawn);
+	if (!Item)
+	{
+		return 0.0f;
+	}
+
+	// Only the server has the full precision value, clients have the byte it last sent
+	return GetNetMode() == NM_Client ? LightDetection::DequantizeIlluminance(Item->Illuminance, MaxReplicatedIlluminance) : Item->ServerIlluminance;
+}
+
+void ALightDetectionManager::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	DOREPLIFETIME(ALightDetectionManager, ReplicatedIlluminance);
+}
+
+void ALightDetectionManager::ApplyDetectionSettings()
+{
+	Settings.ForgivenessBuffer = ForgivenessBuffer;
+	Settings.MaxPointLightTraces = MaxPointLightTraces;
+	Settings.MaxSampleGroupExtent = MaxSampleGroupExtent;
+	Settings.OcclusionCacheTolerance = OcclusionCacheTolerance;
+	Settings.OcclusionCacheMaxAge = OcclusionCacheMaxAge;
+	Settings.RectLightSampleCount = RectLightSampleCount;
+	Settings.RectLightSamplesPerUpdate = RectLightSamplesPerUpdate;
+	Settings.bTransmission = bTransmission && OcclusionBackend == ELightOcclusionBackend::PhysicsScene;
+}
+
+void ALightDetectionManager::RecordUpdateStats(int32 AgentCount)
+{
+	INC_DWORD_STAT_BY(STAT_LightDetection_LightsTested, UpdateCounters.LightsTested);
+	INC_DWORD_STAT_BY(STAT_LightDetection_LightsCulled, UpdateCounters.LightsCulled);
+	INC_DWORD_STAT_BY(STAT_LightDetection_LightsReused, UpdateCounters.LightsReused);
+	INC_DWORD_STAT_BY(STAT_LightDetection_TracesIssued, UpdateCounters.TracesIssued);
+	INC_DWORD_STAT_BY(STAT_LightDetection_TracesSaved, UpdateCounters.TracesSaved);
+
+#if CSV_PROFILER
+	// Candidates are the lights that survived culling and went on to be traced or lit
+	CSV_CUSTOM_STAT(LightDetection, AgentCount, AgentCount, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(LightDetection, LightsTested, UpdateCounters.LightsTested, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(LightDetection, LightsCulled, UpdateCounters.LightsCulled, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(LightDetection, Candidates, UpdateCounters.LightsTested - UpdateCounters.LightsCulled, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(LightDetection, LightsReused, UpdateCounters.LightsReused, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(LightDetection, TracesIssued, UpdateCounters.TracesIssued, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(LightDetection, TracesSaved, UpdateCounters.TracesSaved, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(LightDetection, IlluminanceTotal, IlluminanceTotal, ECsvCustomStatOp::Set);
+#endif
+}
+
+/// <summary>
+/// ValidateDetectionModes() checks the enabled detection modes against each other once the lights and cells have been gathered, warning about
+/// every mode that another takes the place of. Only full single point updates that evaluate every point and spot light as itself can be
+/// replayed, so bRecordSession is turned off, with a warning for each reason, while any mode that breaks that is enabled.
+/// </summary>
+void ALightDetectionManager::ValidateDetectionModes()
+{
+	struct FModeConflict
+	{
+		bool bConflict;
+		const TCHAR* Reason;
+	};
+
+	// Each mode that is ignored, and the mode it is ignored for
+	const FModeConflict IgnoredModes[] =
+	{
+		{ bServerDetection && bTimeSlicedDetection, TEXT("Time-sliced detection is not used with server detection") },
+		{ bServerDetection && HasBodySamples(), TEXT("Body samples are not used with server detection") },
+		{ bServerDetection && bContinuousIlluminance, TEXT("Continuous illuminance is not used with server detection") },
+		{ bServerDetection && bUseLightCells, TEXT("Light cells are not used with server detection") },
+		{ bServerDetection && RectLights.Num() > 0, TEXT("Rect lights are not evaluated with server detection") },
+		{ !bServerDetection && bTimeSlicedDetection && HasBodySamples(), TEXT("Body samples are not used with time-sliced detection") },
+		{ !bServerDetection && bTimeSlicedDetection && bContinuousIlluminance, TEXT("Continuous illuminance is not used with time-sliced detection") },
+		{ !bServerDetection && bTimeSlicedDetection && bUseLightCells, TEXT("Light cells are not used with time-sliced detection") },
+		{ !bServerDetection && bTimeSlicedDetection && bClusterLights, TEXT("Light clusters are not used with time-sliced detection") },
+		{ !bServerDetection && !bTimeSlicedDetection && HasBodySamples() && bContinuousIlluminance, TEXT("Continuous illuminance is not used with body samples") },
+		{ !bServerDetection && !bTimeSlicedDetection && HasBodySamples() && bUseLightCells, TEXT("Light cells are not used with body samples") },
+	};
+	for (const FModeConflict& Mode : IgnoredModes)
+	{
+		if (Mode.bConflict)
+		{
+			UE_LOG(LogLightDetection, Warning, TEXT("%s: %s"), *GetName(), Mode.Reason);
+		}
+	}
+
+	if (!bRecordSession)
+	{
+		return;
+	}
+
+	// Each reason the session could not be replayed
+	const FModeConflict UnrecordableModes[] =
+	{
+		{ bServerDetection, TEXT("server detection evaluates every player") },
+		{ bTimeSlicedDetection, TEXT("time-sliced detection only evaluates some of the lights each update") },
+		{ HasBodySamples(), TEXT("body samples evaluate several points") },
+		{ bClusterLights && bApproximateLightClusters, TEXT("approximate light clusters evaluate a cluster as one light") },
+		{ bContinuousIlluminance, TEXT("continuous illuminance only samples some of the lights") },
+		{ GetLightCells() != nullptr, TEXT("light cells only evaluate the lights that can reach the player's cell") },
+	};
+	for (const FModeConflict& Mode : UnrecordableModes)
+	{
+		if (Mode.bConflict)
+		{
+			UE_LOG(LogLightDetection, Warning, TEXT("%s: The session is not recorded, %s"), *GetName(), Mode.Reason);
+			bRecordSession = false;
+		}
+	}
+}
+
+/// <summary>
+/// BeginSessionRecording() starts recording every detection update to a new file in Saved/Profiling/LightDetection. The recording begins with a
+/// snapshot of every registered light, after which each update only records the lights that have changed, the occlusion traces made, and the
+/// resulting IlluminanceTotal. The LightDetectionReplayer tool in LightDetectionCore re-runs detection over the file without the engine.
+/// </summary>
+void ALightDetectionManager::BeginSessionRecording()
+{
+	SessionRecordingPath = FPaths::ProfilingDir() / TEXT("LightDetection") / FString::Printf(TEXT("%s_%s.ldrec"), *GetName(), *FDateTime::Now().ToString());
+	SessionRecorder.BeginRecording(Scene);
+}
+
+void ALightDetectionManager::RecordLightSnapshots()
+{
+	// Every light is passed to the recorder, which only writes the ones that have changed since they were last recorded
+	for (int idx = 0; idx < PointLights.Num(); idx++)
+	{
+		SessionRecorder.RecordPointLight(idx, LightDetectionAdapter::MakePointLightData(PointLights[idx]));
+	}
+	for (int idx = 0; idx < SpotLights.Num(); idx++)
+	{
+		SessionRecorder.RecordSpotLight(idx, LightDetectionAdapter::MakeSpotLightData(SpotLights[idx]));
+	}
+	for (int idx = 0; idx < RectLights.Num(); idx++)
+	{
+		SessionRecorder.RecordRectLight(idx, LightDetectionAdapter::MakeRectLightData(RectLights[idx]));
+	}
+	if (MainDirectionalLight)
+	{
+		SessionRecorder.RecordDirectionalLight(LightDetectionAdapter::MakeDirectionalLightData(MainDirectionalLight));
+	}
+}
+
+void ALightDetectionManager::FlushSessionRecording()
+{
+	if (!SessionRecorder.IsRecording() || SessionRecorder.GetData().empty())
+	{
+		return;
+	}
+
+	const std::vector<uint8_t>& Data = SessionRecorder.GetData();
+	FFileHelper::SaveArrayToFile(TArrayView64<const uint8>(Data.data(), Data.size()), *SessionRecordingPath, &IFileManager::Get(), FILEWRITE_Append);
+	SessionRecorder.ClearData();
+}
+
+/// <summary>
+/// BuildOccluders() builds the occluders light detection traces against instead of the physics scene when the OccluderBVH or VoxelGrid backend
+/// is selected. Static light blocking geometry goes into a bounding volume hierarchy or is voxelized once, and movable light blocking components
+/// are kept as a small set of boxes that follow their components every update. Movable components of actors spawned or streamed in later are
+/// added to the boxes as they appear, but the static geometry of streamed in levels is not added, as that would mean building it all again.
+/// </summary>
+void ALightDetectionManager::BuildOccluders()
+{
+	LIGHT_DETECTION_SCOPE(BuildOccluders);
+
+	if (!ActorSpawnedHandle.IsValid())
+	{
+		ActorSpawnedHandle = GetWorld()->AddOnActorSpawnedHandler(FOnActorSpawned::FDelegate::CreateUObject(this, &ALightDetectionManager::OnActorSpawned));
+	}
+	if (!LevelAddedHandle.IsValid())
+	{
+		LevelAddedHandle = FWorldDelegates::LevelAddedToWorld.AddUObject(this, &ALightDetectionManager::OnLevelAddedToWorld);
+	}
+
+	if (OcclusionBackend == ELightOcclusionBackend::VoxelGrid)
+	{
+		std::vector<LightDetection::OccluderTriangle> Triangles;
+		LightDetectionAdapter::GatherOccluders(GetWorld(), ECollisionChannel::ECC_GameTraceChannel5, Triangles, DynamicOccluders);
+		OccluderVoxels.Build(Triangles, VoxelSize);
+		LightDetectionAdapter::UpdateDynamicOccluders(DynamicOccluders, Occluders);
+		OccluderQuery = MakeUnique<LightDetection::VoxelOcclusionQuery>(OccluderVoxels, Occluders.Dynamic);
+		SET_MEMORY_STAT(STAT_LightDetection_VoxelMemory, OccluderVoxels.GetAllocatedSize());
+		return;
+	}
+
+	LightDetectionAdapter::BuildOccluderScene(GetWorld(), ECollisionChannel::ECC_GameTraceChannel5, Occluders, DynamicOccluders);
+	OccluderQuery = MakeUnique<LightDetection::OccluderOcclusionQuery>(Occluders);
+	SET_MEMORY_STAT(STAT_LightDetection_OccluderMemory, Occluders.Static.GetAllocatedSize());
+}
+
+void ALightDetectionManager::UpdateOccluders()
+{
+	if (OccluderQuery)
+	{
+		LightDetectionAdapter::UpdateDynamicOccluders(DynamicOccluders, Occluders);
+	}
+}
+
+void ALightDetectionManager::OnActorSpawned(AActor* Actor)
+{
+	LightDetectionAdapter::GatherDynamicOccluders(Actor, ECollisionChannel::ECC_GameTraceChannel5, DynamicOccluders);
+}
+
+void ALightDetectionManager::OnLevelAddedToWorld(ULevel* Level, UWorld* World)
+{
+	if (World != GetWorld() || !Level)
+	{
+		return;
+	}
+
+	for (AActor* Actor : Level->Actors)
+	{
+		LightDetectionAdapter::GatherDynamicOccluders(Actor, ECollisionChannel::ECC_GameTraceChannel5, DynamicOccluders);
+	}
+}
+
+LightDetection::IOcclusionQuery* ALightDetectionManager::GetOcclusionBackend()
+{
+	return OccluderQuery.Get();
+}
+
+FLightTraceOcclusionQuery ALightDetectionManager::MakeOcclusionQuery(LightDetection::RecordingWriter* Recorder)
+{
+	FLightTraceOcclusionQuery Occlusion(GetWorld(), ECollisionChannel::ECC_GameTraceChannel5, Recorder, GetOcclusionBackend());
+	if (Settings.bTransmission)
+	{
+		Occlusion.SetTransmission(&Transmission);
+	}
+	return Occlusion;
+}
+
+LightDetection::RecordingWriter* ALightDetectionManager::GetSessionRecorder()
+{
+	return SessionRecorder.IsRecording() ? &SessionRecorder : nullptr;
+}
+
+void ALightDetectionManager::FlushVisualizer()
+{
+#if LIGHT_DETECTION_DEBUG
+	// Lights only add geometry to the visualizer while their debug flag is set, so hide the layers whose flags have been turned off
+	Visualizer->SetLayerVisible(ELightVisualizerLayer::PointLights, DebugPointLights);
+	Visualizer->SetLayerVisible(ELightVisualizerLayer::SpotLights, DebugSpotLights);
+	Visualizer->SetLayerVisible(ELightVisualizerLayer::RectLights, DebugRectLights);
+	Visualizer->SetLayerVisible(ELightVisualizerLayer::DirectionalLight, DebugDirectionalLight);
+	Visualizer->FlushChanges();
+#endif
+}
+
+/// <summary>
+/// CheckPointLights() finds whether any point light reaches the player. Every point light in range is a candidate, and they are traced for
+/// occlusion nearest first. Point lights do not add up, so the search stops at the first light with nothing in the way, while a light only
+/// partly seen through foliage or glass leaves it going in case a farther light is brighter, and the brightest found sets the total. At most
+/// MaxPointLightTraces traces are made per update, and a light whose cached answer is still valid is not traced again, so point light
+/// occlusion costs a few traces per update however many lights are in range.
+/// </summary>
+void ALightDetectionManager::CheckPointLights(FVector PlayerPosition)
+{
+	LIGHT_DETECTION_SCOPE(CheckPointLights);
+
+	// With cells the candidates were gathered by GatherCellCandidates() for this update. Otherwise snapshot the point lights that may have changed,
+	// lights that are switched off or out of range are culled by the detection core, and with clusters only the lights whose cluster reaches the
+	// player are candidates
+	const LightDetection::Vector3 CorePosition = LightDetectionAdapter::ToCoreVector(PlayerPosition);
+	if (!GetLightCells())
+	{
+		UpdateCandidates.Reset();
+		SnapshotPointLights();
+		if (const LightDetection::PointLightClusters* Clusters = GetLightClusters())
+		{
+			LightDetection::GatherClusteredPointLights(Scene, *Clusters, CorePosition, CorePosition, Settings, bApproximateLightClusters, UpdateCandidates);
+		}
+		else
+		{
+			for (int idx = 0; idx < PointLights.Num(); idx++)
+			{
+				UpdateCandidates.PointLights.push_back(idx);
+			}
+		}
+	}
+
+	FLightTraceOcclusionQuery Occlusion = MakeOcclusionQuery(GetSessionRecorder());
+	int32 TracesLeft = Settings.MaxPointLightTraces;
+	int32 LitLightIndex;
+	LightDetection::LightSample Sample = LightDetection::EvaluatePointLightCandidates(Scene, UpdateCandidates, CorePosition, Settings,
+		Occlusion, &PointLightOcclusionCache, TracesLeft, UpdateCounters, LitLightIndex);
+
+	// If a light lights the player, the total is its relative intensity
+	if (Sample.Evaluation == LightDetection::LightEvaluation::Lit)
+	{
+		IlluminanceTotal = Sample.Illuminance;
+	}
+
+	// Show each point light's attenuation sphere and the ray from it to the player, only the light that reached the player is shown lit, or
+	// every light of the cluster that did when clusters are approximated
+#if LIGHT_DETECTION_DEBUG
+	if (DebugPointLights)
+	{
+		const int32 LitClusterIndex = LitLightIndex - PointLights.Num();
+		for (int idx = 0; idx < PointLights.Num(); idx++)
+		{
+			const bool bLit = idx == LitLightIndex || (LitClusterIndex >= 0 && LightClusters.LightClusters[idx] == LitClusterIndex);
+			Visualizer->UpdatePointLight(PointLights[idx], PlayerPosition, bLit);
+		}
+	}
+#endif
+}
+
+/// <summary>
+/// EstimatePointLights() finds how much light all of the point lights in range add up to on the player, for continuous illuminance. Rather
+/// than tracing every light in range, StochasticLightSamples lights are picked from the light tree each update, each with a chance in
+/// proportion to how much it could add, and only those are traced. Each update's samples are averaged into the estimate kept from earlier
+/// updates, and when the player moves the earlier samples count for less the further they have gone, over LightHistoryFadeDistance, so the
+/// noise in the estimate stays low while they walk and fades away entirely while they stand still.
+/// </summary>
+void ALightDetectionManager::EstimatePointLights(FVector PlayerPosition)
+{
+	LIGHT_DETECTION_SCOPE(CheckPointLights);
+
+	// The tree's bounds and intensities must match the lights, or it would never pick a light that has been switched on since it was refit
+	SnapshotPointLights();
+	if (bPointLightTreeDirty)
+	{
+		PointLightImportanceTree.Refit(Scene);
+		bPointLightTreeDirty = false;
+	}
+
+	LightDetection::StochasticEstimatorSettings EstimatorSettings;
+	EstimatorSettings.SamplesPerUpdate = StochasticLightSamples;
+	EstimatorSettings.MaxAccumulatedSamples = MaxAccumulatedLightSamples;
+	EstimatorSettings.HistoryFadeDistance = LightHistoryFadeDistance;
+
+	FLightTraceOcclusionQuery Occlusion = MakeOcclusionQuery();
+	IlluminanceTotal = LightDetection::EstimatePointLightIlluminance(Scene, PointLightImportanceTree, LightDetectionAdapter::ToCoreVector(PlayerPosition), Settings,
+		EstimatorSettings, Occlusion, PointLightEstimate, UpdateCounters);
+}
+
+LightDetection::LightSample ALightDetectionManager::EvaluatePointLight(int32 LightIndex, const FVector& PlayerPosition, FLightTraceOcclusionQuery& Occlusion)
+{
+	SnapshotPointLight(LightIndex);
+	LightDetection::LightSample Sample = LightDetection::EvaluatePointLight(Scene.PointLights[LightIndex], LightDetectionAdapter::ToCoreVector(PlayerPosition), Settings, Occlusion, UpdateCounters);
+
+	// Show this point light's attenuation sphere and the ray from it to the player
+#if LIGHT_DETECTION_DEBUG
+	if (DebugPointLights)
+	{
+		Visualizer->UpdatePointLight(PointLights[LightIndex], PlayerPosition, Sample.Evaluation == LightDetection::LightEvaluation::Lit);
+	}
+#endif
+
+	return Sample;
+}
+
+void ALightDetectionManager::CheckSpotLights(FVector PlayerPosition)
+{
+	LIGHT_DETECTION_SCOPE(CheckSpotLights);
+
+	FLightTraceOcclusionQuery Occlusion = MakeOcclusionQuery(GetSessionRecorder());
+
+	// A spot light that lights the player raises the total to its relative intensity if it is brighter than the lights so far, or adds to the
+	// point lights' estimate with continuous illuminance, where every light in range adds up
+	const auto ApplySample = [this](const LightDetection::LightSample& Sample)
+	{
+		if (Sample.Evaluation == LightDetection::LightEvaluation::Lit)
+		{
+			IlluminanceTotal = bContinuousIlluminance ? IlluminanceTotal + Sample.Illuminance : FMath::Max(IlluminanceTotal, Sample.Illuminance);
+		}
+	};
+
+	// With cells only the spot lights GatherCellCandidates() found can reach the player's cell are evaluated, in the same order as without them
+	if (GetLightCells())
+	{
+		for (const int32 LightIndex : UpdateCandidates.SpotLights)
+		{
+			ApplySample(EvaluateSpotLight(LightIndex, PlayerPosition, Occlusion));
+		}
+		return;
+	}
+
+	// For each spot light in the spot lights array
+	for (int idx = 0; idx < SpotLights.Num(); idx++)
+	{
+		ApplySample(EvaluateSpotLight(idx, PlayerPosition, Occlusion));
+	}
+}
+
+LightDetection::LightSample ALightDetectionManager::EvaluateSpotLight(int32 LightIndex, const FVector& PlayerPosition, FLightTraceOcclusionQuery& Occlusion)
+{
+	SnapshotSpotLight(LightIndex);
+	LightDetection::LightSample Sample = LightDetection::EvaluateSpotLight(Scene.SpotLights[LightIndex], LightDetectionAdapter::ToCoreVector(PlayerPosition), Settings, Occlusion, UpdateCounters);
+
+	// Show what is blocking this spot light, the name is only looked up when the message is going to be shown
+	if (Sample.Evaluation == LightDetection::LightEvaluation::Occluded)
+	{
+		LIGHT_DETECTION_DEBUG_MESSAGE(DebugSpotLights, 3, 5.0f, FColor::Red, TEXT("%s"), *GetNameSafe(Occlusion.GetLastHitResult().GetActor()));
+	}
+
+	// Show this spot light's outer cone and the ray from it to the player
+#if LIGHT_DETECTION_DEBUG
+	if (DebugSpotLights)
+	{
+		Visualizer->UpdateSpotLight(SpotLights[LightIndex], PlayerPosition, Sample.Evaluation == LightDetection::LightEvaluation::Lit);
+	}
+#endif
+
+	return Sample;
+}
+
+void ALightDetectionManager::CheckRectLights()
+{
+	LIGHT_DETECTION_SCOPE(CheckRectLights);
+
+	// Rect light traces are recorded along with the point and spot lights' so the replayer can evaluate them too
+	FLightTraceOcclusionQuery Occlusion = MakeOcclusionQuery(GetSessionRecorder());
+	FVector PlayerPosition = Player->GetActorLocation();
+	RectLightSampleStates.SetNum(RectLights.Num());
+
+	// For each rect light in the rect lights array
+	for (int idx = 0; idx < RectLights.Num(); idx++)
+	{
+		// If this rect light is not visible in the scene, skip it
+		if (!RectLights[idx]->IsVisible())
+		{
+			continue;
+		}
+
+		// If this rect light is dynamic, re-calculate the frustum points and bounding planes
+		Scene.RectLights[idx] = LightDetectionAdapter::MakeRectLightData(RectLights[idx]);
+		if (RectLights[idx]->Mobility != EComponentMobility::Static)
+		{
+			LIGHT_DETECTION_SCOPE(CalculateFrustum);
+			LightDetection::CalculateFrustumPoints(Scene.RectLights[idx], Scene.RectFrustums[idx]);
+			LightDetection::CalculateBoundingPlanes(Scene.RectFrustums[idx]);
+		}
+
+		// If the player is infront of all the bounding planes, add the relative illuminance from the part of this light's emitter that can see them
+		LightDetection::LightSample Sample = LightDetection::EvaluateRectLightArea(Scene.RectLights[idx], Scene.RectFrustums[idx], LightDetectionAdapter::ToCoreVector(PlayerPosition), Settings, Occlusion,
+			RectLightSampleStates[idx], UpdateCounters);
+		IlluminanceTotal += Sample.Illuminance;
+
+		/////// DEBUG DRAWING ///////
+#if LIGHT_DETECTION_DEBUG
+		if (DebugRectLights)
+		{
+			// Show the barn door frustum for this rect light and the ray from it to the player
+			FVector FrustumPoints[8];
+			for (int pointIdx = 0; pointIdx < 8; pointIdx++)
+			{
+				FrustumPoints[pointIdx] = LightDetectionAdapter::ToFVector(Scene.RectFrustums[idx].FrustumPoints[pointIdx]);
+			}
+			Visualizer->UpdateRectLight(RectLights[idx], MakeArrayView(FrustumPoints, 8), PlayerPosition, Sample.Evaluation == LightDetection::LightEvaluation::Lit);
+		}
+#endif
+	}
+}
+
+void ALightDetectionManager::CheckDirectionalLight()
+{
+	LIGHT_DETECTION_SCOPE(CheckDirectionalLight);
+
+	// If there is not directional light in the scene, skip it
+	if (!MainDirectionalLight)
+	{
+		return;
+	}
+
+	// If the main directional light is not visible, skip it
+	if (!MainDirectionalLight->IsVisible())
+	{
+		return;
+	}
+
+	// The directional light is traced against the visibility channel from a point 5000cm back along its direction from the player
+	FLightTraceOcclusionQuery Occlusion(GetWorld(), ECollisionChannel::ECC_Visibility);
+	LightDetection::Vector3 PlayerPosition = LightDetectionAdapter::ToCoreVector(Player->GetActorLocation());
+	Scene.DirectionalLight = LightDetectionAdapter::MakeDirectionalLightData(MainDirectionalLight);
+
+	LightDetection::LightSample Sample = LightDetection::EvaluateDirectionalLight(Scene.DirectionalLight, PlayerPosition, Settings, Occlusion, UpdateCounters);
+	IlluminanceTotal += Sample.Illuminance;
+
+	// Show the ray from the directional light to the player (DEBUG ONLY)
+#if LIGHT_DETECTION_DEBUG
+	if (DebugDirectionalLight)
+	{
+		FVector DirectionalLightPosition = LightDetectionAdapter::ToFVector(LightDetection::GetDirectionalLightRayStart(Scene.DirectionalLight, PlayerPosition, Settings.DirectionalLightDistance));
+		Visualizer->UpdateDirectionalLight(MainDirectionalLight, DirectionalLightPosition, LightDetectionAdapter::ToFVector(PlayerPosition), Sample.Evaluation == LightDetection::LightEvaluation::Lit);
+	}
+#endif
+}
+
+bool ALightDetectionManager::HasBodySamples() const
+{
+	return bSampleTorso || bSampleHead || SampleSockets.Num() > 0;
+}
+
+void ALightDetectionManager::GatherBodySamples(const FVector& DetectionPoint, TArray<FVector>& OutSamples) const
+{
+	OutSamples.Reset();
+	OutSamples.Add(DetectionPoint);
+
+	// The torso is the middle of the capsule, and the head sits just inside its top
+	FVector PlayerPosition = Player->GetActorLocation();
+	if (bSampleTorso)
+	{
+		OutSamples.Add(PlayerPosition);
+	}
+	if (bSampleHead)
+	{
+		OutSamples.Add(PlayerPosition + ((Player->GetCapsuleComponent()->GetScaledCapsuleHalfHeight() - 10) * FVector::UpVector));
+	}
+
+	const USkeletalMeshComponent* Mesh = Player->GetMesh();
+	for (const FName& SocketName : SampleSockets)
+	{
+		if (Mesh && Mesh->DoesSocketExist(SocketName))
+		{
+			OutSamples.Add(Mesh->GetSocketLocation(SocketName));
+		}
+	}
+}
+
+/// <summary>
+/// CheckBodySamples() evaluates the detection point together with the enabled body samples, so a player whose head or torso is in the light
+/// reads as lit even when their feet are in shadow. Every light is snapshotted, then the detection core gathers the lights that can reach any
+/// of the samples in a single broad phase and tests each of them against every sample in turn. Each sample has its own MaxPointLightTraces
+/// budget, so the samples evaluated first cannot leave the rest without traces. The player is as lit as their most lit sample.
+/// The visualizer is not updated in this mode.
+/// </summary>
+void ALightDetectionManager::CheckBodySamples(const FVector& DetectionPoint)
+{
+	LIGHT_DETECTION_SCOPE(CheckBodySamples);
+
+	// The broad phase considers every light, so they all need to be up to date
+	SnapshotPointAndSpotLights();
+
+	GatherBodySamples(DetectionPoint, BodySamples);
+	TArray<LightDetection::Vector3, TInlineAllocator<8>> CoreSamples;
+	for (const FVector& Sample : BodySamples)
+	{
+		CoreSamples.Add(LightDetectionAdapter::ToCoreVector(Sample));
+	}
+	BodySampleIlluminance.SetNumUninitialized(BodySamples.Num());
+
+	FLightTraceOcclusionQuery Occlusion = MakeOcclusionQuery();
+	LightDetection::EvaluateDetectionSamples(Scene, CoreSamples.GetData(), CoreSamples.Num(), Settings, Occlusion, &PointLightOcclusionCache,
+		UpdateCounters, BodySampleCandidates, BodySampleIlluminance.GetData(), GetLightClusters(), bApproximateLightClusters);
+
+	for (int idx = 0; idx < BodySampleIlluminance.Num(); idx++)
+	{
+		IlluminanceTotal = FMath::Max(IlluminanceTotal, BodySampleIlluminance[idx]);
+		LIGHT_DETECTION_DEBUG_MESSAGE(DebugDetectionPoint, 10 + idx, 0.1f, FColor::Red, TEXT("body sample %d illuminance: %f"), idx, BodySampleIlluminance[idx]);
+	}
+}
+
+void ALightDetectionManager::SnapshotPointAndSpotLights()
+{
+	SnapshotPointLights();
+	for (int idx = 0; idx < SpotLights.Num(); idx++)
+	{
+		SnapshotSpotLight(idx);
+	}
+}
+
+void ALightDetectionManager::SnapshotPointLights()
+{
+	if (!GetLightClusters())
+	{
+		for (int idx = 0; idx < PointLights.Num(); idx++)
+		{
+			SnapshotPointLight(idx);
+		}
+		return;
+	}
+
+	for (const int32 LightIndex : UnclusteredPointLights)
+	{
+		SnapshotPointLight(LightIndex);
+	}
+	for (const int32 LightIndex : ChangedPointLights)
+	{
+		SnapshotPointLight(LightIndex);
+	}
+	ChangedPointLights.Reset();
+
+	// Clustered lights nothing has reported are refreshed a few at a time, so a light switched from a script that does not report it still
+	// has its cluster updated within a few updates
+	const int32 RefreshCount = FMath::Min(StaticLightRefreshCount, ClusteredPointLights.Num());
+	for (int idx = 0; idx < RefreshCount; idx++)
+	{
+		ClusteredLightCursor = (ClusteredLightCursor + 1) % ClusteredPointLights.Num();
+		SnapshotPointLight(ClusteredPointLights[ClusteredLightCursor]);
+	}
+}
+
+/// <summary>
+/// GatherCellCandidates() walks out from the player's cell once per update, gathering the point and spot lights that can reach them into
+/// UpdateCandidates for both CheckPointLights() and CheckSpotLights(). The lights in cells do not move, so only the lights outside any cell,
+/// those reported to NotifyLightChanged() and StaticLightRefreshCount others in turn are snapshotted before the walk, and the lights it gathers
+/// are snapshotted after it, so a light that has been switched off since it was last snapshotted is still culled before it is traced.
+/// </summary>
+void ALightDetectionManager::GatherCellCandidates(const FVector& PlayerPosition)
+{
+	LIGHT_DETECTION_SCOPE(GatherCellCandidates);
+
+	for (const int32 LightIndex : LightCells.UnassignedPointLights)
+	{
+		SnapshotPointLight(LightIndex);
+	}
+	for (const int32 LightIndex : LightCells.UnassignedSpotLights)
+	{
+		SnapshotSpotLight(LightIndex);
+	}
+	for (const int32 LightIndex : ChangedPointLights)
+	{
+		SnapshotPointLight(LightIndex);
+	}
+	for (const int32 LightIndex : ChangedSpotLights)
+	{
+		SnapshotSpotLight(LightIndex);
+	}
+	ChangedPointLights.Reset();
+	ChangedSpotLights.Reset();
+
+	// A light in a cell switched on from a script that does not report it would never be gathered again, so a few are refreshed each update
+	const int32 LightCount = PointLights.Num() + SpotLights.Num();
+	const int32 RefreshCount = FMath::Min(StaticLightRefreshCount, LightCount);
+	for (int idx = 0; idx < RefreshCount; idx++)
+	{
+		CellLightCursor = (CellLightCursor + 1) % LightCount;
+		if (CellLightCursor < PointLights.Num())
+		{
+			SnapshotPointLight(CellLightCursor);
+		}
+		else
+		{
+			SnapshotSpotLight(CellLightCursor - PointLights.Num());
+		}
+	}
+
+	LightDetection::GatherCellCandidates(Scene, LightCells, LightDetectionAdapter::ToCoreVector(PlayerPosition), Settings, MaxPortalDepth, UpdateCandidates);
+
+	// Spot light candidates are snapshotted as they are evaluated
+	for (const int32 LightIndex : UpdateCandidates.PointLights)
+	{
+		SnapshotPointLight(LightIndex);
+	}
+}
+
+void ALightDetectionManager::NotifyLightChanged(ULightComponent* Light)
+{
+	const int32 PointLightIndex = PointLights.IndexOfByKey(Light);
+	if (PointLightIndex != INDEX_NONE)
+	{
+		ChangedPointLights.AddUnique(PointLightIndex);
+	}
+	const int32 SpotLightIndex = SpotLights.IndexOfByKey(Light);
+	if (SpotLightIndex != INDEX_NONE)
+	{
+		ChangedSpotLights.AddUnique(SpotLightIndex);
+	}
+}
+
+void ALightDetectionManager::SnapshotPointLight(int32 LightIndex)
+{
+	const LightDetection::PointLightData Snapshot = LightDetectionAdapter::MakePointLightData(PointLights[LightIndex]);
+	if (LightDetection::IsSameLight(Snapshot, Scene.PointLights[LightIndex]))
+	{
+		return;
+	}
+	Scene.PointLights[LightIndex] = Snapshot;
+	bPointLightTreeDirty = true;
+
+	// A clustered light switched on or off or changed in brightness changes its cluster's bounds and virtual light
+	if (GetLightClusters() && LightClusters.LightClusters[LightIndex] >= 0)
+	{
+		LightDetection::UpdatePointLightCluster(Scene, LightClusters, LightClusters.LightClusters[LightIndex]);
+	}
+}
+
+void ALightDetectionManager::SnapshotSpotLight(int32 LightIndex)
+{
+	Scene.SpotLights[LightIndex] = LightDetectionAdapter::MakeSpotLightData(SpotLights[LightIndex]);
+}
+
+const LightDetection::LightCellScene* ALightDetectionManager::GetLightCells() const
+{
+	return bUseLightCells && !LightCells.Cells.empty() ? &LightCells : nullptr;
+}
+
+const LightDetection::PointLightClusters* ALightDetectionManager::GetLightClusters() const
+{
+	return bClusterLights && LightClusters.LightClusters.size() == Scene.PointLights.size() ? &LightClusters : nullptr;
+}
+
+bool ALightDetectionManager::TraceLightChannel(FHitResult& HitResult, const FVector& Start, const FVector& End, ECollisionChannel TraceChannel)
+{
+	LIGHT_DETECTION_SCOPE(SceneQuery);
+
+	return GetWorld()->LineTraceSingleByChannel(HitResult, Start, End, TraceChannel);
+}
+
+/// <summary>
+/// If time-sliced detection is enabled, every Tick evaluates a budgeted slice of the lights through UpdateDetectionTimeSliced().
+/// Otherwise Tick only runs on the actor tick interval, so each Tick is a detection update. The difference between the time that actually
+/// passed and the target update period is accumulated in UpdateTimeError and taken off the next tick interval, so overshoot from
+/// low frame rates is paid back rather than lost and the average update rate stays at the UpdateFrequency.
+/// </summary>
+void ALightDetectionManager::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	// Query answers age once per tick whatever detection mode is running
+	QueryOcclusionCache.BeginUpdate();
+
+	// Time-sliced detection spreads its work across every tick rather than bursting on the tick interval
+	if (bTimeSlicedDetection && !bServerDetection)
+	{
+		UpdateDetectionTimeSliced(DeltaTime);
+		return;
+	}
+
+	// Call a detection update, with server authoritative detection only the server runs detection and clients read their result from it
+	if (!bServerDetection)
+	{
+		UpdateDetection();
+	}
+	else if (IsServerDetectionClient())
+	{
+		if (bClientPrediction)
+		{
+			UpdateClientPrediction();
+		}
+		else
+		{
+			ReadReplicatedIlluminance();
+		}
+	}
+	else
+	{
+		UpdateServerDetection();
+	}
+
+	// Accumulate how late (positive) or early (negative) this update was, clamped to one period so a long hitch does not cause a burst of catch-up updates
+	const float UpdatePeriod = 1 / UpdateFrequency;
+	UpdateTimeError = FMath::Clamp(UpdateTimeError + (DeltaTime - UpdatePeriod), -UpdatePeriod, UpdatePeriod);
+
+	// Schedule the next update early or late by the accumulated error
+	SetActorTickInterval(FMath::Max(UpdatePeriod - UpdateTimeError, 0.0f));
+}
@@ -1,101 +1,526 @@
-/*
- * Author: Ronan Richardson
- * Contributors: N/A
- * Date: 18/08/2022
- * Folder: Source\Planet_NineMP\Public\
- */
-
-#pragma once
-#include "CoreMinimal.h"
-#include "../Planet_NineMPCharacter.h"
-#include "GameFramework/Actor.h"
-#include "LightDetectionManager.generated.h"
-
-// Forward Declarations
-class UPointLightComponent;
-class USpotLightComponent;
-class URectLightComponent;
-class UDirectionalLightComponent;
-
-struct RectLightWrapper
-{
-	// Reference to the rect light this wrapper represents
-	URectLightComponent* RectLight;
-
-	// Index starts at the near plane top left, moves counterclockwise
-	TArray<FVector> FrustumPoints;
-	
-	// Index starts at the top plane, moves counterclockwise
-	TArray<FPlane> BoundingPlanes;
-
-	RectLightWrapper(URectLightComponent* rectLight)
-	{
-		RectLight = rectLight;
-		FrustumPoints.Init(FVector(0), 8);
-		BoundingPlanes.Init(FPlane::FPlane(), 4);
-	}
-};
-
-UCLASS()
-class PLANET_NINEMP_API ALightDetectionManager : public AActor
-{
-
-	GENERATED_BODY()
-	
-public:	
-	
-	// Sets default values for this actor's properties
-	ALightDetectionManager();
-
-	// Called every frame
-	virtual void Tick(float DeltaTime) override;
-
-protected:
-	
-	// Called when the game starts or when spawned
-	virtual void BeginPlay() override;
-	// Called every (tick amount)
-	virtual void UpdateDetection();
-
-	void CheckPointLights(FVector PlayerPosition);
-	void CheckSpotLights(FVector PlayerPosition);
-	void CheckRectLights();
-	void CheckDirectionalLight();
-
-	void CalculateFrustumPoints(RectLightWrapper* rectLightWrapper);
-	void CalculateBoundingPlanes(RectLightWrapper* rectLightWrapper);
-
-	// Reference to the main character
-	APlanet_NineMPCharacter* Player;
-
-	// Dyanamic lists of all tagged lights in the scene
-	TArray<UPointLightComponent*> PointLights;
-	TArray<USpotLightComponent*> SpotLights;
-	TArray<RectLightWrapper*> RectLights;
-	UDirectionalLightComponent* MainDirectionalLight;
-
-	// The current total light intensity that is falling on the player, unitless
-	UPROPERTY(BlueprintReadWrite, Category = "Light Detection");
-	float IlluminanceTotal;
-	
-	// The amount of light detection calculations the detection manager will perform per-second
-	UPROPERTY(EditAnywhere, Category = "Light Detection");
-	float UpdateFrequency = 50.0f;
-	float UpdateTimer;
-
-	// Debug command bools
-	UPROPERTY(EditAnywhere, Category = "Debug");
-	bool DebugIlluminanceTotal = false;
-	UPROPERTY(EditAnywhere, Category = "Debug");
-	bool DebugPointLights = false;
-	UPROPERTY(EditAnywhere, Category = "Debug");
-	bool DebugSpotLights = false;
-	UPROPERTY(EditAnywhere, Category = "Debug");
-	bool DebugRectLights = false;
-	UPROPERTY(EditAnywhere, Category = "Debug");
-	bool DebugDirectionalLight = false;
-
-	// Undetermined
-	UPROPERTY(EditAnywhere, Category = "Light Detection");
-	float ForgivenessBuffer;
-};
+/*
+ * Author: Ronan Richardson
+ * Contributors: N/A
+ * Date: 18/08/2022
+ * Folder: Source\Planet_NineMP\Public\
+ */
+
+#pragma once
+#include "CoreMinimal.h"
+#include "../Planet_NineMPCharacter.h"
+#include "GameFramework/Actor.h"
+#include "Engine/NetSerialization.h"
+#include "LightDetectionCoreAdapter.h"
+#include "LightDetectionManager.generated.h"
+
+// Forward Declarations
+class ULightComponent;
+class UPointLightComponent;
+class USpotLightComponent;
+class URectLightComponent;
+class UDirectionalLightComponent;
+class UPrimitiveComponent;
+class ULightDetectionVisualizerComponent;
+class ULevel;
+
+// The light arrays a detection result entry can refer to
+enum class ELightDetectionType : uint8
+{
+	Point,
+	Spot
+};
+
+// Where light detection's occlusion queries are answered
+UENUM(BlueprintType)
+enum class ELightOcclusionBackend : uint8
+{
+	// Line traces against the physics scene on the light detection trace channel
+	PhysicsScene,
+	// A hierarchy built at BeginPlay from the level's light blocking collision, which never touches the physics scene
+	OccluderBVH,
+	// The same collision voxelized into a sparse grid at BeginPlay and ray marched, coarse and conservative but cheaper still
+	VoxelGrid
+};
+
+struct LightDetectionResult
+{
+	// Which light array this entry refers to, and the index of the light within it
+	ELightDetectionType Type;
+	int32 LightIndex;
+
+	// The illuminance this light contributed the last time it was evaluated, unitless
+	float Illuminance;
+
+	// Scheduling state for time-sliced detection, urgency accumulates priority until the light is next evaluated
+	float Priority;
+	float Urgency;
+	FTransform LastLightTransform;
+
+	LightDetectionResult(ELightDetectionType type, int32 lightIndex)
+	{
+		Type = type;
+		LightIndex = lightIndex;
+		Illuminance = 0.0f;
+		Priority = 1.0f;
+		Urgency = 0.0f;
+		LastLightTransform = FTransform::Identity;
+	}
+};
+
+// One player's illuminance as replicated to clients by server authoritative detection
+USTRUCT()
+struct FLightDetectionPlayerIlluminance : public FFastArraySerializerItem
+{
+
+	GENERATED_BODY()
+
+	UPROPERTY();
+	APawn* Pawn = nullptr;
+	// The illuminance quantized to a byte, see LightDetection::QuantizeIlluminance()
+	UPROPERTY();
+	uint8 Illuminance = 0;
+	// Goes up each time the illuminance is sent, with the detection point it was evaluated at, so predicting clients can reconcile with it
+	UPROPERTY();
+	uint16 Sequence = 0;
+	UPROPERTY();
+	FVector_NetQuantize DetectionPoint = FVector::ZeroVector;
+
+	// Server only, the full precision illuminance from the latest update and what was last sent to clients
+	float ServerIlluminance = 0.0f;
+	LightDetection::ReplicatedIlluminanceState SendState;
+};
+
+// Every player's illuminance, delta serialized so a replication update only carries the players whose entry was marked dirty
+USTRUCT()
+struct FLightDetectionPlayerIlluminanceArray : public FFastArraySerializer
+{
+
+	GENERATED_BODY()
+
+	UPROPERTY();
+	TArray<FLightDetectionPlayerIlluminance> Items;
+
+	// Server only, the bits written for the array to every connection since the manager last read them for the bandwidth stats
+	int64 SerializedBits = 0;
+
+	bool NetDeltaSerialize(FNetDeltaSerializeInfo& DeltaParms)
+	{
+		const int64 StartBits = DeltaParms.Writer ? DeltaParms.Writer->GetNumBits() : 0;
+		const bool bResult = FFastArraySerializer::FastArrayDeltaSerialize<FLightDetectionPlayerIlluminance, FLightDetectionPlayerIlluminanceArray>(Items, DeltaParms, *this);
+		if (DeltaParms.Writer)
+		{
+			SerializedBits += DeltaParms.Writer->GetNumBits() - StartBits;
+		}
+		return bResult;
+	}
+};
+
+template<>
+struct TStructOpsTypeTraits<FLightDetectionPlayerIlluminanceArray> : public TStructOpsTypeTraitsBase2<FLightDetectionPlayerIlluminanceArray>
+{
+	enum
+	{
+		WithNetDeltaSerializer = true
+	};
+};
+
+UCLASS()
+class PLANET_NINEMP_API ALightDetectionManager : public AActor
+{
+
+	GENERATED_BODY()
+	
+public:	
+	
+	// Sets default values for this actor's properties
+	ALightDetectionManager();
+
+	// Called every update, or every frame when time-sliced
+	virtual void Tick(float DeltaTime) override;
+
+	// How lit an arbitrary point is, evaluated the same way as the player's detection point against the lights as they were last updated.
+	// Skipping occlusion gives a cheap approximation that ignores anything between the lights and the point
+	UFUNCTION(BlueprintCallable, Category = "Light Detection")
+	float GetIlluminanceAt(const FVector& Point, bool bSkipOcclusion = false);
+	// The batched form of GetIlluminanceAt(), the lights that can reach any of the points are found once for the whole batch and each spot light's
+	// occlusion tests are made together, which suits groups of agents near one another
+	UFUNCTION(BlueprintCallable, Category = "Light Detection")
+	void GetIlluminanceAtPoints(const TArray<FVector>& Points, TArray<float>& OutIlluminance, bool bSkipOcclusion = false);
+
+	// How lit a player is according to server authoritative detection. The server answers at full precision, clients with the last value
+	// replicated to them. Returns 0 for pawns the server has not evaluated, or when bServerDetection is disabled
+	UFUNCTION(BlueprintCallable, Category = "Light Detection")
+	float GetPlayerIlluminance(const APawn* Pawn) const;
+
+	// Tells detection a registered light has been switched on or off, or has changed brightness or range. Static lights in clusters or cells are
+	// only snapshotted when they are reported here, or in turn StaticLightRefreshCount lights an update, until they can reach the player
+	UFUNCTION(BlueprintCallable, Category = "Light Detection")
+	void NotifyLightChanged(ULightComponent* Light);
+
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
+protected:
+	
+	// Called when the game starts or when spawned
+	virtual void BeginPlay() override;
+	// Called when the game ends or the manager is destroyed
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+	// Called every (tick amount)
+	virtual void UpdateDetection();
+	// Called every tick instead of UpdateDetection() when time-sliced detection is enabled
+	virtual void UpdateDetectionTimeSliced(float DeltaTime);
+	// Called every update on the server instead of UpdateDetection() when server authoritative detection is enabled
+	virtual void UpdateServerDetection();
+
+	// Server authoritative detection, sends the players whose illuminance has changed on the server, and reads the local player's on clients
+	void ReplicateIlluminance(const TArray<APlanet_NineMPCharacter*>& Players, const TArray<LightDetection::Vector3>& DetectionPoints, const TArray<float>& Illuminance);
+	void ReadReplicatedIlluminance();
+	// Called every update on clients instead of ReadReplicatedIlluminance() when bClientPrediction is enabled
+	void UpdateClientPrediction();
+	const FLightDetectionPlayerIlluminance* FindReplicatedIlluminance(const APawn* Pawn) const;
+	bool IsServerDetectionClient() const;
+
+	FVector FindDetectionPoint(const APlanet_NineMPCharacter* Character);
+	void BuildDetectionResultTable();
+	void UpdateLightPriorities(const FVector& DetectionPoint, float DeltaTime, double RescoreEndTime);
+	void ResolveIlluminanceTotal();
+
+	// Copies the editable detection properties into the settings the detection core is given
+	void ApplyDetectionSettings();
+	void FlushVisualizer();
+	void RecordUpdateStats(int32 AgentCount = 1);
+
+	// Warns about enabled detection modes that have no effect alongside the others, and turns off bRecordSession if the session cannot be replayed
+	void ValidateDetectionModes();
+
+	// Session recording for offline replay, see LightDetectionRecording.h
+	void BeginSessionRecording();
+	void RecordLightSnapshots();
+	void FlushSessionRecording();
+	LightDetection::RecordingWriter* GetSessionRecorder();
+
+	// The occlusion backend, see OcclusionBackend. GetOcclusionBackend() returns null while occlusion is answered by the physics scene
+	void BuildOccluders();
+	void UpdateOccluders();
+	// Pick up the movable occluders of actors spawned or streamed in after the occluders were built
+	void OnActorSpawned(AActor* Actor);
+	void OnLevelAddedToWorld(ULevel* Level, UWorld* World);
+	LightDetection::IOcclusionQuery* GetOcclusionBackend();
+
+	// An occlusion query on the light detection trace channel through the active backend, tracing transmission if it is enabled
+	FLightTraceOcclusionQuery MakeOcclusionQuery(LightDetection::RecordingWriter* Recorder = nullptr);
+
+	void CheckPointLights(FVector PlayerPosition);
+	void CheckSpotLights(FVector PlayerPosition);
+
+	// Continuous illuminance, used instead of CheckPointLights() when bContinuousIlluminance is enabled
+	void EstimatePointLights(FVector PlayerPosition);
+
+	// Multi-sample detection over the player's body, used instead of CheckPointLights() and CheckSpotLights() when any body samples are enabled
+	bool HasBodySamples() const;
+	void GatherBodySamples(const FVector& DetectionPoint, TArray<FVector>& OutSamples) const;
+	void CheckBodySamples(const FVector& DetectionPoint);
+
+	// Snapshots every point and spot light for the detection core, for the detection modes whose broad phase considers all of them at once
+	void SnapshotPointAndSpotLights();
+	// Snapshots the point lights that may have changed since the last update. While lights are clustered that is the lights outside any cluster,
+	// the clustered lights reported to NotifyLightChanged(), and the next few clustered lights in turn, otherwise it is every point light
+	void SnapshotPointLights();
+	// Snapshots one point light for the detection core, updating its cluster if it has changed
+	void SnapshotPointLight(int32 LightIndex);
+	void SnapshotSpotLight(int32 LightIndex);
+	// Gathers the point and spot lights that can reach the player through the cells into UpdateCandidates, once per update
+	void GatherCellCandidates(const FVector& PlayerPosition);
+
+	// The clusters point light candidates are gathered through, or null when lights are not clustered
+	const LightDetection::PointLightClusters* GetLightClusters() const;
+	// The cells single point detection gathers its candidates through, or null when cells are not used or the level has none
+	const LightDetection::LightCellScene* GetLightCells() const;
+
+	void CheckRectLights();
+	void CheckDirectionalLight();
+
+	// Snapshot a light into the detection scene and evaluate it with the detection core, visualising the result if its debug flag is set
+	LightDetection::LightSample EvaluatePointLight(int32 LightIndex, const FVector& PlayerPosition, FLightTraceOcclusionQuery& Occlusion);
+	LightDetection::LightSample EvaluateSpotLight(int32 LightIndex, const FVector& PlayerPosition, FLightTraceOcclusionQuery& Occlusion);
+
+	// Scene queries made directly by the manager go through here so they are timed
+	bool TraceLightChannel(FHitResult& HitResult, const FVector& Start, const FVector& End, ECollisionChannel TraceChannel = ECollisionChannel::ECC_GameTraceChannel5);
+
+	// Reference to the main character
+	APlanet_NineMPCharacter* Player;
+
+	// Dyanamic lists of all tagged lights in the scene
+	TArray<UPointLightComponent*> PointLights;
+	TArray<USpotLightComponent*> SpotLights;
+	TArray<URectLightComponent*> RectLights;
+	UDirectionalLightComponent* MainDirectionalLight;
+
+	// Plain data snapshots of the lights above for the detection core, index aligned with the light arrays
+	LightDetection::LightScene Scene;
+	LightDetection::DetectionSettings Settings;
+
+	// Reused by full detection updates and illuminance queries so they do not allocate
+	LightDetection::LightCandidates UpdateCandidates;
+	LightDetection::LightCandidates QueryCandidates;
+
+	// The last occlusion answer illuminance queries found for each point light, so an agent asking about the same spot again is not traced again.
+	// A single point query keys its entries by light, a batch by light and its place in the batch, and every entry is checked against the
+	// positions it was traced between before it is reused
+	LightDetection::OcclusionCache QueryOcclusionCache;
+
+	// Clusters of the point lights that do not move, built at BeginPlay while bClusterLights is enabled
+	LightDetection::PointLightClusters LightClusters;
+	// The point lights outside any cluster, which are snapshotted every update, and the clustered ones, which are snapshotted when reported
+	// changed and StaticLightRefreshCount at a time from ClusteredLightCursor
+	TArray<int32> UnclusteredPointLights;
+	TArray<int32> ClusteredPointLights;
+	TArray<int32> ChangedPointLights;
+	int32 ClusteredLightCursor = 0;
+
+	// The level's cells and portals, built at BeginPlay while bUseLightCells is enabled. The spot lights reported changed, and the light the
+	// cells' refresh reached last, counting point lights before spot lights
+	LightDetection::LightCellScene LightCells;
+	TArray<int32> ChangedSpotLights;
+	int32 CellLightCursor = 0;
+
+	// The light tree continuous illuminance samples point lights from, refit whenever a point light's snapshot changes, and the estimate built
+	// up from its samples so far
+	LightDetection::PointLightTree PointLightImportanceTree;
+	LightDetection::StochasticIlluminanceState PointLightEstimate;
+	bool bPointLightTreeDirty = false;
+
+	// The last occlusion answer for each point light, reused while neither the light nor the player has moved
+	LightDetection::OcclusionCache PointLightOcclusionCache;
+
+	// The emitter samples traced so far for each rect light, index aligned with RectLights
+	TArray<LightDetection::RectLightSamples> RectLightSampleStates;
+
+	// Light blocking geometry for the OccluderBVH and VoxelGrid backends, and the movable components the dynamic occluders follow. Movable
+	// components of actors spawned or streamed in later are added as they appear, but static geometry is only gathered when the occluders are built
+	LightDetection::OccluderScene Occluders;
+	LightDetection::OccluderVoxelGrid OccluderVoxels;
+	TArray<TWeakObjectPtr<UPrimitiveComponent>> DynamicOccluders;
+	FDelegateHandle ActorSpawnedHandle;
+	FDelegateHandle LevelAddedHandle;
+	TUniquePtr<LightDetection::IOcclusionQuery> OccluderQuery;
+
+	// SurfaceTransmittance looked up by surface type, built at BeginPlay
+	LightDetectionAdapter::TransmissionTable Transmission;
+
+	// Reused by server authoritative detection so it does not allocate, one entry for each player evaluated by the last server update
+	TArray<APlanet_NineMPCharacter*> ServerPlayers;
+	TArray<LightDetection::Vector3> ServerDetectionPoints;
+	TArray<float> ServerIlluminance;
+	LightDetection::LightCandidates ServerCandidates;
+	LightDetection::OcclusionCache ServerOcclusionCache;
+
+	// Every player's illuminance as last evaluated by the server, replicated while bServerDetection is enabled
+	UPROPERTY(Replicated);
+	FLightDetectionPlayerIlluminanceArray ReplicatedIlluminance;
+
+	// The local player's predictions and their reconciliation with the server, on predicting clients
+	LightDetection::IlluminancePredictor Predictor;
+
+	// Reused by body sample detection so it does not allocate
+	TArray<FVector> BodySamples;
+	TArray<float> BodySampleIlluminance;
+	LightDetection::LightCandidates BodySampleCandidates;
+
+	// The work done by the current detection update, reported to the stat system and CSV profiler at the end of each update
+	LightDetection::DetectionCounters UpdateCounters;
+
+	// Writes each detection update to SessionRecordingPath while bRecordSession is enabled
+	LightDetection::RecordingWriter SessionRecorder;
+	FString SessionRecordingPath;
+
+	// Rolling per-light results used by time-sliced detection, one entry per point and spot light
+	TArray<LightDetectionResult> DetectionResults;
+	// A heap of DetectionResults indices on urgency, rebuilt every tick, and the result UpdateLightPriorities() re-scores next
+	TArray<int32> EvaluationOrder;
+	int32 PriorityCursor = 0;
+
+	// The current total light intensity that is falling on the player, unitless
+	UPROPERTY(BlueprintReadWrite, Category = "Light Detection");
+	float IlluminanceTotal;
+	
+	// The amount of light detection calculations the detection manager will perform per-second
+	UPROPERTY(EditAnywhere, Category = "Light Detection");
+	float UpdateFrequency = 50.0f;
+	// How far behind (positive) or ahead (negative) of the UpdateFrequency the updates are running, in seconds
+	float UpdateTimeError;
+
+	// When enabled, lights are evaluated incrementally every tick within TimeSliceBudget instead of all at once per update
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Time Slicing");
+	bool bTimeSlicedDetection = false;
+	// The amount of time in microseconds the detection manager may spend evaluating lights each tick when time-sliced
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Time Slicing", meta = (EditCondition = "bTimeSlicedDetection", ClampMin = "1.0"));
+	float TimeSliceBudget = 100.0f;
+	// Lights within this distance of the detection point are revisited more often, scaled by how close they are
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Time Slicing", meta = (EditCondition = "bTimeSlicedDetection"));
+	float NearPriorityDistance = 1500.0f;
+	// Extra priority given to lights that are near, were lit on their last evaluation, or have moved since it
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Time Slicing", meta = (EditCondition = "bTimeSlicedDetection"));
+	float NearPriorityBoost = 4.0f;
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Time Slicing", meta = (EditCondition = "bTimeSlicedDetection"));
+	float LitPriorityBoost = 4.0f;
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Time Slicing", meta = (EditCondition = "bTimeSlicedDetection"));
+	float MovingPriorityBoost = 8.0f;
+
+	// Where occlusion is answered. The occluder hierarchy and voxel grid are built once at BeginPlay from static light blocking collision and can be
+	// queried from any thread without physics scene locks, movable light blocking components are followed as boxes. The directional light always
+	// uses the physics scene
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Occlusion");
+	ELightOcclusionBackend OcclusionBackend = ELightOcclusionBackend::PhysicsScene;
+	// The size of a voxel for the VoxelGrid backend. Anything a voxel touches blocks light through all of it, so larger voxels occlude more and
+	// close more gaps, while memory grows with the cube of the level's size over this. Set per level on its detection manager
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Occlusion", meta = (EditCondition = "OcclusionBackend == ELightOcclusionBackend::VoxelGrid", ClampMin = "5.0"));
+	float VoxelSize = 50.0f;
+	// The most occlusion traces point lights may make in one detection update. Point lights in range are traced nearest first until one reaches
+	// the player, and any past the budget that have no cached answer are skipped until a later update
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Occlusion", meta = (ClampMin = "0"));
+	int32 MaxPointLightTraces = 4;
+	// A point light's occlusion answer is reused while neither the light nor the player has moved further than this distance since it was traced,
+	// for at most OcclusionCacheMaxAge updates
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Occlusion", meta = (ClampMin = "0.0"));
+	float OcclusionCacheTolerance = 10.0f;
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Occlusion", meta = (ClampMin = "0"));
+	int32 OcclusionCacheMaxAge = 5;
+
+	// When enabled, light passes partly through surfaces that overlap the light detection trace channel rather than block it, such as foliage and
+	// glass, dimmed by their surface type's transmittance. Surfaces that block the channel still block all light. Only the PhysicsScene backend
+	// knows what surfaces are hit, the others always block fully
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Transmission");
+	bool bTransmission = false;
+	// The fraction of light that passes through each physical surface type, surface types not listed let all of it through
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Transmission", meta = (EditCondition = "bTransmission"));
+	TMap<TEnumAsByte<EPhysicalSurface>, float> SurfaceTransmittance;
+	// Once less than this fraction of a light gets through, the light is treated as fully occluded and the rest of its hits are not considered
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Transmission", meta = (EditCondition = "bTransmission", ClampMin = "0.0", ClampMax = "1.0"));
+	float MinTransmittance = 0.05f;
+
+	// The number of points across each rect light's emitter it is traced from, so the player is only partly lit when half hidden from a large
+	// light. One traces from the light's centre only
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Rect Lights", meta = (ClampMin = "1", ClampMax = "64"));
+	int32 RectLightSampleCount = 1;
+	// How many of a rect light's samples are traced in each detection update, the others are kept from earlier updates until the light or
+	// the player moves
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Rect Lights", meta = (ClampMin = "1"));
+	int32 RectLightSamplesPerUpdate = 2;
+
+	// When enabled, point lights that do not move are grouped into clusters when play begins, and a cluster's lights are only tested once a
+	// detection point is in range of the cluster as a whole. Cuts the cost of finding the lights in range in levels dressed with many small lights
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Clustering");
+	bool bClusterLights = false;
+	// The size of the grid cells lights are clustered by, in centimetres
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Clustering", meta = (EditCondition = "bClusterLights", ClampMin = "1.0"));
+	float LightClusterSize = 300.0f;
+	// When enabled, a cluster in range is evaluated as one light at its members' centre with their combined intensity rather than light by
+	// light. Cheaper, but the cluster only reaches as far from its centre as its lights are sure to, so it errs towards dark at its edges
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Clustering", meta = (EditCondition = "bClusterLights"));
+	bool bApproximateLightClusters = false;
+	// Static lights in clusters or cells are not snapshotted every update, only when reported to NotifyLightChanged() and this many each update
+	// in turn, so a change nothing reported is still picked up within a few updates
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Clustering", meta = (EditCondition = "bClusterLights || bUseLightCells", ClampMin = "0"));
+	int32 StaticLightRefreshCount = 4;
+
+	// When enabled, the player's detection and illuminance queries only consider the lights in the ALightDetectionCellVolume they are in, and
+	// those in nearby cells that can shine in through an ALightDetectionPortalVolume, before any light is tested against the point. Takes the
+	// place of light clusters where there are cells. Body samples and batched queries still find lights by range alone
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Cells");
+	bool bUseLightCells = false;
+	// How many portals away from the player's cell lights are considered, one is the cells next to it
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Cells", meta = (EditCondition = "bUseLightCells", ClampMin = "0"));
+	int32 MaxPortalDepth = 1;
+
+	// When enabled, every point light in range adds its intensity, falling off with distance, to the player's illuminance rather than the
+	// first lit one setting it. Only a few lights are traced each update, picked from a tree over the lights by how much they could add, and
+	// the estimate they give is averaged over updates, so the cost stays the same however many lights are in range
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Continuous Illuminance");
+	bool bContinuousIlluminance = false;
+	// The point lights traced each update
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Continuous Illuminance", meta = (EditCondition = "bContinuousIlluminance", ClampMin = "1"));
+	int32 StochasticLightSamples = 4;
+	// The most samples averaged into the estimate, fewer settles on changes in the lights sooner but leaves more noise
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Continuous Illuminance", meta = (EditCondition = "bContinuousIlluminance", ClampMin = "1"));
+	int32 MaxAccumulatedLightSamples = 64;
+	// How far the player moves for the samples taken before they moved to count for half as much, zero starts the estimate over whenever they
+	// move. Longer keeps the estimate smoother while walking, shorter follows changes in light along the way sooner
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Continuous Illuminance", meta = (EditCondition = "bContinuousIlluminance", ClampMin = "0.0"));
+	float LightHistoryFadeDistance = 100.0f;
+
+	// Extra points on the player's body evaluated along with the detection point, the player is as lit as their most lit sample. The lights
+	// that can reach any sample are found once for all of them, so each extra sample costs far less than a detection update of its own
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Body Samples");
+	bool bSampleTorso = false;
+	// The head sample follows the top of the capsule, so it drops when the player crouches
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Body Samples");
+	bool bSampleHead = false;
+	// Sockets on the player's mesh to sample, sockets that do not exist are ignored
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Body Samples");
+	TArray<FName> SampleSockets;
+
+	// When enabled, the server evaluates every connected player in one batched pass each update and replicates each player's illuminance to
+	// clients as a byte, and clients read theirs from it rather than running detection
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Networking");
+	bool bServerDetection = false;
+	// Illuminance at or above this replicates as fully lit, the byte's precision is spread from zero up to it
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Networking", meta = (EditCondition = "bServerDetection", ClampMin = "0.001"));
+	float MaxReplicatedIlluminance = 1.0f;
+	// A player's illuminance is sent at most every MinReplicationInterval seconds when another player is close by, and at most every
+	// MaxReplicationInterval seconds once the nearest is ReplicationRelevanceDistance or further away. Nothing is sent while it does not change
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Networking", meta = (EditCondition = "bServerDetection", ClampMin = "0.0"));
+	float MinReplicationInterval = 0.1f;
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Networking", meta = (EditCondition = "bServerDetection", ClampMin = "0.0"));
+	float MaxReplicationInterval = 1.0f;
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Networking", meta = (EditCondition = "bServerDetection", ClampMin = "1.0"));
+	float ReplicationRelevanceDistance = 3000.0f;
+	// Players within this distance of each other along every axis have the lights that can reach them gathered in one broad phase, and players
+	// further apart each have their own, so spread out players are not tested against every light between them. Batched queries group the same way
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Networking", meta = (ClampMin = "0.0"));
+	float MaxSampleGroupExtent = 2000.0f;
+	// When enabled, clients predict their own illuminance each update so the light meter does not wait a round trip for the server, and show the
+	// server's value instead wherever the server disagrees with what they predicted
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Networking", meta = (EditCondition = "bServerDetection"));
+	bool bClientPrediction = false;
+	// Predictions lean on the occlusion cache, making at most this many point light traces an update and reusing answers for up to
+	// PredictionCacheMaxAge updates
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Networking", meta = (EditCondition = "bClientPrediction", ClampMin = "0"));
+	int32 PredictionTraceBudget = 1;
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Networking", meta = (EditCondition = "bClientPrediction", ClampMin = "0"));
+	int32 PredictionCacheMaxAge = 25;
+	// How close a prediction has to have been made to where the server evaluated the player to be compared with the server's value, and how far
+	// the player can move from there before a correction stops applying
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Networking", meta = (EditCondition = "bClientPrediction", ClampMin = "0.0"));
+	float ReconciliationDistance = 50.0f;
+	// How many steps of the replicated byte a prediction may be from the server's value and still agree with it
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Networking", meta = (EditCondition = "bClientPrediction", ClampMin = "0", ClampMax = "255"));
+	int32 ReconciliationTolerance = 3;
+
+	// When enabled, every detection update is recorded to Saved/Profiling/LightDetection for replay with the LightDetectionReplayer tool.
+	// Play warns and does not record while a detection mode is enabled that the replayer cannot reproduce
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Recording");
+	bool bRecordSession = false;
+
+	// Persistent, batched visualisation of light influence volumes and rays for lights with their Debug* flag set
+	UPROPERTY(VisibleAnywhere, Category = "Debug");
+	ULightDetectionVisualizerComponent* Visualizer;
+
+	// Debug command bools, these only have an effect in builds with LIGHT_DETECTION_DEBUG enabled
+	UPROPERTY(EditAnywhere, Category = "Debug");
+	bool DebugIlluminanceTotal = false;
+	UPROPERTY(EditAnywhere, Category = "Debug");
+	bool DebugPointLights = false;
+	UPROPERTY(EditAnywhere, Category = "Debug");
+	bool DebugSpotLights = false;
+	UPROPERTY(EditAnywhere, Category = "Debug");
+	bool DebugRectLights = false;
+	UPROPERTY(EditAnywhere, Category = "Debug");
+	bool DebugDirectionalLight = false;
+	UPROPERTY(EditAnywhere, Category = "Debug");
+	bool DebugDetectionPoint = false;
+
+	// Undetermined
+	UPROPERTY(EditAnywhere, Category = "Light Detection");
+	float ForgivenessBuffer;
+};
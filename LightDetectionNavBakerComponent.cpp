@@ -0,0 +1,299 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "LightDetectionNavBakerComponent.h"
+#include "NavigationSystem.h"
+#include "NavMesh/RecastNavMesh.h"
+#include "Components/PointLightComponent.h"
+#include "Components/SpotLightComponent.h"
+#include "Components/RectLightComponent.h"
+#include "LightDetectionLitNavArea.h"
+#include "LightDetectionStats.h"
+
+namespace
+{
+	// Lit polygons are as lit as each other however bright the light, so a light's bake only changes if it moves, changes range or cone, or
+	// switches on or off. A flickering light's brightness changes every check without changing which polygons it lights
+	bool ChangesBake(const LightDetection::PointLightData& Baked, const LightDetection::PointLightData& Light)
+	{
+		return !LightDetection::IsSameVector(Baked.Position, Light.Position) || Baked.AttenuationRadius != Light.AttenuationRadius
+			|| (Baked.bVisible && Baked.Intensity > 0) != (Light.bVisible && Light.Intensity > 0);
+	}
+
+	bool ChangesBake(const LightDetection::SpotLightData& Baked, const LightDetection::SpotLightData& Light)
+	{
+		return !LightDetection::IsSameVector(Baked.Position, Light.Position) || !LightDetection::IsSameVector(Baked.Direction, Light.Direction)
+			|| Baked.AttenuationRadius != Light.AttenuationRadius || Baked.OuterConeAngle != Light.OuterConeAngle
+			|| (Baked.bVisible && Baked.Intensity > 0) != (Light.bVisible && Light.Intensity > 0);
+	}
+}
+
+ULightDetectionNavBakerComponent::ULightDetectionNavBakerComponent()
+{
+	// Ticks on the RebakeInterval to watch the movable lights, the interval is set in BeginPlay()
+	PrimaryComponentTick.bCanEverTick = true;
+	PrimaryComponentTick.TickGroup = TG_PostPhysics;
+
+	LitAreaClass = ULightDetectionLitNavArea::StaticClass();
+}
+
+void ULightDetectionNavBakerComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	// Only recast navmeshes can have their polygon areas changed
+	UNavigationSystemV1* NavSystem = FNavigationSystem::GetCurrent<UNavigationSystemV1>(GetWorld());
+	NavMesh = NavSystem ? Cast<ARecastNavMesh>(NavSystem->GetDefaultNavDataInstance(FNavigationSystem::DontCreate)) : nullptr;
+	if (!NavMesh)
+	{
+		SetComponentTickEnabled(false);
+		return;
+	}
+	NavSystem->OnNavigationGenerationFinishedDelegate.AddDynamic(this, &ULightDetectionNavBakerComponent::OnNavigationGenerationFinished);
+
+	// Register the lights the same way the detection manager does
+	LightDetectionAdapter::GatherTaggedLights(GetWorld(), PointLights, SpotLights);
+	LightDetectionAdapter::SnapshotLightScene(PointLights, SpotLights, RectLights, nullptr, BakedScene);
+
+	BakeAll();
+	SetComponentTickInterval(RebakeInterval);
+}
+
+void ULightDetectionNavBakerComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (UNavigationSystemV1* NavSystem = FNavigationSystem::GetCurrent<UNavigationSystemV1>(GetWorld()))
+	{
+		NavSystem->OnNavigationGenerationFinishedDelegate.RemoveDynamic(this, &ULightDetectionNavBakerComponent::OnNavigationGenerationFinished);
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void ULightDetectionNavBakerComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	RebakeChangedLights();
+}
+
+void ULightDetectionNavBakerComponent::OnNavigationGenerationFinished(ANavigationData* NavData)
+{
+	if (NavData == NavMesh)
+	{
+		BakeRebuiltTiles();
+	}
+}
+
+void ULightDetectionNavBakerComponent::BakeAll()
+{
+	if (!NavMesh)
+	{
+		return;
+	}
+
+	TArray<FNavPoly> Polys;
+	TArray<FNavPoly> TilePolys;
+	TilePolyRefs.Reset();
+	for (int32 TileIdx = 0; TileIdx < NavMesh->GetNavMeshTilesCount(); TileIdx++)
+	{
+		TilePolys.Reset();
+		NavMesh->GetPolysInTile(TileIdx, TilePolys);
+		Polys.Append(TilePolys);
+
+		TArray<uint64>& PolyRefs = TilePolyRefs.Add(TileIdx);
+		for (const FNavPoly& Poly : TilePolys)
+		{
+			PolyRefs.Add(Poly.Ref);
+		}
+	}
+
+	BakePolys(Polys);
+}
+
+void ULightDetectionNavBakerComponent::BakeRebuiltTiles()
+{
+	if (!NavMesh)
+	{
+		return;
+	}
+
+	// A rebuilt tile's polygon refs carry a new salt, so any tile whose refs differ from the ones last baked has been rebuilt with the areas it was
+	// generated with. Tiles that survived keep their baked areas and their original areas, and only the rebuilt ones are baked again
+	TArray<FNavPoly> Polys;
+	TArray<FNavPoly> TilePolys;
+	TArray<uint64> CurrentRefs;
+	TSet<int32> CurrentTiles;
+	for (int32 TileIdx = 0; TileIdx < NavMesh->GetNavMeshTilesCount(); TileIdx++)
+	{
+		TilePolys.Reset();
+		NavMesh->GetPolysInTile(TileIdx, TilePolys);
+		CurrentTiles.Add(TileIdx);
+
+		CurrentRefs.Reset();
+		for (const FNavPoly& Poly : TilePolys)
+		{
+			CurrentRefs.Add(Poly.Ref);
+		}
+
+		TArray<uint64>* BakedRefs = TilePolyRefs.Find(TileIdx);
+		if (BakedRefs && *BakedRefs == CurrentRefs)
+		{
+			continue;
+		}
+
+		// The old polygons are gone, so their original areas no longer apply
+		if (BakedRefs)
+		{
+			for (const NavNodeRef PolyRef : *BakedRefs)
+			{
+				OriginalAreaIDs.Remove(PolyRef);
+			}
+		}
+		TilePolyRefs.Add(TileIdx, CurrentRefs);
+		Polys.Append(TilePolys);
+	}
+
+	// Forget tiles that were removed from the navmesh
+	for (auto It = TilePolyRefs.CreateIterator(); It; ++It)
+	{
+		if (!CurrentTiles.Contains(It.Key()))
+		{
+			for (const NavNodeRef PolyRef : It.Value())
+			{
+				OriginalAreaIDs.Remove(PolyRef);
+			}
+			It.RemoveCurrent();
+		}
+	}
+
+	if (Polys.Num() > 0)
+	{
+		BakePolys(Polys);
+	}
+}
+
+void ULightDetectionNavBakerComponent::BakePolys(const TArray<FNavPoly>& Polys)
+{
+	LIGHT_DETECTION_SCOPE(BakeNavigation);
+
+	// Evaluate every polygon in parallel, then apply the areas on the game thread
+	TArray<float> Illuminance;
+	LightDetectionAdapter::ParallelDetectionTotals Totals;
+	LightDetectionAdapter::EvaluatePointsParallel(GetWorld(), BakedScene, Polys.Num(), [&](int32 PolyIdx)
+	{
+		return Polys[PolyIdx].Center + (DetectionHeight * FVector::UpVector);
+	}, false, Illuminance, Totals);
+
+	const int32 LitAreaID = NavMesh->GetAreaID(LitAreaClass);
+	for (int32 PolyIdx = 0; PolyIdx < Polys.Num(); PolyIdx++)
+	{
+		const NavNodeRef PolyRef = Polys[PolyIdx].Ref;
+		const uint8 CurrentAreaID = static_cast<uint8>(NavMesh->GetPolyAreaID(PolyRef));
+
+		// Remember the area this polygon was generated with the first time it is baked
+		const uint8* OriginalAreaID = OriginalAreaIDs.Find(PolyRef);
+		if (!OriginalAreaID)
+		{
+			OriginalAreaID = &OriginalAreaIDs.Add(PolyRef, CurrentAreaID);
+		}
+
+		// Setting an area invalidates paths through the polygon, so only polygons whose area actually changes are touched
+		const int32 TargetAreaID = Illuminance[PolyIdx] > LitThreshold ? LitAreaID : *OriginalAreaID;
+		if (TargetAreaID == CurrentAreaID)
+		{
+			continue;
+		}
+		if (TargetAreaID == LitAreaID)
+		{
+			NavMesh->SetPolyArea(PolyRef, LitAreaClass);
+		}
+		else
+		{
+			NavMesh->SetPolyArea(PolyRef, const_cast<UClass*>(NavMesh->GetAreaClass(*OriginalAreaID)));
+		}
+	}
+}
+
+void ULightDetectionNavBakerComponent::RebakeChangedLights()
+{
+	if (!NavMesh)
+	{
+		return;
+	}
+
+	// Find the regions of the navmesh whose lighting may have changed, the old and new range of each movable light that has changed in a way
+	// that can change which polygons it lights
+	for (int idx = 0; idx < PointLights.Num(); idx++)
+	{
+		if (PointLights[idx]->Mobility != EComponentMobility::Movable)
+		{
+			continue;
+		}
+		const LightDetection::PointLightData PointLight = LightDetectionAdapter::MakePointLightData(PointLights[idx]);
+		LightDetection::PointLightData& BakedPointLight = BakedScene.PointLights[idx];
+		if (ChangesBake(BakedPointLight, PointLight))
+		{
+			AddDirtyRegion(FBox::BuildAABB(LightDetectionAdapter::ToFVector(BakedPointLight.Position), FVector(BakedPointLight.AttenuationRadius)));
+			AddDirtyRegion(FBox::BuildAABB(LightDetectionAdapter::ToFVector(PointLight.Position), FVector(PointLight.AttenuationRadius)));
+		}
+		BakedPointLight = PointLight;
+	}
+	for (int idx = 0; idx < SpotLights.Num(); idx++)
+	{
+		if (SpotLights[idx]->Mobility != EComponentMobility::Movable)
+		{
+			continue;
+		}
+		const LightDetection::SpotLightData SpotLight = LightDetectionAdapter::MakeSpotLightData(SpotLights[idx]);
+		LightDetection::SpotLightData& BakedSpotLight = BakedScene.SpotLights[idx];
+		if (ChangesBake(BakedSpotLight, SpotLight))
+		{
+			AddDirtyRegion(FBox::BuildAABB(LightDetectionAdapter::ToFVector(BakedSpotLight.Position), FVector(BakedSpotLight.AttenuationRadius)));
+			AddDirtyRegion(FBox::BuildAABB(LightDetectionAdapter::ToFVector(SpotLight.Position), FVector(SpotLight.AttenuationRadius)));
+		}
+		BakedSpotLight = SpotLight;
+	}
+
+	// Baking traces on the game thread, so a light that keeps changing has its regions merged and baked at most every MinRebakeInterval
+	const double Now = GetWorld()->GetTimeSeconds();
+	if (DirtyRegions.Num() == 0 || Now < NextRebakeTime)
+	{
+		return;
+	}
+	NextRebakeTime = Now + MinRebakeInterval;
+
+	// Gather each polygon in the dirty regions once, regions of lights close to each other overlap
+	TArray<FNavPoly> Polys;
+	TArray<FNavPoly> RegionPolys;
+	TSet<NavNodeRef> GatheredPolys;
+	for (const FBox& Region : DirtyRegions)
+	{
+		RegionPolys.Reset();
+		NavMesh->GetPolysInBox(Region, RegionPolys);
+		for (const FNavPoly& Poly : RegionPolys)
+		{
+			bool bAlreadyGathered = false;
+			GatheredPolys.Add(Poly.Ref, &bAlreadyGathered);
+			if (!bAlreadyGathered)
+			{
+				Polys.Add(Poly);
+			}
+		}
+	}
+	DirtyRegions.Reset();
+
+	BakePolys(Polys);
+}
+
+void ULightDetectionNavBakerComponent::AddDirtyRegion(const FBox& Region)
+{
+	// A region overlapping one already waiting to be baked is merged into it, so a light moving between bakes leaves one region behind it
+	for (FBox& Dirty : DirtyRegions)
+	{
+		if (Dirty.Intersect(Region))
+		{
+			Dirty += Region;
+			return;
+		}
+	}
+	DirtyRegions.Add(Region);
+}
@@ -0,0 +1,88 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "LightDetectionCoreAdapter.h"
+#include "LightDetectionNavBakerComponent.generated.h"
+
+// Forward Declarations
+class ANavigationData;
+class ARecastNavMesh;
+class UNavArea;
+class UPointLightComponent;
+class USpotLightComponent;
+class URectLightComponent;
+struct FNavPoly;
+
+/// <summary>
+/// ULightDetectionNavBakerComponent bakes light detection onto the navmesh. When play begins, every navmesh polygon is evaluated at its centre
+/// and the lit ones are moved into LitAreaClass, so AI path costs account for light at no extra detection cost per query. Movable lights are
+/// watched every RebakeInterval, and when one moves, changes range or switches on or off only the polygons in its old and new range are baked
+/// again, no more often than MinRebakeInterval. If the navmesh is rebuilt at runtime, only the tiles that were rebuilt are baked again.
+/// </summary>
+UCLASS(ClassGroup = (LightDetection), meta = (BlueprintSpawnableComponent))
+class PLANET_NINEMP_API ULightDetectionNavBakerComponent : public UActorComponent
+{
+
+	GENERATED_BODY()
+
+public:
+
+	ULightDetectionNavBakerComponent();
+
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+	// Re-evaluates every polygon on the navmesh
+	UFUNCTION(BlueprintCallable, Category = "Light Detection|Navigation")
+	void BakeAll();
+
+protected:
+
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	UFUNCTION()
+	void OnNavigationGenerationFinished(ANavigationData* NavData);
+
+	// Bakes the tiles whose polygons have changed since they were last baked, after the navmesh has been rebuilt
+	void BakeRebuiltTiles();
+	// Evaluates the given polygons and moves each into or out of the lit area
+	void BakePolys(const TArray<FNavPoly>& Polys);
+	// Re-bakes the polygons around any movable light that has changed since it was last baked, at most every MinRebakeInterval
+	void RebakeChangedLights();
+	void AddDirtyRegion(const FBox& Region);
+
+	// Polygons whose illuminance is above this are marked as lit
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Navigation");
+	float LitThreshold = 0.0f;
+	// How far above a polygon's centre it is evaluated, matching how far the detection point sits above the floor
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Navigation");
+	float DetectionHeight = 10.0f;
+	// The area lit polygons are moved into
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Navigation");
+	TSubclassOf<UNavArea> LitAreaClass;
+	// How often movable lights are checked for changes, in seconds
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Navigation", meta = (ClampMin = "0.0"));
+	float RebakeInterval = 0.5f;
+	// The shortest time between re-bakes, changes found sooner are merged and baked together once it has passed
+	UPROPERTY(EditAnywhere, Category = "Light Detection|Navigation", meta = (ClampMin = "0.0"));
+	float MinRebakeInterval = 1.0f;
+
+	UPROPERTY(Transient);
+	ARecastNavMesh* NavMesh;
+
+	// The registered lights, and their state when they were last baked
+	TArray<UPointLightComponent*> PointLights;
+	TArray<USpotLightComponent*> SpotLights;
+	TArray<URectLightComponent*> RectLights;
+	LightDetection::LightScene BakedScene;
+	// The regions around changed lights waiting to be baked, and the earliest world time they may be
+	TArray<FBox> DirtyRegions;
+	double NextRebakeTime = 0.0;
+
+	// The area each polygon had before it was first baked, so polygons that stop being lit can be returned to it
+	TMap<uint64, uint8> OriginalAreaIDs;
+	// The polygon refs of each tile when it was last baked, used to tell which tiles a rebuild replaced
+	TMap<int32, TArray<uint64>> TilePolyRefs;
+};
@@ -0,0 +1,13 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "LightDetectionPortalVolume.h"
+#include "Components/BrushComponent.h"
+#include "Engine/CollisionProfile.h"
+
+ALightDetectionPortalVolume::ALightDetectionPortalVolume()
+{
+	// Portals only join cells, they must never block the traces detection makes through them
+	GetBrushComponent()->SetCollisionProfileName(UCollisionProfile::NoCollision_ProfileName);
+	BrushColor = FColor(255, 180, 60);
+	bColored = true;
+}
@@ -0,0 +1,21 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+#include "CoreMinimal.h"
+#include "GameFramework/Volume.h"
+#include "LightDetectionPortalVolume.generated.h"
+
+/// <summary>
+/// ALightDetectionPortalVolume marks an opening light can pass through between ALightDetectionCellVolume cells, such as a doorway or window.
+/// It joins every pair of cells its bounds overlap, so it should cover the opening and reach a little into the cell on each side.
+/// </summary>
+UCLASS()
+class PLANET_NINEMP_API ALightDetectionPortalVolume : public AVolume
+{
+
+	GENERATED_BODY()
+
+public:
+
+	ALightDetectionPortalVolume();
+};
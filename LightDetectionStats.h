@@ -0,0 +1,58 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+
+// All light detection stats live in their own group, shown in game with "stat LightDetection"
+DECLARE_STATS_GROUP(TEXT("LightDetection"), STATGROUP_LightDetection, STATCAT_Advanced);
+
+// Time spent in each detection phase, nested in the order they are called from UpdateDetection()
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Update Detection"), STAT_LightDetection_UpdateDetection, STATGROUP_LightDetection, PLANET_NINEMP_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Update Detection (Time Sliced)"), STAT_LightDetection_UpdateDetectionTimeSliced, STATGROUP_LightDetection, PLANET_NINEMP_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Update Detection (Server)"), STAT_LightDetection_UpdateServerDetection, STATGROUP_LightDetection, PLANET_NINEMP_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Replicate Illuminance"), STAT_LightDetection_ReplicateIlluminance, STATGROUP_LightDetection, PLANET_NINEMP_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Update Client Prediction"), STAT_LightDetection_UpdateClientPrediction, STATGROUP_LightDetection, PLANET_NINEMP_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Find Detection Point"), STAT_LightDetection_FindDetectionPoint, STATGROUP_LightDetection, PLANET_NINEMP_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Update Light Priorities"), STAT_LightDetection_UpdateLightPriorities, STATGROUP_LightDetection, PLANET_NINEMP_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Check Point Lights"), STAT_LightDetection_CheckPointLights, STATGROUP_LightDetection, PLANET_NINEMP_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Check Spot Lights"), STAT_LightDetection_CheckSpotLights, STATGROUP_LightDetection, PLANET_NINEMP_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Gather Cell Candidates"), STAT_LightDetection_GatherCellCandidates, STATGROUP_LightDetection, PLANET_NINEMP_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Check Body Samples"), STAT_LightDetection_CheckBodySamples, STATGROUP_LightDetection, PLANET_NINEMP_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Check Rect Lights"), STAT_LightDetection_CheckRectLights, STATGROUP_LightDetection, PLANET_NINEMP_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Check Directional Light"), STAT_LightDetection_CheckDirectionalLight, STATGROUP_LightDetection, PLANET_NINEMP_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Calculate Frustum"), STAT_LightDetection_CalculateFrustum, STATGROUP_LightDetection, PLANET_NINEMP_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Scene Query"), STAT_LightDetection_SceneQuery, STATGROUP_LightDetection, PLANET_NINEMP_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Illuminance Query"), STAT_LightDetection_IlluminanceQuery, STATGROUP_LightDetection, PLANET_NINEMP_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Bake Navigation"), STAT_LightDetection_BakeNavigation, STATGROUP_LightDetection, PLANET_NINEMP_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Build Occluders"), STAT_LightDetection_BuildOccluders, STATGROUP_LightDetection, PLANET_NINEMP_API);
+
+// Memory held by the occlusion backends
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Occluder BVH Memory"), STAT_LightDetection_OccluderMemory, STATGROUP_LightDetection, PLANET_NINEMP_API);
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Occluder Voxel Grid Memory"), STAT_LightDetection_VoxelMemory, STATGROUP_LightDetection, PLANET_NINEMP_API);
+
+// Per-frame work counters
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Lights Tested"), STAT_LightDetection_LightsTested, STATGROUP_LightDetection, PLANET_NINEMP_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Lights Culled"), STAT_LightDetection_LightsCulled, STATGROUP_LightDetection, PLANET_NINEMP_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Lights Reused"), STAT_LightDetection_LightsReused, STATGROUP_LightDetection, PLANET_NINEMP_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Traces Issued"), STAT_LightDetection_TracesIssued, STATGROUP_LightDetection, PLANET_NINEMP_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Traces Saved"), STAT_LightDetection_TracesSaved, STATGROUP_LightDetection, PLANET_NINEMP_API);
+
+// Server authoritative detection, the cost of each player's detection and the estimated bandwidth of replicating the results
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Server Players"), STAT_LightDetection_ServerPlayers, STATGROUP_LightDetection, PLANET_NINEMP_API);
+DECLARE_FLOAT_COUNTER_STAT_EXTERN(TEXT("Server Microseconds Per Player"), STAT_LightDetection_ServerMicrosecondsPerPlayer, STATGROUP_LightDetection, PLANET_NINEMP_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Players Replicated"), STAT_LightDetection_PlayersReplicated, STATGROUP_LightDetection, PLANET_NINEMP_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Replicated Bytes"), STAT_LightDetection_ReplicatedBytes, STATGROUP_LightDetection, PLANET_NINEMP_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Prediction Corrections"), STAT_LightDetection_PredictionCorrections, STATGROUP_LightDetection, PLANET_NINEMP_API);
+
+// Per-update metrics are also recorded to the CSV profiler under their own category, so they can be graphed against frame time
+CSV_DECLARE_CATEGORY_MODULE_EXTERN(PLANET_NINEMP_API, LightDetection);
+
+// Times a detection phase with the stat system, a CPU profiler trace event and a CSV timing stat, so it shows in "stat LightDetection",
+// in Unreal Insights and in CSV captures. Each of these costs next to nothing while its profiler is not capturing.
+#define LIGHT_DETECTION_SCOPE(Phase) \
+	SCOPE_CYCLE_COUNTER(STAT_LightDetection_##Phase); \
+	TRACE_CPUPROFILER_EVENT_SCOPE(LightDetection_##Phase); \
+	CSV_SCOPED_TIMING_STAT(LightDetection, Phase)
@@ -0,0 +1,367 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "LightDetectionVisualizerComponent.h"
+#include "PrimitiveSceneProxy.h"
+#include "SceneManagement.h"
+#include "Components/PointLightComponent.h"
+#include "Components/SpotLightComponent.h"
+#include "Components/RectLightComponent.h"
+#include "Components/DirectionalLightComponent.h"
+
+// How far a light or the detection point has to move before its geometry is rebuilt, in cm
+static const float VisualizerRebuildTolerance = 1.0f;
+// The number of line segments used to draw each circle of a sphere or cone
+static const int32 VisualizerCircleSegments = 24;
+// How far the bounds reach past the geometry, in cm, so the player can walk around with rays attached without the bounds having to grow
+static const float VisualizerBoundsSlack = 2000.0f;
+
+/// <summary>
+/// The scene proxy draws every volume line and ray through the primitive draw interface, which batches them into a single draw.
+/// Volume lines are fixed for the lifetime of the proxy, rays are replaced from the game thread through SetRays_RenderThread().
+/// </summary>
+class FLightDetectionVisualizerSceneProxy final : public FPrimitiveSceneProxy
+{
+public:
+
+	SIZE_T GetTypeHash() const override
+	{
+		static size_t UniquePointer;
+		return reinterpret_cast<size_t>(&UniquePointer);
+	}
+
+	FLightDetectionVisualizerSceneProxy(const ULightDetectionVisualizerComponent* InComponent, TArray<LightVisualizerLine>&& InVolumeLines, TArray<LightVisualizerLine>&& InRays)
+		: FPrimitiveSceneProxy(InComponent)
+		, VolumeLines(MoveTemp(InVolumeLines))
+		, Rays(MoveTemp(InRays))
+	{
+		bWillEverBeLit = false;
+	}
+
+	void SetRays_RenderThread(TArray<LightVisualizerLine>&& InRays)
+	{
+		Rays = MoveTemp(InRays);
+	}
+
+	virtual void GetDynamicMeshElements(const TArray<const FSceneView*>& Views, const FSceneViewFamily& ViewFamily, uint32 VisibilityMap, FMeshElementCollector& Collector) const override
+	{
+		for (int32 ViewIndex = 0; ViewIndex < Views.Num(); ViewIndex++)
+		{
+			if (!(VisibilityMap & (1 << ViewIndex)))
+			{
+				continue;
+			}
+
+			FPrimitiveDrawInterface* PDI = Collector.GetPDI(ViewIndex);
+			PDI->AddReserveLines(SDPG_World, VolumeLines.Num() + Rays.Num());
+			for (const LightVisualizerLine& Line : VolumeLines)
+			{
+				PDI->DrawLine(Line.Start, Line.End, Line.Color, SDPG_World);
+			}
+			for (const LightVisualizerLine& Line : Rays)
+			{
+				PDI->DrawLine(Line.Start, Line.End, Line.Color, SDPG_World, 0.5f);
+			}
+		}
+	}
+
+	virtual FPrimitiveViewRelevance GetViewRelevance(const FSceneView* View) const override
+	{
+		FPrimitiveViewRelevance Result;
+		Result.bDrawRelevance = IsShown(View);
+		Result.bDynamicRelevance = true;
+		Result.bShadowRelevance = false;
+		Result.bEditorPrimitiveRelevance = UseEditorCompositing(View);
+		return Result;
+	}
+
+	virtual uint32 GetMemoryFootprint() const override
+	{
+		return sizeof(*this) + GetAllocatedSize();
+	}
+
+	uint32 GetAllocatedSize() const
+	{
+		return FPrimitiveSceneProxy::GetAllocatedSize() + VolumeLines.GetAllocatedSize() + Rays.GetAllocatedSize();
+	}
+
+private:
+
+	TArray<LightVisualizerLine> VolumeLines;
+	TArray<LightVisualizerLine> Rays;
+};
+
+// Adds a circle of line segments around the given axes
+static void AddCircleLines(TArray<LightVisualizerLine>& Lines, const FVector& Center, const FVector& AxisX, const FVector& AxisY, float Radius, const FColor& Color)
+{
+	FVector PreviousPoint = Center + (AxisX * Radius);
+	for (int32 segmentIdx = 1; segmentIdx <= VisualizerCircleSegments; segmentIdx++)
+	{
+		float Angle = (2 * PI * segmentIdx) / VisualizerCircleSegments;
+		FVector Point = Center + (AxisX * (Radius * FMath::Cos(Angle))) + (AxisY * (Radius * FMath::Sin(Angle)));
+		Lines.Add(LightVisualizerLine(PreviousPoint, Point, Color));
+		PreviousPoint = Point;
+	}
+}
+
+ULightDetectionVisualizerComponent::ULightDetectionVisualizerComponent()
+{
+	PrimaryComponentTick.bCanEverTick = false;
+
+	// Geometry is stored in world space, so the component ignores whatever it is attached to
+	SetUsingAbsoluteLocation(true);
+	SetUsingAbsoluteRotation(true);
+	SetUsingAbsoluteScale(true);
+
+	SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	SetGenerateOverlapEvents(false);
+	CastShadow = false;
+	bHiddenInGame = false;
+
+	HiddenLayers = 0;
+	bVolumesDirty = false;
+	bRaysDirty = false;
+	GeometryBounds = FBox(ForceInit);
+}
+
+void ULightDetectionVisualizerComponent::UpdatePointLight(const UPointLightComponent* PointLight, const FVector& DetectionPoint, bool bLit)
+{
+	bool bNeedsRebuild;
+	LightVisualizerVolume& Volume = FindOrAddVolume(PointLight, ELightVisualizerLayer::PointLights, FVector4(PointLight->AttenuationRadius, 0, 0, 0), bNeedsRebuild);
+	if (bNeedsRebuild)
+	{
+		// Draw the attenuation sphere as three great circles
+		FVector Center = PointLight->GetComponentLocation();
+		float Radius = PointLight->AttenuationRadius;
+		Volume.VolumeLines.Reset();
+		AddCircleLines(Volume.VolumeLines, Center, FVector::ForwardVector, FVector::RightVector, Radius, FColor::Yellow);
+		AddCircleLines(Volume.VolumeLines, Center, FVector::ForwardVector, FVector::UpVector, Radius, FColor::Yellow);
+		AddCircleLines(Volume.VolumeLines, Center, FVector::RightVector, FVector::UpVector, Radius, FColor::Yellow);
+	}
+
+	UpdateRay(Volume, PointLight->GetComponentLocation(), DetectionPoint, bLit);
+}
+
+void ULightDetectionVisualizerComponent::UpdateSpotLight(const USpotLightComponent* SpotLight, const FVector& DetectionPoint, bool bLit)
+{
+	bool bNeedsRebuild;
+	LightVisualizerVolume& Volume = FindOrAddVolume(SpotLight, ELightVisualizerLayer::SpotLights, FVector4(SpotLight->AttenuationRadius, SpotLight->OuterConeAngle, 0, 0), bNeedsRebuild);
+	if (bNeedsRebuild)
+	{
+		// Draw the outer cone as a rim circle at the attenuation radius with lines back to the light at each quarter
+		FVector Apex = SpotLight->GetComponentLocation();
+		FVector Forward = SpotLight->GetForwardVector();
+		FVector Right = SpotLight->GetRightVector();
+		FVector Up = SpotLight->GetUpVector();
+		float ConeAngle = FMath::DegreesToRadians(SpotLight->OuterConeAngle);
+		FVector RimCenter = Apex + (Forward * (SpotLight->AttenuationRadius * FMath::Cos(ConeAngle)));
+		float RimRadius = SpotLight->AttenuationRadius * FMath::Sin(ConeAngle);
+
+		Volume.VolumeLines.Reset();
+		AddCircleLines(Volume.VolumeLines, RimCenter, Right, Up, RimRadius, FColor::Orange);
+		Volume.VolumeLines.Add(LightVisualizerLine(Apex, RimCenter + (Right * RimRadius), FColor::Orange));
+		Volume.VolumeLines.Add(LightVisualizerLine(Apex, RimCenter - (Right * RimRadius), FColor::Orange));
+		Volume.VolumeLines.Add(LightVisualizerLine(Apex, RimCenter + (Up * RimRadius), FColor::Orange));
+		Volume.VolumeLines.Add(LightVisualizerLine(Apex, RimCenter - (Up * RimRadius), FColor::Orange));
+	}
+
+	UpdateRay(Volume, SpotLight->GetComponentLocation(), DetectionPoint, bLit);
+}
+
+void ULightDetectionVisualizerComponent::UpdateRectLight(const URectLightComponent* RectLight, TArrayView<const FVector> FrustumPoints, const FVector& DetectionPoint, bool bLit)
+{
+	bool bNeedsRebuild;
+	LightVisualizerVolume& Volume = FindOrAddVolume(RectLight, ELightVisualizerLayer::RectLights, FVector4(RectLight->SourceWidth, RectLight->SourceHeight, RectLight->BarnDoorAngle, RectLight->BarnDoorLength), bNeedsRebuild);
+	if (bNeedsRebuild)
+	{
+		// Draw the 12 edges of the barn door frustum, the near and far planes are indexed counterclockwise from the top left
+		Volume.VolumeLines.Reset();
+		for (int pointIdx = 0; pointIdx < 4; pointIdx++)
+		{
+			int nextIdx = (pointIdx + 1) % 4;
+			Volume.VolumeLines.Add(LightVisualizerLine(FrustumPoints[pointIdx], FrustumPoints[nextIdx], FColor::Purple));
+			Volume.VolumeLines.Add(LightVisualizerLine(FrustumPoints[pointIdx + 4], FrustumPoints[nextIdx + 4], FColor::Purple));
+			Volume.VolumeLines.Add(LightVisualizerLine(FrustumPoints[pointIdx], FrustumPoints[pointIdx + 4], FColor::Purple));
+		}
+	}
+
+	UpdateRay(Volume, RectLight->GetComponentLocation(), DetectionPoint, bLit);
+}
+
+void ULightDetectionVisualizerComponent::UpdateDirectionalLight(const UDirectionalLightComponent* DirectionalLight, const FVector& RayStart, const FVector& DetectionPoint, bool bLit)
+{
+	// The directional light has no influence volume, only a ray
+	bool bNeedsRebuild;
+	LightVisualizerVolume& Volume = FindOrAddVolume(DirectionalLight, ELightVisualizerLayer::DirectionalLight, FVector4(0, 0, 0, 0), bNeedsRebuild);
+	UpdateRay(Volume, RayStart, DetectionPoint, bLit);
+}
+
+void ULightDetectionVisualizerComponent::SetLayerVisible(ELightVisualizerLayer Layer, bool bVisible)
+{
+	const uint8 LayerBit = 1 << static_cast<uint8>(Layer);
+	const bool bCurrentlyVisible = (HiddenLayers & LayerBit) == 0;
+	if (bVisible == bCurrentlyVisible)
+	{
+		return;
+	}
+
+	if (bVisible)
+	{
+		HiddenLayers &= ~LayerBit;
+		return;
+	}
+
+	// Hiding a layer throws away its geometry, it will be rebuilt as the lights are evaluated again once the layer is visible
+	HiddenLayers |= LayerBit;
+	for (auto VolumeItr = Volumes.CreateIterator(); VolumeItr; ++VolumeItr)
+	{
+		if (VolumeItr.Value().Layer == Layer)
+		{
+			VolumeItr.RemoveCurrent();
+			bVolumesDirty = true;
+		}
+	}
+}
+
+void ULightDetectionVisualizerComponent::FlushChanges()
+{
+	if (bVolumesDirty)
+	{
+		// Recompute the bounds from all of the geometry and recreate the scene proxy with the new volume lines
+		GeometryBounds = FBox(ForceInit);
+		for (const TPair<const ULightComponent*, LightVisualizerVolume>& VolumePair : Volumes)
+		{
+			for (const LightVisualizerLine& Line : VolumePair.Value.VolumeLines)
+			{
+				GeometryBounds += Line.Start;
+				GeometryBounds += Line.End;
+			}
+			GeometryBounds += VolumePair.Value.RayStart;
+			GeometryBounds += VolumePair.Value.RayEnd;
+		}
+		if (GeometryBounds.IsValid)
+		{
+			GeometryBounds = GeometryBounds.ExpandBy(VisualizerBoundsSlack);
+		}
+
+		UpdateBounds();
+		MarkRenderStateDirty();
+	}
+	else if (bRaysDirty)
+	{
+		// The existing proxy just needs its rays replaced. A ray that leaves the bounds grows them, with slack again, which only moves the
+		// primitive's bounds in the scene rather than recreating the proxy
+		FBox RayBounds(ForceInit);
+		for (const TPair<const ULightComponent*, LightVisualizerVolume>& VolumePair : Volumes)
+		{
+			if (!GeometryBounds.IsInsideOrOn(VolumePair.Value.RayStart) || !GeometryBounds.IsInsideOrOn(VolumePair.Value.RayEnd))
+			{
+				RayBounds += VolumePair.Value.RayStart;
+				RayBounds += VolumePair.Value.RayEnd;
+			}
+		}
+
+		if (RayBounds.IsValid)
+		{
+			GeometryBounds += RayBounds.ExpandBy(VisualizerBoundsSlack);
+			UpdateBounds();
+			MarkRenderTransformDirty();
+		}
+		MarkRenderDynamicDataDirty();
+	}
+
+	bVolumesDirty = false;
+	bRaysDirty = false;
+}
+
+FPrimitiveSceneProxy* ULightDetectionVisualizerComponent::CreateSceneProxy()
+{
+	TArray<LightVisualizerLine> VolumeLines;
+	for (const TPair<const ULightComponent*, LightVisualizerVolume>& VolumePair : Volumes)
+	{
+		VolumeLines.Append(VolumePair.Value.VolumeLines);
+	}
+
+	TArray<LightVisualizerLine> Rays;
+	GatherRays(Rays);
+
+	return new FLightDetectionVisualizerSceneProxy(this, MoveTemp(VolumeLines), MoveTemp(Rays));
+}
+
+FBoxSphereBounds ULightDetectionVisualizerComponent::CalcBounds(const FTransform& LocalToWorld) const
+{
+	// The geometry is already in world space, so the component transform is ignored
+	if (!GeometryBounds.IsValid)
+	{
+		return FBoxSphereBounds(FVector::ZeroVector, FVector::ZeroVector, 0);
+	}
+	return FBoxSphereBounds(GeometryBounds);
+}
+
+void ULightDetectionVisualizerComponent::SendRenderDynamicData_Concurrent()
+{
+	Super::SendRenderDynamicData_Concurrent();
+
+	if (SceneProxy)
+	{
+		TArray<LightVisualizerLine> Rays;
+		GatherRays(Rays);
+
+		FLightDetectionVisualizerSceneProxy* VisualizerSceneProxy = static_cast<FLightDetectionVisualizerSceneProxy*>(SceneProxy);
+		ENQUEUE_RENDER_COMMAND(UpdateLightDetectionVisualizerRays)(
+			[VisualizerSceneProxy, Rays = MoveTemp(Rays)](FRHICommandListImmediate& RHICmdList) mutable
+			{
+				VisualizerSceneProxy->SetRays_RenderThread(MoveTemp(Rays));
+			});
+	}
+}
+
+LightVisualizerVolume& ULightDetectionVisualizerComponent::FindOrAddVolume(const ULightComponent* Light, ELightVisualizerLayer Layer, const FVector4& SourceShape, bool& bOutNeedsRebuild)
+{
+	LightVisualizerVolume* Volume = Volumes.Find(Light);
+	if (!Volume)
+	{
+		Volume = &Volumes.Add(Light);
+		Volume->Layer = Layer;
+		Volume->RayStart = FVector::ZeroVector;
+		Volume->RayEnd = FVector::ZeroVector;
+		Volume->bRayLit = false;
+		bOutNeedsRebuild = true;
+	}
+	else
+	{
+		// Only rebuild the volume if the light has moved or its shape has changed since it was last built
+		bOutNeedsRebuild = !Volume->SourceTransform.Equals(Light->GetComponentTransform(), VisualizerRebuildTolerance) || !Volume->SourceShape.Equals(SourceShape);
+	}
+
+	if (bOutNeedsRebuild)
+	{
+		Volume->SourceTransform = Light->GetComponentTransform();
+		Volume->SourceShape = SourceShape;
+		bVolumesDirty = true;
+	}
+
+	return *Volume;
+}
+
+void ULightDetectionVisualizerComponent::UpdateRay(LightVisualizerVolume& Volume, const FVector& RayStart, const FVector& DetectionPoint, bool bLit)
+{
+	if (Volume.bRayLit == bLit && Volume.RayStart.Equals(RayStart, VisualizerRebuildTolerance) && Volume.RayEnd.Equals(DetectionPoint, VisualizerRebuildTolerance))
+	{
+		return;
+	}
+
+	Volume.RayStart = RayStart;
+	Volume.RayEnd = DetectionPoint;
+	Volume.bRayLit = bLit;
+	bRaysDirty = true;
+}
+
+void ULightDetectionVisualizerComponent::GatherRays(TArray<LightVisualizerLine>& OutRays) const
+{
+	OutRays.Reset(Volumes.Num());
+	for (const TPair<const ULightComponent*, LightVisualizerVolume>& VolumePair : Volumes)
+	{
+		const LightVisualizerVolume& Volume = VolumePair.Value;
+		OutRays.Add(LightVisualizerLine(Volume.RayStart, Volume.RayEnd, Volume.bRayLit ? FColor::Green : FColor::Red));
+	}
+}
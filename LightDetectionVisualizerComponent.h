@@ -0,0 +1,103 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+#include "CoreMinimal.h"
+#include "Components/PrimitiveComponent.h"
+#include "LightDetectionVisualizerComponent.generated.h"
+
+// Forward Declarations
+class ULightComponent;
+class UPointLightComponent;
+class USpotLightComponent;
+class URectLightComponent;
+class UDirectionalLightComponent;
+
+// The groups of lights that can be shown or hidden together, one per light detection Debug* flag
+enum class ELightVisualizerLayer : uint8
+{
+	PointLights,
+	SpotLights,
+	RectLights,
+	DirectionalLight
+};
+
+struct LightVisualizerLine
+{
+	FVector Start;
+	FVector End;
+	FColor Color;
+
+	LightVisualizerLine(const FVector& start, const FVector& end, const FColor& color)
+	{
+		Start = start;
+		End = end;
+		Color = color;
+	}
+};
+
+struct LightVisualizerVolume
+{
+	ELightVisualizerLayer Layer;
+
+	// The light state the volume lines were built from, the lines are only rebuilt when this changes
+	FTransform SourceTransform;
+	FVector4 SourceShape;
+	TArray<LightVisualizerLine> VolumeLines;
+
+	// The line from the light to the detection point, coloured by whether the light was lighting it
+	FVector RayStart;
+	FVector RayEnd;
+	bool bRayLit;
+};
+
+/// <summary>
+/// ULightDetectionVisualizerComponent holds persistent debug geometry for the influence volumes of the lights the light detection manager
+/// evaluates, along with a ray from each light to the detection point. Geometry is only rebuilt when the light it was built from changes,
+/// and everything is drawn by a single scene proxy as one batch of lines, instead of issuing DrawDebug calls for every light on every update.
+/// Volume changes recreate the scene proxy, while ray changes are sent to the existing proxy as dynamic data.
+/// </summary>
+UCLASS(ClassGroup = (Debug), meta = (BlueprintSpawnableComponent))
+class PLANET_NINEMP_API ULightDetectionVisualizerComponent : public UPrimitiveComponent
+{
+
+	GENERATED_BODY()
+
+public:
+
+	// Sets default values for this component's properties
+	ULightDetectionVisualizerComponent();
+
+	// Update the volume and ray for a light, only marking the geometry dirty if something has changed
+	void UpdatePointLight(const UPointLightComponent* PointLight, const FVector& DetectionPoint, bool bLit);
+	void UpdateSpotLight(const USpotLightComponent* SpotLight, const FVector& DetectionPoint, bool bLit);
+	void UpdateRectLight(const URectLightComponent* RectLight, TArrayView<const FVector> FrustumPoints, const FVector& DetectionPoint, bool bLit);
+	void UpdateDirectionalLight(const UDirectionalLightComponent* DirectionalLight, const FVector& RayStart, const FVector& DetectionPoint, bool bLit);
+
+	// Removes all of the geometry in a layer when it is hidden, layers start visible
+	void SetLayerVisible(ELightVisualizerLayer Layer, bool bVisible);
+
+	// Sends any geometry changes made since the last flush to the render thread, called once at the end of each detection update
+	void FlushChanges();
+
+	virtual FPrimitiveSceneProxy* CreateSceneProxy() override;
+	virtual FBoxSphereBounds CalcBounds(const FTransform& LocalToWorld) const override;
+
+protected:
+
+	virtual void SendRenderDynamicData_Concurrent() override;
+
+	LightVisualizerVolume& FindOrAddVolume(const ULightComponent* Light, ELightVisualizerLayer Layer, const FVector4& SourceShape, bool& bOutNeedsRebuild);
+	void UpdateRay(LightVisualizerVolume& Volume, const FVector& RayStart, const FVector& DetectionPoint, bool bLit);
+
+	// Gathers the current ray of every volume, ready to be sent to the render thread
+	void GatherRays(TArray<LightVisualizerLine>& OutRays) const;
+
+	// Persistent geometry for every light that is currently being visualised
+	TMap<const ULightComponent*, LightVisualizerVolume> Volumes;
+	uint8 HiddenLayers;
+
+	// Whether volume geometry (requires a new scene proxy) or only rays (sent as dynamic data) have changed since the last flush
+	bool bVolumesDirty;
+	bool bRaysDirty;
+	FBox GeometryBounds;
+};